@@ -4,9 +4,11 @@
 #include <string.h>
 #include <stdio.h>
 
+static Slab node_slab = SLAB_INIT("ASTNode", ASTNode);
+
 /* Create base AST node */
 ASTNode *ast_create_node(ASTNodeType type, SourceLocation loc) {
-    ASTNode *node = xcalloc(1, sizeof(ASTNode));
+    ASTNode *node = slab_alloc(&node_slab);
     node->type = type;
     node->location = loc;
     node->children = NULL;
@@ -124,6 +126,60 @@ void ast_destroy_node(ASTNode *node) {
     /* xfree(node); */
 }
 
+void ast_free_node(ASTNode *node) {
+    if (!node) return;
+    xfree(node->children);
+    slab_free(&node_slab, node);
+}
+
+/* Unique nodes of a tree, for ast_free_tree */
+typedef struct {
+    ASTNode **slots;            /* Open-addressed set */
+    size_t capacity;
+    ASTNode **nodes;
+    size_t count;
+} NodeSet;
+
+static bool node_set_insert(NodeSet *set, ASTNode *node) {
+    if ((set->count + 1) * 2 > set->capacity) {
+        set->capacity = set->capacity ? set->capacity * 2 : 64;
+        xfree(set->slots);
+        set->slots = xcalloc(set->capacity, sizeof(ASTNode *));
+        set->nodes = xrealloc(set->nodes, set->capacity * sizeof(ASTNode *));
+        for (size_t i = 0; i < set->count; i++) {
+            size_t slot = ((uintptr_t)set->nodes[i] >> 4) & (set->capacity - 1);
+            while (set->slots[slot]) slot = (slot + 1) & (set->capacity - 1);
+            set->slots[slot] = set->nodes[i];
+        }
+    }
+    size_t slot = ((uintptr_t)node >> 4) & (set->capacity - 1);
+    while (set->slots[slot]) {
+        if (set->slots[slot] == node) return false;
+        slot = (slot + 1) & (set->capacity - 1);
+    }
+    set->slots[slot] = node;
+    set->nodes[set->count++] = node;
+    return true;
+}
+
+static void collect_node(ASTNode *node, void *data) {
+    node_set_insert((NodeSet *)data, node);
+}
+
+void ast_free_tree(ASTNode *root) {
+    if (!root) return;
+    
+    /* Union fields only point at nodes that are also children */
+    NodeSet set = {0};
+    ast_traverse(root, collect_node, &set);
+    ast_destroy_node(root);
+    for (size_t i = 0; i < set.count; i++) {
+        slab_free(&node_slab, set.nodes[i]);
+    }
+    xfree(set.nodes);
+    xfree(set.slots);
+}
+
 /* Add child to node */
 void ast_add_child(ASTNode *parent, ASTNode *child) {
     if (!parent || !child) return;
@@ -10,6 +10,14 @@
 ASTNode *ast_create_node(ASTNodeType type, SourceLocation loc);
 void ast_destroy_node(ASTNode *node);
 
+/* Destroy a tree and free its nodes, each shared node once. Only for trees
+ * no other tree refers into (e.g. one top-level declaration). */
+void ast_free_tree(ASTNode *root);
+
+/* Free one node and its child array but not the children, which belong to
+ * other trees. Only for nodes whose data owns nothing (a translation unit). */
+void ast_free_node(ASTNode *node);
+
 /* Add child to node */
 void ast_add_child(ASTNode *parent, ASTNode *child);
 
@@ -0,0 +1,611 @@
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
+#include "ast_image.h"
+#include "../common/hash.h"
+#include "../common/memory.h"
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define AST_IMAGE_MAGIC "LLVMCAST"
+#define AST_IMAGE_VERSION 1
+#define AST_IMAGE_BYTE_ORDER 0x01020304u
+
+/* Everything is stored with native widths; the fields before file_size are
+ * what a reader checks before trusting the rest */
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t node_size;         /* sizeof(ASTNode) */
+    uint32_t pointer_size;
+    uint32_t byte_order;
+    uint64_t file_size;
+    uint64_t node_offset;
+    uint64_t node_count;
+    uint64_t root_offset;
+    uint64_t reloc_offset;
+    uint64_t reloc_count;
+} ASTImageHeader;
+
+struct ASTImage {
+    void *base;
+    size_t size;
+    ASTNode *root;
+    size_t node_count;
+};
+
+static size_t align_up(size_t value) {
+    return (value + 7) & ~(size_t)7;
+}
+
+/* ===== NODE LAYOUT ===== */
+
+/* Which member of ASTNode.data a node type uses, mirroring ast_destroy_node */
+typedef enum {
+    DATA_SCALAR,        /* Literal values and flags, no pointers */
+    DATA_VAR,
+    DATA_FUNC,
+    DATA_IF,
+    DATA_WHILE,
+    DATA_FOR,
+    DATA_BINARY,
+    DATA_UNARY,
+    DATA_CALL,
+    DATA_NAME,
+    DATA_ASM,
+    DATA_STRING,
+    DATA_TYPE
+} DataKind;
+
+static DataKind data_kind(ASTNodeType type) {
+    switch (type) {
+        case AST_VAR_DECL:
+        case AST_GLOBAL_VAR_DECL:
+        case AST_LOCAL_VAR_DECL:
+        case AST_STATIC_VAR_DECL:
+        case AST_EXTERN_VAR_DECL:
+        case AST_PARAM_DECL:
+            return DATA_VAR;
+        case AST_FUNCTION_DECL:
+            return DATA_FUNC;
+        case AST_IF_STMT:
+            return DATA_IF;
+        case AST_WHILE_STMT:
+        case AST_DO_WHILE_STMT:
+            return DATA_WHILE;
+        case AST_FOR_STMT:
+            return DATA_FOR;
+        case AST_BINARY_EXPR:
+        case AST_ADD_EXPR:
+        case AST_SUB_EXPR:
+        case AST_MUL_EXPR:
+        case AST_DIV_EXPR:
+        case AST_MOD_EXPR:
+        case AST_AND_EXPR:
+        case AST_OR_EXPR:
+        case AST_XOR_EXPR:
+        case AST_SHL_EXPR:
+        case AST_SHR_EXPR:
+        case AST_LOGICAL_AND_EXPR:
+        case AST_LOGICAL_OR_EXPR:
+        case AST_EQ_EXPR:
+        case AST_NE_EXPR:
+        case AST_LT_EXPR:
+        case AST_LE_EXPR:
+        case AST_GT_EXPR:
+        case AST_GE_EXPR:
+        case AST_ASSIGN_EXPR:
+        case AST_ADD_ASSIGN_EXPR:
+        case AST_SUB_ASSIGN_EXPR:
+        case AST_MUL_ASSIGN_EXPR:
+        case AST_DIV_ASSIGN_EXPR:
+        case AST_MOD_ASSIGN_EXPR:
+        case AST_AND_ASSIGN_EXPR:
+        case AST_OR_ASSIGN_EXPR:
+        case AST_XOR_ASSIGN_EXPR:
+        case AST_SHL_ASSIGN_EXPR:
+        case AST_SHR_ASSIGN_EXPR:
+            return DATA_BINARY;
+        case AST_UNARY_EXPR:
+        case AST_UNARY_PLUS_EXPR:
+        case AST_UNARY_MINUS_EXPR:
+        case AST_NOT_EXPR:
+        case AST_BIT_NOT_EXPR:
+        case AST_DEREF_EXPR:
+        case AST_ADDR_OF_EXPR:
+        case AST_PRE_INC_EXPR:
+        case AST_PRE_DEC_EXPR:
+        case AST_POST_INC_EXPR:
+        case AST_POST_DEC_EXPR:
+            return DATA_UNARY;
+        case AST_CALL_EXPR:
+            return DATA_CALL;
+        case AST_IDENTIFIER:
+        case AST_MEMBER_EXPR:
+        case AST_ARROW_EXPR:
+        case AST_STRUCT_DECL:
+        case AST_UNION_DECL:
+        case AST_STRUCT_TYPE:
+        case AST_UNION_TYPE:
+        case AST_ENUM_DECL:
+        case AST_ENUM_TYPE:
+        case AST_ENUM_CONSTANT:
+        case AST_LABEL_STMT:
+            return DATA_NAME;
+        case AST_ASM_STMT:
+            return DATA_ASM;
+        case AST_STRING_LITERAL:
+            return DATA_STRING;
+        case AST_TYPE:
+        case AST_BUILTIN_TYPE:
+            return DATA_TYPE;
+        default:
+            return DATA_SCALAR;
+    }
+}
+
+/* Copy only the union member the node type uses; the rest of the union may
+ * hold stale pointers that must not end up in an image */
+static void copy_node_data(ASTNode *dst, const ASTNode *src) {
+    memset(&dst->data, 0, sizeof(dst->data));
+    switch (data_kind(src->type)) {
+        case DATA_SCALAR: dst->data.int_literal = src->data.int_literal; break;
+        case DATA_VAR: dst->data.var_decl = src->data.var_decl; break;
+        case DATA_FUNC: dst->data.func_decl = src->data.func_decl; break;
+        case DATA_IF: dst->data.if_stmt = src->data.if_stmt; break;
+        case DATA_WHILE: dst->data.while_stmt = src->data.while_stmt; break;
+        case DATA_FOR: dst->data.for_stmt = src->data.for_stmt; break;
+        case DATA_BINARY: dst->data.binary_expr = src->data.binary_expr; break;
+        case DATA_UNARY: dst->data.unary_expr = src->data.unary_expr; break;
+        case DATA_CALL: dst->data.call_expr = src->data.call_expr; break;
+        case DATA_NAME: dst->data.identifier = src->data.identifier; break;
+        case DATA_ASM:
+            /* The parser keeps operands as children */
+            dst->data.asm_stmt.asm_string = src->data.asm_stmt.asm_string;
+            dst->data.asm_stmt.is_volatile = src->data.asm_stmt.is_volatile;
+            break;
+        case DATA_STRING: dst->data.string_literal = src->data.string_literal; break;
+        case DATA_TYPE: dst->data.type = src->data.type; break;
+    }
+}
+
+/* Callbacks for every pointer a node owns */
+typedef struct {
+    void (*node)(void *ctx, ASTNode **slot);
+    void (*array)(void *ctx, ASTNode ***slot, size_t count);
+    void (*string)(void *ctx, char **slot);
+} SlotVisitor;
+
+static void visit_slots(ASTNode *node, const SlotVisitor *v, void *ctx) {
+    v->string(ctx, (char **)&node->location.filename);
+    v->array(ctx, &node->children, node->child_count);
+
+    switch (data_kind(node->type)) {
+        case DATA_SCALAR:
+            break;
+        case DATA_VAR:
+            v->string(ctx, &node->data.var_decl.name);
+            v->node(ctx, &node->data.var_decl.type);
+            v->node(ctx, &node->data.var_decl.init);
+            break;
+        case DATA_FUNC:
+            v->string(ctx, &node->data.func_decl.name);
+            v->node(ctx, &node->data.func_decl.return_type);
+            v->array(ctx, &node->data.func_decl.params, node->data.func_decl.param_count);
+            v->node(ctx, &node->data.func_decl.body);
+            break;
+        case DATA_IF:
+            v->node(ctx, &node->data.if_stmt.condition);
+            v->node(ctx, &node->data.if_stmt.then_branch);
+            v->node(ctx, &node->data.if_stmt.else_branch);
+            break;
+        case DATA_WHILE:
+            v->node(ctx, &node->data.while_stmt.condition);
+            v->node(ctx, &node->data.while_stmt.body);
+            break;
+        case DATA_FOR:
+            v->node(ctx, &node->data.for_stmt.init);
+            v->node(ctx, &node->data.for_stmt.condition);
+            v->node(ctx, &node->data.for_stmt.increment);
+            v->node(ctx, &node->data.for_stmt.body);
+            break;
+        case DATA_BINARY:
+            v->string(ctx, &node->data.binary_expr.op);
+            v->node(ctx, &node->data.binary_expr.left);
+            v->node(ctx, &node->data.binary_expr.right);
+            break;
+        case DATA_UNARY:
+            v->string(ctx, &node->data.unary_expr.op);
+            v->node(ctx, &node->data.unary_expr.operand);
+            break;
+        case DATA_CALL:
+            v->node(ctx, &node->data.call_expr.callee);
+            v->array(ctx, &node->data.call_expr.args, node->data.call_expr.arg_count);
+            break;
+        case DATA_NAME:
+            v->string(ctx, &node->data.identifier.name);
+            break;
+        case DATA_ASM:
+            v->string(ctx, &node->data.asm_stmt.asm_string);
+            break;
+        case DATA_STRING:
+            v->string(ctx, &node->data.string_literal.value);
+            break;
+        case DATA_TYPE:
+            v->string(ctx, &node->data.type.name);
+            break;
+    }
+}
+
+/* ===== WRITER ===== */
+
+typedef struct {
+    /* Reachable nodes in discovery order, and pointer -> index */
+    ASTNode **nodes;
+    size_t node_count;
+    size_t node_capacity;
+    ASTNode **index_keys;
+    size_t *index_values;
+    size_t index_capacity;
+
+    /* DFS stack */
+    ASTNode **stack;
+    size_t stack_count;
+    size_t stack_capacity;
+
+    /* Header, node pool and arrays; sized before anything is written */
+    char *data;
+    size_t node_offset;
+    size_t array_offset;
+    size_t array_used;
+
+    /* String table, placed after the arrays */
+    char *strings;
+    size_t strings_len;
+    size_t strings_capacity;
+    size_t strings_offset;
+    size_t *string_slots;       /* Open addressing over offsets + 1 */
+    size_t string_slot_capacity;
+    size_t string_count;
+
+    uint64_t *relocs;
+    size_t reloc_count;
+    size_t reloc_capacity;
+
+    size_t array_slots;         /* Total array entries, counted while collecting */
+} ImageWriter;
+
+static size_t pointer_hash(const void *p) {
+    uintptr_t v = (uintptr_t)p;
+    return (size_t)((v >> 4) * 0x9E3779B97F4A7C15ULL);
+}
+
+static void index_grow(ImageWriter *w) {
+    size_t old_capacity = w->index_capacity;
+    ASTNode **old_keys = w->index_keys;
+    size_t *old_values = w->index_values;
+
+    w->index_capacity = old_capacity ? old_capacity * 2 : 256;
+    w->index_keys = xcalloc(w->index_capacity, sizeof(ASTNode *));
+    w->index_values = xcalloc(w->index_capacity, sizeof(size_t));
+    for (size_t i = 0; i < old_capacity; i++) {
+        if (!old_keys[i]) continue;
+        size_t slot = pointer_hash(old_keys[i]) & (w->index_capacity - 1);
+        while (w->index_keys[slot]) slot = (slot + 1) & (w->index_capacity - 1);
+        w->index_keys[slot] = old_keys[i];
+        w->index_values[slot] = old_values[i];
+    }
+    xfree(old_keys);
+    xfree(old_values);
+}
+
+/* Index of an already collected node, or SIZE_MAX */
+static size_t index_lookup(const ImageWriter *w, const ASTNode *node) {
+    if (!w->index_capacity) return SIZE_MAX;
+    size_t slot = pointer_hash(node) & (w->index_capacity - 1);
+    while (w->index_keys[slot]) {
+        if (w->index_keys[slot] == node) return w->index_values[slot];
+        slot = (slot + 1) & (w->index_capacity - 1);
+    }
+    return SIZE_MAX;
+}
+
+/* Give a node its pool index the first time it is reached */
+static void collect_node(ImageWriter *w, ASTNode *node) {
+    if (!node || index_lookup(w, node) != SIZE_MAX) return;
+
+    if ((w->node_count + 1) * 2 > w->index_capacity) index_grow(w);
+    size_t slot = pointer_hash(node) & (w->index_capacity - 1);
+    while (w->index_keys[slot]) slot = (slot + 1) & (w->index_capacity - 1);
+    w->index_keys[slot] = node;
+    w->index_values[slot] = w->node_count;
+
+    if (w->node_count == w->node_capacity) {
+        w->node_capacity = w->node_capacity ? w->node_capacity * 2 : 256;
+        w->nodes = xrealloc(w->nodes, w->node_capacity * sizeof(ASTNode *));
+    }
+    w->nodes[w->node_count++] = node;
+
+    if (w->stack_count == w->stack_capacity) {
+        w->stack_capacity = w->stack_capacity ? w->stack_capacity * 2 : 256;
+        w->stack = xrealloc(w->stack, w->stack_capacity * sizeof(ASTNode *));
+    }
+    w->stack[w->stack_count++] = node;
+}
+
+static void collect_slot(void *ctx, ASTNode **slot) {
+    collect_node((ImageWriter *)ctx, *slot);
+}
+
+static void collect_array(void *ctx, ASTNode ***slot, size_t count) {
+    ImageWriter *w = (ImageWriter *)ctx;
+    if (!*slot || count == 0) return;
+    w->array_slots += count;
+    for (size_t i = 0; i < count; i++) collect_node(w, (*slot)[i]);
+}
+
+static void collect_string(void *ctx, char **slot) {
+    (void)ctx;
+    (void)slot;
+}
+
+/* Record that the pointer-sized slot at `slot` holds the file offset
+ * `target` */
+static void set_slot(ImageWriter *w, void *slot, size_t target) {
+    uintptr_t value = (uintptr_t)target;
+    memcpy(slot, &value, sizeof(value));
+
+    if (w->reloc_count == w->reloc_capacity) {
+        w->reloc_capacity = w->reloc_capacity ? w->reloc_capacity * 2 : 1024;
+        w->relocs = xrealloc(w->relocs, w->reloc_capacity * sizeof(uint64_t));
+    }
+    w->relocs[w->reloc_count++] = (uint64_t)((char *)slot - w->data);
+}
+
+static size_t node_file_offset(const ImageWriter *w, const ASTNode *node) {
+    return w->node_offset + index_lookup(w, node) * sizeof(ASTNode);
+}
+
+static void write_slot(void *ctx, ASTNode **slot) {
+    ImageWriter *w = (ImageWriter *)ctx;
+    if (*slot) set_slot(w, slot, node_file_offset(w, *slot));
+}
+
+static void write_array(void *ctx, ASTNode ***slot, size_t count) {
+    ImageWriter *w = (ImageWriter *)ctx;
+    ASTNode **source = *slot;
+    *slot = NULL;
+    if (!source || count == 0) return;
+
+    size_t offset = w->array_offset + w->array_used * sizeof(ASTNode *);
+    ASTNode **entries = (ASTNode **)(w->data + offset);
+    w->array_used += count;
+    for (size_t i = 0; i < count; i++) {
+        entries[i] = NULL;
+        if (source[i]) set_slot(w, &entries[i], node_file_offset(w, source[i]));
+    }
+    set_slot(w, slot, offset);
+}
+
+static size_t string_hash(const char *s) {
+    return (size_t)hash64_bytes(s, strlen(s));
+}
+
+/* File offset of `s` in the string table, adding it on first use */
+static size_t intern_string(ImageWriter *w, const char *s) {
+    if ((w->string_count + 1) * 2 > w->string_slot_capacity) {
+        size_t old_capacity = w->string_slot_capacity;
+        size_t *old_slots = w->string_slots;
+        w->string_slot_capacity = old_capacity ? old_capacity * 2 : 256;
+        w->string_slots = xcalloc(w->string_slot_capacity, sizeof(size_t));
+        for (size_t i = 0; i < old_capacity; i++) {
+            if (!old_slots[i]) continue;
+            size_t slot = string_hash(w->strings + old_slots[i] - 1) & (w->string_slot_capacity - 1);
+            while (w->string_slots[slot]) slot = (slot + 1) & (w->string_slot_capacity - 1);
+            w->string_slots[slot] = old_slots[i];
+        }
+        xfree(old_slots);
+    }
+
+    size_t slot = string_hash(s) & (w->string_slot_capacity - 1);
+    while (w->string_slots[slot]) {
+        size_t pos = w->string_slots[slot] - 1;
+        if (strcmp(w->strings + pos, s) == 0) return w->strings_offset + pos;
+        slot = (slot + 1) & (w->string_slot_capacity - 1);
+    }
+
+    size_t len = strlen(s) + 1;
+    if (w->strings_len + len > w->strings_capacity) {
+        while (w->strings_len + len > w->strings_capacity) {
+            w->strings_capacity = w->strings_capacity ? w->strings_capacity * 2 : 4096;
+        }
+        w->strings = xrealloc(w->strings, w->strings_capacity);
+    }
+    size_t pos = w->strings_len;
+    memcpy(w->strings + pos, s, len);
+    w->strings_len += len;
+    w->string_slots[slot] = pos + 1;
+    w->string_count++;
+    return w->strings_offset + pos;
+}
+
+static void write_string(void *ctx, char **slot) {
+    ImageWriter *w = (ImageWriter *)ctx;
+    if (*slot) set_slot(w, slot, intern_string(w, *slot));
+}
+
+static void writer_free(ImageWriter *w) {
+    xfree(w->nodes);
+    xfree(w->index_keys);
+    xfree(w->index_values);
+    xfree(w->stack);
+    xfree(w->data);
+    xfree(w->strings);
+    xfree(w->string_slots);
+    xfree(w->relocs);
+}
+
+bool ast_image_write(ASTNode *root, char **data, size_t *len) {
+    *data = NULL;
+    *len = 0;
+    if (!root) return false;
+
+    ImageWriter w;
+    memset(&w, 0, sizeof(w));
+
+    /* Number every reachable node; an explicit stack keeps deep trees off
+     * the C stack */
+    static const SlotVisitor collector = {collect_slot, collect_array, collect_string};
+    collect_node(&w, root);
+    while (w.stack_count > 0) {
+        ASTNode *node = w.stack[--w.stack_count];
+        visit_slots(node, &collector, &w);
+    }
+
+    w.node_offset = align_up(sizeof(ASTImageHeader));
+    w.array_offset = align_up(w.node_offset + w.node_count * sizeof(ASTNode));
+    w.strings_offset = w.array_offset + w.array_slots * sizeof(ASTNode *);
+    w.data = xcalloc(1, w.strings_offset);
+
+    /* Copy nodes into the pool and turn their pointers into offsets */
+    static const SlotVisitor writer = {write_slot, write_array, write_string};
+    for (size_t i = 0; i < w.node_count; i++) {
+        ASTNode *copy = (ASTNode *)(w.data + w.node_offset + i * sizeof(ASTNode));
+        const ASTNode *node = w.nodes[i];
+
+        memset(copy, 0, sizeof(*copy));
+        copy->type = node->type;
+        /* Field by field: the struct's padding is whatever the parser's
+         * stack held, and images must be byte-identical for equal trees */
+        copy->location.filename = node->location.filename;
+        copy->location.line = node->location.line;
+        copy->location.column = node->location.column;
+        copy->location.offset = node->location.offset;
+        copy->children = node->children;
+        copy->child_count = node->children ? node->child_count : 0;
+        copy->child_capacity = copy->child_count;
+        copy->destroyed = false;
+        copy_node_data(copy, node);
+
+        visit_slots(copy, &writer, &w);
+    }
+
+    size_t reloc_offset = align_up(w.strings_offset + w.strings_len);
+    size_t total = reloc_offset + w.reloc_count * sizeof(uint64_t);
+
+    ASTImageHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, AST_IMAGE_MAGIC, sizeof(header.magic));
+    header.version = AST_IMAGE_VERSION;
+    header.node_size = (uint32_t)sizeof(ASTNode);
+    header.pointer_size = (uint32_t)sizeof(void *);
+    header.byte_order = AST_IMAGE_BYTE_ORDER;
+    header.file_size = total;
+    header.node_offset = w.node_offset;
+    header.node_count = w.node_count;
+    header.root_offset = w.node_offset;     /* The root is collected first */
+    header.reloc_offset = reloc_offset;
+    header.reloc_count = w.reloc_count;
+
+    char *image = xcalloc(1, total);
+    memcpy(image, w.data, w.strings_offset);
+    memcpy(image, &header, sizeof(header));
+    if (w.strings_len) memcpy(image + w.strings_offset, w.strings, w.strings_len);
+    if (w.reloc_count) memcpy(image + reloc_offset, w.relocs, w.reloc_count * sizeof(uint64_t));
+
+    writer_free(&w);
+    *data = image;
+    *len = total;
+    return true;
+}
+
+/* ===== LOADER ===== */
+
+static bool header_is_valid(const ASTImageHeader *h, size_t size) {
+    if (memcmp(h->magic, AST_IMAGE_MAGIC, sizeof(h->magic)) != 0) return false;
+    if (h->version != AST_IMAGE_VERSION || h->node_size != sizeof(ASTNode) ||
+        h->pointer_size != sizeof(void *) || h->byte_order != AST_IMAGE_BYTE_ORDER) {
+        return false;
+    }
+    if (h->file_size != size || h->node_count == 0) return false;
+
+    /* Regions must lie inside the file; divisions avoid overflow */
+    if (h->node_offset > size || h->node_count > (size - h->node_offset) / sizeof(ASTNode)) {
+        return false;
+    }
+    if (h->reloc_offset > size || h->reloc_offset % sizeof(uint64_t) != 0 ||
+        h->reloc_count > (size - h->reloc_offset) / sizeof(uint64_t)) {
+        return false;
+    }
+    if (h->root_offset < h->node_offset ||
+        (h->root_offset - h->node_offset) % sizeof(ASTNode) != 0 ||
+        (h->root_offset - h->node_offset) / sizeof(ASTNode) >= h->node_count) {
+        return false;
+    }
+    return true;
+}
+
+ASTImage *ast_image_map(int fd) {
+    return ast_image_map_at(fd, 0);
+}
+
+ASTImage *ast_image_map_at(int fd, size_t offset) {
+    /* The image runs from `offset` to the end of the file */
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < offset ||
+        (size_t)st.st_size - offset < sizeof(ASTImageHeader)) {
+        return NULL;
+    }
+
+    size_t size = (size_t)st.st_size - offset;
+    void *base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, (off_t)offset);
+    if (base == MAP_FAILED) return NULL;
+
+    const ASTImageHeader *header = (const ASTImageHeader *)base;
+    if (!header_is_valid(header, size)) {
+        munmap(base, size);
+        return NULL;
+    }
+
+    /* Rebase every pointer slot. Slots and targets are checked against the
+     * file size so a corrupt entry is a miss, not a wild pointer. */
+    const uint64_t *relocs = (const uint64_t *)((char *)base + header->reloc_offset);
+    for (uint64_t i = 0; i < header->reloc_count; i++) {
+        uint64_t slot = relocs[i];
+        uintptr_t value;
+        if (slot % sizeof(void *) != 0 || slot > size - sizeof(value) ||
+            slot >= header->reloc_offset) {
+            munmap(base, size);
+            return NULL;
+        }
+        memcpy(&value, (char *)base + slot, sizeof(value));
+        if (value >= size) {
+            munmap(base, size);
+            return NULL;
+        }
+        value += (uintptr_t)base;
+        memcpy((char *)base + slot, &value, sizeof(value));
+    }
+
+    ASTImage *image = xmalloc(sizeof(ASTImage));
+    image->base = base;
+    image->size = size;
+    image->root = (ASTNode *)((char *)base + header->root_offset);
+    image->node_count = (size_t)header->node_count;
+    return image;
+}
+
+ASTNode *ast_image_root(const ASTImage *image) {
+    return image ? image->root : NULL;
+}
+
+size_t ast_image_node_count(const ASTImage *image) {
+    return image ? image->node_count : 0;
+}
+
+void ast_image_unmap(ASTImage *image) {
+    if (!image) return;
+    munmap(image->base, image->size);
+    xfree(image);
+}
@@ -0,0 +1,43 @@
+#ifndef AST_IMAGE_H
+#define AST_IMAGE_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include "../common/types.h"
+
+/* Relocatable AST images.
+ *
+ * An image is a flat file holding a whole AST in the in-memory ASTNode
+ * layout:
+ *
+ *   header | node pool | child/param/arg arrays | string table | relocations
+ *
+ * Every pointer inside the pool and the arrays is stored as a file offset,
+ * and the relocation table lists the file offset of each such slot. Loading
+ * is a single private mmap() followed by one pass over the relocation table
+ * that adds the mapping's base address; nodes, arrays and strings are used
+ * in place, with no per-node allocation. Images are only valid for the
+ * build that wrote them (the header records the node size, pointer size and
+ * byte order and a mismatch is treated as a miss). */
+
+typedef struct ASTImage ASTImage;
+
+/* Serialize the tree under `root` into a buffer the caller frees. Shared
+ * subtrees stay shared. */
+bool ast_image_write(ASTNode *root, char **data, size_t *len);
+
+/* Map an image from an open file; NULL if it is truncated or was written by
+ * an incompatible build. The descriptor may be closed afterwards. */
+ASTImage *ast_image_map(int fd);
+
+/* Same for an image embedded at `offset` (a multiple of the page size) and
+ * running to the end of the file */
+ASTImage *ast_image_map_at(int fd, size_t offset);
+
+ASTNode *ast_image_root(const ASTImage *image);
+size_t ast_image_node_count(const ASTImage *image);
+
+/* Releases every node of the image at once; never ast_destroy_node() them */
+void ast_image_unmap(ASTImage *image);
+
+#endif /* AST_IMAGE_H */
@@ -0,0 +1,76 @@
+#define _POSIX_C_SOURCE 200809L
+#include "../common/memory.h"
+#include "../driver/protocol.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* llvm-c-client: forwards an llvm-c command line to a running compile server
+ * (llvm-c --daemon) and replays its output. Without a reachable server the
+ * command is run locally by exec'ing $LLVMC_COMPILER (default: llvm-c). */
+
+#define CLIENT_COMPILER_ENV "LLVMC_COMPILER"
+
+extern char **environ;
+
+/* Returns the server's exit status, or -1 if the server could not answer */
+static int forward_to_server(int argc, char **argv) {
+    char *socket_path = proto_default_socket_path();
+    int fd = proto_connect(socket_path);
+    xfree(socket_path);
+    if (fd < 0) return -1;
+
+    char cwd[4096];
+    if (!getcwd(cwd, sizeof(cwd))) {
+        close(fd);
+        return -1;
+    }
+
+    char argc_str[16];
+    snprintf(argc_str, sizeof(argc_str), "%d", argc);
+
+    ProtoMessage request;
+    proto_message_init(&request);
+    proto_message_add_str(&request, PROTO_MAGIC);
+    proto_message_add_str(&request, cwd);
+    proto_message_add_str(&request, argc_str);
+    proto_message_add_str(&request, "llvm-c");
+    for (int i = 1; i < argc; i++) {
+        proto_message_add_str(&request, argv[i]);
+    }
+    for (char **env = environ; *env; env++) {
+        proto_message_add_str(&request, *env);
+    }
+
+    ProtoMessage response;
+    bool ok = proto_send(fd, &request) && proto_recv(fd, &response);
+    proto_message_free(&request);
+    close(fd);
+
+    if (!ok) return -1;
+    if (response.count < 4 || strcmp(response.items[0], PROTO_MAGIC) != 0) {
+        proto_message_free(&response);
+        return -1;
+    }
+
+    int status = atoi(response.items[1]);
+    fwrite(response.items[2], 1, response.lengths[2], stdout);
+    fwrite(response.items[3], 1, response.lengths[3], stderr);
+    proto_message_free(&response);
+    return status;
+}
+
+int main(int argc, char **argv) {
+    int status = forward_to_server(argc, argv);
+    if (status >= 0) return status;
+
+    /* No server, or it went away mid-request: compile locally */
+    const char *compiler = getenv(CLIENT_COMPILER_ENV);
+    if (!compiler || !*compiler) compiler = "llvm-c";
+
+    argv[0] = (char *)compiler;
+    execvp(compiler, argv);
+    fprintf(stderr, "llvm-c-client: cannot run %s\n", compiler);
+    return 127;
+}
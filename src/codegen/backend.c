@@ -1,5 +1,8 @@
+#define _POSIX_C_SOURCE 200809L
 #include "backend.h"
 #include "../common/memory.h"
+#include <regex.h>
+#include <stdio.h>
 #include <string.h>
 
 /* Backend registry */
@@ -60,6 +63,52 @@ Backend *backend_select_for_target(const char *target_triple) {
     return backend_llvm_create();
 }
 
+/* ===== OPTIMIZATION REMARKS ===== */
+
+static RemarkFilters remark_filters;
+
+/* LLVM's regular expressions are POSIX extended ones */
+static bool valid_remark_pattern(const char *option, const char *pattern) {
+    if (!pattern) return true;
+    regex_t regex;
+    int error = regcomp(&regex, pattern, REG_EXTENDED | REG_NOSUB);
+    if (error != 0) {
+        char message[128];
+        regerror(error, &regex, message, sizeof(message));
+        fprintf(stderr, "Error: invalid regular expression '%s' in %s: %s\n", pattern, option, message);
+        return false;
+    }
+    regfree(&regex);
+    return true;
+}
+
+bool backend_set_remark_filters(const RemarkFilters *filters) {
+    if (!valid_remark_pattern("-Rpass", filters->passed) ||
+        !valid_remark_pattern("-Rpass-missed", filters->missed) ||
+        !valid_remark_pattern("-Rpass-analysis", filters->analysis)) {
+        return false;
+    }
+    remark_filters = *filters;
+    return true;
+}
+
+const RemarkFilters *backend_remark_filters(void) {
+    return &remark_filters;
+}
+
+/* ===== FUNCTION REPORT ===== */
+
+void function_report_free(FunctionReport *report) {
+    if (!report) return;
+    for (size_t i = 0; i < report->count; i++) {
+        xfree(report->records[i].name);
+    }
+    xfree(report->records);
+    report->records = NULL;
+    report->count = 0;
+    report->capacity = 0;
+}
+
 /* ===== BUILT-IN BACKENDS ===== */
 
 /* LLVM backend is implemented in llvm_backend_impl.c */
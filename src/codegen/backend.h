@@ -3,6 +3,7 @@
 
 #include <stddef.h>
 #include "../common/types.h"
+#include "../common/taskpool.h"
 
 /* Backend types - pluggable code generation */
 typedef enum {
@@ -27,6 +28,67 @@ typedef struct {
     size_t target_count;
 } BackendCapabilities;
 
+/* Per-function result cache for incremental code generation. The backend
+ * computes a fingerprint of everything that determines one function's
+ * optimized code; the owner maps it to storage and may mix in its own
+ * flags. Fetched data is allocated with xmalloc and freed by the backend. */
+typedef struct {
+    bool (*fetch)(void *owner, const char *fingerprint, char **data, size_t *len);
+    void (*store)(void *owner, const char *fingerprint, const char *data, size_t len);
+    void *owner;
+    
+    /* Filled in by the backend */
+    size_t reused;
+    size_t rebuilt;
+} FunctionCache;
+
+/* What one function costs, for --function-report. The backend fills in
+ * the IR numbers and timings; the "before" counts are the IR as first
+ * generated, the "after" ones what the optimizer made of it. */
+typedef struct {
+    char *name;
+    size_t ast_nodes;
+    size_t blocks_before;
+    size_t instructions_before;
+    size_t blocks_after;
+    size_t instructions_after;
+    double codegen_ms;
+    double optimize_ms;
+    double emit_ms;
+    size_t code_bytes;          /* Size of the function's symbol in the object */
+} FunctionRecord;
+
+typedef struct {
+    FunctionRecord *records;
+    size_t count;
+    size_t capacity;
+} FunctionReport;
+
+void function_report_free(FunctionReport *report);
+
+/* Optimization remarks (-Rpass=, -Rpass-missed=, -Rpass-analysis=): for
+ * each kind, an extended regular expression over the names of the passes
+ * whose remarks to report, NULL for none. The optimizer filters them and
+ * prints them on stderr itself, at the source location when the IR has
+ * one. Process-wide; read when the first backend context is created. */
+typedef struct {
+    const char *passed;
+    const char *missed;
+    const char *analysis;
+} RemarkFilters;
+
+/* False, with an error printed, if a pattern does not compile */
+bool backend_set_remark_filters(const RemarkFilters *filters);
+const RemarkFilters *backend_remark_filters(void);
+
+/* Output kinds for emitting into memory */
+typedef enum {
+    BACKEND_OUTPUT_OBJECT,
+    BACKEND_OUTPUT_ASSEMBLY,
+    BACKEND_OUTPUT_LLVM_IR,
+    BACKEND_OUTPUT_BITCODE
+} BackendOutput;
+
 /* Backend context - opaque handle */
 typedef struct BackendContext BackendContext;
 
@@ -68,12 +130,35 @@ typedef struct Backend {
     /* Optimization */
     void (*optimize)(BackendContext *ctx, void *module, int opt_level);
     
+    /* Optimization reusing cached functions; returns the module to use from
+     * now on, which may replace `module`. Optional. */
+    void *(*optimize_cached)(BackendContext *ctx, void *module, int opt_level,
+                             FunctionCache *cache);
+    
+    /* Record each function generated from now on into `report`; NULL stops.
+     * Optional. */
+    void (*set_function_report)(BackendContext *ctx, FunctionReport *report);
+    
+    /* Fill in the optimization and emission costs of the recorded functions,
+     * measured on copies of them; `module` is left as it is. Optional. */
+    void (*measure_functions)(BackendContext *ctx, void *module, int opt_level);
+    
     /* Output */
     bool (*emit_object)(BackendContext *ctx, void *module, const char *filename);
     bool (*emit_assembly)(BackendContext *ctx, void *module, const char *filename);
     bool (*emit_llvm_ir)(BackendContext *ctx, void *module, const char *filename);
     bool (*emit_bitcode)(BackendContext *ctx, void *module, const char *filename);
     
+    /* Emit into a buffer allocated with xmalloc instead of a file. Optional. */
+    bool (*emit_to_memory)(BackendContext *ctx, void *module, BackendOutput kind,
+                           char **data, size_t *len);
+    
+    /* Object code split over up to `count` files, compiled on `pool`, for
+     * linking together; returns how many files were written (the first
+     * ones), 0 on error. Optional. */
+    size_t (*emit_object_parts)(BackendContext *ctx, void *module, const char **filenames,
+                                size_t count, TaskPool *pool);
+    
     /* Linking */
     bool (*link)(BackendContext *ctx, const char **object_files, size_t count,
                 const char *output, bool is_shared);
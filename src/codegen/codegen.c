@@ -1,6 +1,7 @@
 #include "codegen.h"
 #include "../common/memory.h"
 #include "../common/error.h"
+#include "../common/timer.h"
 
 /* Stub implementation - to be completed */
 
@@ -56,32 +57,80 @@ void codegen_set_pic(CodegenContext *ctx, bool enable) {
     }
 }
 
+void codegen_set_function_cache(CodegenContext *ctx, FunctionCache *cache) {
+    if (ctx) {
+        ctx->function_cache = cache;
+    }
+}
+
+void codegen_set_function_report(CodegenContext *ctx, FunctionReport *report) {
+    if (ctx && ctx->backend->set_function_report && ctx->backend->measure_functions) {
+        ctx->function_report = report;
+        ctx->backend->set_function_report(ctx->backend_ctx, report);
+    }
+}
+
 bool codegen_generate(CodegenContext *ctx, ASTNode *ast, const char *module_name) {
-    if (!ctx || !ast || !ctx->backend) return false;
+    if (!ast || !codegen_begin(ctx, module_name)) return false;
+    
+    /* Generate code for translation unit */
+    codegen_add_decl(ctx, ast);
+    codegen_finish(ctx);
+    
+    return true;
+}
+
+bool codegen_begin(CodegenContext *ctx, const char *module_name) {
+    if (!ctx || !ctx->backend) return false;
     
     /* Create module */
     ctx->current_module = ctx->backend->create_module(ctx->backend_ctx, module_name);
-    if (!ctx->current_module) return false;
-    
-    /* Generate code for translation unit */
-    ctx->backend->codegen_decl(ctx->backend_ctx, ast);
+    return ctx->current_module != NULL;
+}
+
+void codegen_add_decl(CodegenContext *ctx, ASTNode *decl) {
+    MemoryPhase phase = memory_set_phase(MEMORY_PHASE_CODEGEN);
+    ctx->backend->codegen_decl(ctx->backend_ctx, decl);
+    memory_set_phase(phase);
+}
+
+void codegen_finish(CodegenContext *ctx) {
+    /* Measured on copies, before the module itself is optimized */
+    if (ctx->function_report) {
+        timer_begin("function report", NULL);
+        ctx->backend->measure_functions(ctx->backend_ctx, ctx->current_module, ctx->opt_level);
+        timer_end();
+    }
     
     /* Optimize if requested */
     if (ctx->opt_level > 0) {
-        ctx->backend->optimize(ctx->backend_ctx, ctx->current_module, ctx->opt_level);
+        MemoryPhase phase = memory_set_phase(MEMORY_PHASE_OPTIMIZE);
+        timer_begin("optimize", NULL);
+        if (ctx->function_cache && ctx->backend->optimize_cached) {
+            ctx->current_module = ctx->backend->optimize_cached(ctx->backend_ctx, ctx->current_module,
+                                                                ctx->opt_level, ctx->function_cache);
+        } else {
+            ctx->backend->optimize(ctx->backend_ctx, ctx->current_module, ctx->opt_level);
+        }
+        timer_end();
+        memory_set_phase(phase);
     }
-    
-    return true;
 }
 
 bool codegen_emit_object(CodegenContext *ctx, const char *filename) {
     if (!ctx || !ctx->backend || !ctx->current_module) return false;
-    return ctx->backend->emit_object(ctx->backend_ctx, ctx->current_module, filename);
+    MemoryPhase phase = memory_set_phase(MEMORY_PHASE_EMIT);
+    bool ok = ctx->backend->emit_object(ctx->backend_ctx, ctx->current_module, filename);
+    memory_set_phase(phase);
+    return ok;
 }
 
 bool codegen_emit_assembly(CodegenContext *ctx, const char *filename) {
     if (!ctx || !ctx->backend || !ctx->current_module) return false;
-    return ctx->backend->emit_assembly(ctx->backend_ctx, ctx->current_module, filename);
+    MemoryPhase phase = memory_set_phase(MEMORY_PHASE_EMIT);
+    bool ok = ctx->backend->emit_assembly(ctx->backend_ctx, ctx->current_module, filename);
+    memory_set_phase(phase);
+    return ok;
 }
 
 bool codegen_emit_llvm_ir(CodegenContext *ctx, const char *filename) {
@@ -96,10 +145,32 @@ bool codegen_emit_bitcode(CodegenContext *ctx, const char *filename) {
     return ctx->backend->emit_bitcode(ctx->backend_ctx, ctx->current_module, filename);
 }
 
+bool codegen_emit_to_memory(CodegenContext *ctx, BackendOutput kind, char **data, size_t *len) {
+    if (!ctx || !ctx->backend || !ctx->current_module) return false;
+    if (!ctx->backend->emit_to_memory) return false;
+    return ctx->backend->emit_to_memory(ctx->backend_ctx, ctx->current_module, kind, data, len);
+}
+
+size_t codegen_emit_object_parts(CodegenContext *ctx, TaskPool *pool, const char **filenames,
+                                 size_t count) {
+    if (!ctx || !ctx->backend || !ctx->current_module || count == 0) return 0;
+    if (!ctx->backend->emit_object_parts) {
+        return codegen_emit_object(ctx, filenames[0]) ? 1 : 0;
+    }
+    MemoryPhase phase = memory_set_phase(MEMORY_PHASE_EMIT);
+    size_t written = ctx->backend->emit_object_parts(ctx->backend_ctx, ctx->current_module,
+                                                     filenames, count, pool);
+    memory_set_phase(phase);
+    return written;
+}
+
 bool codegen_link(CodegenContext *ctx, const char **object_files, size_t count,
                  const char *output, bool is_shared) {
     if (!ctx || !ctx->backend) return false;
-    return ctx->backend->link(ctx->backend_ctx, object_files, count, output, is_shared);
+    timer_begin("link", output);
+    bool ok = ctx->backend->link(ctx->backend_ctx, object_files, count, output, is_shared);
+    timer_end();
+    return ok;
 }
 
 const char *codegen_get_error(CodegenContext *ctx) {
@@ -27,6 +27,8 @@ typedef struct CodegenContext {
     const char *target_cpu;
     const char **target_features;
     size_t target_feature_count;
+    FunctionCache *function_cache;  /* NULL: optimize the whole module */
+    FunctionReport *function_report;    /* NULL: no per-function costs */
 } CodegenContext;
 
 /* Initialize codegen */
@@ -37,16 +39,36 @@ void codegen_destroy(CodegenContext *ctx);
 void codegen_set_opt_level(CodegenContext *ctx, int level);
 void codegen_set_debug_info(CodegenContext *ctx, bool enable);
 void codegen_set_pic(CodegenContext *ctx, bool enable);
+void codegen_set_function_cache(CodegenContext *ctx, FunctionCache *cache);
+
+/* Record what each function costs into `report`, owned by the caller;
+ * ignored by backends that cannot */
+void codegen_set_function_report(CodegenContext *ctx, FunctionReport *report);
 
 /* Generate code from AST */
 bool codegen_generate(CodegenContext *ctx, ASTNode *ast, const char *module_name);
 
+/* The same in steps, for a unit parsed one declaration at a time: begin a
+ * module, add each top-level declaration in source order (the backend
+ * keeps nothing that points into it), then optimize */
+bool codegen_begin(CodegenContext *ctx, const char *module_name);
+void codegen_add_decl(CodegenContext *ctx, ASTNode *decl);
+void codegen_finish(CodegenContext *ctx);
+
 /* Emit output */
 bool codegen_emit_object(CodegenContext *ctx, const char *filename);
 bool codegen_emit_assembly(CodegenContext *ctx, const char *filename);
 bool codegen_emit_llvm_ir(CodegenContext *ctx, const char *filename);
 bool codegen_emit_bitcode(CodegenContext *ctx, const char *filename);
 
+/* Emit into a buffer the caller releases with xfree */
+bool codegen_emit_to_memory(CodegenContext *ctx, BackendOutput kind, char **data, size_t *len);
+
+/* Object code for an executable in up to `count` pieces compiled in
+ * parallel on `pool`; returns how many of `filenames` were written */
+size_t codegen_emit_object_parts(CodegenContext *ctx, TaskPool *pool, const char **filenames,
+                                 size_t count);
+
 /* Link */
 bool codegen_link(CodegenContext *ctx, const char **object_files, size_t count,
                  const char *output, bool is_shared);
@@ -42,12 +42,22 @@ void llvm_codegen_decl(BackendContext *ctx, ASTNode *decl);
 
 /* Optimization */
 void llvm_optimize(BackendContext *ctx, void *module, int opt_level);
+void *llvm_optimize_cached(BackendContext *ctx, void *module, int opt_level,
+                           FunctionCache *cache);
+
+/* Function report */
+void llvm_set_function_report(BackendContext *ctx, FunctionReport *report);
+void llvm_measure_functions(BackendContext *ctx, void *module, int opt_level);
 
 /* Output */
 bool llvm_emit_object(BackendContext *ctx, void *module, const char *filename);
 bool llvm_emit_assembly(BackendContext *ctx, void *module, const char *filename);
 bool llvm_emit_llvm_ir(BackendContext *ctx, void *module, const char *filename);
 bool llvm_emit_bitcode(BackendContext *ctx, void *module, const char *filename);
+bool llvm_emit_to_memory(BackendContext *ctx, void *module, BackendOutput kind,
+                         char **data, size_t *len);
+size_t llvm_emit_object_parts(BackendContext *ctx, void *module, const char **filenames,
+                              size_t count, TaskPool *pool);
 
 /* Linking */
 bool llvm_link(BackendContext *ctx, const char **object_files, size_t count,
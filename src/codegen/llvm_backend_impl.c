@@ -1,6 +1,12 @@
 #include "llvm_backend.h"
+#include "../ast/ast.h"
 #include "../common/memory.h"
 #include "../common/error.h"
+#include "../common/hash.h"
+#include "../common/probes.h"
+#include "../common/statistic.h"
+#include "../common/thread.h"
+#include "../common/timer.h"
 #include <string.h>
 #include <stdio.h>
 
@@ -9,9 +15,13 @@
 #include <llvm-c/Target.h>
 #include <llvm-c/TargetMachine.h>
 #include <llvm-c/Analysis.h>
+#include <llvm-c/BitReader.h>
 #include <llvm-c/BitWriter.h>
+#include <llvm-c/Linker.h>
+#include <llvm-c/Object.h>
 #include <llvm-c/Transforms/PassBuilder.h>
 #include <llvm-c/Error.h>
+#include <llvm-c/Support.h>
 #include <stdarg.h>
 #include <stdlib.h>
 
@@ -26,6 +36,16 @@ typedef struct SymbolEntry {
 
 #define SYMBOL_TABLE_SIZE 256
 
+static Slab symbol_slab = SLAB_INIT("BackendSymbol", SymbolEntry);
+
+STATISTIC(NumSymbolLookups, "backend", "Symbol table lookups");
+STATISTIC(NumSymbolProbes, "backend", "Symbol table chain entries compared");
+STATISTIC_MAX(MaxSymbolChain, "backend", "Longest symbol table chain walked");
+STATISTIC(NumAllocas, "backend", "Allocas emitted for locals");
+STATISTIC(NumFunctions, "backend", "Function bodies generated");
+STATISTIC(NumInstructions, "backend", "IR instructions in generated functions");
+STATISTIC_MAX(MaxInstructions, "backend", "IR instructions in the largest function");
+
 /* LLVM backend context */
 typedef struct LLVMBackendContext {
     LLVMContextRef llvm_context;
@@ -47,6 +67,9 @@ typedef struct LLVMBackendContext {
     /* Recursion depth tracking */
     int recursion_depth;
     
+    /* Per-function costs; NULL unless --function-report */
+    FunctionReport *function_report;
+    
     /* Error handling */
     char *last_error;
 } LLVMBackendContext;
@@ -66,7 +89,7 @@ static void symbol_table_add(LLVMBackendContext *ctx, const char *name,
                              LLVMValueRef value, LLVMTypeRef type, bool is_global) {
     unsigned int index = hash_string(name);
     
-    SymbolEntry *entry = xcalloc(1, sizeof(SymbolEntry));
+    SymbolEntry *entry = slab_alloc(&symbol_slab);
     entry->name = xstrdup(name);
     entry->value = value;
     entry->type = type;
@@ -80,13 +103,18 @@ static SymbolEntry *symbol_table_lookup(LLVMBackendContext *ctx, const char *nam
     unsigned int index = hash_string(name);
     
     SymbolEntry *entry = ctx->symbol_table[index];
+    unsigned long long probes = 0;
     while (entry) {
+        probes++;
         if (strcmp(entry->name, name) == 0) {
-            return entry;
+            break;
         }
         entry = entry->next;
     }
-    return NULL;
+    STATISTIC_INC(NumSymbolLookups);
+    STATISTIC_ADD(NumSymbolProbes, probes);
+    STATISTIC_NOTE_MAX(MaxSymbolChain, probes);
+    return entry;
 }
 
 /* Helper: Clear symbol table */
@@ -96,7 +124,7 @@ static void symbol_table_clear(LLVMBackendContext *ctx) {
         while (entry) {
             SymbolEntry *next = entry->next;
             xfree(entry->name);
-            xfree(entry);
+            slab_free(&symbol_slab, entry);
             entry = next;
         }
         ctx->symbol_table[i] = NULL;
@@ -126,12 +154,67 @@ static void set_error(LLVMBackendContext *ctx, const char *fmt, ...) {
 
 /* ===== LIFECYCLE ===== */
 
-BackendContext *llvm_backend_init(const char *target_triple, const char *cpu,
-                                   const char **features, size_t feature_count) {
-    /* Initialize LLVM */
+/* Target registration is process-wide; do it once even when several
+ * translation units are compiled concurrently */
+static pthread_once_t llvm_targets_once = PTHREAD_ONCE_INIT;
+
+/* LLVM's options can be parsed once per process. They are parsed by the
+ * first context created after some are requested, not by a warm-up, so a
+ * daemon's forked requests still get their own. */
+static pthread_mutex_t llvm_options_lock = PTHREAD_MUTEX_INITIALIZER;
+static bool llvm_options_parsed = false;
+
+static char *remark_option(const char *option, const char *pattern) {
+    size_t len = strlen(option) + strlen(pattern) + 1;
+    char *arg = xmalloc(len);
+    snprintf(arg, len, "%s%s", option, pattern);
+    return arg;
+}
+
+static void llvm_initialize_targets(void) {
     LLVMInitializeNativeTarget();
     LLVMInitializeNativeAsmPrinter();
     LLVMInitializeNativeAsmParser();
+}
+
+static void llvm_apply_options(void) {
+    pthread_mutex_lock(&llvm_options_lock);
+    if (llvm_options_parsed) {
+        pthread_mutex_unlock(&llvm_options_lock);
+        return;
+    }
+
+    /* Pass timing and remarks are only switched on through LLVM's own
+     * command-line options. Remarks go to LLVM's default handler: one set
+     * through the C API would receive them unfiltered. */
+    const char *args[5] = {"llvm-c"};
+    char *owned[3] = {NULL, NULL, NULL};
+    int argc = 1;
+    if (timer_pass_timing()) args[argc++] = "-time-passes";
+
+    const RemarkFilters *remarks = backend_remark_filters();
+    if (remarks->passed) owned[0] = remark_option("-pass-remarks=", remarks->passed);
+    if (remarks->missed) owned[1] = remark_option("-pass-remarks-missed=", remarks->missed);
+    if (remarks->analysis) owned[2] = remark_option("-pass-remarks-analysis=", remarks->analysis);
+    for (size_t i = 0; i < 3; i++) {
+        if (owned[i]) args[argc++] = owned[i];
+    }
+
+    if (argc > 1) {
+        LLVMParseCommandLineOptions(argc, args, NULL);
+        llvm_options_parsed = true;
+    }
+    pthread_mutex_unlock(&llvm_options_lock);
+    for (size_t i = 0; i < 3; i++) {
+        xfree(owned[i]);
+    }
+}
+
+BackendContext *llvm_backend_init(const char *target_triple, const char *cpu,
+                                   const char **features, size_t feature_count) {
+    /* Initialize LLVM */
+    pthread_once(&llvm_targets_once, llvm_initialize_targets);
+    llvm_apply_options();
     
     LLVMBackendContext *ctx = xcalloc(1, sizeof(LLVMBackendContext));
     
@@ -169,7 +252,7 @@ BackendContext *llvm_backend_init(const char *target_triple, const char *cpu,
     }
     
     if (actual_triple && LLVMGetTargetFromTriple(actual_triple, &target, &error)) {
-        fprintf(stderr, "Error getting target for '%s': %s\n", actual_triple, error);
+        fprintf(diagnostic_stream(), "Error getting target for '%s': %s\n", actual_triple, error);
         LLVMDisposeMessage(error);
         target = NULL;
         
@@ -180,7 +263,7 @@ BackendContext *llvm_backend_init(const char *target_triple, const char *cpu,
             }
             allocated_triple = LLVMGetDefaultTargetTriple();
             if (allocated_triple && LLVMGetTargetFromTriple(allocated_triple, &target, &error)) {
-                fprintf(stderr, "Error getting native target: %s\n", error);
+                fprintf(diagnostic_stream(), "Error getting native target: %s\n", error);
                 LLVMDisposeMessage(error);
                 target = NULL;
             }
@@ -197,7 +280,7 @@ BackendContext *llvm_backend_init(const char *target_triple, const char *cpu,
         );
         
         if (!ctx->target_machine) {
-            fprintf(stderr, "Failed to create target machine for '%s'\n", actual_triple);
+            fprintf(diagnostic_stream(), "Failed to create target machine for '%s'\n", actual_triple);
         }
     }
     
@@ -1271,6 +1354,7 @@ void llvm_codegen_stmt(BackendContext *ctx_opaque, ASTNode *stmt) {
             }
             
             /* Add to symbol table */
+            STATISTIC_INC(NumAllocas);
             symbol_table_add(ctx, var_name, alloca, llvm_type, false);
             
             /* Handle initializer if present */
@@ -1819,6 +1903,45 @@ static void codegen_function_decl(LLVMBackendContext *ctx, ASTNode *func_decl) {
     if (param_names) xfree(param_names);
 }
 
+/* Only walked for --stats, --function-report or an attached
+ * function__done probe; `blocks` may be NULL */
+static unsigned long long count_instructions(LLVMValueRef function, size_t *blocks) {
+    unsigned long long count = 0;
+    if (blocks) *blocks = 0;
+    for (LLVMBasicBlockRef block = LLVMGetFirstBasicBlock(function); block; block = LLVMGetNextBasicBlock(block)) {
+        if (blocks) (*blocks)++;
+        for (LLVMValueRef inst = LLVMGetFirstInstruction(block); inst; inst = LLVMGetNextInstruction(inst)) {
+            count++;
+        }
+    }
+    return count;
+}
+
+static void count_ast_node(ASTNode *node, void *data) {
+    (void)node;
+    (*(size_t *)data)++;
+}
+
+/* A function as first generated, before optimization */
+static void record_function(FunctionReport *report, ASTNode *decl, LLVMValueRef function,
+                            double codegen_ms) {
+    if (report->count == report->capacity) {
+        report->capacity = report->capacity ? report->capacity * 2 : 16;
+        report->records = xrealloc(report->records, report->capacity * sizeof(FunctionRecord));
+    }
+    FunctionRecord *record = &report->records[report->count++];
+    memset(record, 0, sizeof(*record));
+
+    size_t len = 0;
+    const char *name = LLVMGetValueName2(function, &len);
+    record->name = xstrndup(name, len);
+    ast_traverse(decl, count_ast_node, &record->ast_nodes);
+    record->instructions_before = count_instructions(function, &record->blocks_before);
+    record->blocks_after = record->blocks_before;
+    record->instructions_after = record->instructions_before;
+    record->codegen_ms = codegen_ms;
+}
+
 void llvm_codegen_decl(BackendContext *ctx_opaque, ASTNode *decl) {
     if (!ctx_opaque || !decl) return;
     
@@ -1847,9 +1970,30 @@ void llvm_codegen_decl(BackendContext *ctx_opaque, ASTNode *decl) {
             }
             break;
             
-        case AST_FUNCTION_DECL:
+        case AST_FUNCTION_DECL: {
+            const char *name = decl->data.func_decl.name;
+            LLVMValueRef previous = ctx->current_function;
+            uint64_t started = ctx->function_report ? timer_now() : 0;
+            LLVMC_PROBE1(function__start, name);
+            timer_begin("function", name);
             codegen_function_decl(ctx, decl);
+            timer_end();
+            if (ctx->function_report && ctx->current_function != previous) {
+                record_function(ctx->function_report, decl, ctx->current_function,
+                                (double)(timer_now() - started) / 1e6);
+            }
+
+            unsigned long long instructions = 0;
+            if (ctx->current_function != previous &&
+                (statistics_enabled() || LLVMC_PROBE_ENABLED(function__done))) {
+                instructions = count_instructions(ctx->current_function, NULL);
+                STATISTIC_INC(NumFunctions);
+                STATISTIC_ADD(NumInstructions, instructions);
+                STATISTIC_NOTE_MAX(MaxInstructions, instructions);
+            }
+            LLVMC_PROBE2(function__done, name, instructions);
             break;
+        }
             
         case AST_FUNCTION_PROTO:
             /* Function prototype - just declare it */
@@ -1925,14 +2069,8 @@ void llvm_codegen_decl(BackendContext *ctx_opaque, ASTNode *decl) {
 
 /* ===== OPTIMIZATION ===== */
 
-void llvm_optimize(BackendContext *ctx_opaque, void *module, int opt_level) {
-    if (!ctx_opaque || !module) return;
-    
-    LLVMBackendContext *ctx = (LLVMBackendContext *)ctx_opaque;
-    LLVMModuleRef mod = (LLVMModuleRef)module;
-    
-    if (opt_level == 0) return;  /* No optimization */
-    
+/* Run the standard pipeline for `opt_level` over `mod`; false on failure */
+static bool run_pass_pipeline(LLVMBackendContext *ctx, LLVMModuleRef mod, int opt_level) {
     /* Use new PassBuilder API (LLVM 14+) */
     LLVMPassBuilderOptionsRef options = LLVMCreatePassBuilderOptions();
     
@@ -1967,7 +2105,9 @@ void llvm_optimize(BackendContext *ctx_opaque, void *module, int opt_level) {
     }
     
     /* Run the optimization passes */
+    timer_begin("pass pipeline", passes);
     LLVMErrorRef error = LLVMRunPasses(mod, passes, ctx->target_machine, options);
+    timer_end();
     
     if (error) {
         char *error_msg = LLVMGetErrorMessage(error);
@@ -1976,6 +2116,721 @@ void llvm_optimize(BackendContext *ctx_opaque, void *module, int opt_level) {
     }
     
     LLVMDisposePassBuilderOptions(options);
+    return error == NULL;
+}
+
+void llvm_optimize(BackendContext *ctx_opaque, void *module, int opt_level) {
+    if (!ctx_opaque || !module) return;
+    
+    if (opt_level == 0) return;  /* No optimization */
+    
+    run_pass_pipeline((LLVMBackendContext *)ctx_opaque, (LLVMModuleRef)module, opt_level);
+}
+
+/* ===== INCREMENTAL OPTIMIZATION ===== */
+
+/* Per-function caching. Each defined function is fingerprinted from its
+ * unoptimized IR together with the IR of everything it can see: the
+ * functions it may inline, transitively, and the declarations and globals
+ * those reference. Changed functions are optimized in a work module that
+ * holds only their inlining inputs, with every symbol given external
+ * linkage so the optimizer may inline but cannot rewrite signatures or drop
+ * symbols another function refers to. The result is cut into one module
+ * per function (a shard) and cached. The final module is the original with
+ * all bodies removed and every shard linked back in; local linkage is then
+ * restored and functions that were inlined everywhere are dropped. */
+
+#define FUNCTION_SHARD_FORMAT "llvm-c function shard 2"
+
+/* One global value of the module being optimized */
+typedef struct {
+    LLVMValueRef value;
+    const char *name;
+    unsigned char digest[SHA256_DIGEST_SIZE];   /* Of the printed definition */
+    size_t *refs;               /* Global values referenced by the body */
+    size_t ref_count;
+    size_t ref_capacity;
+    bool has_body;
+    unsigned mark;
+    char fingerprint[SHA256_HEX_SIZE];
+    LLVMModuleRef shard;        /* This function alone, optimized */
+} GlobalInfo;
+
+/* Global values by name, so clones of the module can be matched up */
+typedef struct {
+    GlobalInfo *infos;
+    size_t count;
+    size_t *slots;              /* Open addressing, index + 1 */
+    size_t slot_mask;
+    unsigned stamp;
+} GlobalIndex;
+
+/* A symbol whose linkage was widened to external while splitting */
+typedef struct {
+    char *name;
+    LLVMLinkage linkage;
+    bool is_function;
+} PromotedSymbol;
+
+#define NOT_INDEXED ((size_t)-1)
+
+static bool has_local_linkage(LLVMValueRef value) {
+    LLVMLinkage linkage = LLVMGetLinkage(value);
+    return linkage == LLVMInternalLinkage || linkage == LLVMPrivateLinkage;
+}
+
+/* Local constants whose address is not significant (string literals) are
+ * simply copied into every shard that uses them */
+static bool is_duplicable_constant(LLVMValueRef global) {
+    return LLVMIsAGlobalVariable(global) && LLVMIsGlobalConstant(global) &&
+           has_local_linkage(global) && LLVMGetUnnamedAddress(global) != LLVMNoUnnamedAddr;
+}
+
+static bool is_declaration(LLVMValueRef value) {
+    return LLVMIsDeclaration(value) != 0;
+}
+
+/* Shards sit in a shared cache directory, so their keys are built from
+ * SHA-256 digests of the printed IR; the cheap FNV digest only names
+ * constants */
+static void digest_definition(LLVMValueRef value, unsigned char digest[SHA256_DIGEST_SIZE]) {
+    char *text = LLVMPrintValueToString(value);
+    Sha256 h;
+    sha256_init(&h);
+    sha256_update_str(&h, text);
+    sha256_final(&h, digest);
+    LLVMDisposeMessage(text);
+}
+
+static uint64_t digest_value(LLVMValueRef value, bool skip_name) {
+    char *text = LLVMPrintValueToString(value);
+    const char *start = text;
+    if (skip_name) {
+        const char *eq = strstr(text, " = ");
+        if (eq) start = eq + 3;
+    }
+    uint64_t digest = hash64_bytes(start, strlen(start));
+    LLVMDisposeMessage(text);
+    return digest;
+}
+
+/* Name constants after their contents: the default ".str.N" numbering
+ * shifts whenever an earlier function gains a literal, which would change
+ * the fingerprint of every function after it */
+static void name_constants_by_content(LLVMModuleRef module) {
+    for (LLVMValueRef g = LLVMGetFirstGlobal(module); g; g = LLVMGetNextGlobal(g)) {
+        size_t len = 0;
+        LLVMGetValueName2(g, &len);
+        if (len > 0 && !is_duplicable_constant(g)) continue;
+
+        char name[32];
+        snprintf(name, sizeof(name), ".cst.%016llx", (unsigned long long)digest_value(g, true));
+        LLVMSetValueName2(g, name, strlen(name));
+    }
+}
+
+static size_t index_lookup(const GlobalIndex *index, const char *name, size_t len) {
+    if (len == 0) return NOT_INDEXED;
+    for (size_t slot = hash64_bytes(name, len) & index->slot_mask; index->slots[slot];
+         slot = (slot + 1) & index->slot_mask) {
+        const GlobalInfo *info = &index->infos[index->slots[slot] - 1];
+        if (strlen(info->name) == len && memcmp(info->name, name, len) == 0) {
+            return index->slots[slot] - 1;
+        }
+    }
+    return NOT_INDEXED;
+}
+
+static size_t index_lookup_value(const GlobalIndex *index, LLVMValueRef value) {
+    size_t len = 0;
+    const char *name = LLVMGetValueName2(value, &len);
+    return index_lookup(index, name, len);
+}
+
+static void index_add(GlobalIndex *index, LLVMValueRef value) {
+    size_t len = 0;
+    const char *name = LLVMGetValueName2(value, &len);
+    if (len == 0) return;
+
+    GlobalInfo *info = &index->infos[index->count];
+    info->value = value;
+    info->name = name;
+    info->has_body = LLVMIsAFunction(value) && !is_declaration(value);
+    digest_definition(value, info->digest);
+
+    size_t slot = hash64_bytes(name, len) & index->slot_mask;
+    while (index->slots[slot]) slot = (slot + 1) & index->slot_mask;
+    index->slots[slot] = ++index->count;
+}
+
+static void add_reference(GlobalIndex *index, GlobalInfo *info, LLVMValueRef operand, int depth) {
+    if (LLVMIsAGlobalValue(operand)) {
+        size_t target = index_lookup_value(index, operand);
+        if (target == NOT_INDEXED || index->infos[target].mark == index->stamp) return;
+        index->infos[target].mark = index->stamp;
+
+        if (info->ref_count == info->ref_capacity) {
+            info->ref_capacity = info->ref_capacity ? info->ref_capacity * 2 : 8;
+            info->refs = xrealloc(info->refs, info->ref_capacity * sizeof(size_t));
+        }
+        info->refs[info->ref_count++] = target;
+    } else if (LLVMIsAConstant(operand) && depth < 16) {
+        /* Constant expressions such as a GEP into a string literal */
+        int count = LLVMGetNumOperands(operand);
+        for (int i = 0; i < count; i++) {
+            add_reference(index, info, LLVMGetOperand(operand, i), depth + 1);
+        }
+    }
+}
+
+static void index_build(GlobalIndex *index, LLVMModuleRef module) {
+    size_t total = 0;
+    for (LLVMValueRef f = LLVMGetFirstFunction(module); f; f = LLVMGetNextFunction(f)) total++;
+    for (LLVMValueRef g = LLVMGetFirstGlobal(module); g; g = LLVMGetNextGlobal(g)) total++;
+
+    size_t slot_count = 16;
+    while (slot_count < total * 2) slot_count *= 2;
+
+    index->infos = xcalloc(total ? total : 1, sizeof(GlobalInfo));
+    index->count = 0;
+    index->slots = xcalloc(slot_count, sizeof(size_t));
+    index->slot_mask = slot_count - 1;
+    index->stamp = 0;
+
+    for (LLVMValueRef f = LLVMGetFirstFunction(module); f; f = LLVMGetNextFunction(f)) index_add(index, f);
+    for (LLVMValueRef g = LLVMGetFirstGlobal(module); g; g = LLVMGetNextGlobal(g)) index_add(index, g);
+
+    /* What each body refers to */
+    for (size_t i = 0; i < index->count; i++) {
+        GlobalInfo *info = &index->infos[i];
+        if (!info->has_body) continue;
+
+        index->stamp++;
+        for (LLVMBasicBlockRef bb = LLVMGetFirstBasicBlock(info->value); bb; bb = LLVMGetNextBasicBlock(bb)) {
+            for (LLVMValueRef inst = LLVMGetFirstInstruction(bb); inst; inst = LLVMGetNextInstruction(inst)) {
+                int count = LLVMGetNumOperands(inst);
+                for (int op = 0; op < count; op++) {
+                    add_reference(index, info, LLVMGetOperand(inst, op), 0);
+                }
+            }
+        }
+    }
+}
+
+static void index_destroy(GlobalIndex *index) {
+    for (size_t i = 0; i < index->count; i++) {
+        xfree(index->infos[i].refs);
+        if (index->infos[i].shard) LLVMDisposeModule(index->infos[i].shard);
+    }
+    xfree(index->infos);
+    xfree(index->slots);
+}
+
+/* Mark everything reachable from `roots` through function bodies with a
+ * fresh stamp; `visit` sees each value once, in a deterministic order */
+static void mark_closure(GlobalIndex *index, const size_t *roots, size_t root_count,
+                         void (*visit)(const GlobalInfo *info, Sha256 *hash), Sha256 *hash) {
+    size_t *stack = xmalloc((index->count + 1) * sizeof(size_t));
+    size_t depth = 0;
+
+    index->stamp++;
+    for (size_t i = 0; i < root_count; i++) {
+        if (index->infos[roots[i]].mark == index->stamp) continue;
+        index->infos[roots[i]].mark = index->stamp;
+        stack[depth++] = roots[i];
+
+        while (depth > 0) {
+            const GlobalInfo *info = &index->infos[stack[--depth]];
+            if (visit) visit(info, hash);
+            if (!info->has_body) continue;
+
+            for (size_t r = 0; r < info->ref_count; r++) {
+                GlobalInfo *ref = &index->infos[info->refs[r]];
+                if (ref->mark == index->stamp) continue;
+                ref->mark = index->stamp;
+                stack[depth++] = info->refs[r];
+            }
+        }
+    }
+    xfree(stack);
+}
+
+static void hash_digest(const GlobalInfo *info, Sha256 *hash) {
+    sha256_update(hash, info->digest, sizeof(info->digest));
+}
+
+static void compute_fingerprint(GlobalIndex *index, size_t root, const Sha256 *prefix) {
+    Sha256 hash = *prefix;
+    mark_closure(index, &root, 1, hash_digest, &hash);
+    sha256_final_hex(&hash, index->infos[root].fingerprint);
+}
+
+/* Drop a function's body, leaving an external declaration */
+static void make_declaration(LLVMValueRef function) {
+    for (LLVMBasicBlockRef bb = LLVMGetFirstBasicBlock(function); bb; bb = LLVMGetNextBasicBlock(bb)) {
+        for (LLVMValueRef inst = LLVMGetFirstInstruction(bb); inst; inst = LLVMGetNextInstruction(inst)) {
+            LLVMTypeRef type = LLVMTypeOf(inst);
+            if (LLVMGetTypeKind(type) != LLVMVoidTypeKind) {
+                LLVMReplaceAllUsesWith(inst, LLVMGetUndef(type));
+            }
+        }
+    }
+    for (LLVMBasicBlockRef bb = LLVMGetFirstBasicBlock(function); bb; bb = LLVMGetNextBasicBlock(bb)) {
+        LLVMValueRef inst;
+        while ((inst = LLVMGetLastInstruction(bb)) != NULL) {
+            LLVMInstructionEraseFromParent(inst);
+        }
+    }
+    LLVMBasicBlockRef bb;
+    while ((bb = LLVMGetFirstBasicBlock(function)) != NULL) {
+        LLVMDeleteBasicBlock(bb);
+    }
+    LLVMSetLinkage(function, LLVMExternalLinkage);
+}
+
+/* Replace a global variable's definition by an external declaration */
+static void make_global_declaration(LLVMModuleRef module, LLVMValueRef global) {
+    LLVMValueRef decl = LLVMAddGlobal(module, LLVMGlobalGetValueType(global), "");
+    LLVMSetGlobalConstant(decl, LLVMIsGlobalConstant(global));
+    LLVMSetThreadLocal(decl, LLVMIsThreadLocal(global));
+    LLVMSetAlignment(decl, LLVMGetAlignment(global));
+
+    size_t len = 0;
+    const char *name = LLVMGetValueName2(global, &len);
+    char *saved = xstrndup(name, len);
+    LLVMReplaceAllUsesWith(global, decl);
+    LLVMDeleteGlobal(global);
+    LLVMSetValueName2(decl, saved, len);
+    xfree(saved);
+}
+
+/* Remove bodies of indexed functions not marked with the current stamp.
+ * Functions the optimizer created are kept. Unless `keep_definitions`,
+ * global variables become declarations too, except duplicable constants. */
+static void strip_module(LLVMModuleRef module, const GlobalIndex *index, bool keep_definitions) {
+    for (LLVMValueRef f = LLVMGetFirstFunction(module); f; f = LLVMGetNextFunction(f)) {
+        if (is_declaration(f)) continue;
+        size_t i = index_lookup_value(index, f);
+        if (i != NOT_INDEXED && index->infos[i].mark != index->stamp) make_declaration(f);
+    }
+
+    if (keep_definitions) return;
+
+    LLVMValueRef next;
+    for (LLVMValueRef g = LLVMGetFirstGlobal(module); g; g = next) {
+        next = LLVMGetNextGlobal(g);
+        if (!is_declaration(g) && !is_duplicable_constant(g)) make_global_declaration(module, g);
+    }
+}
+
+/* Delete unreferenced duplicable constants and, when asked, unreferenced
+ * declarations and optimizer-created local functions */
+static void remove_unused(LLVMModuleRef module, const GlobalIndex *index, bool declarations) {
+    bool changed = true;
+    while (changed) {
+        changed = false;
+
+        LLVMValueRef next;
+        for (LLVMValueRef f = LLVMGetFirstFunction(module); f; f = next) {
+            next = LLVMGetNextFunction(f);
+            if (!declarations || LLVMGetFirstUse(f)) continue;
+            if (is_declaration(f) ||
+                (has_local_linkage(f) && index_lookup_value(index, f) == NOT_INDEXED)) {
+                LLVMDeleteFunction(f);
+                changed = true;
+            }
+        }
+
+        for (LLVMValueRef g = LLVMGetFirstGlobal(module); g; g = next) {
+            next = LLVMGetNextGlobal(g);
+            if (LLVMGetFirstUse(g)) continue;
+            if (is_duplicable_constant(g) || (declarations && is_declaration(g))) {
+                LLVMDeleteGlobal(g);
+                changed = true;
+            }
+        }
+    }
+}
+
+/* Widen local linkage so shards can refer to each other's symbols. Only
+ * duplicable constants stay local. */
+static PromotedSymbol *promote_local_symbols(LLVMModuleRef module, size_t *count) {
+    size_t capacity = 16;
+    PromotedSymbol *promoted = xmalloc(capacity * sizeof(PromotedSymbol));
+    *count = 0;
+
+    for (int pass = 0; pass < 2; pass++) {
+        LLVMValueRef value = pass == 0 ? LLVMGetFirstFunction(module) : LLVMGetFirstGlobal(module);
+        for (; value; value = pass == 0 ? LLVMGetNextFunction(value) : LLVMGetNextGlobal(value)) {
+            if (!has_local_linkage(value) || is_duplicable_constant(value)) continue;
+
+            if (*count == capacity) {
+                capacity *= 2;
+                promoted = xrealloc(promoted, capacity * sizeof(PromotedSymbol));
+            }
+            size_t len = 0;
+            const char *name = LLVMGetValueName2(value, &len);
+            promoted[*count].name = xstrndup(name, len);
+            promoted[*count].linkage = LLVMGetLinkage(value);
+            promoted[*count].is_function = pass == 0;
+            (*count)++;
+
+            LLVMSetLinkage(value, LLVMExternalLinkage);
+        }
+    }
+    return promoted;
+}
+
+static bool module_is_valid(LLVMModuleRef module) {
+    char *message = NULL;
+    bool broken = LLVMVerifyModule(module, LLVMReturnStatusAction, &message);
+    if (message) LLVMDisposeMessage(message);
+    return !broken;
+}
+
+static bool run_passes(LLVMBackendContext *ctx, LLVMModuleRef module, const char *passes) {
+    LLVMPassBuilderOptionsRef options = LLVMCreatePassBuilderOptions();
+    timer_begin("pass pipeline", passes);
+    LLVMErrorRef error = LLVMRunPasses(module, passes, ctx->target_machine, options);
+    timer_end();
+    LLVMDisposePassBuilderOptions(options);
+    if (error) {
+        LLVMConsumeError(error);
+        return false;
+    }
+    return true;
+}
+
+/* Validate a single-function module, cache it and keep it for splicing */
+static bool finish_shard(LLVMModuleRef shard, GlobalInfo *info, FunctionCache *cache) {
+    if (!module_is_valid(shard)) {
+        LLVMDisposeModule(shard);
+        return false;
+    }
+
+    LLVMMemoryBufferRef bitcode = LLVMWriteBitcodeToMemoryBuffer(shard);
+    if (bitcode) {
+        cache->store(cache->owner, info->fingerprint, LLVMGetBufferStart(bitcode),
+                     LLVMGetBufferSize(bitcode));
+        LLVMDisposeMemoryBuffer(bitcode);
+    }
+    info->shard = shard;
+    return true;
+}
+
+/* Cut an optimized work module into one shard per member, halving the
+ * module at each step so the total work stays O(n log n). Takes ownership
+ * of `module`. */
+static bool split_into_shards(LLVMModuleRef module, GlobalIndex *index,
+                              const size_t *members, size_t count, FunctionCache *cache) {
+    index->stamp++;
+    for (size_t i = 0; i < count; i++) {
+        index->infos[members[i]].mark = index->stamp;
+    }
+    strip_module(module, index, false);
+    remove_unused(module, index, true);
+
+    if (count == 1) {
+        return finish_shard(module, &index->infos[members[0]], cache);
+    }
+
+    size_t half = count / 2;
+    LLVMModuleRef upper = LLVMCloneModule(module);
+    if (!split_into_shards(upper, index, members + half, count - half, cache)) {
+        LLVMDisposeModule(module);
+        return false;
+    }
+    return split_into_shards(module, index, members, half, cache);
+}
+
+/* Use a cached shard for `info` if one is stored and well-formed */
+static bool fetch_shard(LLVMBackendContext *ctx, GlobalInfo *info, FunctionCache *cache) {
+    char *data = NULL;
+    size_t len = 0;
+    if (!cache->fetch(cache->owner, info->fingerprint, &data, &len)) return false;
+
+    LLVMMemoryBufferRef buffer = LLVMCreateMemoryBufferWithMemoryRangeCopy(data, len, info->name);
+    xfree(data);
+
+    LLVMModuleRef shard = NULL;
+    bool ok = !LLVMParseBitcodeInContext2(ctx->llvm_context, buffer, &shard);
+    LLVMDisposeMemoryBuffer(buffer);
+
+    if (ok) {
+        LLVMValueRef function = LLVMGetNamedFunction(shard, info->name);
+        ok = function && !is_declaration(function);
+    }
+    if (!ok) {
+        if (shard) LLVMDisposeModule(shard);
+        return false;
+    }
+    info->shard = shard;
+    return true;
+}
+
+static void record_link_error(LLVMDiagnosticInfoRef info, void *failed) {
+    if (LLVMGetDiagInfoSeverity(info) == LLVMDSError) *(bool *)failed = true;
+}
+
+/* Replace every body in `module` by its shard and undo the promotion */
+static bool assemble_shards(LLVMBackendContext *ctx, LLVMModuleRef module, GlobalIndex *index,
+                            const PromotedSymbol *promoted, size_t promoted_count) {
+    index->stamp++;
+    strip_module(module, index, true);
+    remove_unused(module, index, false);
+
+    /* Without a handler a link error would terminate the process */
+    LLVMDiagnosticHandler saved_handler = LLVMContextGetDiagnosticHandler(ctx->llvm_context);
+    void *saved_context = LLVMContextGetDiagnosticContext(ctx->llvm_context);
+    bool failed = false;
+    LLVMContextSetDiagnosticHandler(ctx->llvm_context, record_link_error, &failed);
+
+    for (size_t i = 0; i < index->count; i++) {
+        GlobalInfo *info = &index->infos[i];
+        if (!info->shard) continue;
+
+        /* The shard is consumed either way */
+        if (!failed && LLVMLinkModules2(module, info->shard)) failed = true;
+        else if (failed) LLVMDisposeModule(info->shard);
+        info->shard = NULL;
+    }
+
+    LLVMContextSetDiagnosticHandler(ctx->llvm_context, saved_handler, saved_context);
+    if (failed) return false;
+
+    for (size_t i = 0; i < promoted_count; i++) {
+        LLVMValueRef value = promoted[i].is_function ? LLVMGetNamedFunction(module, promoted[i].name)
+                                                     : LLVMGetNamedGlobal(module, promoted[i].name);
+        if (value) LLVMSetLinkage(value, promoted[i].linkage);
+    }
+
+    /* Local functions that were inlined into every caller are dead now */
+    return run_passes(ctx, module, "globaldce") && module_is_valid(module);
+}
+
+void *llvm_optimize_cached(BackendContext *ctx_opaque, void *module, int opt_level,
+                           FunctionCache *cache) {
+    if (!ctx_opaque || !module || opt_level == 0) return module;
+    
+    LLVMBackendContext *ctx = (LLVMBackendContext *)ctx_opaque;
+    LLVMModuleRef original = (LLVMModuleRef)module;
+    
+    /* Broken input gets the ordinary pipeline and its error reporting */
+    if (!cache || !module_is_valid(original)) {
+        run_pass_pipeline(ctx, original, opt_level);
+        return module;
+    }
+    
+    name_constants_by_content(original);
+    
+    GlobalIndex index;
+    index_build(&index, original);
+    
+    /* Everything that applies to all functions alike */
+    char level[8];
+    snprintf(level, sizeof(level), "O%d", opt_level);
+    Sha256 prefix;
+    sha256_init(&prefix);
+    sha256_update_str(&prefix, FUNCTION_SHARD_FORMAT);
+    sha256_update_str(&prefix, LLVMGetTarget(original));
+    sha256_update_str(&prefix, LLVMGetDataLayoutStr(original));
+    sha256_update_str(&prefix, level);
+    
+    size_t *misses = xmalloc((index.count + 1) * sizeof(size_t));
+    size_t miss_count = 0, reused = 0;
+    for (size_t i = 0; i < index.count; i++) {
+        if (!index.infos[i].has_body) continue;
+        compute_fingerprint(&index, i, &prefix);
+        if (fetch_shard(ctx, &index.infos[i], cache)) {
+            reused++;
+        } else {
+            misses[miss_count++] = i;
+        }
+    }
+    
+    LLVMModuleRef result = LLVMCloneModule(original);
+    size_t promoted_count = 0;
+    PromotedSymbol *promoted = promote_local_symbols(result, &promoted_count);
+    
+    bool ok = true;
+    if (miss_count > 0) {
+        /* Optimize the changed functions together with their inlining inputs */
+        LLVMModuleRef work = LLVMCloneModule(result);
+        mark_closure(&index, misses, miss_count, NULL, NULL);
+        strip_module(work, &index, true);
+        
+        ok = run_pass_pipeline(ctx, work, opt_level);
+        if (ok) {
+            ok = split_into_shards(work, &index, misses, miss_count, cache);
+        } else {
+            LLVMDisposeModule(work);
+        }
+    }
+    
+    if (ok) {
+        ok = assemble_shards(ctx, result, &index, promoted, promoted_count);
+    }
+    
+    for (size_t i = 0; i < promoted_count; i++) {
+        xfree(promoted[i].name);
+    }
+    xfree(promoted);
+    xfree(misses);
+    index_destroy(&index);
+    
+    if (!ok) {
+        /* Fall back to optimizing the module as a whole */
+        LLVMDisposeModule(result);
+        run_pass_pipeline(ctx, original, opt_level);
+        return module;
+    }
+    
+    cache->reused += reused;
+    cache->rebuilt += miss_count;
+    
+    LLVMDisposeModule(original);
+    ctx->llvm_module = result;
+    return result;
+}
+
+/* ===== FUNCTION REPORT ===== */
+
+/* What the optimizer and code generator make of a function is measured on
+ * a module holding that function alone, cut from a copy of the unit the
+ * same way as function shards. Its callees are only declared there, so
+ * nothing is inlined into it and the time spent is its own; the LLVM-C
+ * pass API cannot attribute a whole-module run to functions. */
+
+void llvm_set_function_report(BackendContext *ctx_opaque, FunctionReport *report) {
+    if (!ctx_opaque) return;
+    ((LLVMBackendContext *)ctx_opaque)->function_report = report;
+}
+
+/* Records come in module order, so searching on from the last match
+ * usually finds the next one straight away */
+static FunctionRecord *find_record(FunctionReport *report, const char *name, size_t *hint) {
+    for (size_t n = 0; n < report->count; n++) {
+        size_t i = (*hint + n) % report->count;
+        if (strcmp(report->records[i].name, name) == 0) {
+            *hint = i + 1;
+            return &report->records[i];
+        }
+    }
+    return NULL;
+}
+
+/* Size of the symbol for `name` in an object file; 0 where the format
+ * records none */
+static size_t symbol_size(LLVMBackendContext *ctx, LLVMMemoryBufferRef object, const char *name) {
+    char *error = NULL;
+    LLVMBinaryRef binary = LLVMCreateBinary(object, ctx->llvm_context, &error);
+    if (!binary) {
+        if (error) LLVMDisposeMessage(error);
+        return 0;
+    }
+
+    size_t size = 0;
+    LLVMSymbolIteratorRef it = LLVMObjectFileCopySymbolIterator(binary);
+    for (; it && !LLVMObjectFileIsSymbolIteratorAtEnd(binary, it); LLVMMoveToNextSymbol(it)) {
+        const char *symbol = LLVMGetSymbolName(it);
+        if (!symbol) continue;
+        /* Mach-O and 32-bit Windows prefix C names with an underscore */
+        if (strcmp(symbol, name) == 0 || (symbol[0] == '_' && strcmp(symbol + 1, name) == 0)) {
+            size = (size_t)LLVMGetSymbolSize(it);
+            break;
+        }
+    }
+    if (it) LLVMDisposeSymbolIterator(it);
+    LLVMDisposeBinary(binary);
+    return size;
+}
+
+static void measure_function(LLVMBackendContext *ctx, LLVMModuleRef module, const char *name,
+                             FunctionRecord *record, int opt_level) {
+    if (opt_level > 0) {
+        uint64_t start = timer_now();
+        bool ok = run_pass_pipeline(ctx, module, opt_level);
+        record->optimize_ms = (double)(timer_now() - start) / 1e6;
+        if (!ok) return;
+    }
+
+    LLVMValueRef function = LLVMGetNamedFunction(module, name);
+    if (function) {
+        record->instructions_after = count_instructions(function, &record->blocks_after);
+    }
+    if (!ctx->target_machine) return;
+
+    char *error = NULL;
+    LLVMMemoryBufferRef object = NULL;
+    uint64_t start = timer_now();
+    if (LLVMTargetMachineEmitToMemoryBuffer(ctx->target_machine, module, LLVMObjectFile,
+                                            &error, &object)) {
+        if (error) LLVMDisposeMessage(error);
+        return;
+    }
+    record->emit_ms = (double)(timer_now() - start) / 1e6;
+    record->code_bytes = symbol_size(ctx, object, name);
+    LLVMDisposeMemoryBuffer(object);
+}
+
+/* Halve the module down to one member per module, as split_into_shards
+ * does. Takes ownership of `module`. */
+static void measure_members(LLVMBackendContext *ctx, LLVMModuleRef module, GlobalIndex *index,
+                            const size_t *members, size_t count, int opt_level, size_t *hint) {
+    index->stamp++;
+    for (size_t i = 0; i < count; i++) {
+        index->infos[members[i]].mark = index->stamp;
+    }
+    strip_module(module, index, false);
+    remove_unused(module, index, true);
+
+    if (count == 1) {
+        const char *name = index->infos[members[0]].name;
+        FunctionRecord *record = find_record(ctx->function_report, name, hint);
+        if (record) measure_function(ctx, module, name, record, opt_level);
+        LLVMDisposeModule(module);
+        return;
+    }
+
+    size_t half = count / 2;
+    measure_members(ctx, LLVMCloneModule(module), index, members + half, count - half,
+                    opt_level, hint);
+    measure_members(ctx, module, index, members, half, opt_level, hint);
+}
+
+void llvm_measure_functions(BackendContext *ctx_opaque, void *module, int opt_level) {
+    if (!ctx_opaque || !module) return;
+
+    LLVMBackendContext *ctx = (LLVMBackendContext *)ctx_opaque;
+    FunctionReport *report = ctx->function_report;
+    if (!report || report->count == 0 || !module_is_valid((LLVMModuleRef)module)) return;
+
+    /* The index keeps pointing at names in `work`, which outlives the cuts */
+    LLVMModuleRef work = LLVMCloneModule((LLVMModuleRef)module);
+    size_t promoted_count = 0;
+    PromotedSymbol *promoted = promote_local_symbols(work, &promoted_count);
+    GlobalIndex index;
+    index_build(&index, work);
+
+    size_t *members = xmalloc((index.count + 1) * sizeof(size_t));
+    size_t count = 0;
+    size_t hint = 0;
+    for (size_t i = 0; i < index.count; i++) {
+        if (index.infos[i].has_body && find_record(report, index.infos[i].name, &hint)) {
+            members[count++] = i;
+        }
+    }
+    if (count > 0) {
+        measure_members(ctx, LLVMCloneModule(work), &index, members, count, opt_level, &hint);
+    }
+
+    xfree(members);
+    for (size_t i = 0; i < promoted_count; i++) {
+        xfree(promoted[i].name);
+    }
+    xfree(promoted);
+    index_destroy(&index);
+    LLVMDisposeModule(work);
 }
 
 /* ===== OUTPUT ===== */
@@ -2059,6 +2914,342 @@ bool llvm_emit_bitcode(BackendContext *ctx_opaque, void *module, const char *fil
     return true;
 }
 
+static bool copy_memory_buffer(LLVMMemoryBufferRef buffer, char **data, size_t *len) {
+    *len = LLVMGetBufferSize(buffer);
+    *data = xmalloc(*len ? *len : 1);
+    memcpy(*data, LLVMGetBufferStart(buffer), *len);
+    LLVMDisposeMemoryBuffer(buffer);
+    return true;
+}
+
+bool llvm_emit_to_memory(BackendContext *ctx_opaque, void *module, BackendOutput kind,
+                         char **data, size_t *len) {
+    if (!ctx_opaque || !module || !data || !len) return false;
+    
+    LLVMBackendContext *ctx = (LLVMBackendContext *)ctx_opaque;
+    char *error = NULL;
+    
+    switch (kind) {
+        case BACKEND_OUTPUT_LLVM_IR: {
+            char *text = LLVMPrintModuleToString((LLVMModuleRef)module);
+            *len = strlen(text);
+            *data = xstrndup(text, *len);
+            LLVMDisposeMessage(text);
+            return true;
+        }
+        case BACKEND_OUTPUT_BITCODE:
+            return copy_memory_buffer(LLVMWriteBitcodeToMemoryBuffer((LLVMModuleRef)module),
+                                      data, len);
+        case BACKEND_OUTPUT_OBJECT:
+        case BACKEND_OUTPUT_ASSEMBLY:
+            break;
+    }
+    
+    if (!ctx->target_machine) {
+        set_error(ctx, "No target machine configured");
+        return false;
+    }
+    
+    /* Same verification as llvm_emit_object */
+    if (LLVMVerifyModule((LLVMModuleRef)module, LLVMReturnStatusAction, &error)) {
+        set_error(ctx, "Module verification failed: %s", error ? error : "unknown error");
+        if (error) LLVMDisposeMessage(error);
+        return false;
+    }
+    if (error) {
+        LLVMDisposeMessage(error);
+        error = NULL;
+    }
+    
+    LLVMMemoryBufferRef buffer = NULL;
+    LLVMCodeGenFileType type = kind == BACKEND_OUTPUT_OBJECT ? LLVMObjectFile : LLVMAssemblyFile;
+    if (LLVMTargetMachineEmitToMemoryBuffer(ctx->target_machine, (LLVMModuleRef)module,
+                                            type, &error, &buffer)) {
+        set_error(ctx, "Failed to emit %s: %s",
+                  kind == BACKEND_OUTPUT_OBJECT ? "object code" : "assembly", error);
+        LLVMDisposeMessage(error);
+        return false;
+    }
+    return copy_memory_buffer(buffer, data, len);
+}
+
+/* ===== PARALLEL EMISSION ===== */
+
+/* Object code for an executable may come in several pieces. The module is
+ * cut into partitions that each define a share of the functions and
+ * variables and declare the rest; local symbols are widened to hidden
+ * globals under a name no C identifier can take, and duplicable constants
+ * are copied wherever they are used. Each partition travels as bitcode to
+ * a pool thread, which reads it into a private LLVMContext and runs code
+ * generation with its own target machine. */
+
+typedef struct {
+    char *bitcode;
+    size_t len;
+    const char *filename;
+    LLVMTargetRef target;
+    const char *triple;
+    const char *cpu;
+    const char *features;
+    bool failed;
+} EmitPart;
+
+/* Global values not to be split: appending arrays like llvm.global_ctors,
+ * aliases and ifuncs */
+static bool module_is_splittable(LLVMModuleRef module) {
+    if (LLVMGetFirstGlobalAlias(module) || LLVMGetFirstGlobalIFunc(module)) return false;
+    for (LLVMValueRef g = LLVMGetFirstGlobal(module); g; g = LLVMGetNextGlobal(g)) {
+        size_t len = 0;
+        const char *name = LLVMGetValueName2(g, &len);
+        if (len >= 5 && strncmp(name, "llvm.", 5) == 0) return false;
+    }
+    return true;
+}
+
+static size_t function_size(LLVMValueRef function) {
+    size_t size = 1;
+    for (LLVMBasicBlockRef bb = LLVMGetFirstBasicBlock(function); bb; bb = LLVMGetNextBasicBlock(bb)) {
+        for (LLVMValueRef inst = LLVMGetFirstInstruction(bb); inst; inst = LLVMGetNextInstruction(inst)) {
+            size++;
+        }
+    }
+    return size;
+}
+
+/* Definitions that get an owner: every function body and every variable
+ * except duplicable constants, functions first, in module order */
+static bool is_partitioned(LLVMValueRef value) {
+    return !is_declaration(value) && !is_duplicable_constant(value);
+}
+
+/* Give every definition to the partition with the least code so far,
+ * largest first; ties keep module order so the split is reproducible */
+static size_t *assign_partitions(LLVMModuleRef module, size_t parts, size_t *count) {
+    size_t total = 0;
+    for (LLVMValueRef f = LLVMGetFirstFunction(module); f; f = LLVMGetNextFunction(f)) total++;
+    for (LLVMValueRef g = LLVMGetFirstGlobal(module); g; g = LLVMGetNextGlobal(g)) total++;
+
+    size_t *owners = xcalloc(total ? total : 1, sizeof(size_t));
+    size_t *sizes = xcalloc(total ? total : 1, sizeof(size_t));
+    size_t *order = xmalloc((total ? total : 1) * sizeof(size_t));
+    size_t items = 0, i = 0;
+    for (LLVMValueRef f = LLVMGetFirstFunction(module); f; f = LLVMGetNextFunction(f), i++) {
+        if (is_partitioned(f)) sizes[i] = function_size(f);
+    }
+    for (LLVMValueRef g = LLVMGetFirstGlobal(module); g; g = LLVMGetNextGlobal(g), i++) {
+        if (is_partitioned(g)) sizes[i] = 1;
+    }
+    for (i = 0; i < total; i++) {
+        if (sizes[i] == 0) continue;
+        /* Insertion sort by size, descending; stable */
+        size_t at = items++;
+        while (at > 0 && sizes[order[at - 1]] < sizes[i]) {
+            order[at] = order[at - 1];
+            at--;
+        }
+        order[at] = i;
+    }
+
+    size_t *load = xcalloc(parts, sizeof(size_t));
+    for (i = 0; i < items; i++) {
+        size_t lightest = 0;
+        for (size_t p = 1; p < parts; p++) {
+            if (load[p] < load[lightest]) lightest = p;
+        }
+        owners[order[i]] = lightest;
+        load[lightest] += sizes[order[i]];
+    }
+
+    xfree(load);
+    xfree(order);
+    xfree(sizes);
+    *count = total;
+    return owners;
+}
+
+/* Widen local linkage so partitions can refer to each other, and name
+ * anonymous values so declarations can find their definitions */
+static void prepare_for_split(LLVMModuleRef module) {
+    size_t anonymous = 0;
+    for (int pass = 0; pass < 2; pass++) {
+        LLVMValueRef value = pass == 0 ? LLVMGetFirstFunction(module) : LLVMGetFirstGlobal(module);
+        for (; value; value = pass == 0 ? LLVMGetNextFunction(value) : LLVMGetNextGlobal(value)) {
+            size_t len = 0;
+            const char *name = LLVMGetValueName2(value, &len);
+            if (is_duplicable_constant(value) || (len > 0 && !has_local_linkage(value))) continue;
+
+            char renamed[256];
+            if (len == 0) {
+                snprintf(renamed, sizeof(renamed), ".anon.%zu.llvmc.local", anonymous++);
+            } else {
+                snprintf(renamed, sizeof(renamed), "%.*s.llvmc.local", (int)(len < 200 ? len : 200), name);
+            }
+            LLVMSetLinkage(value, LLVMExternalLinkage);
+            LLVMSetVisibility(value, LLVMHiddenVisibility);
+            LLVMSetValueName2(value, renamed, strlen(renamed));
+        }
+    }
+}
+
+/* Keep only the definitions `part` owns; `work` and its clone `module`
+ * list their global values in the same order */
+static bool strip_to_partition(LLVMModuleRef module, LLVMModuleRef work, const size_t *owners,
+                               size_t part) {
+    unsigned dbg = LLVMGetMDKindIDInContext(LLVMGetModuleContext(module), "dbg", 3);
+    size_t i = 0;
+
+    LLVMValueRef src = LLVMGetFirstFunction(work);
+    LLVMValueRef dst = LLVMGetFirstFunction(module);
+    for (; src && dst; src = LLVMGetNextFunction(src), dst = LLVMGetNextFunction(dst), i++) {
+        if (is_partitioned(src) && owners[i] != part) {
+            make_declaration(dst);
+            LLVMGlobalEraseMetadata(dst, dbg);
+        }
+    }
+    if (src || dst) return false;
+
+    /* Replacing a variable appends its declaration, so collect first */
+    size_t capacity = 16, count = 0;
+    LLVMValueRef *foreign = xmalloc(capacity * sizeof(LLVMValueRef));
+    src = LLVMGetFirstGlobal(work);
+    dst = LLVMGetFirstGlobal(module);
+    for (; src && dst; src = LLVMGetNextGlobal(src), dst = LLVMGetNextGlobal(dst), i++) {
+        if (!is_partitioned(src) || owners[i] == part) continue;
+        if (count == capacity) {
+            capacity *= 2;
+            foreign = xrealloc(foreign, capacity * sizeof(LLVMValueRef));
+        }
+        foreign[count++] = dst;
+    }
+    bool aligned = !src && !dst;
+    for (size_t k = 0; aligned && k < count; k++) {
+        LLVMVisibility visibility = LLVMGetVisibility(foreign[k]);
+        make_global_declaration(module, foreign[k]);
+        LLVMSetVisibility(LLVMGetLastGlobal(module), visibility);
+    }
+    xfree(foreign);
+    if (!aligned) return false;
+
+    /* Constants and declarations nobody in this partition uses */
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        LLVMValueRef next;
+        for (LLVMValueRef f = LLVMGetFirstFunction(module); f; f = next) {
+            next = LLVMGetNextFunction(f);
+            if (is_declaration(f) && !LLVMGetFirstUse(f)) {
+                LLVMDeleteFunction(f);
+                changed = true;
+            }
+        }
+        for (LLVMValueRef g = LLVMGetFirstGlobal(module); g; g = next) {
+            next = LLVMGetNextGlobal(g);
+            if (!LLVMGetFirstUse(g) && (is_declaration(g) || is_duplicable_constant(g))) {
+                LLVMDeleteGlobal(g);
+                changed = true;
+            }
+        }
+    }
+    return true;
+}
+
+static void emit_part(void *arg) {
+    EmitPart *part = (EmitPart *)arg;
+    timer_begin("emit part", part->filename);
+    LLVMContextRef context = LLVMContextCreate();
+    LLVMMemoryBufferRef buffer = LLVMCreateMemoryBufferWithMemoryRange(part->bitcode, part->len,
+                                                                       part->filename, false);
+    LLVMModuleRef module = NULL;
+    part->failed = LLVMParseBitcodeInContext2(context, buffer, &module) != 0 ||
+                   !module_is_valid(module);
+    LLVMDisposeMemoryBuffer(buffer);
+
+    if (!part->failed) {
+        LLVMTargetMachineRef machine = LLVMCreateTargetMachine(
+            part->target, part->triple, part->cpu, part->features,
+            LLVMCodeGenLevelDefault, LLVMRelocDefault, LLVMCodeModelDefault);
+        char *error = NULL;
+        part->failed = !machine || LLVMTargetMachineEmitToFile(machine, module, (char *)part->filename,
+                                                               LLVMObjectFile, &error);
+        if (error) LLVMDisposeMessage(error);
+        if (machine) LLVMDisposeTargetMachine(machine);
+    }
+
+    if (module) LLVMDisposeModule(module);
+    LLVMContextDispose(context);
+    xfree(part->bitcode);
+    part->bitcode = NULL;
+    timer_end();
+}
+
+size_t llvm_emit_object_parts(BackendContext *ctx_opaque, void *module, const char **filenames,
+                              size_t count, TaskPool *pool) {
+    if (!ctx_opaque || !module || !filenames || count == 0) return 0;
+
+    LLVMBackendContext *ctx = (LLVMBackendContext *)ctx_opaque;
+    LLVMModuleRef original = (LLVMModuleRef)module;
+
+    size_t functions = 0;
+    for (LLVMValueRef f = LLVMGetFirstFunction(original); f; f = LLVMGetNextFunction(f)) {
+        if (!is_declaration(f)) functions++;
+    }
+    size_t parts = count < functions ? count : functions;
+    if (parts < 2 || !ctx->target_machine || !module_is_splittable(original) ||
+        !module_is_valid(original)) {
+        return llvm_emit_object(ctx_opaque, module, filenames[0]) ? 1 : 0;
+    }
+
+    LLVMModuleRef work = LLVMCloneModule(original);
+    prepare_for_split(work);
+    size_t owner_count = 0;
+    size_t *owners = assign_partitions(work, parts, &owner_count);
+
+    char *triple = LLVMGetTargetMachineTriple(ctx->target_machine);
+    char *cpu = LLVMGetTargetMachineCPU(ctx->target_machine);
+    char *features = LLVMGetTargetMachineFeatureString(ctx->target_machine);
+    EmitPart *emit = xcalloc(parts, sizeof(EmitPart));
+
+    /* Partitions are cut one at a time on this thread (the module's context
+     * is not shared) and start compiling as soon as each is ready */
+    TaskGroup group;
+    taskgroup_init(&group, pool);
+    bool ok = true;
+    for (size_t p = 0; p < parts && ok; p++) {
+        LLVMModuleRef piece = LLVMCloneModule(work);
+        ok = strip_to_partition(piece, work, owners, p);
+        if (ok) {
+            emit[p] = (EmitPart){
+                .filename = filenames[p],
+                .target = LLVMGetTargetMachineTarget(ctx->target_machine),
+                .triple = triple,
+                .cpu = cpu,
+                .features = features
+            };
+            copy_memory_buffer(LLVMWriteBitcodeToMemoryBuffer(piece), &emit[p].bitcode, &emit[p].len);
+            taskgroup_spawn(&group, emit_part, &emit[p]);
+        }
+        LLVMDisposeModule(piece);
+    }
+    taskgroup_wait(&group);
+
+    for (size_t p = 0; p < parts; p++) {
+        if (emit[p].failed || !emit[p].filename) ok = false;
+    }
+
+    xfree(emit);
+    LLVMDisposeMessage(features);
+    LLVMDisposeMessage(cpu);
+    LLVMDisposeMessage(triple);
+    xfree(owners);
+    LLVMDisposeModule(work);
+
+    /* Anything unexpected: the whole module as one object */
+    if (!ok) {
+        return llvm_emit_object(ctx_opaque, module, filenames[0]) ? 1 : 0;
+    }
+    return parts;
+}
+
 /* ===== LINKING ===== */
 
 bool llvm_link(BackendContext *ctx_opaque, const char **object_files, size_t count,
@@ -2130,12 +3321,19 @@ Backend *backend_llvm_create(void) {
     
     /* Optimization */
     backend->optimize = llvm_optimize;
+    backend->optimize_cached = llvm_optimize_cached;
+    
+    /* Function report */
+    backend->set_function_report = llvm_set_function_report;
+    backend->measure_functions = llvm_measure_functions;
     
     /* Output */
     backend->emit_object = llvm_emit_object;
     backend->emit_assembly = llvm_emit_assembly;
     backend->emit_llvm_ir = llvm_emit_llvm_ir;
     backend->emit_bitcode = llvm_emit_bitcode;
+    backend->emit_to_memory = llvm_emit_to_memory;
+    backend->emit_object_parts = llvm_emit_object_parts;
     
     /* Linking */
     backend->link = llvm_link;
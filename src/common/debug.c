@@ -455,6 +455,25 @@ void debug_print_ast_stats(FILE *out, ASTNode *node) {
     fprintf(out, "\n");
 }
 
+/* ===== MEMORY STATISTICS ===== */
+
+void debug_print_memory_stats(FILE *out) {
+    const MemoryStats *stats = memory_get_stats();
+    fprintf(out, "%-11s %14s %14s %12s %14s %14s %14s\n", "Phase", "Allocated", "Freed",
+            "Allocations", "Heap at end", "Peak heap", "Peak RSS");
+    for (int i = 0; i < MEMORY_PHASE_COUNT; i++) {
+        const PhaseStats *phase = &stats->phases[i];
+        if (phase->allocations == 0 && phase->peak_rss == 0) continue;
+        fprintf(out, "%-11s %14zu %14zu %12zu %14zu %14zu %14zu\n", memory_phase_name((MemoryPhase)i),
+                phase->allocated, phase->freed, phase->allocations, phase->live, phase->peak,
+                phase->peak_rss);
+    }
+    fprintf(out, "Heap peak:       %zu bytes\n", stats->peak_usage);
+    fprintf(out, "Peak RSS:        %zu bytes (%.1f MB, includes LLVM)\n", stats->peak_rss,
+            stats->peak_rss / 1024.0 / 1024.0);
+    fprintf(out, "\n");
+}
+
 /* ===== FILE OUTPUT ===== */
 
 void debug_dump_tokens_to_file(const char *filename, TokenList *tokens) {
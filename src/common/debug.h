@@ -51,6 +51,11 @@ void debug_print_ast_tree(FILE *out, ASTNode *node);
 /* Print AST statistics */
 void debug_print_ast_stats(FILE *out, ASTNode *node);
 
+/* ===== MEMORY ===== */
+
+/* Per-phase allocation table and resident-memory peaks */
+void debug_print_memory_stats(FILE *out);
+
 /* Export AST to JSON */
 void debug_export_ast_json(FILE *out, ASTNode *node);
 
@@ -1,24 +1,83 @@
+#define _POSIX_C_SOURCE 200809L
 #include "error.h"
 #include "memory.h"
+#include "thread.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
-/* Global state */
-static int error_cnt = 0;
-static int warning_cnt = 0;
-static DiagnosticOptions diag_opts;
-
-/* Source file cache for showing snippets */
-#define MAX_SOURCE_FILES 256
+/* A source file snippets are taken from. The text is the registering
+ * caller's, not a copy; the offsets of its lines are found on the first
+ * snippet that needs them. */
 typedef struct {
     char *filename;
-    char *source;
+    const char *source;
+    uint32_t *line_starts;      /* NULL until indexed */
+    uint32_t line_count;
 } SourceFile;
 
-static SourceFile source_files[MAX_SOURCE_FILES];
-static int source_file_count = 0;
+/* Everything one compilation reports into: counters, optional capture of
+ * the output, and the sources snippets are taken from */
+struct DiagnosticState {
+    int error_cnt;
+    int warning_cnt;
+    DiagnosticOptions *opts;    /* NULL: the process-wide options */
+    
+    FILE *capture_stream;
+    char *capture_buffer;
+    size_t capture_size;
+    
+    SourceFile *source_files;
+    size_t source_file_count;
+    size_t source_file_capacity;
+    size_t *source_slots;       /* By file name, open addressing, index + 1 */
+    size_t source_slot_mask;
+    size_t last_source;         /* Index + 1 of the last file looked up */
+};
+
+/* Options are set once at startup and shared. Each thread reports into its
+ * own state unless a session has bound one, so translation units compiled
+ * concurrently keep separate diagnostics. */
+static DiagnosticOptions diag_opts;
+static THREAD_LOCAL DiagnosticState thread_state;
+static THREAD_LOCAL DiagnosticState *bound_state = NULL;
+
+static DiagnosticState *state(void) {
+    return bound_state ? bound_state : &thread_state;
+}
+
+static DiagnosticOptions *options(void) {
+    DiagnosticState *current = state();
+    return current->opts ? current->opts : &diag_opts;
+}
+
+DiagnosticState *diagnostic_state_create(DiagnosticOptions *opts) {
+    DiagnosticState *created = xcalloc(1, sizeof(DiagnosticState));
+    created->opts = opts;
+    return created;
+}
+
+void diagnostic_state_destroy(DiagnosticState *destroyed) {
+    if (!destroyed) return;
+    if (destroyed->capture_stream) {
+        fclose(destroyed->capture_stream);
+        free(destroyed->capture_buffer);
+    }
+    for (size_t i = 0; i < destroyed->source_file_count; i++) {
+        xfree(destroyed->source_files[i].filename);
+        xfree(destroyed->source_files[i].line_starts);
+    }
+    xfree(destroyed->source_files);
+    xfree(destroyed->source_slots);
+    xfree(destroyed);
+}
+
+DiagnosticState *diagnostic_bind(DiagnosticState *bound) {
+    DiagnosticState *previous = bound_state;
+    bound_state = bound;
+    return previous;
+}
 
 /* Initialize diagnostic system */
 void diagnostic_init(void) {
@@ -44,52 +103,155 @@ DiagnosticOptions *diagnostic_get_options(void) {
     return &diag_opts;
 }
 
+/* Output stream / capture */
+FILE *diagnostic_stream(void) {
+    DiagnosticState *st = state();
+    return st->capture_stream ? st->capture_stream : stderr;
+}
+
+bool diagnostic_begin_capture(void) {
+    DiagnosticState *st = state();
+    if (st->capture_stream) return false;
+    
+    st->capture_stream = open_memstream(&st->capture_buffer, &st->capture_size);
+    return st->capture_stream != NULL;
+}
+
+char *diagnostic_end_capture(size_t *len) {
+    DiagnosticState *st = state();
+    if (!st->capture_stream) {
+        if (len) *len = 0;
+        return NULL;
+    }
+    
+    fclose(st->capture_stream);
+    st->capture_stream = NULL;
+    
+    /* Hand back an xmalloc'd copy so callers release it with xfree */
+    char *text = xstrndup(st->capture_buffer ? st->capture_buffer : "", st->capture_size);
+    if (len) *len = st->capture_size;
+    
+    free(st->capture_buffer);
+    st->capture_buffer = NULL;
+    st->capture_size = 0;
+    return text;
+}
+
+/* Fatal errors terminate the process; don't lose captured text */
+static void flush_capture_for_exit(void) {
+    DiagnosticState *st = state();
+    if (!st->capture_stream) return;
+    
+    fflush(st->capture_stream);
+    fwrite(st->capture_buffer, 1, st->capture_size, stderr);
+}
+
 /* Source management */
+static size_t hash_filename(const char *filename) {
+    size_t hash = 14695981039346656037ull & SIZE_MAX;
+    for (const unsigned char *p = (const unsigned char *)filename; *p; p++) {
+        hash = (hash ^ *p) * (size_t)1099511628211ull;
+    }
+    return hash;
+}
+
+/* Registration and removal are rare next to lookups, so the table is
+ * simply rebuilt; it stays at most half full */
+static void rebuild_source_slots(DiagnosticState *st) {
+    size_t slot_count = 16;
+    while (slot_count < st->source_file_count * 2) slot_count *= 2;
+    xfree(st->source_slots);
+    st->source_slots = xcalloc(slot_count, sizeof(size_t));
+    st->source_slot_mask = slot_count - 1;
+
+    for (size_t i = 0; i < st->source_file_count; i++) {
+        size_t slot = hash_filename(st->source_files[i].filename) & st->source_slot_mask;
+        while (st->source_slots[slot]) slot = (slot + 1) & st->source_slot_mask;
+        st->source_slots[slot] = i + 1;
+    }
+    st->last_source = 0;
+}
+
+static SourceFile *find_source(DiagnosticState *st, const char *filename) {
+    if (!filename || st->source_file_count == 0) return NULL;
+
+    /* A flood of diagnostics mostly repeats one file */
+    if (st->last_source && strcmp(st->source_files[st->last_source - 1].filename, filename) == 0) {
+        return &st->source_files[st->last_source - 1];
+    }
+
+    for (size_t slot = hash_filename(filename) & st->source_slot_mask; st->source_slots[slot];
+         slot = (slot + 1) & st->source_slot_mask) {
+        SourceFile *file = &st->source_files[st->source_slots[slot] - 1];
+        if (strcmp(file->filename, filename) == 0) {
+            st->last_source = st->source_slots[slot];
+            return file;
+        }
+    }
+    return NULL;
+}
+
 void diagnostic_set_source(const char *filename, const char *source) {
-    if (source_file_count >= MAX_SOURCE_FILES) return;
+    DiagnosticState *st = state();
     
     /* Check if already exists */
-    for (int i = 0; i < source_file_count; i++) {
-        if (strcmp(source_files[i].filename, filename) == 0) {
-            xfree(source_files[i].source);
-            source_files[i].source = xstrdup(source);
-            return;
-        }
+    SourceFile *file = find_source(st, filename);
+    if (file) {
+        file->source = source;
+        xfree(file->line_starts);
+        file->line_starts = NULL;
+        file->line_count = 0;
+        return;
     }
     
     /* Add new */
-    source_files[source_file_count].filename = xstrdup(filename);
-    source_files[source_file_count].source = xstrdup(source);
-    source_file_count++;
+    if (st->source_file_count == st->source_file_capacity) {
+        st->source_file_capacity = st->source_file_capacity ? st->source_file_capacity * 2 : 4;
+        st->source_files = xrealloc(st->source_files, st->source_file_capacity * sizeof(SourceFile));
+    }
+    file = &st->source_files[st->source_file_count++];
+    file->filename = xstrdup(filename);
+    file->source = source;
+    file->line_starts = NULL;
+    file->line_count = 0;
+    rebuild_source_slots(st);
 }
 
 void diagnostic_clear_source(const char *filename) {
-    for (int i = 0; i < source_file_count; i++) {
-        if (strcmp(source_files[i].filename, filename) == 0) {
-            xfree(source_files[i].filename);
-            xfree(source_files[i].source);
-            /* Shift remaining */
-            for (int j = i; j < source_file_count - 1; j++) {
-                source_files[j] = source_files[j + 1];
-            }
-            source_file_count--;
-            return;
-        }
-    }
+    DiagnosticState *st = state();
+    SourceFile *file = find_source(st, filename);
+    if (!file) return;
+    
+    xfree(file->filename);
+    xfree(file->line_starts);
+    /* The last file takes its place */
+    *file = st->source_files[--st->source_file_count];
+    rebuild_source_slots(st);
 }
 
-static const char *get_source_for_file(const char *filename) {
-    for (int i = 0; i < source_file_count; i++) {
-        if (strcmp(source_files[i].filename, filename) == 0) {
-            return source_files[i].source;
+/* Offsets of every line start, in one pass over the text */
+static void index_lines(SourceFile *file) {
+    size_t capacity = 256;
+    uint32_t *starts = xmalloc(capacity * sizeof(uint32_t));
+    uint32_t count = 0;
+    starts[count++] = 0;
+
+    const char *p = file->source;
+    while ((p = strchr(p, '\n')) != NULL) {
+        p++;
+        if (count == capacity) {
+            capacity *= 2;
+            starts = xrealloc(starts, capacity * sizeof(uint32_t));
         }
+        starts[count++] = (uint32_t)(p - file->source);
     }
-    return NULL;
+    file->line_starts = starts;
+    file->line_count = count;
 }
 
 /* Color helpers */
 static const char *color_for_level(DiagnosticLevel level) {
-    if (!diag_opts.use_color) return "";
+    if (!options()->use_color) return "";
     
     switch (level) {
         case DIAG_ERROR:
@@ -118,151 +280,139 @@ static const char *level_string(DiagnosticLevel level) {
 }
 
 /* Get line from source */
-static const char *get_line_from_source(const char *source, uint32_t line_num, size_t *len) {
-    if (!source) return NULL;
-    
-    uint32_t current_line = 1;
-    const char *line_start = source;
-    const char *p = source;
-    
-    while (*p && current_line < line_num) {
-        if (*p == '\n') {
-            current_line++;
-            line_start = p + 1;
-        }
-        p++;
-    }
-    
-    if (current_line != line_num) return NULL;
-    
-    /* Find line end */
-    const char *line_end = line_start;
-    while (*line_end && *line_end != '\n') {
-        line_end++;
-    }
-    
-    *len = line_end - line_start;
+static const char *get_line_from_source(SourceFile *file, uint32_t line_num, size_t *len) {
+    if (!file->source || line_num == 0) return NULL;
+    if (!file->line_starts) index_lines(file);
+    if (line_num > file->line_count) return NULL;
+    
+    const char *line_start = file->source + file->line_starts[line_num - 1];
+    const char *line_end = strchr(line_start, '\n');
+    *len = line_end ? (size_t)(line_end - line_start) : strlen(line_start);
     return line_start;
 }
 
 /* Print source snippet with caret */
 static void print_source_snippet(SourceLocation loc) {
-    if (!diag_opts.show_source_snippet) return;
+    const DiagnosticOptions *opts = options();
+    if (!opts->show_source_snippet) return;
     
-    const char *source = get_source_for_file(loc.filename);
-    if (!source) return;
+    SourceFile *file = find_source(state(), loc.filename);
+    if (!file) return;
     
     size_t line_len;
-    const char *line = get_line_from_source(source, loc.line, &line_len);
+    const char *line = get_line_from_source(file, loc.line, &line_len);
     if (!line) return;
     
     /* Print line number if enabled */
-    if (diag_opts.show_line_numbers) {
-        if (diag_opts.use_color) {
-            fprintf(stderr, "%s%5u | %s", COLOR_BOLD, loc.line, COLOR_RESET);
+    if (opts->show_line_numbers) {
+        if (opts->use_color) {
+            fprintf(diagnostic_stream(), "%s%5u | %s", COLOR_BOLD, loc.line, COLOR_RESET);
         } else {
-            fprintf(stderr, "%5u | ", loc.line);
+            fprintf(diagnostic_stream(), "%5u | ", loc.line);
         }
     }
     
     /* Print source line */
-    fprintf(stderr, "%.*s\n", (int)line_len, line);
+    fprintf(diagnostic_stream(), "%.*s\n", (int)line_len, line);
     
     /* Print caret if enabled */
-    if (diag_opts.show_caret && loc.column > 0) {
-        if (diag_opts.show_line_numbers) {
-            fprintf(stderr, "      | ");
+    if (opts->show_caret && loc.column > 0) {
+        if (opts->show_line_numbers) {
+            fprintf(diagnostic_stream(), "      | ");
         }
         
         /* Print spaces up to column */
         for (uint32_t i = 1; i < loc.column; i++) {
-            fprintf(stderr, " ");
+            fprintf(diagnostic_stream(), " ");
         }
         
         /* Print caret */
-        if (diag_opts.use_color) {
-            fprintf(stderr, "%s^%s\n", COLOR_BOLD COLOR_GREEN, COLOR_RESET);
+        if (opts->use_color) {
+            fprintf(diagnostic_stream(), "%s^%s\n", COLOR_BOLD COLOR_GREEN, COLOR_RESET);
         } else {
-            fprintf(stderr, "^\n");
+            fprintf(diagnostic_stream(), "^\n");
         }
     }
 }
 
 /* Main diagnostic emission */
 void diagnostic_emit(DiagnosticLevel level, SourceLocation loc, const char *fmt, ...) {
+    const DiagnosticOptions *opts = options();
     const char *color = color_for_level(level);
-    const char *reset = diag_opts.use_color ? COLOR_RESET : "";
+    const char *reset = opts->use_color ? COLOR_RESET : "";
     
     /* Print location */
-    if (diag_opts.show_source_location) {
-        fprintf(stderr, "%s%s:%u:%u: %s",
-                diag_opts.use_color ? COLOR_BOLD : "",
+    if (opts->show_source_location) {
+        fprintf(diagnostic_stream(), "%s%s:%u:%u: %s",
+                opts->use_color ? COLOR_BOLD : "",
                 loc.filename ? loc.filename : "<unknown>",
                 loc.line,
-                diag_opts.show_column ? loc.column : 0,
+                opts->show_column ? loc.column : 0,
                 reset);
-        fprintf(stderr, " ");
+        fprintf(diagnostic_stream(), " ");
     }
     
     /* Print level */
-    fprintf(stderr, "%s%s:%s ", color, level_string(level), reset);
+    fprintf(diagnostic_stream(), "%s%s:%s ", color, level_string(level), reset);
     
     /* Print message */
     va_list args;
     va_start(args, fmt);
-    vfprintf(stderr, fmt, args);
+    vfprintf(diagnostic_stream(), fmt, args);
     va_end(args);
-    fprintf(stderr, "\n");
+    fprintf(diagnostic_stream(), "\n");
     
     /* Print source snippet */
     print_source_snippet(loc);
     
     /* Update counters */
     if (level == DIAG_ERROR || level == DIAG_FATAL) {
-        error_cnt++;
+        state()->error_cnt++;
     } else if (level == DIAG_WARNING) {
-        warning_cnt++;
+        state()->warning_cnt++;
     }
     
     if (level == DIAG_FATAL) {
+        flush_capture_for_exit();
         exit(EXIT_FAILURE);
     }
 }
 
 void diagnostic_emit_range(DiagnosticLevel level, SourceLocation start, 
                           SourceLocation end, const char *fmt, ...) {
+    const DiagnosticOptions *opts = options();
     const char *color = color_for_level(level);
-    const char *reset = diag_opts.use_color ? COLOR_RESET : "";
+    const char *reset = opts->use_color ? COLOR_RESET : "";
     
     /* Print location range */
-    if (diag_opts.show_source_location) {
-        fprintf(stderr, "%s%s:%u:%u-%u:%u: %s",
-                diag_opts.use_color ? COLOR_BOLD : "",
+    if (opts->show_source_location) {
+        fprintf(diagnostic_stream(), "%s%s:%u:%u-%u:%u: %s",
+                opts->use_color ? COLOR_BOLD : "",
                 start.filename ? start.filename : "<unknown>",
                 start.line, start.column,
                 end.line, end.column,
                 reset);
-        fprintf(stderr, " ");
+        fprintf(diagnostic_stream(), " ");
     }
     
     /* Print level */
-    fprintf(stderr, "%s%s:%s ", color, level_string(level), reset);
+    fprintf(diagnostic_stream(), "%s%s:%s ", color, level_string(level), reset);
     
     /* Print message */
     va_list args;
     va_start(args, fmt);
-    vfprintf(stderr, fmt, args);
+    vfprintf(diagnostic_stream(), fmt, args);
     va_end(args);
-    fprintf(stderr, "\n");
+    fprintf(diagnostic_stream(), "\n");
     
     /* Print source snippet for start location */
     print_source_snippet(start);
     
     /* Update counters */
     if (level == DIAG_ERROR || level == DIAG_FATAL) {
-        error_cnt++;
+        state()->error_cnt++;
     } else if (level == DIAG_WARNING) {
-        warning_cnt++;
+        state()->warning_cnt++;
     }
 }
 
@@ -330,12 +480,13 @@ void error_remark(SourceLocation loc, const char *fmt, ...) {
 }
 
 void diagnostic_add_fixit(SourceLocation loc, const char *replacement) {
-    if (!diag_opts.show_fix_hints) return;
+    const DiagnosticOptions *opts = options();
+    if (!opts->show_fix_hints) return;
     
-    const char *color = diag_opts.use_color ? COLOR_BOLD COLOR_GREEN : "";
-    const char *reset = diag_opts.use_color ? COLOR_RESET : "";
+    const char *color = opts->use_color ? COLOR_BOLD COLOR_GREEN : "";
+    const char *reset = opts->use_color ? COLOR_RESET : "";
     
-    fprintf(stderr, "%sfix-it hint:%s replace with '%s'\n", color, reset, replacement);
+    fprintf(diagnostic_stream(), "%sfix-it hint:%s replace with '%s'\n", color, reset, replacement);
 }
 
 void diagnostic_add_note(SourceLocation loc, const char *fmt, ...) {
@@ -349,30 +500,32 @@ void diagnostic_add_note(SourceLocation loc, const char *fmt, ...) {
 }
 
 int error_count(void) {
-    return error_cnt;
+    return state()->error_cnt;
 }
 
 int warning_count(void) {
-    return warning_cnt;
+    return state()->warning_cnt;
 }
 
 void error_reset(void) {
-    error_cnt = 0;
-    warning_cnt = 0;
+    state()->error_cnt = 0;
+    state()->warning_cnt = 0;
 }
 
 void error_fatal(const char *fmt, ...) {
-    const char *color = diag_opts.use_color ? COLOR_BOLD COLOR_RED : "";
-    const char *reset = diag_opts.use_color ? COLOR_RESET : "";
+    const DiagnosticOptions *opts = options();
+    const char *color = opts->use_color ? COLOR_BOLD COLOR_RED : "";
+    const char *reset = opts->use_color ? COLOR_RESET : "";
     
-    fprintf(stderr, "%sfatal error:%s ", color, reset);
+    fprintf(diagnostic_stream(), "%sfatal error:%s ", color, reset);
     
     va_list args;
     va_start(args, fmt);
-    vfprintf(stderr, fmt, args);
+    vfprintf(diagnostic_stream(), fmt, args);
     va_end(args);
     
-    fprintf(stderr, "\n");
+    fprintf(diagnostic_stream(), "\n");
+    flush_capture_for_exit();
     exit(EXIT_FAILURE);
 }
 
@@ -3,6 +3,7 @@
 
 #include "types.h"
 #include <stdarg.h>
+#include <stdio.h>
 
 typedef enum {
     ERROR_LEXER,
@@ -55,7 +56,26 @@ void diagnostic_emit_range(DiagnosticLevel level, SourceLocation start,
 void diagnostic_add_fixit(SourceLocation loc, const char *replacement);
 void diagnostic_add_note(SourceLocation loc, const char *fmt, ...);
 
-/* Source context management */
+/* Diagnostic output stream: stderr, or the calling thread's capture buffer
+ * while a capture is active (used to keep each translation unit's
+ * diagnostics together when several are compiled in parallel) */
+FILE *diagnostic_stream(void);
+bool diagnostic_begin_capture(void);
+char *diagnostic_end_capture(size_t *len);
+
+/* Diagnostic state: error and warning counts, the capture above and the
+ * registered sources. Each thread reports into its own by default; binding
+ * a state (as a CompilerSession does around its calls) redirects the
+ * calling thread to it until the previous binding is restored. States made
+ * with NULL options use the process-wide ones. */
+typedef struct DiagnosticState DiagnosticState;
+DiagnosticState *diagnostic_state_create(DiagnosticOptions *opts);
+void diagnostic_state_destroy(DiagnosticState *state);
+DiagnosticState *diagnostic_bind(DiagnosticState *state);
+
+/* Source context management. The text is registered by reference, not
+ * copied: it must stay unchanged until it is cleared or replaced by
+ * registering the same file name again. */
 void diagnostic_set_source(const char *filename, const char *source);
 void diagnostic_clear_source(const char *filename);
 
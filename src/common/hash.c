@@ -0,0 +1,170 @@
+#include "hash.h"
+#include <stdio.h>
+#include <string.h>
+
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ULL
+#define FNV_PRIME        0x100000001b3ULL
+
+void hash64_init(Hash64 *h) {
+    h->state = FNV_OFFSET_BASIS;
+}
+
+void hash64_update(Hash64 *h, const void *data, size_t len) {
+    const unsigned char *p = (const unsigned char *)data;
+    uint64_t state = h->state;
+    for (size_t i = 0; i < len; i++) {
+        state ^= p[i];
+        state *= FNV_PRIME;
+    }
+    h->state = state;
+}
+
+void hash64_update_str(Hash64 *h, const char *s) {
+    /* Include the terminator so ("ab","c") and ("a","bc") differ */
+    if (!s) s = "";
+    hash64_update(h, s, strlen(s) + 1);
+}
+
+uint64_t hash64_final(const Hash64 *h) {
+    return h->state;
+}
+
+uint64_t hash64_bytes(const void *data, size_t len) {
+    Hash64 h;
+    hash64_init(&h);
+    hash64_update(&h, data, len);
+    return hash64_final(&h);
+}
+
+bool hash64_file(const char *path, uint64_t *out) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return false;
+
+    Hash64 h;
+    hash64_init(&h);
+
+    char buffer[16384];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0) {
+        hash64_update(&h, buffer, n);
+    }
+
+    bool ok = !ferror(f);
+    fclose(f);
+
+    if (ok && out) *out = hash64_final(&h);
+    return ok;
+}
+
+/* ===== SHA-256 ===== */
+
+static const uint32_t SHA256_K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define ROTR32(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void sha256_block(uint32_t state[8], const unsigned char *block) {
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++) {
+        w[i] = (uint32_t)block[i * 4] << 24 | (uint32_t)block[i * 4 + 1] << 16 |
+               (uint32_t)block[i * 4 + 2] << 8 | (uint32_t)block[i * 4 + 3];
+    }
+    for (int i = 16; i < 64; i++) {
+        uint32_t s0 = ROTR32(w[i - 15], 7) ^ ROTR32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = ROTR32(w[i - 2], 17) ^ ROTR32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+    for (int i = 0; i < 64; i++) {
+        uint32_t t1 = h + (ROTR32(e, 6) ^ ROTR32(e, 11) ^ ROTR32(e, 25)) + ((e & f) ^ (~e & g)) +
+                      SHA256_K[i] + w[i];
+        uint32_t t2 = (ROTR32(a, 2) ^ ROTR32(a, 13) ^ ROTR32(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+
+    state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+    state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+
+void sha256_init(Sha256 *h) {
+    static const uint32_t initial[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    memcpy(h->state, initial, sizeof(initial));
+    h->length = 0;
+    h->used = 0;
+}
+
+void sha256_update(Sha256 *h, const void *data, size_t len) {
+    const unsigned char *p = (const unsigned char *)data;
+    h->length += len;
+
+    if (h->used > 0) {
+        size_t take = 64 - h->used < len ? 64 - h->used : len;
+        memcpy(h->block + h->used, p, take);
+        h->used += take;
+        p += take;
+        len -= take;
+        if (h->used < 64) return;
+        sha256_block(h->state, h->block);
+        h->used = 0;
+    }
+    for (; len >= 64; p += 64, len -= 64) {
+        sha256_block(h->state, p);
+    }
+    memcpy(h->block, p, len);
+    h->used = len;
+}
+
+void sha256_update_str(Sha256 *h, const char *s) {
+    /* Include the terminator, as hash64_update_str() does */
+    if (!s) s = "";
+    sha256_update(h, s, strlen(s) + 1);
+}
+
+void sha256_final(Sha256 *h, unsigned char digest[SHA256_DIGEST_SIZE]) {
+    uint64_t bits = h->length * 8;
+
+    /* 0x80, zeros up to 56 mod 64, then the big-endian bit length */
+    unsigned char pad[72] = {0x80};
+    size_t pad_len = (h->used < 56 ? 56 : 120) - h->used;
+    for (int i = 0; i < 8; i++) {
+        pad[pad_len + (size_t)i] = (unsigned char)(bits >> (56 - 8 * i));
+    }
+    sha256_update(h, pad, pad_len + 8);
+
+    for (int i = 0; i < 8; i++) {
+        digest[i * 4] = (unsigned char)(h->state[i] >> 24);
+        digest[i * 4 + 1] = (unsigned char)(h->state[i] >> 16);
+        digest[i * 4 + 2] = (unsigned char)(h->state[i] >> 8);
+        digest[i * 4 + 3] = (unsigned char)h->state[i];
+    }
+}
+
+void sha256_final_hex(Sha256 *h, char hex[SHA256_HEX_SIZE]) {
+    static const char digits[] = "0123456789abcdef";
+    unsigned char digest[SHA256_DIGEST_SIZE];
+    sha256_final(h, digest);
+    for (int i = 0; i < SHA256_DIGEST_SIZE; i++) {
+        hex[i * 2] = digits[digest[i] >> 4];
+        hex[i * 2 + 1] = digits[digest[i] & 0xf];
+    }
+    hex[SHA256_HEX_SIZE - 1] = '\0';
+}
@@ -0,0 +1,44 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Streaming 64-bit FNV-1a hash (same function the parser uses for its tables) */
+typedef struct {
+    uint64_t state;
+} Hash64;
+
+void hash64_init(Hash64 *h);
+void hash64_update(Hash64 *h, const void *data, size_t len);
+void hash64_update_str(Hash64 *h, const char *s);
+uint64_t hash64_final(const Hash64 *h);
+
+/* One-shot helpers */
+uint64_t hash64_bytes(const void *data, size_t len);
+
+/* Hash a whole file; returns false if it cannot be read */
+bool hash64_file(const char *path, uint64_t *out);
+
+/* Streaming SHA-256 (FIPS 180-4), for keys that must not collide even when
+ * someone tries to make them: FNV-1a is fast but trivially steered */
+#define SHA256_DIGEST_SIZE 32
+#define SHA256_HEX_SIZE    65       /* 64 hex digits + NUL */
+
+typedef struct {
+    uint32_t state[8];
+    uint64_t length;                /* Bytes hashed so far */
+    unsigned char block[64];
+    size_t used;                    /* Bytes buffered in `block` */
+} Sha256;
+
+void sha256_init(Sha256 *h);
+void sha256_update(Sha256 *h, const void *data, size_t len);
+void sha256_update_str(Sha256 *h, const char *s);
+void sha256_final(Sha256 *h, unsigned char digest[SHA256_DIGEST_SIZE]);
+
+/* Finish and write the digest as lowercase hex */
+void sha256_final_hex(Sha256 *h, char hex[SHA256_HEX_SIZE]);
+
+#endif /* HASH_H */
@@ -1,11 +1,22 @@
 #define _POSIX_C_SOURCE 200809L
+#define MEMORY_NO_SITES
 #include "memory.h"
 #include "error.h"
+#include "probes.h"
+#include "thread.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <assert.h>
+#ifdef __linux__
+#include <malloc.h>
+#endif
+#ifdef __GLIBC__
+#include <execinfo.h>
+#endif
+#include <unistd.h>
+#include <sys/resource.h>
 
 /* ========== Configuration ========== */
 
@@ -18,6 +29,24 @@
 /* Maximum number of tracked allocations */
 #define MAX_TRACKED_ALLOCS 100000
 
+/* Production mode: requests up to SMALL_LIMIT bytes are rounded to a size
+ * class and recycled through per-thread free lists of CACHE_DEPTH blocks */
+#define SIZE_CLASS_COUNT 20
+#define SMALL_LIMIT 1024
+#define CACHE_DEPTH 64
+
+/* Per-thread usage changes are published once they add up to this much */
+#define STATS_FLUSH_BYTES (64 * 1024)
+
+/* Heap profile: frames kept per sample and the site table size (a power
+ * of two; the table stops taking new stacks at three quarters full) */
+#define PROFILE_MAX_FRAMES 32
+#define PROFILE_TABLE_SIZE 4096
+
+/* Slab chunk size; objects are rounded up to SLAB_ALIGN */
+#define SLAB_CHUNK_SIZE (64 * 1024)
+#define SLAB_ALIGN 16
+
 /* ========== Internal Structures ========== */
 
 typedef struct AllocationHeader {
@@ -39,6 +68,9 @@ typedef struct {
 
 /* ========== Global State ========== */
 
+/* Serializes the allocation list and statistics between compile threads */
+static pthread_mutex_t g_memory_lock = PTHREAD_MUTEX_INITIALIZER;
+
 static struct {
     MemoryStats stats;
     AllocationHeader *alloc_list_head;
@@ -55,6 +87,89 @@ static struct {
     .initialized = false
 };
 
+/* Which allocator serves xmalloc; decided once, before the first block */
+typedef enum {
+    MEMORY_MODE_UNDECIDED,
+    MEMORY_MODE_FAST,           /* Plain blocks, per-thread caches */
+    MEMORY_MODE_GUARDED         /* Headers, guards and the allocation list */
+} MemoryMode;
+
+static MemoryMode g_mode = MEMORY_MODE_UNDECIDED;
+static pthread_once_t g_mode_once = PTHREAD_ONCE_INIT;
+
+/* A thread's view of one slab */
+typedef struct {
+    void *free_list;
+    char *bump;                 /* Unused tail of the last chunk taken */
+    char *bump_end;
+    unsigned generation;        /* Slab generation the pointers belong to */
+    size_t allocations;
+    size_t frees;
+} SlabCache;
+
+/* Registry entry behind Slab.id */
+typedef struct {
+    Slab *slab;
+    size_t size;                /* object_size rounded up to SLAB_ALIGN */
+    pthread_mutex_t lock;       /* Guards everything below */
+    void *chunks;               /* Each chunk starts with the next pointer */
+    void *orphans;              /* Free lists of threads that exited */
+    size_t chunk_bytes;
+    unsigned generation;        /* Bumped by slab_release */
+    size_t retired_allocations;
+    size_t retired_frees;
+} SlabState;
+
+static SlabState g_slabs[MEMORY_MAX_SLABS];
+static int g_slab_count;
+
+/* One thread's free lists and its share of the statistics. Only the owner
+ * writes it; readers merging statistics use relaxed atomic loads. */
+typedef struct ThreadHeap {
+    void *free_lists[SIZE_CLASS_COUNT];
+    unsigned cached[SIZE_CLASS_COUNT];
+    SlabCache slabs[MEMORY_MAX_SLABS];
+    size_t phase_allocated[MEMORY_PHASE_COUNT];
+    size_t phase_freed[MEMORY_PHASE_COUNT];
+    size_t phase_allocations[MEMORY_PHASE_COUNT];
+    MemoryStats stats;          /* current_usage and peak_usage unused */
+    long long unflushed;        /* Usage change not yet in g_usage */
+    struct ThreadHeap *next;
+} ThreadHeap;
+
+static const size_t size_classes[SIZE_CLASS_COUNT] = {
+    16, 32, 48, 64, 80, 96, 112, 128,
+    160, 192, 224, 256, 320, 384, 448, 512,
+    640, 768, 896, 1024
+};
+
+static THREAD_LOCAL ThreadHeap *t_heap;
+static pthread_key_t g_heap_key;
+static pthread_mutex_t g_heaps_lock = PTHREAD_MUTEX_INITIALIZER;
+static ThreadHeap *g_heaps;             /* Live threads */
+static MemoryStats g_retired;           /* Totals of threads that exited */
+static PhaseStats g_retired_phases[MEMORY_PHASE_COUNT];
+static long long g_usage;               /* Published current usage */
+static long long g_peak;
+static MemoryStats g_snapshot;          /* Returned by memory_get_stats */
+
+/* Phase bookkeeping shared by both allocators. Counts are per thread (in
+ * ThreadHeap); marks are process-wide high-water values. */
+typedef struct {
+    size_t peak_heap;           /* Heap in use, highest seen during the phase */
+    size_t live;                /* Heap in use when the phase last ended */
+    size_t peak_rss;
+} PhaseMarks;
+
+static PhaseMarks g_phase_marks[MEMORY_PHASE_COUNT];
+static bool g_sample_rss;
+static MemoryPhaseHook g_phase_hook;
+static THREAD_LOCAL MemoryPhase t_phase;
+static THREAD_LOCAL size_t t_phase_start_maxrss;
+
+static void phase_account(size_t bytes, bool allocated);
+static void phase_note_usage(long long usage);
+
 /* ========== Internal Functions ========== */
 
 static void memory_ensure_init(void) {
@@ -168,7 +283,7 @@ static void untrack_allocation(AllocationHeader *header) {
     }
 }
 
-static void *allocate_with_guards(size_t size) {
+static void *allocate_with_guards(size_t size, const char *file, int line) {
     memory_ensure_init();
     
     size_t total_size = sizeof(AllocationHeader) + size + sizeof(AllocationFooter);
@@ -182,8 +297,8 @@ static void *allocate_with_guards(size_t size) {
     header->magic = HEADER_MAGIC;
     header->front_guard = GUARD_PATTERN_FRONT;
     header->size = size;
-    header->file = NULL;
-    header->line = 0;
+    header->file = file;
+    header->line = (size_t)line;
     header->is_freed = false;
     header->next = NULL;
     header->prev = NULL;
@@ -192,6 +307,8 @@ static void *allocate_with_guards(size_t size) {
     AllocationFooter *footer = (AllocationFooter*)((char*)(header + 1) + size);
     footer->back_guard = GUARD_PATTERN_BACK;
     
+    pthread_mutex_lock(&g_memory_lock);
+    
     /* Track allocation */
     track_allocation(header);
     
@@ -203,7 +320,12 @@ static void *allocate_with_guards(size_t size) {
     if (g_memory.stats.current_usage > g_memory.stats.peak_usage) {
         g_memory.stats.peak_usage = g_memory.stats.current_usage;
     }
+    size_t usage = g_memory.stats.current_usage;
+    
+    pthread_mutex_unlock(&g_memory_lock);
     
+    phase_account(size, true);
+    phase_note_usage((long long)usage);
     return (void*)(header + 1);
 }
 
@@ -223,6 +345,8 @@ static void free_with_guards(void *ptr) {
     /* Fill with freed pattern to detect use-after-free */
     memset(ptr, 0xFE, header->size);
     
+    pthread_mutex_lock(&g_memory_lock);
+    
     /* Update statistics */
     g_memory.stats.total_freed += header->size;
     g_memory.stats.current_usage -= header->size;
@@ -231,10 +355,744 @@ static void free_with_guards(void *ptr) {
     /* Untrack */
     untrack_allocation(header);
     
+    pthread_mutex_unlock(&g_memory_lock);
+    
+    phase_account(header->size, false);
+    
     /* Free the memory */
     free(header);
 }
 
+/* ========== Production Allocator ========== */
+
+static void choose_mode(void) {
+#ifdef MEMORY_DEBUG
+    bool guarded = true;
+#else
+    const char *env = getenv(MEMORY_DEBUG_ENV);
+    bool guarded = env && *env && strcmp(env, "0") != 0;
+#endif
+    __atomic_store_n(&g_mode, guarded ? MEMORY_MODE_GUARDED : MEMORY_MODE_FAST, __ATOMIC_RELEASE);
+}
+
+static bool guarded_mode(void) {
+    MemoryMode mode = __atomic_load_n(&g_mode, __ATOMIC_ACQUIRE);
+    if (mode == MEMORY_MODE_UNDECIDED) {
+        pthread_once(&g_mode_once, choose_mode);
+        mode = __atomic_load_n(&g_mode, __ATOMIC_ACQUIRE);
+    }
+    return mode == MEMORY_MODE_GUARDED;
+}
+
+/* Bytes malloc actually handed out; 0 where that cannot be asked, which
+ * turns off caching and byte counts */
+static size_t block_size(void *ptr) {
+#ifdef __linux__
+    return malloc_usable_size(ptr);
+#else
+    (void)ptr;
+    return 0;
+#endif
+}
+
+/* Smallest class that holds `size` (at most SMALL_LIMIT) */
+static size_t class_for_request(size_t size) {
+    if (size <= 128) return size == 0 ? 0 : (size - 1) / 16;
+    if (size <= 256) return 8 + (size - 129) / 32;
+    if (size <= 512) return 12 + (size - 257) / 64;
+    return 16 + (size - 513) / 128;
+}
+
+/* Largest class a block of `size` usable bytes can serve */
+static size_t class_for_block(size_t size) {
+    size_t index = class_for_request(size < SMALL_LIMIT ? size : SMALL_LIMIT);
+    return size_classes[index] > size ? index - 1 : index;
+}
+
+#define STAT_ADD(field, amount) \
+    __atomic_store_n(&(field), (field) + (amount), __ATOMIC_RELAXED)
+
+static void store_max(size_t *target, size_t value) {
+    size_t current = __atomic_load_n(target, __ATOMIC_RELAXED);
+    while (value > current &&
+           !__atomic_compare_exchange_n(target, &current, value, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+static void phase_note_usage(long long usage) {
+    if (usage > 0) store_max(&g_phase_marks[t_phase].peak_heap, (size_t)usage);
+}
+
+static void publish_usage(ThreadHeap *heap) {
+    long long usage = __atomic_add_fetch(&g_usage, heap->unflushed, __ATOMIC_RELAXED);
+    __atomic_store_n(&heap->unflushed, 0, __ATOMIC_RELAXED);
+    phase_note_usage(usage);
+
+    long long peak = __atomic_load_n(&g_peak, __ATOMIC_RELAXED);
+    while (usage > peak &&
+           !__atomic_compare_exchange_n(&g_peak, &peak, usage, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+static void account(ThreadHeap *heap, long long delta) {
+    long long unflushed = heap->unflushed + delta;
+    __atomic_store_n(&heap->unflushed, unflushed, __ATOMIC_RELAXED);
+    if (unflushed >= STATS_FLUSH_BYTES || unflushed <= -STATS_FLUSH_BYTES) {
+        publish_usage(heap);
+    }
+}
+
+/* Thread exit: return cached blocks to malloc and fold the statistics
+ * into the retired totals */
+static void retire_heap(void *arg) {
+    ThreadHeap *heap = (ThreadHeap *)arg;
+    for (size_t i = 0; i < SIZE_CLASS_COUNT; i++) {
+        while (heap->free_lists[i]) {
+            void *block = heap->free_lists[i];
+            heap->free_lists[i] = *(void **)block;
+            free(block);
+        }
+    }
+    publish_usage(heap);
+
+    int slab_count = __atomic_load_n(&g_slab_count, __ATOMIC_ACQUIRE);
+    for (int i = 0; i < slab_count; i++) {
+        SlabState *state = &g_slabs[i];
+        SlabCache *cache = &heap->slabs[i];
+        pthread_mutex_lock(&state->lock);
+        if (cache->generation == state->generation) {
+            while (cache->free_list) {
+                void *object = cache->free_list;
+                cache->free_list = *(void **)object;
+                *(void **)object = state->orphans;
+                state->orphans = object;
+            }
+        }
+        state->retired_allocations += cache->allocations;
+        state->retired_frees += cache->frees;
+        pthread_mutex_unlock(&state->lock);
+    }
+
+    pthread_mutex_lock(&g_heaps_lock);
+    for (ThreadHeap **link = &g_heaps; *link; link = &(*link)->next) {
+        if (*link == heap) {
+            *link = heap->next;
+            break;
+        }
+    }
+    g_retired.total_allocated += heap->stats.total_allocated;
+    g_retired.total_freed += heap->stats.total_freed;
+    g_retired.allocation_count += heap->stats.allocation_count;
+    g_retired.free_count += heap->stats.free_count;
+    g_retired.realloc_count += heap->stats.realloc_count;
+    for (int i = 0; i < MEMORY_PHASE_COUNT; i++) {
+        g_retired_phases[i].allocated += heap->phase_allocated[i];
+        g_retired_phases[i].freed += heap->phase_freed[i];
+        g_retired_phases[i].allocations += heap->phase_allocations[i];
+    }
+    pthread_mutex_unlock(&g_heaps_lock);
+
+    if (t_heap == heap) t_heap = NULL;
+    free(heap);
+}
+
+static void create_heap_key(void) {
+    pthread_key_create(&g_heap_key, retire_heap);
+}
+
+static ThreadHeap *thread_heap(void) {
+    ThreadHeap *heap = t_heap;
+    if (heap) return heap;
+
+    static pthread_once_t key_once = PTHREAD_ONCE_INIT;
+    pthread_once(&key_once, create_heap_key);
+
+    heap = calloc(1, sizeof(ThreadHeap));
+    if (!heap) error_fatal("out of memory");
+    pthread_setspecific(g_heap_key, heap);
+
+    pthread_mutex_lock(&g_heaps_lock);
+    heap->next = g_heaps;
+    g_heaps = heap;
+    pthread_mutex_unlock(&g_heaps_lock);
+
+    t_heap = heap;
+    return heap;
+}
+
+static void *fast_alloc(size_t size, bool zero) {
+    ThreadHeap *heap = thread_heap();
+    void *ptr;
+
+    if (size <= SMALL_LIMIT) {
+        size_t index = class_for_request(size);
+        ptr = heap->free_lists[index];
+        if (ptr) {
+            heap->free_lists[index] = *(void **)ptr;
+            heap->cached[index]--;
+            if (zero) memset(ptr, 0, size);
+        } else {
+            ptr = zero ? calloc(1, size_classes[index]) : malloc(size_classes[index]);
+        }
+    } else {
+        ptr = zero ? calloc(1, size) : malloc(size);
+    }
+    if (!ptr) return NULL;
+
+    size_t bytes = block_size(ptr);
+    STAT_ADD(heap->stats.total_allocated, bytes);
+    STAT_ADD(heap->stats.allocation_count, 1);
+    STAT_ADD(heap->phase_allocated[t_phase], bytes);
+    STAT_ADD(heap->phase_allocations[t_phase], 1);
+    account(heap, (long long)bytes);
+    return ptr;
+}
+
+static void fast_free(void *ptr) {
+    ThreadHeap *heap = thread_heap();
+    size_t bytes = block_size(ptr);
+    STAT_ADD(heap->stats.total_freed, bytes);
+    STAT_ADD(heap->stats.free_count, 1);
+    STAT_ADD(heap->phase_freed[t_phase], bytes);
+    account(heap, -(long long)bytes);
+
+    /* Whole classes only: a block of 1030 usable bytes serves class 1024 */
+    if (bytes >= size_classes[0] && bytes < SMALL_LIMIT + size_classes[0]) {
+        size_t index = class_for_block(bytes);
+        if (heap->cached[index] < CACHE_DEPTH) {
+            *(void **)ptr = heap->free_lists[index];
+            heap->free_lists[index] = ptr;
+            heap->cached[index]++;
+            return;
+        }
+    }
+    free(ptr);
+}
+
+static void *fast_realloc(void *ptr, size_t size) {
+    ThreadHeap *heap = thread_heap();
+    size_t old_bytes = block_size(ptr);
+    void *new_ptr = realloc(ptr, size);
+    if (!new_ptr) return NULL;
+
+    size_t new_bytes = block_size(new_ptr);
+    STAT_ADD(heap->stats.total_freed, old_bytes);
+    STAT_ADD(heap->stats.total_allocated, new_bytes);
+    STAT_ADD(heap->stats.realloc_count, 1);
+    STAT_ADD(heap->phase_freed[t_phase], old_bytes);
+    STAT_ADD(heap->phase_allocated[t_phase], new_bytes);
+    STAT_ADD(heap->phase_allocations[t_phase], 1);
+    account(heap, (long long)new_bytes - (long long)old_bytes);
+    return new_ptr;
+}
+
+/* ========== Phases ========== */
+
+static const char *phase_names[MEMORY_PHASE_COUNT] = {
+    "other", "preprocess", "lex", "parse", "codegen", "optimize", "emit"
+};
+
+/* Guarded allocator only; the fast paths count inline */
+static void phase_account(size_t bytes, bool allocated) {
+    ThreadHeap *heap = thread_heap();
+    if (allocated) {
+        STAT_ADD(heap->phase_allocated[t_phase], bytes);
+        STAT_ADD(heap->phase_allocations[t_phase], 1);
+    } else {
+        STAT_ADD(heap->phase_freed[t_phase], bytes);
+    }
+}
+
+const char *memory_phase_name(MemoryPhase phase) {
+    return phase < MEMORY_PHASE_COUNT ? phase_names[phase] : "?";
+}
+
+size_t memory_current_rss(void) {
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (!f) return 0;
+    unsigned long pages = 0, resident = 0;
+    int fields = fscanf(f, "%lu %lu", &pages, &resident);
+    fclose(f);
+    return fields == 2 ? (size_t)resident * (size_t)sysconf(_SC_PAGESIZE) : 0;
+}
+
+size_t memory_peak_rss(void) {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+    return (size_t)usage.ru_maxrss * 1024;      /* Kilobytes on Linux */
+}
+
+void memory_sample_rss(bool enable) {
+    __atomic_store_n(&g_sample_rss, enable, __ATOMIC_RELAXED);
+    t_phase_start_maxrss = enable ? memory_peak_rss() : 0;
+}
+
+/* Marks for the phase this thread is leaving. The process peak is only
+ * charged to the phase if it rose while the phase ran. */
+static void phase_close(MemoryPhase phase) {
+    long long usage;
+    if (guarded_mode()) {
+        pthread_mutex_lock(&g_memory_lock);
+        usage = (long long)g_memory.stats.current_usage;
+        pthread_mutex_unlock(&g_memory_lock);
+    } else {
+        usage = __atomic_load_n(&g_usage, __ATOMIC_RELAXED) + (t_heap ? t_heap->unflushed : 0);
+    }
+    PhaseMarks *marks = &g_phase_marks[phase];
+    __atomic_store_n(&marks->live, usage > 0 ? (size_t)usage : 0, __ATOMIC_RELAXED);
+    phase_note_usage(usage);
+
+    if (__atomic_load_n(&g_sample_rss, __ATOMIC_RELAXED)) {
+        size_t maxrss = memory_peak_rss();
+        store_max(&marks->peak_rss, memory_current_rss());
+        if (t_phase_start_maxrss && maxrss > t_phase_start_maxrss) store_max(&marks->peak_rss, maxrss);
+        t_phase_start_maxrss = maxrss;
+    }
+}
+
+MemoryPhase memory_set_phase(MemoryPhase phase) {
+    MemoryPhase previous = t_phase;
+    if (phase != previous) {
+        phase_close(previous);
+        t_phase = phase;
+        LLVMC_PROBE2(phase__change, memory_phase_name(previous), memory_phase_name(phase));
+        MemoryPhaseHook hook = __atomic_load_n(&g_phase_hook, __ATOMIC_ACQUIRE);
+        if (hook) hook(previous, phase);
+    }
+    return previous;
+}
+
+MemoryPhase memory_get_phase(void) {
+    return t_phase;
+}
+
+void memory_set_phase_hook(MemoryPhaseHook hook) {
+    __atomic_store_n(&g_phase_hook, hook, __ATOMIC_RELEASE);
+}
+
+static void collect_phase_stats(MemoryStats *out) {
+    for (int i = 0; i < MEMORY_PHASE_COUNT; i++) {
+        PhaseStats *stats = &out->phases[i];
+        *stats = g_retired_phases[i];
+        for (ThreadHeap *heap = g_heaps; heap; heap = heap->next) {
+            stats->allocated += __atomic_load_n(&heap->phase_allocated[i], __ATOMIC_RELAXED);
+            stats->freed += __atomic_load_n(&heap->phase_freed[i], __ATOMIC_RELAXED);
+            stats->allocations += __atomic_load_n(&heap->phase_allocations[i], __ATOMIC_RELAXED);
+        }
+        stats->live = __atomic_load_n(&g_phase_marks[i].live, __ATOMIC_RELAXED);
+        stats->peak = __atomic_load_n(&g_phase_marks[i].peak_heap, __ATOMIC_RELAXED);
+        stats->peak_rss = __atomic_load_n(&g_phase_marks[i].peak_rss, __ATOMIC_RELAXED);
+    }
+    out->peak_rss = memory_peak_rss();
+}
+
+/* ========== Heap Profile ========== */
+
+/* One sampled call stack; weights are estimates scaled by the rate */
+typedef struct {
+    const char *file;
+    int line;
+    int depth;
+    void *frames[PROFILE_MAX_FRAMES];
+    uint64_t hash;
+    size_t bytes;
+    size_t count;
+} ProfileSite;
+
+static size_t g_profile_rate;           /* 0: not profiling */
+static pthread_mutex_t g_profile_lock = PTHREAD_MUTEX_INITIALIZER;
+static ProfileSite *g_profile_sites;    /* Open-addressed by hash */
+static size_t g_profile_site_count;
+static size_t g_profile_dropped;
+static THREAD_LOCAL long long t_until_sample;
+
+static uint64_t profile_hash(const char *file, int line, void **frames, int depth) {
+    uint64_t hash = 0xcbf29ce484222325ULL ^ (uint64_t)(uintptr_t)file ^ ((uint64_t)line << 32);
+    for (int i = 0; i < depth; i++) {
+        hash = (hash ^ (uint64_t)(uintptr_t)frames[i]) * 0x100000001b3ULL;
+    }
+    return hash ? hash : 1;
+}
+
+/* Frames to drop: profile_sample itself and the allocation entry point
+ * (profile_note is always inlined into it) */
+#define PROFILE_SKIP_FRAMES 2
+
+static __attribute__((noinline)) void profile_sample(size_t size, long long samples,
+                                                     const char *file, int line) {
+    void *buffer[PROFILE_MAX_FRAMES + PROFILE_SKIP_FRAMES];
+    void **frames = buffer + PROFILE_SKIP_FRAMES;
+    int depth = 0;
+#ifdef __GLIBC__
+    depth = backtrace(buffer, PROFILE_MAX_FRAMES + PROFILE_SKIP_FRAMES) - PROFILE_SKIP_FRAMES;
+    if (depth < 0) depth = 0;
+#endif
+    uint64_t hash = profile_hash(file, line, frames, depth);
+    size_t bytes = (size_t)samples * g_profile_rate;
+    size_t count = size ? bytes / size : (size_t)samples;
+
+    pthread_mutex_lock(&g_profile_lock);
+    size_t slot = hash & (PROFILE_TABLE_SIZE - 1);
+    ProfileSite *site = &g_profile_sites[slot];
+    while (site->hash && (site->hash != hash || site->file != file || site->line != line ||
+                          site->depth != depth ||
+                          memcmp(site->frames, frames, (size_t)depth * sizeof(void *)) != 0)) {
+        slot = (slot + 1) & (PROFILE_TABLE_SIZE - 1);
+        site = &g_profile_sites[slot];
+    }
+    if (!site->hash) {
+        if (g_profile_site_count * 4 >= PROFILE_TABLE_SIZE * 3) {
+            g_profile_dropped += bytes;
+            pthread_mutex_unlock(&g_profile_lock);
+            return;
+        }
+        site->hash = hash;
+        site->file = file;
+        site->line = line;
+        site->depth = depth;
+        memcpy(site->frames, frames, (size_t)depth * sizeof(void *));
+        g_profile_site_count++;
+    }
+    site->bytes += bytes;
+    site->count += count ? count : 1;
+    pthread_mutex_unlock(&g_profile_lock);
+}
+
+/* Every allocation counts down the thread's byte budget; crossing zero
+ * takes a sample standing for `rate` bytes per crossing */
+static inline __attribute__((always_inline)) void profile_note(size_t size, const char *file, int line) {
+    size_t rate = __atomic_load_n(&g_profile_rate, __ATOMIC_RELAXED);
+    if (!rate) return;
+
+    long long until = t_until_sample - (long long)size;
+    if (until > 0) {
+        t_until_sample = until;
+        return;
+    }
+    long long samples = 1 + (-until) / (long long)rate;
+    t_until_sample = until + samples * (long long)rate;
+    profile_sample(size, samples, file, line);
+}
+
+void memory_profile_start(size_t sample_bytes) {
+    if (sample_bytes == 0) sample_bytes = MEMORY_PROFILE_DEFAULT_RATE;
+    pthread_mutex_lock(&g_profile_lock);
+    if (!g_profile_sites) {
+        g_profile_sites = calloc(PROFILE_TABLE_SIZE, sizeof(ProfileSite));
+        if (!g_profile_sites) error_fatal("out of memory");
+    }
+#ifdef __GLIBC__
+    /* The first backtrace loads the unwinder; do it outside any sample */
+    void *frame;
+    backtrace(&frame, 1);
+#endif
+    pthread_mutex_unlock(&g_profile_lock);
+    __atomic_store_n(&g_profile_rate, sample_bytes, __ATOMIC_RELAXED);
+}
+
+bool memory_profile_active(void) {
+    return __atomic_load_n(&g_profile_rate, __ATOMIC_RELAXED) != 0;
+}
+
+/* Sites merged by file and line, heaviest first */
+static int site_location_order(const ProfileSite *x, const ProfileSite *y) {
+    int order = strcmp(x->file ? x->file : "?", y->file ? y->file : "?");
+    return order ? order : (x->line > y->line) - (x->line < y->line);
+}
+
+static int compare_site_location(const void *a, const void *b) {
+    return site_location_order(*(const ProfileSite *const *)a, *(const ProfileSite *const *)b);
+}
+
+static int compare_site_bytes(const void *a, const void *b) {
+    const ProfileSite *x = (const ProfileSite *)a, *y = (const ProfileSite *)b;
+    return (x->bytes < y->bytes) - (x->bytes > y->bytes);
+}
+
+static int compare_site_count(const void *a, const void *b) {
+    const ProfileSite *x = (const ProfileSite *)a, *y = (const ProfileSite *)b;
+    return (x->count < y->count) - (x->count > y->count);
+}
+
+static void print_sites(FILE *out, const char *title, ProfileSite *sites, size_t count, size_t top) {
+    fprintf(out, "Top allocation sites by %s:\n", title);
+    fprintf(out, "  %12s %10s  %s\n", "bytes", "count", "site");
+    for (size_t i = 0; i < count && i < top; i++) {
+        fprintf(out, "  %12zu %10zu  %s:%d\n", sites[i].bytes, sites[i].count,
+                sites[i].file ? sites[i].file : "?", sites[i].line);
+    }
+}
+
+void memory_profile_report(FILE *out, size_t top) {
+    pthread_mutex_lock(&g_profile_lock);
+    size_t rate = g_profile_rate;
+    ProfileSite **sorted = malloc((g_profile_site_count + 1) * sizeof(ProfileSite *));
+    ProfileSite *merged = malloc((g_profile_site_count + 1) * sizeof(ProfileSite));
+    if (!sorted || !merged) error_fatal("out of memory");
+    size_t count = 0;
+    for (size_t i = 0; g_profile_sites && i < PROFILE_TABLE_SIZE; i++) {
+        if (g_profile_sites[i].hash) sorted[count++] = &g_profile_sites[i];
+    }
+    qsort(sorted, count, sizeof(ProfileSite *), compare_site_location);
+
+    size_t merged_count = 0;
+    size_t total = 0;
+    for (size_t i = 0; i < count; i++) {
+        total += sorted[i]->bytes;
+        if (merged_count > 0 && site_location_order(sorted[i], &merged[merged_count - 1]) == 0) {
+            merged[merged_count - 1].bytes += sorted[i]->bytes;
+            merged[merged_count - 1].count += sorted[i]->count;
+        } else {
+            merged[merged_count++] = *sorted[i];
+        }
+    }
+    size_t dropped = g_profile_dropped;
+    pthread_mutex_unlock(&g_profile_lock);
+
+    fprintf(out, "\n");
+    fprintf(out, "=================================================================\n");
+    fprintf(out, "                    HEAP PROFILE\n");
+    fprintf(out, "=================================================================\n");
+    fprintf(out, "Sampling:            1 per %zu bytes\n", rate);
+    fprintf(out, "Estimated allocated: %zu bytes at %zu sites\n", total, merged_count);
+    if (dropped) fprintf(out, "Not attributed:      %zu bytes (site table full)\n", dropped);
+    qsort(merged, merged_count, sizeof(ProfileSite), compare_site_bytes);
+    print_sites(out, "bytes", merged, merged_count, top);
+    qsort(merged, merged_count, sizeof(ProfileSite), compare_site_count);
+    print_sites(out, "count", merged, merged_count, top);
+    fprintf(out, "=================================================================\n");
+
+    free(merged);
+    free(sorted);
+}
+
+/* "func" from backtrace_symbols' "module(func+0x1f) [0x...]", or
+ * "module+0x1f" when the symbol has no dynamic name */
+static void write_frame(FILE *out, const char *symbol) {
+    const char *open = strchr(symbol, '(');
+    const char *plus = open ? strchr(open, '+') : NULL;
+    if (open && plus && plus > open + 1) {
+        fprintf(out, "%.*s", (int)(plus - open - 1), open + 1);
+        return;
+    }
+    const char *base = strrchr(symbol, '/');
+    base = base ? base + 1 : symbol;
+    const char *end = strpbrk(base, "( ");
+    const char *close = plus ? strchr(plus, ')') : NULL;
+    fprintf(out, "%.*s", (int)(end ? end - base : (int)strlen(base)), base);
+    if (plus && close) fprintf(out, "%.*s", (int)(close - plus), plus);
+}
+
+bool memory_profile_write_folded(const char *path) {
+    FILE *out = fopen(path, "w");
+    if (!out) {
+        fprintf(stderr, "Error: cannot write heap profile '%s'\n", path);
+        return false;
+    }
+
+    pthread_mutex_lock(&g_profile_lock);
+    for (size_t i = 0; g_profile_sites && i < PROFILE_TABLE_SIZE; i++) {
+        ProfileSite *site = &g_profile_sites[i];
+        if (!site->hash) continue;
+#ifdef __GLIBC__
+        char **symbols = backtrace_symbols(site->frames, site->depth);
+        for (int f = site->depth - 1; symbols && f >= 0; f--) {
+            write_frame(out, symbols[f]);
+            fputc(';', out);
+        }
+        free(symbols);
+#endif
+        fprintf(out, "%s:%d %zu\n", site->file ? site->file : "?", site->line, site->bytes);
+    }
+    pthread_mutex_unlock(&g_profile_lock);
+
+    bool ok = !ferror(out);
+    if (fclose(out) != 0) ok = false;
+    if (!ok) fprintf(stderr, "Error: cannot write heap profile '%s'\n", path);
+    return ok;
+}
+
+/* ========== Slabs ========== */
+
+static SlabState *slab_state(Slab *slab) {
+    int id = __atomic_load_n(&slab->id, __ATOMIC_ACQUIRE);
+    if (id >= 0) return &g_slabs[id];
+
+    pthread_mutex_lock(&g_heaps_lock);
+    id = slab->id;
+    if (id < 0) {
+        if (g_slab_count == MEMORY_MAX_SLABS) {
+            error_fatal("too many slabs (raise MEMORY_MAX_SLABS)");
+        }
+        id = g_slab_count;
+        SlabState *state = &g_slabs[id];
+        state->slab = slab;
+        state->size = (slab->object_size + SLAB_ALIGN - 1) & ~(size_t)(SLAB_ALIGN - 1);
+        pthread_mutex_init(&state->lock, NULL);
+        __atomic_store_n(&g_slab_count, id + 1, __ATOMIC_RELEASE);
+        __atomic_store_n(&slab->id, id, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&g_heaps_lock);
+    return &g_slabs[id];
+}
+
+/* Drop pointers into chunks a slab_release has freed */
+static void slab_cache_sync(SlabState *state, SlabCache *cache) {
+    unsigned generation = __atomic_load_n(&state->generation, __ATOMIC_ACQUIRE);
+    if (cache->generation != generation) {
+        cache->free_list = NULL;
+        cache->bump = NULL;
+        cache->bump_end = NULL;
+        cache->generation = generation;
+    }
+}
+
+/* Adopt orphaned objects, or carve up a new chunk */
+static void *slab_refill(SlabState *state, SlabCache *cache) {
+    pthread_mutex_lock(&state->lock);
+    void *object = state->orphans;
+    if (object) {
+        state->orphans = NULL;
+        pthread_mutex_unlock(&state->lock);
+        cache->free_list = *(void **)object;
+        memset(object, 0, state->size);
+        return object;
+    }
+
+    char *chunk = calloc(1, SLAB_CHUNK_SIZE);
+    if (!chunk) error_fatal("out of memory");
+    account(thread_heap(), SLAB_CHUNK_SIZE);
+    *(void **)chunk = state->chunks;
+    state->chunks = chunk;
+    state->chunk_bytes += SLAB_CHUNK_SIZE;
+    pthread_mutex_unlock(&state->lock);
+
+    size_t per_chunk = (SLAB_CHUNK_SIZE - SLAB_ALIGN) / state->size;
+    object = chunk + SLAB_ALIGN;
+    cache->bump = (char *)object + state->size;
+    cache->bump_end = (char *)object + per_chunk * state->size;
+    return object;
+}
+
+void *slab_alloc_at(Slab *slab, const char *file, int line) {
+    SlabState *state = slab_state(slab);
+    SlabCache *cache = &thread_heap()->slabs[state - g_slabs];
+    STAT_ADD(cache->allocations, 1);
+    if (guarded_mode()) return xcalloc_at(1, slab->object_size, file, line);
+    profile_note(slab->object_size, file, line);
+    STAT_ADD(thread_heap()->phase_allocated[t_phase], state->size);
+    STAT_ADD(thread_heap()->phase_allocations[t_phase], 1);
+
+    slab_cache_sync(state, cache);
+    void *object = cache->free_list;
+    if (object) {
+        cache->free_list = *(void **)object;
+        memset(object, 0, state->size);
+        return object;
+    }
+    if (cache->bump < cache->bump_end) {
+        object = cache->bump;
+        cache->bump += state->size;
+        return object;
+    }
+    return slab_refill(state, cache);
+}
+
+void *slab_alloc(Slab *slab) {
+    return slab_alloc_at(slab, NULL, 0);
+}
+
+void slab_free(Slab *slab, void *ptr) {
+    if (!ptr) return;
+    SlabState *state = slab_state(slab);
+    SlabCache *cache = &thread_heap()->slabs[state - g_slabs];
+    STAT_ADD(cache->frees, 1);
+    if (guarded_mode()) {
+        xfree(ptr);
+        return;
+    }
+
+    STAT_ADD(thread_heap()->phase_freed[t_phase], state->size);
+    slab_cache_sync(state, cache);
+    *(void **)ptr = cache->free_list;
+    cache->free_list = ptr;
+}
+
+void slab_release(Slab *slab) {
+    SlabState *state = slab_state(slab);
+    size_t index = (size_t)(state - g_slabs);
+    pthread_mutex_lock(&g_heaps_lock);
+    pthread_mutex_lock(&state->lock);
+
+    /* Objects still out die with their chunks */
+    size_t live = state->retired_allocations - state->retired_frees;
+    for (ThreadHeap *heap = g_heaps; heap; heap = heap->next) {
+        live += __atomic_load_n(&heap->slabs[index].allocations, __ATOMIC_RELAXED) -
+                __atomic_load_n(&heap->slabs[index].frees, __ATOMIC_RELAXED);
+    }
+    state->retired_frees += live;
+
+    void *chunk = state->chunks;
+    while (chunk) {
+        void *next = *(void **)chunk;
+        free(chunk);
+        chunk = next;
+    }
+    if (!guarded_mode()) account(thread_heap(), -(long long)state->chunk_bytes);
+    state->chunks = NULL;
+    state->orphans = NULL;
+    state->chunk_bytes = 0;
+    __atomic_store_n(&state->generation, state->generation + 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&state->lock);
+    pthread_mutex_unlock(&g_heaps_lock);
+}
+
+/* Per-type counts; g_heaps_lock held */
+static void collect_slab_stats(MemoryStats *out) {
+    int slab_count = __atomic_load_n(&g_slab_count, __ATOMIC_ACQUIRE);
+    out->slab_count = (size_t)slab_count;
+    for (int i = 0; i < slab_count; i++) {
+        SlabState *state = &g_slabs[i];
+        SlabStats *stats = &out->slabs[i];
+        pthread_mutex_lock(&state->lock);
+        size_t allocations = state->retired_allocations;
+        size_t frees = state->retired_frees;
+        stats->chunk_bytes = state->chunk_bytes;
+        pthread_mutex_unlock(&state->lock);
+
+        for (ThreadHeap *heap = g_heaps; heap; heap = heap->next) {
+            allocations += __atomic_load_n(&heap->slabs[i].allocations, __ATOMIC_RELAXED);
+            frees += __atomic_load_n(&heap->slabs[i].frees, __ATOMIC_RELAXED);
+        }
+        stats->name = state->slab->name;
+        stats->object_size = state->size;
+        stats->allocations = allocations;
+        stats->live = allocations - frees;
+    }
+}
+
+/* Merge the per-thread shards */
+static void collect_stats(MemoryStats *out) {
+    pthread_mutex_lock(&g_heaps_lock);
+    *out = g_retired;
+    long long usage = __atomic_load_n(&g_usage, __ATOMIC_RELAXED);
+    for (ThreadHeap *heap = g_heaps; heap; heap = heap->next) {
+        out->total_allocated += __atomic_load_n(&heap->stats.total_allocated, __ATOMIC_RELAXED);
+        out->total_freed += __atomic_load_n(&heap->stats.total_freed, __ATOMIC_RELAXED);
+        out->allocation_count += __atomic_load_n(&heap->stats.allocation_count, __ATOMIC_RELAXED);
+        out->free_count += __atomic_load_n(&heap->stats.free_count, __ATOMIC_RELAXED);
+        out->realloc_count += __atomic_load_n(&heap->stats.realloc_count, __ATOMIC_RELAXED);
+        usage += __atomic_load_n(&heap->unflushed, __ATOMIC_RELAXED);
+    }
+    collect_slab_stats(out);
+    collect_phase_stats(out);
+    pthread_mutex_unlock(&g_heaps_lock);
+
+    long long peak = __atomic_load_n(&g_peak, __ATOMIC_RELAXED);
+    out->current_usage = usage > 0 ? (size_t)usage : 0;
+    out->peak_usage = (size_t)(peak > usage ? peak : usage);
+}
+
 /* ========== Public API ========== */
 
 void memory_init(void) {
@@ -255,17 +1113,32 @@ void memory_shutdown(void) {
     g_memory.initialized = false;
 }
 
-void *xmalloc(size_t size) {
-    void *ptr = allocate_with_guards(size);
+bool memory_debug_enabled(void) {
+    return guarded_mode();
+}
+
+void *xmalloc_at(size_t size, const char *file, int line) {
+    profile_note(size, file, line);
+    void *ptr = guarded_mode() ? allocate_with_guards(size, file, line) : fast_alloc(size, false);
     if (!ptr && size != 0) {
         error_fatal("out of memory");
     }
     return ptr;
 }
 
-void *xcalloc(size_t nmemb, size_t size) {
+void *xcalloc_at(size_t nmemb, size_t size, const char *file, int line) {
+    if (size != 0 && nmemb > SIZE_MAX / size) {
+        error_fatal("out of memory");
+    }
     size_t total = nmemb * size;
-    void *ptr = allocate_with_guards(total);
+    profile_note(total, file, line);
+    if (!guarded_mode()) {
+        void *ptr = fast_alloc(total, true);
+        if (!ptr) error_fatal("out of memory");
+        return ptr;
+    }
+
+    void *ptr = allocate_with_guards(total, file, line);
     if (!ptr && total != 0) {
         error_fatal("out of memory");
     }
@@ -275,9 +1148,9 @@ void *xcalloc(size_t nmemb, size_t size) {
     return ptr;
 }
 
-void *xrealloc(void *ptr, size_t size) {
+void *xrealloc_at(void *ptr, size_t size, const char *file, int line) {
     if (!ptr) {
-        return xmalloc(size);
+        return xmalloc_at(size, file, line);
     }
     
     if (size == 0) {
@@ -285,13 +1158,20 @@ void *xrealloc(void *ptr, size_t size) {
         return NULL;
     }
     
+    profile_note(size, file, line);
+    if (!guarded_mode()) {
+        void *new_ptr = fast_realloc(ptr, size);
+        if (!new_ptr) error_fatal("out of memory");
+        return new_ptr;
+    }
+    
     memory_ensure_init();
     
     AllocationHeader *old_header = ((AllocationHeader*)ptr) - 1;
     check_guards(old_header, "realloc");
     
     /* Allocate new block */
-    void *new_ptr = allocate_with_guards(size);
+    void *new_ptr = allocate_with_guards(size, file, line);
     if (!new_ptr) {
         error_fatal("out of memory");
     }
@@ -303,63 +1183,107 @@ void *xrealloc(void *ptr, size_t size) {
     /* Free old block */
     free_with_guards(ptr);
     
+    pthread_mutex_lock(&g_memory_lock);
     g_memory.stats.realloc_count++;
+    pthread_mutex_unlock(&g_memory_lock);
     
     return new_ptr;
 }
 
-char *xstrdup(const char *s) {
+char *xstrdup_at(const char *s, const char *file, int line) {
     if (!s) return NULL;
     
     size_t len = strlen(s) + 1;
-    char *dup = (char*)xmalloc(len);
+    char *dup = (char*)xmalloc_at(len, file, line);
     memcpy(dup, s, len);
     return dup;
 }
 
-char *xstrndup(const char *s, size_t n) {
+char *xstrndup_at(const char *s, size_t n, const char *file, int line) {
     if (!s) return NULL;
     
     size_t len = strnlen(s, n);
-    char *dup = (char*)xmalloc(len + 1);
+    char *dup = (char*)xmalloc_at(len + 1, file, line);
     memcpy(dup, s, len);
     dup[len] = '\0';
     return dup;
 }
 
+/* Without a call site, for callers that take the address of these */
+void *xmalloc(size_t size) {
+    return xmalloc_at(size, NULL, 0);
+}
+
+void *xcalloc(size_t nmemb, size_t size) {
+    return xcalloc_at(nmemb, size, NULL, 0);
+}
+
+void *xrealloc(void *ptr, size_t size) {
+    return xrealloc_at(ptr, size, NULL, 0);
+}
+
+char *xstrdup(const char *s) {
+    return xstrdup_at(s, NULL, 0);
+}
+
+char *xstrndup(const char *s, size_t n) {
+    return xstrndup_at(s, n, NULL, 0);
+}
+
 void xfree(void *ptr) {
-    free_with_guards(ptr);
+    if (!ptr) return;
+    if (guarded_mode()) {
+        free_with_guards(ptr);
+    } else {
+        fast_free(ptr);
+    }
 }
 
 void memory_print_stats(void) {
+    const MemoryStats *stats = memory_get_stats();
     fprintf(stderr, "\n");
     fprintf(stderr, "=================================================================\n");
     fprintf(stderr, "                    MEMORY STATISTICS\n");
     fprintf(stderr, "=================================================================\n");
-    fprintf(stderr, "Total allocated:     %zu bytes\n", g_memory.stats.total_allocated);
-    fprintf(stderr, "Total freed:         %zu bytes\n", g_memory.stats.total_freed);
-    fprintf(stderr, "Current usage:       %zu bytes\n", g_memory.stats.current_usage);
+    fprintf(stderr, "Total allocated:     %zu bytes\n", stats->total_allocated);
+    fprintf(stderr, "Total freed:         %zu bytes\n", stats->total_freed);
+    fprintf(stderr, "Current usage:       %zu bytes\n", stats->current_usage);
     fprintf(stderr, "Peak usage:          %zu bytes (%.2f MB)\n", 
-            g_memory.stats.peak_usage, g_memory.stats.peak_usage / 1024.0 / 1024.0);
-    fprintf(stderr, "Allocations:         %zu\n", g_memory.stats.allocation_count);
-    fprintf(stderr, "Frees:               %zu\n", g_memory.stats.free_count);
-    fprintf(stderr, "Reallocs:            %zu\n", g_memory.stats.realloc_count);
+            stats->peak_usage, stats->peak_usage / 1024.0 / 1024.0);
+    fprintf(stderr, "Allocations:         %zu\n", stats->allocation_count);
+    fprintf(stderr, "Frees:               %zu\n", stats->free_count);
+    fprintf(stderr, "Reallocs:            %zu\n", stats->realloc_count);
+    for (size_t i = 0; i < stats->slab_count; i++) {
+        const SlabStats *slab = &stats->slabs[i];
+        fprintf(stderr, "Slab %-14s %zu live (%zu bytes), %zu allocations, %zu bytes in chunks\n",
+                slab->name, slab->live, slab->live * slab->object_size,
+                slab->allocations, slab->chunk_bytes);
+    }
     fprintf(stderr, "=================================================================\n");
 }
 
 void memory_check_leaks(void) {
-    if (!g_memory.tracking_enabled) return;
-    
     size_t leak_count = 0;
     size_t leak_bytes = 0;
     
-    AllocationHeader *current = g_memory.alloc_list_head;
-    while (current) {
-        if (!current->is_freed) {
-            leak_count++;
-            leak_bytes += current->size;
+    if (!guarded_mode()) {
+        /* No list of blocks, only the balance */
+        const MemoryStats *stats = memory_get_stats();
+        leak_count = stats->allocation_count - stats->free_count;
+        leak_bytes = stats->current_usage;
+    } else if (!g_memory.tracking_enabled) {
+        return;
+    } else {
+        pthread_mutex_lock(&g_memory_lock);
+        AllocationHeader *current = g_memory.alloc_list_head;
+        while (current) {
+            if (!current->is_freed) {
+                leak_count++;
+                leak_bytes += current->size;
+            }
+            current = current->next;
         }
-        current = current->next;
+        pthread_mutex_unlock(&g_memory_lock);
     }
     
     if (leak_count > 0) {
@@ -386,5 +1310,13 @@ bool memory_enable_tracking(bool enable) {
 }
 
 const MemoryStats *memory_get_stats(void) {
-    return &g_memory.stats;
+    if (guarded_mode()) {
+        pthread_mutex_lock(&g_heaps_lock);
+        collect_slab_stats(&g_memory.stats);
+        collect_phase_stats(&g_memory.stats);
+        pthread_mutex_unlock(&g_heaps_lock);
+        return &g_memory.stats;
+    }
+    collect_stats(&g_snapshot);
+    return &g_snapshot;
 }
@@ -3,8 +3,19 @@
 
 #include <stddef.h>
 #include <stdbool.h>
+#include <stdio.h>
+
+/* Memory allocation wrappers with error checking and safety features.
+ *
+ * Two allocators sit behind these, chosen once per process before the first
+ * allocation. The default hands out plain malloc blocks recycled through
+ * per-thread size-class caches, with statistics kept per thread and merged
+ * when asked for. The guarded one wraps every block in a header and guard
+ * bytes and keeps a list of live blocks for leak reports; it is selected by
+ * building with MEMORY_DEBUG or by setting MEMORY_DEBUG_ENV to anything but
+ * "0". */
+#define MEMORY_DEBUG_ENV "LLVMC_MEMORY_DEBUG"
 
-/* Memory allocation wrappers with error checking and safety features */
 void *xmalloc(size_t size);
 void *xcalloc(size_t nmemb, size_t size);
 void *xrealloc(void *ptr, size_t size);
@@ -12,6 +23,16 @@ char *xstrdup(const char *s);
 char *xstrndup(const char *s, size_t n);
 void xfree(void *ptr);
 
+/* The same, recording the call site for the heap profile and the guarded
+ * allocator's block headers. The macros at the end of this file route
+ * every call through these; the plain functions remain for taking their
+ * address. */
+void *xmalloc_at(size_t size, const char *file, int line);
+void *xcalloc_at(size_t nmemb, size_t size, const char *file, int line);
+void *xrealloc_at(void *ptr, size_t size, const char *file, int line);
+char *xstrdup_at(const char *s, const char *file, int line);
+char *xstrndup_at(const char *s, size_t n, const char *file, int line);
+
 /* Memory debugging and statistics */
 void memory_init(void);
 void memory_shutdown(void);
@@ -20,6 +41,80 @@ void memory_check_leaks(void);
 bool memory_enable_guards(bool enable);
 bool memory_enable_tracking(bool enable);
 
+/* Whether the guarded allocator is in use (guards and tracking only apply
+ * to it) */
+bool memory_debug_enabled(void);
+
+/* Typed slabs for hot fixed-size objects (tokens, AST nodes, symbol
+ * entries). Objects are carved from 64 KiB chunks and recycled through
+ * per-thread free lists; chunks go back to malloc only in slab_release.
+ * Under the guarded allocator each object is an ordinary xcalloc block. */
+#define MEMORY_MAX_SLABS 8
+
+typedef struct {
+    const char *name;
+    size_t object_size;
+    int id;                     /* Registry slot, -1 until first use */
+} Slab;
+
+#define SLAB_INIT(name, type) {name, sizeof(type), -1}
+
+/* Zeroed object */
+void *slab_alloc(Slab *slab);
+void *slab_alloc_at(Slab *slab, const char *file, int line);
+void slab_free(Slab *slab, void *ptr);
+
+/* Free every chunk at once, including objects never handed back. Only
+ * when no object of the slab is in use and no other thread allocates from
+ * it. */
+void slab_release(Slab *slab);
+
+typedef struct {
+    const char *name;
+    size_t object_size;
+    size_t live;                /* Allocated and not yet freed */
+    size_t allocations;
+    size_t chunk_bytes;         /* Held in chunks, in use or not */
+} SlabStats;
+
+/* Compiler phases allocations are charged to. The phase is per thread;
+ * memory_set_phase returns the previous one so callers can restore it. */
+typedef enum {
+    MEMORY_PHASE_OTHER,
+    MEMORY_PHASE_PREPROCESS,
+    MEMORY_PHASE_LEX,
+    MEMORY_PHASE_PARSE,
+    MEMORY_PHASE_CODEGEN,
+    MEMORY_PHASE_OPTIMIZE,
+    MEMORY_PHASE_EMIT,
+    MEMORY_PHASE_COUNT
+} MemoryPhase;
+
+typedef struct {
+    size_t allocated;           /* Bytes allocated while in the phase */
+    size_t freed;
+    size_t allocations;
+    size_t live;                /* Heap in use when the phase last ended */
+    size_t peak;                /* Heap in use, highest while in the phase */
+    size_t peak_rss;            /* Only sampled after memory_sample_rss */
+} PhaseStats;
+
+MemoryPhase memory_set_phase(MemoryPhase phase);
+MemoryPhase memory_get_phase(void);
+const char *memory_phase_name(MemoryPhase phase);
+
+/* Called on the switching thread at every phase change, so other
+ * per-phase accounting can follow the same switches. One hook, set before
+ * compile threads start. */
+typedef void (*MemoryPhaseHook)(MemoryPhase from, MemoryPhase to);
+void memory_set_phase_hook(MemoryPhaseHook hook);
+
+/* Sample resident memory at phase changes. RSS also covers what LLVM and
+ * libc allocate without going through xmalloc. */
+void memory_sample_rss(bool enable);
+size_t memory_current_rss(void);
+size_t memory_peak_rss(void);
+
 /* Memory statistics structure */
 typedef struct {
     size_t total_allocated;
@@ -29,8 +124,40 @@ typedef struct {
     size_t allocation_count;
     size_t free_count;
     size_t realloc_count;
+    size_t slab_count;
+    SlabStats slabs[MEMORY_MAX_SLABS];
+    PhaseStats phases[MEMORY_PHASE_COUNT];
+    size_t peak_rss;            /* Process high-water mark */
 } MemoryStats;
 
 const MemoryStats *memory_get_stats(void);
 
+/* Sampling heap profile. Once started, each thread takes a sample every
+ * `sample_bytes` allocated (0: MEMORY_PROFILE_DEFAULT_RATE), recording the
+ * call site and stack and crediting it with the bytes the sample stands
+ * for. Cheap enough to leave on for a whole compile at the default rate. */
+#define MEMORY_PROFILE_DEFAULT_RATE (512 * 1024)
+#define MEMORY_PROFILE_RATE_ENV "LLVMC_HEAP_PROFILE_RATE"
+
+void memory_profile_start(size_t sample_bytes);
+bool memory_profile_active(void);
+
+/* The `top` heaviest sites by estimated bytes and by estimated count */
+void memory_profile_report(FILE *out, size_t top);
+
+/* One line per sampled stack in folded form, outermost frame first and the
+ * allocation site last ("main;driver_run;parse:c_parser.c:120 1048576"),
+ * ready for flamegraph.pl or speedscope. Frames without a dynamic symbol
+ * print as module+offset. */
+bool memory_profile_write_folded(const char *path);
+
+#ifndef MEMORY_NO_SITES
+#define xmalloc(size) xmalloc_at((size), __FILE__, __LINE__)
+#define xcalloc(nmemb, size) xcalloc_at((nmemb), (size), __FILE__, __LINE__)
+#define xrealloc(ptr, size) xrealloc_at((ptr), (size), __FILE__, __LINE__)
+#define xstrdup(s) xstrdup_at((s), __FILE__, __LINE__)
+#define xstrndup(s, n) xstrndup_at((s), (n), __FILE__, __LINE__)
+#define slab_alloc(slab) slab_alloc_at((slab), __FILE__, __LINE__)
+#endif
+
 #endif /* MEMORY_H */
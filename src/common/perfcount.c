@@ -0,0 +1,241 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include "perfcount.h"
+#include "thread.h"
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+typedef struct {
+    uint32_t type;
+    uint64_t config;
+    const char *name;
+} PerfEventSpec;
+
+#ifdef __linux__
+static const PerfEventSpec event_specs[PERF_COUNTER_COUNT] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, "cycles"},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, "instructions"},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, "branch-misses"},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, "cache-misses"},
+    {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS, "page-faults"},
+};
+#endif
+
+/* One thread's group. Read in a single call: nr, time enabled, time
+ * running, then a value per member in the order they were opened. */
+typedef struct {
+    bool opened;                /* Tried already, whether or not it worked */
+    int leader;
+    int fds[PERF_COUNTER_COUNT];
+    int slot[PERF_COUNTER_COUNT];       /* Position in the read, -1 if absent */
+    int members;
+    uint64_t last[PERF_COUNTER_COUNT];  /* Scaled values at the last read */
+    MemoryPhase phase;
+} PerfThread;
+
+static bool g_active;
+static bool g_available[PERF_COUNTER_COUNT];   /* Opened on some thread */
+static unsigned long long g_totals[MEMORY_PHASE_COUNT][PERF_COUNTER_COUNT];
+static pthread_key_t g_thread_key;
+static pthread_once_t g_key_once = PTHREAD_ONCE_INIT;
+/* Static storage: the exit flush must not allocate once the thread's heap
+ * may be gone */
+static THREAD_LOCAL PerfThread t_perf;
+
+#ifdef __linux__
+static int perf_open(const PerfEventSpec *spec, int group) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = spec->type;
+    attr.config = spec->config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    /* This thread only, on whichever CPU it runs */
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+/* Current values, scaled up if the kernel had to multiplex the group */
+static bool perf_read(PerfThread *perf, uint64_t values[PERF_COUNTER_COUNT]) {
+    uint64_t buffer[3 + PERF_COUNTER_COUNT];
+    ssize_t want = (ssize_t)((3 + (size_t)perf->members) * sizeof(uint64_t));
+    if (read(perf->leader, buffer, sizeof(buffer)) < want) return false;
+
+    uint64_t enabled = buffer[1], running = buffer[2];
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+        if (perf->slot[i] < 0) continue;
+        uint64_t value = buffer[3 + perf->slot[i]];
+        if (running > 0 && running < enabled) {
+            value = (uint64_t)((double)value * (double)enabled / (double)running);
+        }
+        values[i] = value;
+    }
+    return true;
+}
+#endif
+
+/* Charge what was counted since the last read to the current phase */
+static void perf_flush(PerfThread *perf) {
+#ifdef __linux__
+    if (perf->members == 0) return;
+    uint64_t values[PERF_COUNTER_COUNT];
+    if (!perf_read(perf, values)) return;
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+        if (perf->slot[i] < 0) continue;
+        uint64_t delta = values[i] >= perf->last[i] ? values[i] - perf->last[i] : 0;
+        __atomic_add_fetch(&g_totals[perf->phase][i], delta, __ATOMIC_RELAXED);
+        perf->last[i] = values[i];
+    }
+#else
+    (void)perf;
+#endif
+}
+
+static void perf_thread_exit(void *arg) {
+    PerfThread *perf = (PerfThread *)arg;
+    perf_flush(perf);
+    if (perf->leader >= 0) close(perf->leader);
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+        if (perf->fds[i] >= 0 && perf->fds[i] != perf->leader) close(perf->fds[i]);
+    }
+    perf->members = 0;
+    perf->leader = -1;
+}
+
+static void create_key(void) {
+    pthread_key_create(&g_thread_key, perf_thread_exit);
+}
+
+/* Open this thread's group; the first counter that opens leads it */
+static PerfThread *perf_thread(MemoryPhase phase) {
+    PerfThread *perf = &t_perf;
+    if (perf->opened) return perf;
+    perf->opened = true;
+    perf->leader = -1;
+    perf->phase = phase;
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+        perf->fds[i] = -1;
+        perf->slot[i] = -1;
+    }
+
+#ifdef __linux__
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+        int fd = perf_open(&event_specs[i], perf->leader);
+        if (fd < 0) continue;
+        if (perf->leader < 0) perf->leader = fd;
+        perf->fds[i] = fd;
+        perf->slot[i] = perf->members++;
+        __atomic_store_n(&g_available[i], true, __ATOMIC_RELAXED);
+    }
+    if (perf->members > 0) {
+        uint64_t values[PERF_COUNTER_COUNT];
+        if (perf_read(perf, values)) memcpy(perf->last, values, sizeof(values));
+        pthread_once(&g_key_once, create_key);
+        pthread_setspecific(g_thread_key, perf);
+    }
+#endif
+    return perf;
+}
+
+static void perf_phase_hook(MemoryPhase from, MemoryPhase to) {
+    PerfThread *perf = perf_thread(from);
+    perf_flush(perf);
+    perf->phase = to;
+}
+
+bool perfcount_start(void) {
+    if (perfcount_active()) return true;
+
+    PerfThread *perf = perf_thread(memory_get_phase());
+    if (perf->members == 0) {
+#ifdef __linux__
+        fprintf(stderr, "Warning: performance counters unavailable (perf_event_open: %s)\n", strerror(errno));
+#else
+        fprintf(stderr, "Warning: performance counters are only supported on Linux\n");
+#endif
+        return false;
+    }
+
+    __atomic_store_n(&g_active, true, __ATOMIC_RELEASE);
+    memory_set_phase_hook(perf_phase_hook);
+    return true;
+}
+
+bool perfcount_active(void) {
+    return __atomic_load_n(&g_active, __ATOMIC_ACQUIRE);
+}
+
+bool perfcount_get(MemoryPhase phase, PerfCounter counter, unsigned long long *value) {
+    if (phase >= MEMORY_PHASE_COUNT || counter >= PERF_COUNTER_COUNT) return false;
+    if (!__atomic_load_n(&g_available[counter], __ATOMIC_RELAXED)) return false;
+    if (t_perf.opened) perf_flush(&t_perf);
+    *value = __atomic_load_n(&g_totals[phase][counter], __ATOMIC_RELAXED);
+    return true;
+}
+
+/* Misses per thousand instructions, or n/a */
+static void print_rate(FILE *out, MemoryPhase phase, PerfCounter counter, unsigned long long instructions,
+                       bool have_instructions) {
+    unsigned long long misses;
+    if (!perfcount_get(phase, counter, &misses) || !have_instructions) {
+        fprintf(out, " %9s", "n/a");
+    } else if (instructions == 0) {
+        fprintf(out, " %9s", "-");
+    } else {
+        fprintf(out, " %9.2f", 1000.0 * (double)misses / (double)instructions);
+    }
+}
+
+static void print_count(FILE *out, bool have, unsigned long long value, int width) {
+    if (have) {
+        fprintf(out, " %*llu", width, value);
+    } else {
+        fprintf(out, " %*s", width, "n/a");
+    }
+}
+
+void perfcount_report(FILE *out) {
+    fprintf(out, "\n");
+    fprintf(out, "=================================================================\n");
+    fprintf(out, "                    PERFORMANCE COUNTERS\n");
+    fprintf(out, "=================================================================\n");
+    if (!perfcount_active()) {
+        fprintf(out, "No counters could be opened\n");
+        fprintf(out, "=================================================================\n");
+        return;
+    }
+    fprintf(out, "%-11s %14s %14s %5s %9s %9s %9s\n", "Phase", "Cycles", "Instructions", "IPC",
+            "BrMPKI", "CacheMPKI", "PgFaults");
+    for (int i = 0; i < MEMORY_PHASE_COUNT; i++) {
+        MemoryPhase phase = (MemoryPhase)i;
+        unsigned long long cycles = 0, instructions = 0, faults = 0;
+        bool have_cycles = perfcount_get(phase, PERF_CYCLES, &cycles);
+        bool have_instructions = perfcount_get(phase, PERF_INSTRUCTIONS, &instructions);
+        bool have_faults = perfcount_get(phase, PERF_PAGE_FAULTS, &faults);
+        if (cycles == 0 && instructions == 0 && faults == 0) continue;
+
+        fprintf(out, "%-11s", memory_phase_name(phase));
+        print_count(out, have_cycles, cycles, 14);
+        print_count(out, have_instructions, instructions, 14);
+        if (have_cycles && have_instructions && cycles > 0) {
+            fprintf(out, " %5.2f", (double)instructions / (double)cycles);
+        } else {
+            fprintf(out, " %5s", "n/a");
+        }
+        print_rate(out, phase, PERF_BRANCH_MISSES, instructions, have_instructions);
+        print_rate(out, phase, PERF_CACHE_MISSES, instructions, have_instructions);
+        print_count(out, have_faults, faults, 9);
+        fprintf(out, "\n");
+    }
+    fprintf(out, "MPKI: misses per thousand instructions; user space only\n");
+    fprintf(out, "=================================================================\n");
+}
@@ -0,0 +1,39 @@
+#ifndef PERFCOUNT_H
+#define PERFCOUNT_H
+
+#include "memory.h"
+#include <stdbool.h>
+#include <stdio.h>
+
+/* Hardware performance counters per compiler phase.
+ *
+ * Each thread opens one counter group (perf_event_open) the first time it
+ * changes phase, and every phase change reads the group once and charges
+ * the difference to the phase being left. Phases are the ones allocations
+ * are charged to (memory_set_phase), so both tables line up.
+ *
+ * Counters the kernel or the machine does not offer (containers,
+ * perf_event_paranoid, virtual machines) are reported as n/a; if none
+ * open, perfcount_start warns and returns false and compilation goes on. */
+
+typedef enum {
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_BRANCH_MISSES,
+    PERF_CACHE_MISSES,
+    PERF_PAGE_FAULTS,
+    PERF_COUNTER_COUNT
+} PerfCounter;
+
+bool perfcount_start(void);
+bool perfcount_active(void);
+
+/* Totals so far; false if the counter never opened. Includes what the
+ * calling thread has counted since its last phase change. */
+bool perfcount_get(MemoryPhase phase, PerfCounter counter, unsigned long long *value);
+
+/* Per phase: cycles, instructions, IPC, branch and cache misses per
+ * thousand instructions, page faults */
+void perfcount_report(FILE *out);
+
+#endif /* PERFCOUNT_H */
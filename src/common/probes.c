@@ -0,0 +1,21 @@
+#include "probes.h"
+
+/* Semaphores for the probes in probes.h: a tracer increments one while
+ * attached to its probe */
+#ifdef LLVMC_HAVE_SDT
+#define LLVMC_DEFINE_PROBE(name) \
+    __extension__ unsigned short LLVMC_PROBE_SEMAPHORE(name) \
+        __attribute__((unused)) __attribute__((section(".probes")))
+
+LLVMC_DEFINE_PROBE(phase__change);
+LLVMC_DEFINE_PROBE(unit__start);
+LLVMC_DEFINE_PROBE(unit__done);
+LLVMC_DEFINE_PROBE(function__start);
+LLVMC_DEFINE_PROBE(function__done);
+LLVMC_DEFINE_PROBE(cache__hit);
+LLVMC_DEFINE_PROBE(cache__miss);
+LLVMC_DEFINE_PROBE(preprocess__spawn);
+#else
+/* ISO C wants something in every translation unit */
+typedef int probes_unused;
+#endif
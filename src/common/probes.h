@@ -0,0 +1,61 @@
+#ifndef PROBES_H
+#define PROBES_H
+
+/* USDT static probes (provider "llvmc") for tracing live compiles with
+ * bpftrace, perf or SystemTap. Built in when <sys/sdt.h> was found at
+ * configure time (LLVMC_HAVE_SDT); otherwise each probe expands to nothing
+ * and its arguments are not evaluated. An unattached probe is a single
+ * nop; work done only for a probe argument is guarded by
+ * LLVMC_PROBE_ENABLED, which reads the probe's semaphore.
+ *
+ *   phase__change(from, to)            compiler phase names, per thread
+ *   unit__start(input)
+ *   unit__done(input, status)          status 0 on success
+ *   function__start(name)
+ *   function__done(name, instructions) IR instructions in the body
+ *   cache__hit(key, ext)               object cache lookups
+ *   cache__miss(key, ext)
+ *   preprocess__spawn(input, command)  before running the external
+ *                                      preprocessor
+ *
+ * For example, a histogram of function codegen time:
+ *
+ *   bpftrace -e 'usdt:./llvm-c:llvmc:function__start { @s[tid] = nsecs; }
+ *     usdt:./llvm-c:llvmc:function__done /@s[tid]/ {
+ *       @us = hist((nsecs - @s[tid]) / 1000); delete(@s[tid]); }'
+ */
+
+#ifdef LLVMC_HAVE_SDT
+
+/* Every probe site then refers to its semaphore; probes.c defines them */
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+
+#define LLVMC_PROBE_SEMAPHORE(name) llvmc_##name##_semaphore
+#define LLVMC_DECLARE_PROBE(name) \
+    __extension__ extern unsigned short LLVMC_PROBE_SEMAPHORE(name) \
+        __attribute__((unused)) __attribute__((section(".probes")))
+
+LLVMC_DECLARE_PROBE(phase__change);
+LLVMC_DECLARE_PROBE(unit__start);
+LLVMC_DECLARE_PROBE(unit__done);
+LLVMC_DECLARE_PROBE(function__start);
+LLVMC_DECLARE_PROBE(function__done);
+LLVMC_DECLARE_PROBE(cache__hit);
+LLVMC_DECLARE_PROBE(cache__miss);
+LLVMC_DECLARE_PROBE(preprocess__spawn);
+
+#define LLVMC_PROBE_ENABLED(name) __builtin_expect(LLVMC_PROBE_SEMAPHORE(name) != 0, 0)
+#define LLVMC_PROBE1(name, a) DTRACE_PROBE1(llvmc, name, a)
+#define LLVMC_PROBE2(name, a, b) DTRACE_PROBE2(llvmc, name, a, b)
+
+#else
+
+#define LLVMC_PROBE_ENABLED(name) 0
+/* sizeof keeps the arguments used without evaluating them */
+#define LLVMC_PROBE1(name, a) ((void)sizeof(a))
+#define LLVMC_PROBE2(name, a, b) ((void)sizeof(a), (void)sizeof(b))
+
+#endif /* LLVMC_HAVE_SDT */
+
+#endif /* PROBES_H */
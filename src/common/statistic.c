@@ -0,0 +1,161 @@
+#define _POSIX_C_SOURCE 200809L
+#include "statistic.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Slot arrays come from calloc rather than xcalloc: they are released from
+ * a thread-exit destructor, possibly after the thread's heap has gone, and
+ * should not show up in the allocation statistics they sit beside. */
+typedef struct StatisticThread {
+    unsigned long long slots[STATISTIC_SLOTS];
+    struct StatisticThread *next;
+} StatisticThread;
+
+static bool g_enabled;
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+static Statistic *g_stats[STATISTIC_SLOTS];     /* Slot 0 is never handed out */
+static unsigned g_count;
+static StatisticThread *g_threads;
+static unsigned long long g_retired[STATISTIC_SLOTS];
+static pthread_key_t g_thread_key;
+static pthread_once_t g_key_once = PTHREAD_ONCE_INIT;
+
+THREAD_LOCAL unsigned long long *t_statistic_slots;
+
+void statistics_enable(void) {
+    __atomic_store_n(&g_enabled, true, __ATOMIC_RELAXED);
+}
+
+bool statistics_enabled(void) {
+    return __atomic_load_n(&g_enabled, __ATOMIC_RELAXED);
+}
+
+static void merge_slot(unsigned long long *into, unsigned id, unsigned long long value) {
+    if (g_stats[id] && g_stats[id]->is_max) {
+        if (value > *into) *into = value;
+    } else {
+        *into += value;
+    }
+}
+
+/* Fold an exiting thread's counts into the retired totals */
+static void retire_thread(void *arg) {
+    StatisticThread *thread = (StatisticThread *)arg;
+    pthread_mutex_lock(&g_lock);
+    for (StatisticThread **link = &g_threads; *link; link = &(*link)->next) {
+        if (*link == thread) {
+            *link = thread->next;
+            break;
+        }
+    }
+    for (unsigned id = 1; id <= g_count; id++) {
+        merge_slot(&g_retired[id], id, thread->slots[id]);
+    }
+    pthread_mutex_unlock(&g_lock);
+    t_statistic_slots = NULL;
+    free(thread);
+}
+
+static void create_key(void) {
+    pthread_key_create(&g_thread_key, retire_thread);
+}
+
+unsigned statistic_register(Statistic *stat) {
+    if (!t_statistic_slots) {
+        StatisticThread *thread = calloc(1, sizeof(StatisticThread));
+        if (!thread) {
+            /* Count into a scratch slot rather than fail the compile */
+            static THREAD_LOCAL unsigned long long scratch[STATISTIC_SLOTS];
+            t_statistic_slots = scratch;
+            return 0;
+        }
+        pthread_once(&g_key_once, create_key);
+        pthread_mutex_lock(&g_lock);
+        thread->next = g_threads;
+        g_threads = thread;
+        pthread_mutex_unlock(&g_lock);
+        pthread_setspecific(g_thread_key, thread);
+        t_statistic_slots = thread->slots;
+    }
+
+    unsigned id = __atomic_load_n(&stat->id, __ATOMIC_ACQUIRE);
+    if (id) return id;
+    pthread_mutex_lock(&g_lock);
+    if (!stat->id && g_count + 1 < STATISTIC_SLOTS) {
+        g_stats[++g_count] = stat;
+        __atomic_store_n(&stat->id, g_count, __ATOMIC_RELEASE);
+    }
+    id = stat->id;
+    pthread_mutex_unlock(&g_lock);
+    /* Past the last slot, counts go to slot 0 and are not reported */
+    return id;
+}
+
+/* Snapshot of every registered statistic, sorted for printing */
+typedef struct {
+    Statistic *stat;
+    unsigned long long value;
+} StatisticValue;
+
+static int compare_values(const void *a, const void *b) {
+    const Statistic *x = ((const StatisticValue *)a)->stat;
+    const Statistic *y = ((const StatisticValue *)b)->stat;
+    int order = strcmp(x->group, y->group);
+    return order ? order : strcmp(x->name, y->name);
+}
+
+static size_t collect(StatisticValue *values) {
+    pthread_mutex_lock(&g_lock);
+    size_t count = g_count;
+    for (unsigned id = 1; id <= g_count; id++) {
+        unsigned long long value = g_retired[id];
+        for (StatisticThread *thread = g_threads; thread; thread = thread->next) {
+            merge_slot(&value, id, __atomic_load_n(&thread->slots[id], __ATOMIC_RELAXED));
+        }
+        values[id - 1].stat = g_stats[id];
+        values[id - 1].value = value;
+    }
+    pthread_mutex_unlock(&g_lock);
+    qsort(values, count, sizeof(StatisticValue), compare_values);
+    return count;
+}
+
+void statistics_report(FILE *out) {
+    StatisticValue values[STATISTIC_SLOTS];
+    size_t count = collect(values);
+
+    fprintf(out, "\n");
+    fprintf(out, "=================================================================\n");
+    fprintf(out, "                    STATISTICS\n");
+    fprintf(out, "=================================================================\n");
+    for (size_t i = 0; i < count; i++) {
+        Statistic *stat = values[i].stat;
+        fprintf(out, "%14llu %-10s - %s%s\n", values[i].value, stat->group, stat->description,
+                stat->is_max ? " (max)" : "");
+    }
+    if (count == 0) fprintf(out, "Nothing was counted\n");
+    fprintf(out, "=================================================================\n");
+}
+
+bool statistics_write_json(const char *path) {
+    FILE *out = fopen(path, "w");
+    if (!out) {
+        fprintf(stderr, "Error: cannot write statistics '%s'\n", path);
+        return false;
+    }
+
+    StatisticValue values[STATISTIC_SLOTS];
+    size_t count = collect(values);
+    fprintf(out, "{\n");
+    for (size_t i = 0; i < count; i++) {
+        fprintf(out, "\t\"%s.%s\": %llu%s\n", values[i].stat->group, values[i].stat->name, values[i].value,
+                i + 1 < count ? "," : "");
+    }
+    fprintf(out, "}\n");
+
+    bool ok = !ferror(out);
+    if (fclose(out) != 0) ok = false;
+    if (!ok) fprintf(stderr, "Error: cannot write statistics '%s'\n", path);
+    return ok;
+}
@@ -0,0 +1,80 @@
+#ifndef STATISTIC_H
+#define STATISTIC_H
+
+#include "thread.h"
+#include <stdbool.h>
+#include <stdio.h>
+
+/* Named event counters for hot paths, after LLVM's STATISTIC.
+ *
+ *   STATISTIC(NumTokens, "lexer", "Tokens lexed");
+ *   ...
+ *   STATISTIC_INC(NumTokens);
+ *
+ * Each thread counts into its own slots with a plain add; a statistic gets
+ * its slot the first time it is counted. The slots of every thread,
+ * including exited ones, are summed when reported. STATISTIC_MAX declares
+ * one that keeps the highest value noted instead.
+ *
+ * Building with LLVMC_NO_STATISTICS compiles all of it away. */
+
+#define STATISTIC_SLOTS 128
+
+typedef struct {
+    const char *group;
+    const char *name;
+    const char *description;
+    bool is_max;
+    unsigned id;                /* Slot, 0 until first counted */
+} Statistic;
+
+/* Whether --stats asked for them; guards statistics that cost something
+ * to compute beyond the increment */
+void statistics_enable(void);
+bool statistics_enabled(void);
+
+/* "value group - description" lines, by group then name */
+void statistics_report(FILE *out);
+
+/* {"group.name": value, ...} */
+bool statistics_write_json(const char *path);
+
+#ifndef LLVMC_NO_STATISTICS
+
+extern THREAD_LOCAL unsigned long long *t_statistic_slots;
+unsigned statistic_register(Statistic *stat);
+
+static inline unsigned long long *statistic_slot(Statistic *stat) {
+    unsigned id = __atomic_load_n(&stat->id, __ATOMIC_ACQUIRE);
+    if (__builtin_expect(id == 0 || !t_statistic_slots, 0)) id = statistic_register(stat);
+    return &t_statistic_slots[id];
+}
+
+/* Only the owning thread writes a slot; the report reads them all */
+static inline void statistic_add(Statistic *stat, unsigned long long n) {
+    unsigned long long *slot = statistic_slot(stat);
+    __atomic_store_n(slot, *slot + n, __ATOMIC_RELAXED);
+}
+
+static inline void statistic_note_max(Statistic *stat, unsigned long long value) {
+    unsigned long long *slot = statistic_slot(stat);
+    if (value > *slot) __atomic_store_n(slot, value, __ATOMIC_RELAXED);
+}
+
+#define STATISTIC(var, group, desc) static Statistic var = {group, #var, desc, false, 0}
+#define STATISTIC_MAX(var, group, desc) static Statistic var = {group, #var, desc, true, 0}
+#define STATISTIC_INC(var) statistic_add(&(var), 1)
+#define STATISTIC_ADD(var, n) statistic_add(&(var), (n))
+#define STATISTIC_NOTE_MAX(var, value) statistic_note_max(&(var), (value))
+
+#else
+
+#define STATISTIC(var, group, desc) typedef int statistic_unused_##var
+#define STATISTIC_MAX(var, group, desc) typedef int statistic_unused_##var
+#define STATISTIC_INC(var) ((void)0)
+#define STATISTIC_ADD(var, n) ((void)0)
+#define STATISTIC_NOTE_MAX(var, value) ((void)0)
+
+#endif /* LLVMC_NO_STATISTICS */
+
+#endif /* STATISTIC_H */
@@ -0,0 +1,553 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include "taskpool.h"
+#include "memory.h"
+#include "thread.h"
+#include <sched.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+/* The tree is C99, so atomics use the GCC/Clang builtins */
+#define LOAD(p, order) __atomic_load_n((p), __ATOMIC_##order)
+#define STORE(p, v, order) __atomic_store_n((p), (v), __ATOMIC_##order)
+#define CAS(p, expected, desired) \
+    __atomic_compare_exchange_n((p), (expected), (desired), false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)
+#define FENCE(order) __atomic_thread_fence(__ATOMIC_##order)
+
+#define CACHE_LINE 64
+#define DEQUE_INITIAL_CAPACITY 64
+#define TASK_CACHE_LIMIT 256        /* Recycled task records kept per worker */
+#define IDLE_SPINS 32               /* Empty scans before a thread sleeps */
+
+/* ===== TASKS ===== */
+
+typedef struct Task {
+    TaskFn fn;
+    void *arg;
+    TaskGroup *group;
+    struct Task *next;          /* Injection queue or free list */
+} Task;
+
+/* ===== CHASE-LEV DEQUE ===== */
+
+/* Circular array of tasks. A full array is replaced by one twice the size;
+ * thieves may still be reading the old one, so it is kept until the pool
+ * is destroyed. */
+typedef struct TaskBuffer {
+    long capacity;              /* Power of two */
+    struct TaskBuffer *retired;
+    Task *slots[];
+} TaskBuffer;
+
+/* Only the owner touches `bottom` (push and pop); thieves advance `top`
+ * with a CAS. The two ends live on separate cache lines. */
+typedef struct {
+    long top;
+    char top_pad[CACHE_LINE - sizeof(long)];
+    long bottom;
+    TaskBuffer *buffer;
+    char bottom_pad[CACHE_LINE - sizeof(long) - sizeof(TaskBuffer *)];
+} TaskDeque;
+
+static TaskBuffer *buffer_create(long capacity) {
+    TaskBuffer *buffer = xmalloc(sizeof(TaskBuffer) + (size_t)capacity * sizeof(Task *));
+    buffer->capacity = capacity;
+    buffer->retired = NULL;
+    return buffer;
+}
+
+static void deque_init(TaskDeque *deque) {
+    memset(deque, 0, sizeof(*deque));
+    deque->buffer = buffer_create(DEQUE_INITIAL_CAPACITY);
+}
+
+static void deque_destroy(TaskDeque *deque) {
+    TaskBuffer *buffer = deque->buffer;
+    while (buffer) {
+        TaskBuffer *retired = buffer->retired;
+        xfree(buffer);
+        buffer = retired;
+    }
+}
+
+static void deque_push(TaskDeque *deque, Task *task) {
+    long bottom = LOAD(&deque->bottom, RELAXED);
+    long top = LOAD(&deque->top, ACQUIRE);
+    TaskBuffer *buffer = LOAD(&deque->buffer, RELAXED);
+
+    if (bottom - top > buffer->capacity - 1) {
+        TaskBuffer *grown = buffer_create(buffer->capacity * 2);
+        for (long i = top; i < bottom; i++) {
+            grown->slots[i & (grown->capacity - 1)] =
+                LOAD(&buffer->slots[i & (buffer->capacity - 1)], RELAXED);
+        }
+        grown->retired = buffer;
+        STORE(&deque->buffer, grown, RELEASE);
+        buffer = grown;
+    }
+
+    STORE(&buffer->slots[bottom & (buffer->capacity - 1)], task, RELAXED);
+    STORE(&deque->bottom, bottom + 1, RELEASE);
+}
+
+/* Owner side: newest task first */
+static Task *deque_pop(TaskDeque *deque) {
+    long bottom = LOAD(&deque->bottom, RELAXED) - 1;
+    TaskBuffer *buffer = LOAD(&deque->buffer, RELAXED);
+    STORE(&deque->bottom, bottom, RELAXED);
+    FENCE(SEQ_CST);
+    long top = LOAD(&deque->top, RELAXED);
+
+    if (top > bottom) {
+        STORE(&deque->bottom, bottom + 1, RELAXED);
+        return NULL;
+    }
+
+    Task *task = LOAD(&buffer->slots[bottom & (buffer->capacity - 1)], RELAXED);
+    if (top == bottom) {
+        /* The last task: thieves may be racing for it */
+        if (!CAS(&deque->top, &top, top + 1)) task = NULL;
+        STORE(&deque->bottom, bottom + 1, RELAXED);
+    }
+    return task;
+}
+
+/* Thief side: oldest task first. Sets *contended when another thread won
+ * the race, in which case the deque may well still hold work. */
+static Task *deque_steal(TaskDeque *deque, bool *contended) {
+    long top = LOAD(&deque->top, ACQUIRE);
+    FENCE(SEQ_CST);
+    long bottom = LOAD(&deque->bottom, ACQUIRE);
+    if (top >= bottom) return NULL;
+
+    TaskBuffer *buffer = LOAD(&deque->buffer, ACQUIRE);
+    Task *task = LOAD(&buffer->slots[top & (buffer->capacity - 1)], RELAXED);
+    if (!CAS(&deque->top, &top, top + 1)) {
+        *contended = true;
+        return NULL;
+    }
+    return task;
+}
+
+/* ===== POOL ===== */
+
+typedef struct {
+    TaskDeque deque;
+    TaskPool *pool;
+    pthread_t thread;
+    uint32_t seed;              /* Victim selection */
+    Task *free_tasks;
+    size_t free_count;
+} Worker;
+
+struct TaskPool {
+    Worker *workers;
+    size_t worker_count;
+
+    /* Tasks spawned from outside the pool */
+    pthread_mutex_t inject_lock;
+    Task *inject_head;
+    Task *inject_tail;
+    long injected;
+
+    /* Sleeping. An idle worker registers in `sleepers`, rescans, then
+     * waits for `epoch` to move; spawns and finished groups move it only
+     * when someone is registered, so the busy path never takes the lock.
+     * Threads outside the pool wait for their group on `done`. */
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_cond_t done;
+    unsigned long epoch;
+    long sleepers;
+    long waiters;
+    bool shutdown;
+};
+
+static THREAD_LOCAL Worker *current_worker;
+
+static Worker *worker_of(TaskPool *pool) {
+    Worker *self = current_worker;
+    return self && self->pool == pool ? self : NULL;
+}
+
+static Task *task_acquire(Worker *self) {
+    if (self && self->free_tasks) {
+        Task *task = self->free_tasks;
+        self->free_tasks = task->next;
+        self->free_count--;
+        return task;
+    }
+    return xmalloc(sizeof(Task));
+}
+
+static void task_release(Worker *self, Task *task) {
+    if (self && self->free_count < TASK_CACHE_LIMIT) {
+        task->next = self->free_tasks;
+        self->free_tasks = task;
+        self->free_count++;
+    } else {
+        xfree(task);
+    }
+}
+
+static void inject_push(TaskPool *pool, Task *task) {
+    task->next = NULL;
+    pthread_mutex_lock(&pool->inject_lock);
+    if (pool->inject_tail) {
+        pool->inject_tail->next = task;
+    } else {
+        pool->inject_head = task;
+    }
+    pool->inject_tail = task;
+    STORE(&pool->injected, pool->injected + 1, RELEASE);
+    pthread_mutex_unlock(&pool->inject_lock);
+}
+
+static Task *inject_pop(TaskPool *pool) {
+    if (LOAD(&pool->injected, ACQUIRE) == 0) return NULL;
+
+    pthread_mutex_lock(&pool->inject_lock);
+    Task *task = pool->inject_head;
+    if (task) {
+        pool->inject_head = task->next;
+        if (!pool->inject_head) pool->inject_tail = NULL;
+        STORE(&pool->injected, pool->injected - 1, RELEASE);
+    }
+    pthread_mutex_unlock(&pool->inject_lock);
+    return task;
+}
+
+static uint32_t next_random(uint32_t *seed) {
+    uint32_t x = *seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *seed = x;
+}
+
+static Task *steal_any(TaskPool *pool, Worker *self) {
+    static THREAD_LOCAL uint32_t outside_seed = 0x9e3779b9u;
+    size_t count = pool->worker_count;
+    if (count == 0) return NULL;
+
+    size_t start = next_random(self ? &self->seed : &outside_seed) % count;
+    bool contended = true;
+    while (contended) {
+        contended = false;
+        for (size_t i = 0; i < count; i++) {
+            Worker *victim = &pool->workers[(start + i) % count];
+            if (victim == self) continue;
+            Task *task = deque_steal(&victim->deque, &contended);
+            if (task) return task;
+        }
+    }
+    return NULL;
+}
+
+static Task *find_task(TaskPool *pool, Worker *self) {
+    Task *task = self ? deque_pop(&self->deque) : NULL;
+    if (!task) task = inject_pop(pool);
+    if (!task) task = steal_any(pool, self);
+    return task;
+}
+
+/* Wake a sleeping worker after new work. The push must be visible before
+ * the sleeper count is read, which the fence guarantees. */
+static void notify_work(TaskPool *pool) {
+    FENCE(SEQ_CST);
+    if (LOAD(&pool->sleepers, RELAXED) == 0) return;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->epoch++;
+    pthread_cond_signal(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/* A group finished: wake whoever may be waiting for it, a worker in a
+ * nested wait or a thread outside the pool */
+static void notify_done(TaskPool *pool) {
+    FENCE(SEQ_CST);
+    bool sleepers = LOAD(&pool->sleepers, RELAXED) > 0;
+    bool waiters = LOAD(&pool->waiters, RELAXED) > 0;
+    if (!sleepers && !waiters) return;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->epoch++;
+    if (sleepers) pthread_cond_broadcast(&pool->wake);
+    if (waiters) pthread_cond_broadcast(&pool->done);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+static void run_task(TaskPool *pool, Worker *self, Task *task) {
+    TaskGroup *group = task->group;
+    task->fn(task->arg);
+    task_release(self, task);
+
+    /* The waiter may return and drop the group as soon as this hits zero */
+    if (__atomic_sub_fetch(&group->pending, 1, __ATOMIC_SEQ_CST) == 0) {
+        notify_done(pool);
+    }
+}
+
+/* Register as a sleeper, look for work once more, and sleep if there is
+ * none until something changes. Returns a task found on the rescan. */
+static Task *idle_wait(TaskPool *pool, Worker *self, TaskGroup *group) {
+    pthread_mutex_lock(&pool->lock);
+    __atomic_add_fetch(&pool->sleepers, 1, __ATOMIC_SEQ_CST);
+    unsigned long seen = pool->epoch;
+    pthread_mutex_unlock(&pool->lock);
+
+    Task *task = find_task(pool, self);
+
+    pthread_mutex_lock(&pool->lock);
+    while (!task && pool->epoch == seen && !pool->shutdown &&
+           !(group && LOAD(&group->pending, SEQ_CST) == 0)) {
+        pthread_cond_wait(&pool->wake, &pool->lock);
+    }
+    __atomic_sub_fetch(&pool->sleepers, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&pool->lock);
+    return task;
+}
+
+static void *worker_main(void *arg) {
+    Worker *self = (Worker *)arg;
+    TaskPool *pool = self->pool;
+    current_worker = self;
+
+    int idle = 0;
+    while (!LOAD(&pool->shutdown, ACQUIRE)) {
+        Task *task = find_task(pool, self);
+        if (!task && ++idle < IDLE_SPINS) {
+            sched_yield();
+            continue;
+        }
+        if (!task) task = idle_wait(pool, self, NULL);
+        idle = 0;
+        if (task) run_task(pool, self, task);
+    }
+    return NULL;
+}
+
+size_t taskpool_default_size(void) {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        int count = CPU_COUNT(&set);
+        if (count > 0) return (size_t)count;
+    }
+#endif
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return cpus > 0 ? (size_t)cpus : 1;
+}
+
+static void stop_workers(TaskPool *pool, size_t started) {
+    pthread_mutex_lock(&pool->lock);
+    STORE(&pool->shutdown, true, RELEASE);
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (size_t i = 0; i < started; i++) {
+        pthread_join(pool->workers[i].thread, NULL);
+    }
+}
+
+static void free_pool(TaskPool *pool) {
+    for (size_t i = 0; i < pool->worker_count; i++) {
+        Worker *worker = &pool->workers[i];
+        deque_destroy(&worker->deque);
+        while (worker->free_tasks) {
+            Task *task = worker->free_tasks;
+            worker->free_tasks = task->next;
+            xfree(task);
+        }
+    }
+    pthread_mutex_destroy(&pool->inject_lock);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->wake);
+    pthread_cond_destroy(&pool->done);
+    xfree(pool->workers);
+    xfree(pool);
+}
+
+TaskPool *taskpool_create(size_t workers, size_t stack_size) {
+    TaskPool *pool = xcalloc(1, sizeof(TaskPool));
+    pool->workers = xcalloc(workers ? workers : 1, sizeof(Worker));
+    pool->worker_count = workers;
+    pthread_mutex_init(&pool->inject_lock, NULL);
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    /* Every deque exists before any thread can try to steal from it */
+    for (size_t i = 0; i < workers; i++) {
+        deque_init(&pool->workers[i].deque);
+        pool->workers[i].pool = pool;
+        pool->workers[i].seed = (uint32_t)(i + 1) * 2654435761u;
+    }
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    if (stack_size > 0) pthread_attr_setstacksize(&attr, stack_size);
+
+    size_t started = 0;
+    while (started < workers &&
+           pthread_create(&pool->workers[started].thread, &attr, worker_main,
+                          &pool->workers[started]) == 0) {
+        started++;
+    }
+    pthread_attr_destroy(&attr);
+
+    if (started < workers) {
+        stop_workers(pool, started);
+        free_pool(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+void taskpool_destroy(TaskPool *pool) {
+    if (!pool) return;
+    stop_workers(pool, pool->worker_count);
+    free_pool(pool);
+}
+
+size_t taskpool_workers(const TaskPool *pool) {
+    return pool ? pool->worker_count : 0;
+}
+
+/* ===== GROUPS ===== */
+
+void taskgroup_init(TaskGroup *group, TaskPool *pool) {
+    group->pool = pool;
+    group->pending = 0;
+}
+
+void taskgroup_spawn(TaskGroup *group, TaskFn fn, void *arg) {
+    TaskPool *pool = group->pool;
+    if (!pool) {
+        fn(arg);
+        return;
+    }
+
+    Worker *self = worker_of(pool);
+    Task *task = task_acquire(self);
+    task->fn = fn;
+    task->arg = arg;
+    task->group = group;
+    __atomic_add_fetch(&group->pending, 1, __ATOMIC_RELAXED);
+
+    if (self) {
+        deque_push(&self->deque, task);
+    } else {
+        inject_push(pool, task);
+    }
+    notify_work(pool);
+}
+
+void taskgroup_wait(TaskGroup *group) {
+    TaskPool *pool = group->pool;
+    if (!pool) return;
+
+    Worker *self = worker_of(pool);
+    if (!self && pool->worker_count > 0) {
+        /* Outside the pool: running stolen work here could nest without
+         * bound on a stack the pool does not control, so just sleep */
+        pthread_mutex_lock(&pool->lock);
+        __atomic_add_fetch(&pool->waiters, 1, __ATOMIC_SEQ_CST);
+        while (LOAD(&group->pending, SEQ_CST) > 0) {
+            pthread_cond_wait(&pool->done, &pool->lock);
+        }
+        __atomic_sub_fetch(&pool->waiters, 1, __ATOMIC_SEQ_CST);
+        pthread_mutex_unlock(&pool->lock);
+        return;
+    }
+
+    int idle = 0;
+    while (LOAD(&group->pending, ACQUIRE) > 0) {
+        Task *task = find_task(pool, self);
+        if (!task && ++idle < IDLE_SPINS) {
+            sched_yield();
+            continue;
+        }
+        if (!task) task = idle_wait(pool, self, group);
+        idle = 0;
+        if (task) run_task(pool, self, task);
+    }
+}
+
+/* ===== PARALLEL FOR ===== */
+
+typedef struct {
+    TaskGroup *group;
+    TaskRangeFn fn;
+    void *ctx;
+    size_t lo;
+    size_t hi;
+    size_t grain;
+} RangeTask;
+
+/* Hand off the upper half until the rest is small enough, then run it */
+static void run_range(void *arg) {
+    RangeTask *range = (RangeTask *)arg;
+    while (range->hi - range->lo > range->grain) {
+        size_t mid = range->lo + (range->hi - range->lo) / 2;
+        RangeTask *upper = xmalloc(sizeof(RangeTask));
+        *upper = *range;
+        upper->lo = mid;
+        range->hi = mid;
+        taskgroup_spawn(range->group, run_range, upper);
+    }
+    range->fn(range->ctx, range->lo, range->hi);
+    xfree(range);
+}
+
+void taskpool_parallel_for(TaskPool *pool, size_t begin, size_t end, size_t grain,
+                           TaskRangeFn fn, void *ctx) {
+    if (begin >= end) return;
+    if (!pool || pool->worker_count == 0) {
+        fn(ctx, begin, end);
+        return;
+    }
+
+    /* A few pieces per thread leaves room to balance uneven items */
+    if (grain == 0) {
+        grain = (end - begin) / ((pool->worker_count + 1) * 4);
+        if (grain == 0) grain = 1;
+    }
+
+    TaskGroup group;
+    taskgroup_init(&group, pool);
+
+    RangeTask *root = xmalloc(sizeof(RangeTask));
+    *root = (RangeTask){.group = &group, .fn = fn, .ctx = ctx, .lo = begin, .hi = end, .grain = grain};
+    run_range(root);
+    taskgroup_wait(&group);
+}
+
+/* ===== ORDERED RESULTS ===== */
+
+void task_order_init(TaskOrder *order, size_t count, TaskEmitFn emit, void *ctx) {
+    order->done = xcalloc(count ? count : 1, sizeof(bool));
+    order->count = count;
+    order->next = 0;
+    order->emit = emit;
+    order->ctx = ctx;
+    pthread_mutex_init(&order->lock, NULL);
+}
+
+void task_order_complete(TaskOrder *order, size_t index) {
+    pthread_mutex_lock(&order->lock);
+    order->done[index] = true;
+    while (order->next < order->count && order->done[order->next]) {
+        order->emit(order->ctx, order->next++);
+    }
+    pthread_mutex_unlock(&order->lock);
+}
+
+void task_order_destroy(TaskOrder *order) {
+    xfree(order->done);
+    pthread_mutex_destroy(&order->lock);
+}
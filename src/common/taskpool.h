@@ -0,0 +1,76 @@
+#ifndef TASKPOOL_H
+#define TASKPOOL_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+/* Work-stealing task scheduler.
+ *
+ * Every worker owns a Chase-Lev deque: it pushes and pops its own tasks at
+ * the bottom (newest first, which keeps nested work cache-warm and the
+ * stack shallow) while idle workers steal from the top (oldest first, the
+ * biggest pieces of a divide-and-conquer split). Tasks spawned from threads
+ * outside the pool go through a shared injection queue.
+ *
+ * Tasks belong to a group. A worker waiting on a group does not block:
+ * it runs queued tasks, its own group's or any other, until the group is
+ * done, and only sleeps when there is nothing to run, so nested fork-join
+ * from inside tasks cannot deadlock the pool. A thread outside the pool
+ * sleeps while it waits. A pool without workers is valid: everything then
+ * runs on the waiting thread. */
+
+typedef struct TaskPool TaskPool;
+
+typedef void (*TaskFn)(void *arg);
+
+/* Tasks whose completion is awaited together; lives on the waiter's stack */
+typedef struct {
+    TaskPool *pool;             /* NULL: tasks run immediately on spawn */
+    long pending;               /* Spawned and not yet finished */
+} TaskGroup;
+
+/* CPUs this process may run on (its affinity mask), at least 1 */
+size_t taskpool_default_size(void);
+
+/* Start `workers` threads, each with a stack of `stack_size` bytes (0 for
+ * the system default). Returns NULL if a thread cannot be started. */
+TaskPool *taskpool_create(size_t workers, size_t stack_size);
+
+/* Stop the workers; every group must have been waited for */
+void taskpool_destroy(TaskPool *pool);
+
+size_t taskpool_workers(const TaskPool *pool);
+
+void taskgroup_init(TaskGroup *group, TaskPool *pool);
+void taskgroup_spawn(TaskGroup *group, TaskFn fn, void *arg);
+void taskgroup_wait(TaskGroup *group);
+
+/* Call fn(ctx, lo, hi) over disjoint subranges covering [begin, end) and
+ * return when all are done. Ranges are split in halves down to `grain`
+ * items (0 picks one from the pool size). */
+typedef void (*TaskRangeFn)(void *ctx, size_t lo, size_t hi);
+void taskpool_parallel_for(TaskPool *pool, size_t begin, size_t end, size_t grain,
+                           TaskRangeFn fn, void *ctx);
+
+/* Deterministic ordering. Results computed in parallel finish in any
+ * order; a TaskOrder releases them strictly by index. After
+ * task_order_complete(order, i), emit(ctx, j) runs for every j whose
+ * predecessors are all complete, in increasing order and never two at a
+ * time, on whichever thread completed the last missing index. */
+typedef void (*TaskEmitFn)(void *ctx, size_t index);
+
+typedef struct {
+    bool *done;
+    size_t count;
+    size_t next;                /* First index not yet emitted */
+    TaskEmitFn emit;
+    void *ctx;
+    pthread_mutex_t lock;
+} TaskOrder;
+
+void task_order_init(TaskOrder *order, size_t count, TaskEmitFn emit, void *ctx);
+void task_order_complete(TaskOrder *order, size_t index);
+void task_order_destroy(TaskOrder *order);
+
+#endif /* TASKPOOL_H */
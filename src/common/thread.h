@@ -0,0 +1,14 @@
+#ifndef THREAD_H
+#define THREAD_H
+
+#include <pthread.h>
+
+/* Thread-local storage qualifier. The tree builds as C99, which has no
+ * _Thread_local, so use the GNU spelling every supported compiler accepts. */
+#if defined(__GNUC__) || defined(__clang__)
+#define THREAD_LOCAL __thread
+#else
+#define THREAD_LOCAL _Thread_local
+#endif
+
+#endif /* THREAD_H */
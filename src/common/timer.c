@@ -0,0 +1,260 @@
+#define _POSIX_C_SOURCE 200809L
+#include "timer.h"
+#include "memory.h"
+#include "thread.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Deepest nesting kept per thread; deeper regions are not recorded */
+#define TIMER_MAX_DEPTH 64
+
+typedef struct {
+    const char *name;
+    char *detail;
+    uint64_t start;             /* Nanoseconds since recording started */
+    uint64_t duration;
+} TimerEvent;
+
+typedef struct TimerThread {
+    size_t id;                  /* Trace tid, in order of first use */
+    TimerEvent open[TIMER_MAX_DEPTH];
+    size_t depth;               /* Open regions, including unrecorded ones */
+    TimerEvent *events;         /* Finished regions, in order of ending */
+    size_t count;
+    size_t capacity;
+    struct TimerThread *next;
+} TimerThread;
+
+static bool g_recording;
+static bool g_pass_timing;
+static uint64_t g_origin;
+static pthread_mutex_t g_threads_lock = PTHREAD_MUTEX_INITIALIZER;
+static TimerThread *g_threads;          /* Kept after their threads exit */
+static size_t g_thread_count;
+static THREAD_LOCAL TimerThread *t_timer;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static TimerThread *timer_thread(void) {
+    if (t_timer) return t_timer;
+    TimerThread *thread = xcalloc(1, sizeof(TimerThread));
+    pthread_mutex_lock(&g_threads_lock);
+    thread->id = g_thread_count++;
+    thread->next = g_threads;
+    g_threads = thread;
+    pthread_mutex_unlock(&g_threads_lock);
+    t_timer = thread;
+    return thread;
+}
+
+uint64_t timer_now(void) {
+    return now_ns();
+}
+
+void timer_start_recording(void) {
+    if (timer_recording()) return;
+    g_origin = now_ns();
+    __atomic_store_n(&g_recording, true, __ATOMIC_RELEASE);
+}
+
+bool timer_recording(void) {
+    return __atomic_load_n(&g_recording, __ATOMIC_ACQUIRE);
+}
+
+void timer_enable_pass_timing(void) {
+    __atomic_store_n(&g_pass_timing, true, __ATOMIC_RELAXED);
+}
+
+bool timer_pass_timing(void) {
+    return __atomic_load_n(&g_pass_timing, __ATOMIC_RELAXED);
+}
+
+void timer_begin(const char *name, const char *detail) {
+    if (!timer_recording()) return;
+    TimerThread *thread = timer_thread();
+    if (thread->depth < TIMER_MAX_DEPTH) {
+        TimerEvent *event = &thread->open[thread->depth];
+        event->name = name;
+        event->detail = detail ? xstrdup(detail) : NULL;
+        event->start = now_ns() - g_origin;
+    }
+    thread->depth++;
+}
+
+void timer_end(void) {
+    if (!timer_recording()) return;
+    TimerThread *thread = timer_thread();
+    if (thread->depth == 0) return;
+    thread->depth--;
+    if (thread->depth >= TIMER_MAX_DEPTH) return;
+
+    TimerEvent *event = &thread->open[thread->depth];
+    event->duration = now_ns() - g_origin - event->start;
+
+    /* The buffer is only read once the threads are done with it */
+    if (thread->count == thread->capacity) {
+        thread->capacity = thread->capacity ? thread->capacity * 2 : 256;
+        thread->events = xrealloc(thread->events, thread->capacity * sizeof(TimerEvent));
+    }
+    thread->events[thread->count++] = *event;
+}
+
+/* ===== REPORT ===== */
+
+typedef struct ReportNode {
+    const char *name;
+    uint64_t total;
+    size_t count;
+    struct ReportNode **children;
+    size_t child_count;
+} ReportNode;
+
+static ReportNode *report_child(ReportNode *parent, const char *name) {
+    for (size_t i = 0; i < parent->child_count; i++) {
+        if (strcmp(parent->children[i]->name, name) == 0) return parent->children[i];
+    }
+    ReportNode *child = xcalloc(1, sizeof(ReportNode));
+    child->name = name;
+    parent->children = xrealloc(parent->children, (parent->child_count + 1) * sizeof(ReportNode *));
+    parent->children[parent->child_count++] = child;
+    return child;
+}
+
+/* Outer regions first: earlier start, then longer */
+static int compare_events(const void *a, const void *b) {
+    const TimerEvent *x = (const TimerEvent *)a, *y = (const TimerEvent *)b;
+    if (x->start != y->start) return x->start < y->start ? -1 : 1;
+    return (x->duration < y->duration) - (x->duration > y->duration);
+}
+
+/* Rebuild the nesting of one thread's regions from their extents */
+static void add_thread(ReportNode *root, TimerThread *thread) {
+    TimerEvent *events = xmalloc((thread->count + 1) * sizeof(TimerEvent));
+    memcpy(events, thread->events, thread->count * sizeof(TimerEvent));
+    qsort(events, thread->count, sizeof(TimerEvent), compare_events);
+
+    ReportNode *stack[TIMER_MAX_DEPTH + 1];
+    uint64_t ends[TIMER_MAX_DEPTH + 1];
+    size_t depth = 0;
+    for (size_t i = 0; i < thread->count; i++) {
+        TimerEvent *event = &events[i];
+        while (depth > 0 && ends[depth - 1] < event->start + event->duration) depth--;
+        ReportNode *node = report_child(depth > 0 ? stack[depth - 1] : root, event->name);
+        node->total += event->duration;
+        node->count++;
+        if (depth <= TIMER_MAX_DEPTH) {
+            stack[depth] = node;
+            ends[depth] = event->start + event->duration;
+            depth++;
+        }
+    }
+    xfree(events);
+}
+
+static int compare_nodes(const void *a, const void *b) {
+    const ReportNode *x = *(const ReportNode *const *)a;
+    const ReportNode *y = *(const ReportNode *const *)b;
+    return (x->total < y->total) - (x->total > y->total);
+}
+
+static void print_node(FILE *out, ReportNode *node, int indent, uint64_t run) {
+    qsort(node->children, node->child_count, sizeof(ReportNode *), compare_nodes);
+    for (size_t i = 0; i < node->child_count; i++) {
+        ReportNode *child = node->children[i];
+        int pad = 40 - 2 * indent;
+        fprintf(out, "%*s%-*s %10.3f %8zu %6.1f%%\n", 2 * indent, "", pad > 0 ? pad : 0, child->name,
+                child->total / 1e6, child->count, run ? 100.0 * (double)child->total / (double)run : 0.0);
+        print_node(out, child, indent + 1, run);
+    }
+}
+
+static void free_node(ReportNode *node) {
+    for (size_t i = 0; i < node->child_count; i++) {
+        free_node(node->children[i]);
+        xfree(node->children[i]);
+    }
+    xfree(node->children);
+}
+
+void timer_report(FILE *out) {
+    ReportNode root = {0};
+    uint64_t run = now_ns() - g_origin;
+
+    pthread_mutex_lock(&g_threads_lock);
+    for (TimerThread *thread = g_threads; thread; thread = thread->next) {
+        add_thread(&root, thread);
+    }
+    pthread_mutex_unlock(&g_threads_lock);
+
+    fprintf(out, "\n");
+    fprintf(out, "=================================================================\n");
+    fprintf(out, "                    TIME REPORT\n");
+    fprintf(out, "=================================================================\n");
+    fprintf(out, "Total wall time: %.3f ms\n", run / 1e6);
+    fprintf(out, "%-40s %10s %8s %7s\n", "Region", "ms", "count", "share");
+    print_node(out, &root, 0, run);
+    fprintf(out, "=================================================================\n");
+    free_node(&root);
+}
+
+/* ===== TRACE ===== */
+
+static void write_json_string(FILE *out, const char *s) {
+    fputc('"', out);
+    for (const unsigned char *p = (const unsigned char *)s; *p; p++) {
+        if (*p == '"' || *p == '\\') {
+            fprintf(out, "\\%c", *p);
+        } else if (*p < 0x20) {
+            fprintf(out, "\\u%04x", *p);
+        } else {
+            fputc(*p, out);
+        }
+    }
+    fputc('"', out);
+}
+
+bool timer_write_trace(const char *path) {
+    FILE *out = fopen(path, "w");
+    if (!out) {
+        fprintf(stderr, "Error: cannot write time trace '%s'\n", path);
+        return false;
+    }
+
+    long pid = (long)getpid();
+    bool first = true;
+    fprintf(out, "{\"traceEvents\":[\n");
+    pthread_mutex_lock(&g_threads_lock);
+    for (TimerThread *thread = g_threads; thread; thread = thread->next) {
+        fprintf(out, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%ld,\"tid\":%zu,"
+                "\"args\":{\"name\":\"%s %zu\"}}",
+                first ? "" : ",\n", pid, thread->id, thread->id == 0 ? "main" : "thread", thread->id);
+        first = false;
+        for (size_t i = 0; i < thread->count; i++) {
+            TimerEvent *event = &thread->events[i];
+            fprintf(out, ",\n{\"name\":");
+            write_json_string(out, event->name);
+            fprintf(out, ",\"cat\":\"llvm-c\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%ld,\"tid\":%zu",
+                    event->start / 1e3, event->duration / 1e3, pid, thread->id);
+            if (event->detail) {
+                fprintf(out, ",\"args\":{\"detail\":");
+                write_json_string(out, event->detail);
+                fputc('}', out);
+            }
+            fputc('}', out);
+        }
+    }
+    pthread_mutex_unlock(&g_threads_lock);
+    fprintf(out, "\n],\"displayTimeUnit\":\"ms\"}\n");
+
+    bool ok = !ferror(out);
+    if (fclose(out) != 0) ok = false;
+    if (!ok) fprintf(stderr, "Error: cannot write time trace '%s'\n", path);
+    return ok;
+}
@@ -0,0 +1,42 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* Hierarchical wall-clock timers.
+ *
+ * timer_begin/timer_end bracket a region on the calling thread; regions
+ * nest, and each thread keeps its own stack of open regions and its own
+ * buffer of finished ones, so timing compile threads takes no lock. Until
+ * timer_start_recording is called both are a single load and return.
+ *
+ * `name` must outlive the recording (a string literal); `detail` (a
+ * function or file name, may be NULL) is copied. */
+
+void timer_start_recording(void);
+bool timer_recording(void);
+
+/* Also have the backend time its own passes. LLVM has no hook to feed
+ * these into our regions, so it prints its table to stderr after each
+ * pipeline run; the pipeline itself is a region here. */
+void timer_enable_pass_timing(void);
+bool timer_pass_timing(void);
+
+void timer_begin(const char *name, const char *detail);
+void timer_end(void);
+
+/* Monotonic clock in nanoseconds, for callers that keep their own
+ * measurements; works whether or not recording */
+uint64_t timer_now(void);
+
+/* Regions merged by their path of names, as an indented table of total
+ * time, count and share of the run; regions on different threads add up */
+void timer_report(FILE *out);
+
+/* Every region as a Chrome trace event ("ph":"X", microseconds), for
+ * chrome://tracing, Perfetto or speedscope */
+bool timer_write_trace(const char *path);
+
+#endif /* TIMER_H */
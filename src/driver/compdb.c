@@ -0,0 +1,545 @@
+#define _POSIX_C_SOURCE 200809L
+#include "compdb.h"
+#include "../common/error.h"
+#include "../common/hash.h"
+#include "../common/memory.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Number of slowest units listed after a build */
+#define COMPDB_SLOWEST_REPORT 10
+
+/* ===== JSON READER =====
+ * Just enough JSON for compilation databases: an array of objects whose
+ * interesting members are strings or arrays of strings. */
+
+typedef struct {
+    const char *p;
+    const char *end;
+    bool failed;
+} JsonReader;
+
+static void json_skip_ws(JsonReader *r) {
+    while (r->p < r->end && (*r->p == ' ' || *r->p == '\t' || *r->p == '\n' || *r->p == '\r')) {
+        r->p++;
+    }
+}
+
+static bool json_consume(JsonReader *r, char c) {
+    json_skip_ws(r);
+    if (r->p < r->end && *r->p == c) {
+        r->p++;
+        return true;
+    }
+    return false;
+}
+
+static void json_put_utf8(char *out, size_t *len, unsigned cp) {
+    if (cp < 0x80) {
+        out[(*len)++] = (char)cp;
+    } else if (cp < 0x800) {
+        out[(*len)++] = (char)(0xC0 | (cp >> 6));
+        out[(*len)++] = (char)(0x80 | (cp & 0x3F));
+    } else {
+        out[(*len)++] = (char)(0xE0 | (cp >> 12));
+        out[(*len)++] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        out[(*len)++] = (char)(0x80 | (cp & 0x3F));
+    }
+}
+
+static char *json_parse_string(JsonReader *r) {
+    if (!json_consume(r, '"')) {
+        r->failed = true;
+        return NULL;
+    }
+
+    /* Decoded text is never longer than the escaped source */
+    const char *start = r->p;
+    while (r->p < r->end && *r->p != '"') {
+        if (*r->p == '\\') r->p++;
+        r->p++;
+    }
+    if (r->p >= r->end) {
+        r->failed = true;
+        return NULL;
+    }
+
+    char *out = xmalloc((size_t)(r->p - start) + 1);
+    size_t len = 0;
+    for (const char *s = start; s < r->p; s++) {
+        if (*s != '\\') {
+            out[len++] = *s;
+            continue;
+        }
+        s++;
+        switch (*s) {
+            case 'b': out[len++] = '\b'; break;
+            case 'f': out[len++] = '\f'; break;
+            case 'n': out[len++] = '\n'; break;
+            case 'r': out[len++] = '\r'; break;
+            case 't': out[len++] = '\t'; break;
+            case 'u': {
+                unsigned cp = 0;
+                for (int i = 0; i < 4 && s + 1 < r->p; i++) {
+                    char h = *++s;
+                    cp = cp * 16 + (unsigned)(h >= 'a' ? h - 'a' + 10 : h >= 'A' ? h - 'A' + 10 : h - '0');
+                }
+                json_put_utf8(out, &len, cp);
+                break;
+            }
+            default: out[len++] = *s; break;   /* \" \\ \/ */
+        }
+    }
+    out[len] = '\0';
+    r->p++;     /* Closing quote */
+    return out;
+}
+
+static void json_skip_value(JsonReader *r) {
+    json_skip_ws(r);
+    if (r->p >= r->end) {
+        r->failed = true;
+        return;
+    }
+
+    if (*r->p == '"') {
+        xfree(json_parse_string(r));
+    } else if (*r->p == '[' || *r->p == '{') {
+        char close = *r->p == '[' ? ']' : '}';
+        r->p++;
+        if (json_consume(r, close)) return;
+        do {
+            if (close == '}') {
+                xfree(json_parse_string(r));
+                if (!json_consume(r, ':')) r->failed = true;
+            }
+            json_skip_value(r);
+        } while (!r->failed && json_consume(r, ','));
+        if (!json_consume(r, close)) r->failed = true;
+    } else {
+        /* Number, true, false, null */
+        while (r->p < r->end && !strchr(",]} \t\r\n", *r->p)) r->p++;
+    }
+}
+
+static char **json_parse_string_array(JsonReader *r, size_t *count) {
+    *count = 0;
+    if (!json_consume(r, '[')) {
+        r->failed = true;
+        return NULL;
+    }
+
+    size_t capacity = 16;
+    char **items = xmalloc(capacity * sizeof(char *));
+    if (!json_consume(r, ']')) {
+        do {
+            char *item = json_parse_string(r);
+            if (!item) break;
+            if (*count == capacity) {
+                capacity *= 2;
+                items = xrealloc(items, capacity * sizeof(char *));
+            }
+            items[(*count)++] = item;
+        } while (json_consume(r, ','));
+        if (!json_consume(r, ']')) r->failed = true;
+    }
+    return items;
+}
+
+/* ===== COMMAND SPLITTING ===== */
+
+/* Split a "command" string the way /bin/sh would (quotes and backslashes,
+ * no expansions) */
+static char **split_command(const char *command, size_t *count) {
+    size_t capacity = 16;
+    char **args = xmalloc(capacity * sizeof(char *));
+    char *word = xmalloc(strlen(command) + 1);
+    *count = 0;
+
+    const char *p = command;
+    for (;;) {
+        while (*p == ' ' || *p == '\t' || *p == '\n') p++;
+        if (!*p) break;
+
+        size_t len = 0;
+        while (*p && *p != ' ' && *p != '\t' && *p != '\n') {
+            if (*p == '\'') {
+                p++;
+                while (*p && *p != '\'') word[len++] = *p++;
+                if (*p) p++;
+            } else if (*p == '"') {
+                p++;
+                while (*p && *p != '"') {
+                    if (*p == '\\' && p[1] && strchr("\"\\$`", p[1])) p++;
+                    word[len++] = *p++;
+                }
+                if (*p) p++;
+            } else if (*p == '\\' && p[1]) {
+                word[len++] = p[1];
+                p += 2;
+            } else {
+                word[len++] = *p++;
+            }
+        }
+
+        if (*count == capacity) {
+            capacity *= 2;
+            args = xrealloc(args, capacity * sizeof(char *));
+        }
+        args[(*count)++] = xstrndup(word, len);
+    }
+
+    xfree(word);
+    return args;
+}
+
+/* ===== LOADING ===== */
+
+static void compile_command_free(CompileCommand *cmd) {
+    xfree(cmd->directory);
+    xfree(cmd->file);
+    xfree(cmd->output);
+    for (size_t i = 0; i < cmd->argument_count; i++) {
+        xfree(cmd->arguments[i]);
+    }
+    xfree(cmd->arguments);
+}
+
+static bool parse_entry(JsonReader *r, CompileCommand *cmd) {
+    memset(cmd, 0, sizeof(*cmd));
+    char *command = NULL;
+
+    if (!json_consume(r, '{')) return false;
+    if (!json_consume(r, '}')) {
+        do {
+            char *key = json_parse_string(r);
+            if (!key || !json_consume(r, ':')) {
+                xfree(key);
+                r->failed = true;
+                break;
+            }
+
+            if (strcmp(key, "directory") == 0) {
+                xfree(cmd->directory);
+                cmd->directory = json_parse_string(r);
+            } else if (strcmp(key, "file") == 0) {
+                xfree(cmd->file);
+                cmd->file = json_parse_string(r);
+            } else if (strcmp(key, "output") == 0) {
+                xfree(cmd->output);
+                cmd->output = json_parse_string(r);
+            } else if (strcmp(key, "command") == 0) {
+                xfree(command);
+                command = json_parse_string(r);
+            } else if (strcmp(key, "arguments") == 0 && !cmd->arguments) {
+                cmd->arguments = json_parse_string_array(r, &cmd->argument_count);
+            } else {
+                json_skip_value(r);
+            }
+            xfree(key);
+        } while (!r->failed && json_consume(r, ','));
+        if (!json_consume(r, '}')) r->failed = true;
+    }
+
+    /* "arguments" wins over "command" when both are present */
+    if (!cmd->arguments && command) {
+        cmd->arguments = split_command(command, &cmd->argument_count);
+    }
+    xfree(command);
+
+    if (r->failed || !cmd->directory || !cmd->file) {
+        compile_command_free(cmd);
+        return false;
+    }
+    return true;
+}
+
+CompileDatabase *compdb_load(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        fprintf(diagnostic_stream(), "Error: cannot open compilation database '%s'\n", path);
+        return NULL;
+    }
+
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    if (size < 0) size = 0;
+
+    char *text = xmalloc((size_t)size + 1);
+    size_t len = fread(text, 1, (size_t)size, f);
+    text[len] = '\0';
+    fclose(f);
+
+    JsonReader r = {.p = text, .end = text + len, .failed = false};
+    CompileDatabase *db = xcalloc(1, sizeof(CompileDatabase));
+    size_t capacity = 0;
+
+    bool ok = json_consume(&r, '[');
+    if (ok && !json_consume(&r, ']')) {
+        do {
+            if (db->count == capacity) {
+                capacity = capacity ? capacity * 2 : 64;
+                db->entries = xrealloc(db->entries, capacity * sizeof(CompileCommand));
+            }
+            if (!parse_entry(&r, &db->entries[db->count])) {
+                ok = false;
+                break;
+            }
+            db->count++;
+        } while (json_consume(&r, ','));
+        ok = ok && json_consume(&r, ']');
+    }
+
+    xfree(text);
+
+    if (!ok) {
+        fprintf(diagnostic_stream(), "Error: malformed compilation database '%s'\n", path);
+        compdb_destroy(db);
+        return NULL;
+    }
+    return db;
+}
+
+void compdb_destroy(CompileDatabase *db) {
+    if (!db) return;
+    for (size_t i = 0; i < db->count; i++) {
+        compile_command_free(&db->entries[i]);
+    }
+    xfree(db->entries);
+    xfree(db);
+}
+
+/* ===== BUILD ===== */
+
+/* Per-entry state that must outlive the compile */
+typedef struct {
+    DriverOptions opts;
+    char *input;
+    char *dep_file;
+    PreprocessorFlag *pp_flags; /* Values owned */
+    size_t pp_flag_count;
+} BuildEntry;
+
+static char *join_path(const char *dir, const char *path) {
+    if (!path) return NULL;
+    if (path[0] == '/' || !dir || !*dir) return xstrdup(path);
+
+    size_t dir_len = strlen(dir);
+    size_t path_len = strlen(path);
+    char *joined = xmalloc(dir_len + path_len + 2);
+    memcpy(joined, dir, dir_len);
+    joined[dir_len] = '/';
+    memcpy(joined + dir_len + 1, path, path_len + 1);
+    return joined;
+}
+
+/* "src/foo.c" -> "<dir>/foo.o" */
+static char *default_object_path(const char *dir, const char *file) {
+    const char *base = strrchr(file, '/');
+    base = base ? base + 1 : file;
+    const char *dot = strrchr(base, '.');
+    size_t stem_len = dot && dot != base ? (size_t)(dot - base) : strlen(base);
+
+    char *name = xmalloc(stem_len + 3);
+    memcpy(name, base, stem_len);
+    memcpy(name + stem_len, ".o", 3);
+
+    char *path = join_path(dir, name);
+    xfree(name);
+    return path;
+}
+
+/* The value of `flag` given as "<flag>value" or "<flag> value", advancing
+ * past a separate value; NULL if argument `*i` is not `flag` */
+static const char *flag_value(const CompileCommand *cmd, size_t *i, const char *flag) {
+    const char *arg = cmd->arguments[*i];
+    size_t len = strlen(flag);
+    if (strncmp(arg, flag, len) != 0) return NULL;
+    if (arg[len] != '\0') return arg + len;
+    if (*i + 1 >= cmd->argument_count) return NULL;
+    return cmd->arguments[++*i];
+}
+
+static void add_pp_flag(BuildEntry *entry, PreprocessorFlagKind kind, char *value) {
+    entry->pp_flags = xrealloc(entry->pp_flags, (entry->pp_flag_count + 1) * sizeof(PreprocessorFlag));
+    entry->pp_flags[entry->pp_flag_count].kind = kind;
+    entry->pp_flags[entry->pp_flag_count].value = value;
+    entry->pp_flag_count++;
+}
+
+/* Apply the flags of one database entry that this compiler understands;
+ * everything else (-W..., -std=, the compiler name) is ignored. Include
+ * directories are relative to the entry's directory. Returns the -o
+ * argument, if any. */
+static const char *apply_entry_flags(const CompileCommand *cmd, BuildEntry *entry) {
+    DriverOptions *opts = &entry->opts;
+    const char *output = NULL;
+    bool saw_mmd = false;
+
+    for (size_t i = 1; i < cmd->argument_count; i++) {
+        const char *arg = cmd->arguments[i];
+        bool has_next = i + 1 < cmd->argument_count;
+        const char *value;
+
+        if ((value = flag_value(cmd, &i, "-I")) != NULL) {
+            add_pp_flag(entry, PP_FLAG_INCLUDE, join_path(cmd->directory, value));
+        } else if ((value = flag_value(cmd, &i, "-isystem")) != NULL) {
+            add_pp_flag(entry, PP_FLAG_SYSTEM_INCLUDE, join_path(cmd->directory, value));
+        } else if ((value = flag_value(cmd, &i, "-D")) != NULL) {
+            add_pp_flag(entry, PP_FLAG_DEFINE, xstrdup(value));
+        } else if ((value = flag_value(cmd, &i, "-U")) != NULL) {
+            add_pp_flag(entry, PP_FLAG_UNDEFINE, xstrdup(value));
+        } else if (strcmp(arg, "-o") == 0 && has_next) {
+            output = cmd->arguments[++i];
+        } else if (strncmp(arg, "-O", 2) == 0) {
+            char level = arg[2];
+            if (level >= '0' && level <= '3') {
+                opts->opt_level = level - '0';
+            } else if (level == 's' || level == 'z') {
+                opts->opt_level = 2;
+            } else if (level == '\0') {
+                opts->opt_level = 1;
+            }
+        } else if (strncmp(arg, "-g", 2) == 0) {
+            opts->debug_info = strcmp(arg, "-g0") != 0;
+        } else if (strcmp(arg, "-S") == 0) {
+            opts->emit_assembly = true;
+        } else if (strcmp(arg, "--emit-llvm") == 0) {
+            opts->emit_llvm = true;
+        } else if (strncmp(arg, "--target=", 9) == 0) {
+            opts->target_triple = arg + 9;
+        } else if (strcmp(arg, "-target") == 0 && has_next) {
+            opts->target_triple = cmd->arguments[++i];
+        } else if (strcmp(arg, "-MMD") == 0) {
+            saw_mmd = true;
+        } else if (strcmp(arg, "-MF") == 0 && has_next) {
+            opts->dep_file = cmd->arguments[++i];
+        } else if (strcmp(arg, "-MT") == 0 && has_next) {
+            opts->dep_target = cmd->arguments[++i];
+        }
+    }
+
+    /* Skipping unchanged entries needs a depfile for every entry */
+    opts->dep_requested = true;
+    opts->dep_system_headers = !saw_mmd;
+    opts->pp_flags = entry->pp_flags;
+    opts->pp_flag_count = entry->pp_flag_count;
+    return output;
+}
+
+static int compare_slowest(const void *a, const void *b) {
+    const DriverUnit *ua = *(const DriverUnit *const *)a;
+    const DriverUnit *ub = *(const DriverUnit *const *)b;
+    return (ua->seconds < ub->seconds) - (ua->seconds > ub->seconds);
+}
+
+int compdb_build(const char *path, const DriverOptions *base) {
+    CompileDatabase *db = compdb_load(path);
+    if (!db) return 1;
+    if (db->count == 0) {
+        printf("Nothing to build: %s is empty\n", path);
+        compdb_destroy(db);
+        return 0;
+    }
+
+    BuildEntry *entries = xcalloc(db->count, sizeof(BuildEntry));
+    DriverUnit *units = xcalloc(db->count, sizeof(DriverUnit));
+
+    for (size_t i = 0; i < db->count; i++) {
+        const CompileCommand *cmd = &db->entries[i];
+        BuildEntry *entry = &entries[i];
+
+        entry->opts = *base;
+        entry->opts.output_file = NULL;
+        entry->opts.dep_file = NULL;
+        entry->opts.dep_target = NULL;
+        entry->opts.compile_only = true;
+        entry->opts.skip_if_up_to_date = true;
+
+        const char *output = apply_entry_flags(cmd, entry);
+        if (cmd->output) output = cmd->output;
+
+        /* Paths in an entry are relative to its directory */
+        entry->input = join_path(cmd->directory, cmd->file);
+        if (entry->opts.dep_file) {
+            entry->dep_file = join_path(cmd->directory, entry->opts.dep_file);
+            entry->opts.dep_file = entry->dep_file;
+        }
+
+        /* An entry's own flags invalidate its output like a header edit */
+        Hash64 hash;
+        hash64_init(&hash);
+        hash64_update(&hash, &base->command_hash, sizeof(base->command_hash));
+        for (size_t a = 0; a < cmd->argument_count; a++) {
+            hash64_update_str(&hash, cmd->arguments[a]);
+        }
+
+        /* So do its search paths and macros, with relative directories as
+         * resolved against the entry's directory */
+        for (size_t f = 0; f < entry->pp_flag_count; f++) {
+            uint32_t kind = (uint32_t)entry->pp_flags[f].kind;
+            hash64_update(&hash, &kind, sizeof(kind));
+            hash64_update_str(&hash, entry->pp_flags[f].value);
+        }
+        entry->opts.command_hash = hash64_final(&hash);
+
+        units[i].input = entry->input;
+        units[i].output = output ? join_path(cmd->directory, output)
+                                 : default_object_path(cmd->directory, cmd->file);
+        units[i].opts = &entry->opts;
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    size_t failed = driver_compile_units(base, units, db->count);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double total = (double)(end.tv_sec - start.tv_sec) +
+                   (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+
+    /* Summary: slowest units first */
+    DriverUnit **order = xmalloc(db->count * sizeof(DriverUnit *));
+    size_t compiled = 0, skipped = 0, cached = 0;
+    for (size_t i = 0; i < db->count; i++) {
+        order[i] = &units[i];
+        if (units[i].skipped) {
+            skipped++;
+        } else if (units[i].cached) {
+            cached++;
+        } else {
+            compiled++;
+        }
+    }
+    qsort(order, db->count, sizeof(DriverUnit *), compare_slowest);
+
+    if (compiled > 0) {
+        printf("\nSlowest translation units:\n");
+        for (size_t i = 0; i < db->count && i < COMPDB_SLOWEST_REPORT; i++) {
+            if (order[i]->skipped || order[i]->cached) continue;
+            printf("  %10.1f ms  %s\n", order[i]->seconds * 1000.0, order[i]->input);
+        }
+    }
+    printf("Built %zu, cached %zu, up to date %zu, failed %zu of %zu translation unit(s) in %.2f s\n",
+           compiled - failed, cached, skipped, failed, db->count, total);
+
+    bool report_ok = !base->function_report ||
+                     driver_write_function_report(base->function_report, units, db->count);
+
+    xfree(order);
+    for (size_t i = 0; i < db->count; i++) {
+        xfree(units[i].output);
+        xfree(entries[i].input);
+        xfree(entries[i].dep_file);
+        for (size_t f = 0; f < entries[i].pp_flag_count; f++) {
+            xfree((char *)entries[i].pp_flags[f].value);
+        }
+        xfree(entries[i].pp_flags);
+    }
+    xfree(units);
+    xfree(entries);
+    compdb_destroy(db);
+
+    return failed > 0 || !report_ok ? 1 : 0;
+}
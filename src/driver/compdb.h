@@ -0,0 +1,34 @@
+#ifndef COMPDB_H
+#define COMPDB_H
+
+#include <stddef.h>
+#include "driver.h"
+
+/* JSON compilation databases (compile_commands.json) and the --build mode
+ * that compiles every entry in one process. */
+
+typedef struct {
+    char *directory;
+    char *file;
+    char *output;               /* "output" field, NULL if absent */
+    char **arguments;           /* "arguments", or "command" split like sh */
+    size_t argument_count;
+} CompileCommand;
+
+typedef struct {
+    CompileCommand *entries;
+    size_t count;
+} CompileDatabase;
+
+/* Load a database; NULL (with a diagnostic) if unreadable or malformed */
+CompileDatabase *compdb_load(const char *path);
+void compdb_destroy(CompileDatabase *db);
+
+/* Compile every entry of the database on the driver's worker pool. Each
+ * entry's -O/-g/-o/-S/-M*, -I/-isystem and -D/-U flags are applied on top
+ * of `base`; entries whose output is current with respect to its
+ * dependency file are skipped.
+ * Returns the process exit status. */
+int compdb_build(const char *path, const DriverOptions *base);
+
+#endif /* COMPDB_H */
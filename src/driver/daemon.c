@@ -0,0 +1,235 @@
+#define _POSIX_C_SOURCE 200809L
+#include "daemon.h"
+#include "driver.h"
+#include "protocol.h"
+#include "../common/memory.h"
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+extern char **environ;
+
+static volatile sig_atomic_t g_stop_requested = 0;
+
+/* State of the request being served by a forked child, kept so that an
+ * exit() from deep inside the compiler still answers the client */
+static struct {
+    int conn;
+    FILE *out;
+    FILE *err;
+    bool responded;
+} g_request = {-1, NULL, NULL, false};
+
+static void handle_stop_signal(int sig) {
+    (void)sig;
+    g_stop_requested = 1;
+}
+
+/* ===== REQUEST HANDLING (child) ===== */
+
+static char *slurp_stream(FILE *f, size_t *len) {
+    *len = 0;
+    if (!f) return xstrdup("");
+
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    if (size < 0) size = 0;
+
+    char *data = xmalloc((size_t)size + 1);
+    *len = fread(data, 1, (size_t)size, f);
+    data[*len] = '\0';
+    return data;
+}
+
+static void send_response(int status) {
+    if (g_request.responded || g_request.conn < 0) return;
+    g_request.responded = true;
+
+    fflush(stdout);
+    fflush(stderr);
+
+    size_t out_len, err_len;
+    char *out = slurp_stream(g_request.out, &out_len);
+    char *err = slurp_stream(g_request.err, &err_len);
+
+    char status_str[16];
+    snprintf(status_str, sizeof(status_str), "%d", status);
+
+    ProtoMessage response;
+    proto_message_init(&response);
+    proto_message_add_str(&response, PROTO_MAGIC);
+    proto_message_add_str(&response, status_str);
+    proto_message_add(&response, out, out_len);
+    proto_message_add(&response, err, err_len);
+    proto_send(g_request.conn, &response);
+
+    proto_message_free(&response);
+    xfree(out);
+    xfree(err);
+}
+
+/* The compiler called exit() (e.g. a fatal diagnostic) */
+static void respond_at_exit(void) {
+    send_response(1);
+}
+
+static void serve_request(int conn, DaemonCommand run) {
+    ProtoMessage request;
+    if (!proto_recv(conn, &request) || request.count < 3 ||
+        strcmp(request.items[0], PROTO_MAGIC) != 0) {
+        _exit(1);
+    }
+
+    long argc = strtol(request.items[2], NULL, 10);
+    if (argc < 1 || (size_t)argc > request.count - 3) {
+        _exit(1);
+    }
+
+    g_request.conn = conn;
+    g_request.out = tmpfile();
+    g_request.err = tmpfile();
+    atexit(respond_at_exit);
+
+    /* Everything the command prints goes back to the client */
+    fflush(stdout);
+    fflush(stderr);
+    if (g_request.out) dup2(fileno(g_request.out), STDOUT_FILENO);
+    if (g_request.err) dup2(fileno(g_request.err), STDERR_FILENO);
+
+    if (chdir(request.items[1]) != 0) {
+        fprintf(stderr, "Error: cannot change to directory '%s': %s\n",
+                request.items[1], strerror(errno));
+        send_response(1);
+        _exit(0);
+    }
+
+    /* Adopt the client's environment (the child's copy is never freed) */
+    size_t env_start = 3 + (size_t)argc;
+    size_t env_count = request.count - env_start;
+    char **env = xmalloc((env_count + 1) * sizeof(char *));
+    for (size_t i = 0; i < env_count; i++) {
+        env[i] = request.items[env_start + i];
+    }
+    env[env_count] = NULL;
+    environ = env;
+
+    char **argv = xmalloc(((size_t)argc + 1) * sizeof(char *));
+    for (long i = 0; i < argc; i++) {
+        argv[i] = request.items[3 + i];
+    }
+    argv[argc] = NULL;
+
+    int status = run((int)argc, argv);
+    send_response(status);
+    _exit(0);
+}
+
+/* ===== SERVER ===== */
+
+static int open_listener(const char *socket_path) {
+    struct sockaddr_un addr;
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Error: socket path too long: %s\n", socket_path);
+        return -1;
+    }
+
+    /* A live server already owns the path; a dead one left a stale file */
+    int probe = proto_connect(socket_path);
+    if (probe >= 0) {
+        close(probe);
+        fprintf(stderr, "Error: a server is already listening on %s\n", socket_path);
+        return -1;
+    }
+    unlink(socket_path);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, socket_path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+
+    /* Only the owning user may submit compiles */
+    mode_t old_mask = umask(077);
+    int bound = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+    umask(old_mask);
+
+    if (bound < 0 || listen(fd, SOMAXCONN) < 0) {
+        fprintf(stderr, "Error: cannot listen on %s: %s\n", socket_path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int daemon_serve_connections(int listen_fd, DaemonHandler handle, void *ctx) {
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sigemptyset(&sa.sa_mask);
+    sa.sa_handler = handle_stop_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    /* Children are reaped automatically; a vanished client is not fatal */
+    sa.sa_handler = SIG_IGN;
+    sigaction(SIGCHLD, &sa, NULL);
+    sigaction(SIGPIPE, &sa, NULL);
+
+    while (!g_stop_requested) {
+        int conn = accept(listen_fd, NULL, NULL);
+        if (conn < 0) {
+            if (errno != EINTR) perror("accept");
+            continue;
+        }
+
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(listen_fd);
+
+            /* Back to default dispositions so popen()/pclose() of clang and
+             * the linker can wait for their children; SIGPIPE stays ignored */
+            signal(SIGCHLD, SIG_DFL);
+            signal(SIGINT, SIG_DFL);
+            signal(SIGTERM, SIG_DFL);
+
+            handle(conn, ctx);
+            _exit(0);
+        } else if (pid < 0) {
+            perror("fork");
+        }
+        close(conn);
+    }
+
+    return 0;
+}
+
+static void handle_command_request(int conn, void *ctx) {
+    serve_request(conn, *(DaemonCommand *)ctx);
+}
+
+int daemon_serve(const char *socket_path, DaemonCommand run) {
+    int listen_fd = open_listener(socket_path);
+    if (listen_fd < 0) return 1;
+
+    /* Pay the one-time setup cost here so every forked request inherits it */
+    driver_warm_up();
+
+    printf("Listening on %s\n", socket_path);
+    fflush(stdout);
+
+    int status = daemon_serve_connections(listen_fd, handle_command_request, &run);
+
+    close(listen_fd);
+    unlink(socket_path);
+    return status;
+}
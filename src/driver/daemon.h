@@ -0,0 +1,26 @@
+#ifndef DAEMON_H
+#define DAEMON_H
+
+/* Compile server (--daemon).
+ *
+ * The server initializes everything that is expensive and shareable once
+ * (LLVM targets, builtin type tables), then listens on a Unix domain socket.
+ * Each request is served by a forked child of that warm process: it adopts
+ * the client's cwd and environment, runs the ordinary command line, and
+ * sends back the exit status together with everything written to stdout and
+ * stderr. Outputs are written straight to the client's filesystem paths. */
+
+/* Runs one compiler command line; returns its exit status */
+typedef int (*DaemonCommand)(int argc, char **argv);
+
+/* Serve until SIGINT/SIGTERM; returns the process exit status */
+int daemon_serve(const char *socket_path, DaemonCommand run);
+
+/* Handles one accepted connection inside a forked child */
+typedef void (*DaemonHandler)(int conn, void *ctx);
+
+/* The fork-per-connection loop behind daemon_serve, for other servers on an
+ * already listening socket. Runs until SIGINT/SIGTERM. */
+int daemon_serve_connections(int listen_fd, DaemonHandler handle, void *ctx);
+
+#endif /* DAEMON_H */
@@ -0,0 +1,242 @@
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
+#include "dist.h"
+#include "daemon.h"
+#include "protocol.h"
+#include "../common/error.h"
+#include "../common/memory.h"
+#include "../common/thread.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Round-robin position over the worker list, shared by driver threads */
+static pthread_mutex_t g_dist_lock = PTHREAD_MUTEX_INITIALIZER;
+static size_t g_next_worker = 0;
+static bool g_fallback_reported = false;
+
+/* ===== HELPERS ===== */
+
+static char *read_whole_file(const char *path, size_t *len) {
+    *len = 0;
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
+
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    if (size < 0) {
+        fclose(f);
+        return NULL;
+    }
+
+    char *data = xmalloc((size_t)size + 1);
+    *len = fread(data, 1, (size_t)size, f);
+    fclose(f);
+    return data;
+}
+
+/* Write via a temporary next to `path` and rename, so a concurrent reader
+ * never sees a half-written object */
+static bool write_file_atomically(const char *path, const char *data, size_t len) {
+    size_t path_len = strlen(path);
+    char *temp = xmalloc(path_len + 8);
+    memcpy(temp, path, path_len);
+    memcpy(temp + path_len, ".XXXXXX", 8);
+
+    int fd = mkstemp(temp);
+    if (fd < 0) {
+        xfree(temp);
+        return false;
+    }
+
+    bool ok = true;
+    const char *p = data;
+    size_t left = len;
+    while (ok && left > 0) {
+        ssize_t n = write(fd, p, left);
+        if (n < 0) {
+            ok = false;
+        } else {
+            p += n;
+            left -= (size_t)n;
+        }
+    }
+    fchmod(fd, 0644);
+    if (close(fd) != 0) ok = false;
+    if (ok && rename(temp, path) != 0) ok = false;
+    if (!ok) unlink(temp);
+
+    xfree(temp);
+    return ok;
+}
+
+/* ===== WORKER ===== */
+
+static void serve_dist_request(int conn, void *ctx) {
+    (void)ctx;
+
+    ProtoMessage request;
+    if (!proto_recv(conn, &request) || request.count < 7 ||
+        strcmp(request.items[0], DIST_MAGIC) != 0) {
+        return;
+    }
+
+    DriverOptions opts;
+    driver_options_init(&opts);
+    opts.compile_only = true;
+    opts.jobs = 1;
+    opts.opt_level = atoi(request.items[3]);
+    opts.debug_info = atoi(request.items[4]) != 0;
+    opts.backend = (BackendType)atoi(request.items[5]);
+    opts.target_triple = request.items[6][0] ? request.items[6] : NULL;
+
+    char object_path[] = "/tmp/llvm-c-dist-XXXXXX.o";
+    int fd = mkstemps(object_path, 2);
+    if (fd < 0) return;
+    close(fd);
+
+    /* Progress lines are of no interest to the coordinator */
+    int null_fd = open("/dev/null", O_WRONLY);
+    if (null_fd >= 0) {
+        fflush(stdout);
+        dup2(null_fd, STDOUT_FILENO);
+        close(null_fd);
+    }
+
+    DriverUnit unit = {
+        .input = request.items[1],
+        .output = object_path,
+        .source = request.items[2]
+    };
+
+    diagnostic_begin_capture();
+    size_t failed = driver_compile_units(&opts, &unit, 1);
+    size_t diag_len = 0;
+    char *diag = diagnostic_end_capture(&diag_len);
+
+    size_t object_len = 0;
+    char *object = failed == 0 ? read_whole_file(object_path, &object_len) : NULL;
+    unlink(object_path);
+
+    ProtoMessage response;
+    proto_message_init(&response);
+    proto_message_add_str(&response, DIST_MAGIC);
+    proto_message_add_str(&response, failed == 0 && object ? "0" : "1");
+    proto_message_add(&response, diag ? diag : "", diag_len);
+    proto_message_add(&response, object ? object : "", object_len);
+    proto_send(conn, &response);
+
+    proto_message_free(&response);
+    proto_message_free(&request);
+    xfree(object);
+    xfree(diag);
+}
+
+int dist_worker_serve(const char *address) {
+    int listen_fd = proto_listen_address(address);
+    if (listen_fd < 0) {
+        fprintf(stderr, "Error: cannot listen on %s\n", address);
+        return 1;
+    }
+
+    /* Forked requests inherit initialized targets and tables */
+    driver_warm_up();
+
+    printf("Worker listening on %s\n", address);
+    fflush(stdout);
+
+    int status = daemon_serve_connections(listen_fd, serve_dist_request, NULL);
+
+    close(listen_fd);
+    if (strncmp(address, "unix:", 5) == 0) unlink(address + 5);
+    else if (address[0] == '/') unlink(address);
+    return status;
+}
+
+/* ===== COORDINATOR ===== */
+
+/* Send one unit to one worker; false on any transport or protocol failure */
+static bool compile_on_worker(const char *address, const ProtoMessage *request,
+                              const char *output, int *status) {
+    int fd = proto_connect_address(address);
+    if (fd < 0) return false;
+
+    ProtoMessage response;
+    bool ok = proto_send(fd, request) && proto_recv(fd, &response);
+    close(fd);
+    if (!ok) return false;
+
+    if (response.count < 4 || strcmp(response.items[0], DIST_MAGIC) != 0) {
+        proto_message_free(&response);
+        return false;
+    }
+
+    FILE *diag = diagnostic_stream();
+    fwrite(response.items[2], 1, response.lengths[2], diag);
+
+    *status = atoi(response.items[1]);
+    if (*status == 0 && !write_file_atomically(output, response.items[3], response.lengths[3])) {
+        fprintf(diag, "Error: cannot write '%s'\n", output);
+        *status = 1;
+    }
+
+    proto_message_free(&response);
+    return true;
+}
+
+bool dist_compile(const DriverOptions *opts, const char *input, const char *source,
+                  const char *output, int *status) {
+    if (!opts->dist_workers || !*opts->dist_workers) return false;
+
+    /* Split the worker list */
+    char *list = xstrdup(opts->dist_workers);
+    size_t worker_count = 0;
+    char *workers[64];
+    char *save = NULL;
+    for (char *tok = strtok_r(list, ",", &save); tok && worker_count < 64;
+         tok = strtok_r(NULL, ",", &save)) {
+        if (*tok) workers[worker_count++] = tok;
+    }
+
+    char opt_level[8], debug_info[4], backend[8];
+    snprintf(opt_level, sizeof(opt_level), "%d", opts->opt_level);
+    snprintf(debug_info, sizeof(debug_info), "%d", opts->debug_info ? 1 : 0);
+    snprintf(backend, sizeof(backend), "%d", (int)opts->backend);
+
+    ProtoMessage request;
+    proto_message_init(&request);
+    proto_message_add_str(&request, DIST_MAGIC);
+    proto_message_add_str(&request, input);
+    proto_message_add_str(&request, source);
+    proto_message_add_str(&request, opt_level);
+    proto_message_add_str(&request, debug_info);
+    proto_message_add_str(&request, backend);
+    proto_message_add_str(&request, opts->target_triple ? opts->target_triple : "");
+
+    pthread_mutex_lock(&g_dist_lock);
+    size_t start = g_next_worker++;
+    pthread_mutex_unlock(&g_dist_lock);
+
+    bool done = false;
+    for (size_t i = 0; i < worker_count && !done; i++) {
+        done = compile_on_worker(workers[(start + i) % worker_count], &request, output, status);
+    }
+
+    proto_message_free(&request);
+    xfree(list);
+
+    if (!done) {
+        pthread_mutex_lock(&g_dist_lock);
+        bool report = !g_fallback_reported;
+        g_fallback_reported = true;
+        pthread_mutex_unlock(&g_dist_lock);
+        if (report) {
+            fprintf(diagnostic_stream(), "Warning: no distributed worker answered, compiling locally\n");
+        }
+    }
+    return done;
+}
@@ -0,0 +1,38 @@
+#ifndef DIST_H
+#define DIST_H
+
+#include <stdbool.h>
+#include "driver.h"
+
+/* Distributed compilation.
+ *
+ * The coordinator (any llvm-c run with --dist) preprocesses each unit
+ * locally, so headers never leave the machine, and ships the self-contained
+ * text plus the flags that affect code generation to a worker process
+ * (llvm-c --dist-worker=<address>). The worker compiles it to an object and
+ * streams the object and diagnostics back. Addresses are those understood
+ * by proto_connect_address(): "unix:PATH" or "HOST:PORT". Workers do not
+ * authenticate their clients, so a TCP worker belongs on a trusted network
+ * only.
+ *
+ * Request:  DIST_MAGIC, input name, source, opt level, debug info, backend,
+ *           target triple ("" for the default)
+ * Response: DIST_MAGIC, exit status, diagnostics, object bytes */
+
+#define DIST_MAGIC "llvm-c-dist/1"
+
+/* Environment variable used when --dist is not given */
+#define DIST_WORKERS_ENV "LLVMC_DIST_WORKERS"
+
+/* Serve compile requests until SIGINT/SIGTERM; returns the exit status */
+int dist_worker_serve(const char *address);
+
+/* Compile preprocessed `source` into the object file `output` on one of
+ * the comma-separated `opts->dist_workers`, trying each in turn. Remote
+ * diagnostics are written to diagnostic_stream(). Returns false when no
+ * worker produced an answer, in which case the caller compiles locally;
+ * otherwise `*status` is the remote exit status. */
+bool dist_compile(const DriverOptions *opts, const char *input, const char *source,
+                  const char *output, int *status);
+
+#endif /* DIST_H */
@@ -0,0 +1,1167 @@
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
+#include "driver.h"
+#include "../ast/ast.h"
+#include "../ast/ast_image.h"
+#include "../codegen/codegen.h"
+#include "../common/debug.h"
+#include "../common/error.h"
+#include "../common/hash.h"
+#include "../common/memory.h"
+#include "../common/probes.h"
+#include "../common/taskpool.h"
+#include "../common/thread.h"
+#include "../common/timer.h"
+#include "../lexer/lexer.h"
+#include "../parser/c_parser.h"
+#include "../preprocessor/preprocessor.h"
+#include "../syntax/c_syntax.h"
+#include "dist.h"
+#include "jobserver.h"
+#include "objcache.h"
+#include "pch.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* What a translation unit is turned into */
+typedef enum {
+    EMIT_EXECUTABLE,    /* Object + link (single input only) */
+    EMIT_OBJECT,
+    EMIT_ASSEMBLY,
+    EMIT_LLVM_IR,
+    EMIT_PCH            /* Prefix snapshot of a header, no code */
+} EmitKind;
+
+/* Per-run state shared by every unit */
+typedef struct {
+    const DriverOptions *opts;
+    SyntaxDefinition *syntax;   /* Read-only, shared between threads */
+    EmitKind emit;
+    bool progress;              /* Print per-phase progress lines */
+    bool link_after;            /* Outputs are temporaries for a final link */
+    PrefixSnapshot *pch;        /* -include-pch, shared read-only */
+    TaskPool *pool;             /* Workers for parallel emission, NULL if none */
+    size_t emit_parts;          /* Code generation partitions for an executable */
+    Jobserver *jobserver;       /* Outer make's job slots for those, NULL if none */
+} DriverJob;
+
+/* Units of one parallel compilation */
+typedef struct {
+    DriverJob *job;
+    DriverUnit *units;
+    size_t count;
+    char **diags;               /* Captured diagnostics per unit until reported */
+    size_t *diag_lens;
+    FILE *diag_out;             /* Diagnostics stream of the calling thread */
+    Jobserver *jobserver;       /* Outer make's job slots, NULL if none */
+    bool implicit_slot_taken;   /* One unit runs on our own job slot */
+    pthread_mutex_t lock;       /* Guards the slot flag */
+    pthread_cond_t slot_free;
+    TaskOrder order;            /* Reports units in input order */
+} DriverQueue;
+
+#define DRIVER_THREAD_STACK_SIZE (8u * 1024u * 1024u)
+
+void driver_options_init(DriverOptions *opts) {
+    memset(opts, 0, sizeof(*opts));
+    opts->backend = BACKEND_LLVM;
+    opts->skip_mode = DEP_CHECK_MTIME;
+    opts->jobs = 0;
+}
+
+void driver_warm_up(void) {
+    c_parser_init_tables();
+    codegen_destroy(codegen_init(BACKEND_LLVM, NULL));
+}
+
+/* ===== HELPERS ===== */
+
+/* "dir/foo.c" -> "foo<ext>" in the current directory, like cc -c */
+static char *derive_output_name(const char *input, const char *ext) {
+    const char *base = strrchr(input, '/');
+    base = base ? base + 1 : input;
+
+    const char *dot = strrchr(base, '.');
+    size_t stem_len = dot && dot != base ? (size_t)(dot - base) : strlen(base);
+    size_t ext_len = strlen(ext);
+
+    char *name = xmalloc(stem_len + ext_len + 1);
+    memcpy(name, base, stem_len);
+    memcpy(name + stem_len, ext, ext_len + 1);
+    return name;
+}
+
+static char *make_temp_object(void) {
+    char template_path[] = "/tmp/llvm-c-XXXXXX.o";
+    int fd = mkstemps(template_path, 2);
+    if (fd < 0) return NULL;
+    close(fd);
+    return xstrdup(template_path);
+}
+
+static char *read_source_file(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) return NULL;
+
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    if (size < 0) {
+        fclose(f);
+        return NULL;
+    }
+
+    char *source = xmalloc(size + 1);
+    size_t read = fread(source, 1, size, f);
+    source[read] = '\0';
+    fclose(f);
+    return source;
+}
+
+/* ===== CACHING ===== */
+
+/* Everything besides the text that decides what codegen produces */
+static ObjectCacheFlags cache_flags_for(const DriverOptions *opts, const char *input_name) {
+    ObjectCacheFlags flags = {
+        .input_name = input_name,
+        .target_triple = opts->target_triple,
+        .target_cpu = NULL,         /* codegen_init always uses the defaults */
+        .target_features = "",
+        .backend = (int)opts->backend,
+        .opt_level = opts->opt_level,
+        .debug_info = opts->debug_info,
+        .pic = false
+    };
+    return flags;
+}
+
+/* Function shards live next to whole objects in the cache directory. They
+ * do not depend on the unit they came from, so no input name is mixed in. */
+static bool fetch_function_shard(void *owner, const char *fingerprint, char **data, size_t *len) {
+    const DriverOptions *opts = (const DriverOptions *)owner;
+    ObjectCacheFlags flags = cache_flags_for(opts, "");
+    char key[OBJCACHE_KEY_SIZE];
+    objcache_key(key, fingerprint, strlen(fingerprint), &flags);
+    return objcache_fetch_blob(opts->cache_dir, key, ".bc", data, len);
+}
+
+static void store_function_shard(void *owner, const char *fingerprint, const char *data, size_t len) {
+    const DriverOptions *opts = (const DriverOptions *)owner;
+    ObjectCacheFlags flags = cache_flags_for(opts, "");
+    char key[OBJCACHE_KEY_SIZE];
+    objcache_key(key, fingerprint, strlen(fingerprint), &flags);
+    objcache_store_blob(opts->cache_dir, key, ".bc", data, len, opts->cache_limit);
+}
+
+/* Bump when the AST layout or the way the parser builds it changes */
+#define AST_CACHE_FORMAT "llvm-c ast 1"
+
+/* AST images are keyed by the token stream rather than the text: the parser
+ * sees nothing else, and positions are part of the key because nodes carry
+ * them into diagnostics and debug info */
+static void ast_cache_key(char key[OBJCACHE_KEY_SIZE], const TokenList *tokens,
+                          uint64_t prefix_hash) {
+    Sha256 h;
+    sha256_init(&h);
+    sha256_update_str(&h, AST_CACHE_FORMAT);
+
+    const char *last_file = NULL;
+    for (const Token *t = tokens->head; t; t = t->next) {
+        uint64_t fields[4] = {
+            (uint64_t)t->type, t->location.line, t->location.column, t->length
+        };
+        sha256_update(&h, fields, sizeof(fields));
+        if (t->lexeme) sha256_update(&h, t->lexeme, t->length);
+        if (t->location.filename != last_file) {
+            last_file = t->location.filename;
+            sha256_update_str(&h, last_file ? last_file : "");
+        }
+    }
+
+    char digest[SHA256_HEX_SIZE];
+    sha256_final_hex(&h, digest);
+
+    /* Besides the tokens, only the compiler identity and the names a prefix
+     * snapshot seeds the parser with matter */
+    ObjectCacheFlags flags = {.input_name = "", .target_features = "", .prefix_hash = prefix_hash};
+    objcache_key(key, digest, strlen(digest), &flags);
+}
+
+/* Map a cached AST image; NULL on a miss */
+static ASTImage *fetch_ast_image(const DriverOptions *opts, const char *key) {
+    int fd = objcache_open_blob(opts->cache_dir, key, ".ast");
+    if (fd < 0) return NULL;
+    ASTImage *image = ast_image_map(fd);
+    close(fd);
+    return image;
+}
+
+static void store_ast_image(const DriverOptions *opts, const char *key, ASTNode *ast) {
+    char *data = NULL;
+    size_t len = 0;
+    if (ast_image_write(ast, &data, &len)) {
+        objcache_store_blob(opts->cache_dir, key, ".ast", data, len, opts->cache_limit);
+    }
+    xfree(data);
+}
+
+/* ===== SINGLE TRANSLATION UNIT ===== */
+
+static EmitKind emit_kind_for(const DriverOptions *opts) {
+    if (opts->emit_pch) return EMIT_PCH;
+    if (opts->emit_llvm) return EMIT_LLVM_IR;
+    if (opts->emit_assembly) return EMIT_ASSEMBLY;
+    if (opts->compile_only) return EMIT_OBJECT;
+    return EMIT_EXECUTABLE;
+}
+
+static bool debug_requested(const DebugFlags *flags) {
+    return flags->lexer || flags->parser || flags->ast || flags->codegen ||
+           flags->tokens || flags->stats || flags->verbose || flags->all;
+}
+
+/* Report a written output and record its dependency hashes */
+static void finish_unit(DriverJob *job, const DriverOptions *opts,
+                        const char *output_file, const char *dep_file) {
+    if (job->progress) printf("Successfully generated: %s\n", output_file);
+    if (opts->skip_if_up_to_date && opts->skip_mode == DEP_CHECK_HASH &&
+        !depfile_write_stamp(dep_file, opts->command_hash)) {
+        fprintf(diagnostic_stream(), "Warning: could not record dependency hashes for '%s'\n",
+                output_file);
+    }
+}
+
+static void apply_preprocessor_flags(Preprocessor *pp, const DriverOptions *opts) {
+    for (size_t i = 0; i < opts->pp_flag_count; i++) {
+        const PreprocessorFlag *flag = &opts->pp_flags[i];
+        switch (flag->kind) {
+            case PP_FLAG_INCLUDE:
+                preprocessor_add_include_path(pp, flag->value);
+                break;
+            case PP_FLAG_SYSTEM_INCLUDE:
+                preprocessor_add_system_include_path(pp, flag->value);
+                break;
+            case PP_FLAG_DEFINE: {
+                /* "NAME=VALUE", or "NAME" alone for 1 */
+                const char *eq = strchr(flag->value, '=');
+                if (!eq) {
+                    preprocessor_define(pp, flag->value, NULL);
+                    break;
+                }
+                char *name = xstrdup(flag->value);
+                name[eq - flag->value] = '\0';
+                preprocessor_define(pp, name, eq + 1);
+                xfree(name);
+                break;
+            }
+            case PP_FLAG_UNDEFINE:
+                preprocessor_undefine(pp, flag->value);
+                break;
+        }
+    }
+}
+
+/* Drop what a unit holds when it finishes before parsing */
+static void release_unit_source(const char *input_file, char *source, char *dep_file) {
+    diagnostic_clear_source(input_file);
+    xfree(source);
+    xfree(dep_file);
+}
+
+static CodegenContext *create_codegen(const DriverOptions *opts, FunctionCache *function_cache,
+                                      DriverUnit *unit) {
+    CodegenContext *codegen = codegen_init(opts->backend, opts->target_triple);
+    if (!codegen) return NULL;
+
+    codegen_set_opt_level(codegen, opts->opt_level);
+    codegen_set_debug_info(codegen, opts->debug_info);
+    if (opts->cache_dir) {
+        codegen_set_function_cache(codegen, function_cache);
+    }
+    if (opts->function_report) {
+        codegen_set_function_report(codegen, &unit->functions);
+    }
+    return codegen;
+}
+
+/* Streamed declarations go straight to the backend until the first error,
+ * after which no code is emitted */
+static bool generate_decl(ASTNode *decl, void *ctx) {
+    if (error_count() > 0) return false;
+    codegen_add_decl((CodegenContext *)ctx, decl);
+    return true;
+}
+
+/* A unit's phases, for memory accounting and the time report */
+typedef struct {
+    MemoryPhase outer;
+    bool in_phase;
+} UnitPhases;
+
+static void unit_phases_begin(UnitPhases *phases, const char *input_file) {
+    timer_begin("unit", input_file);
+    phases->outer = memory_set_phase(MEMORY_PHASE_OTHER);
+    phases->in_phase = false;
+}
+
+static void unit_phase(UnitPhases *phases, MemoryPhase phase) {
+    if (phases->in_phase) timer_end();
+    memory_set_phase(phase);
+    timer_begin(memory_phase_name(phase), NULL);
+    phases->in_phase = true;
+}
+
+static void unit_phases_end(UnitPhases *phases) {
+    if (phases->in_phase) timer_end();
+    phases->in_phase = false;
+    memory_set_phase(phases->outer);
+    timer_end();
+}
+
+static int compile_unit(DriverJob *job, DriverUnit *unit) {
+    const DriverOptions *opts = unit->opts ? unit->opts : job->opts;
+    EmitKind emit = job->emit;
+    if (unit->opts) {
+        /* Units with their own options are never linked here */
+        emit = emit_kind_for(unit->opts);
+        if (emit == EMIT_EXECUTABLE) emit = EMIT_OBJECT;
+    }
+    const DebugFlags *debug_flags = &opts->debug;
+    const char *input_file = unit->input;
+    const char *output_file = unit->output;
+    bool progress = job->progress && !debug_flags->verbose;
+    FILE *diag = diagnostic_stream();
+
+    /* Dependency file for this unit */
+    char *dep_file = NULL;
+    if (opts->dep_requested) {
+        dep_file = opts->dep_file ? xstrdup(opts->dep_file) : depfile_default_path(output_file);
+    }
+
+    if (opts->skip_if_up_to_date &&
+        depfile_is_up_to_date(output_file, dep_file, opts->skip_mode, opts->command_hash)) {
+        unit->skipped = true;
+        if (job->progress) printf("Up to date: %s\n", output_file);
+        xfree(dep_file);
+        return 0;
+    }
+
+    /* A snapshot records every header it was built from, so preprocessing
+     * one always writes a depfile; a temporary one unless -MD/-MMD asked */
+    bool temporary_dep_file = false;
+    DepFile *pch_deps = NULL;
+    if (emit == EMIT_PCH && !dep_file) {
+        size_t len = strlen(output_file) + sizeof(".tmp.d");
+        dep_file = xmalloc(len);
+        snprintf(dep_file, len, "%s.tmp.d", output_file);
+        temporary_dep_file = true;
+    }
+
+    /* Charge what the unit allocates to its phases; --debug-stats also
+     * samples resident memory at every phase change */
+    if (debug_flags->stats || debug_flags->all) memory_sample_rss(true);
+    UnitPhases phases;
+    unit_phases_begin(&phases, input_file);
+    unit_phase(&phases, MEMORY_PHASE_PREPROCESS);
+
+    /* Read input file, unless the unit arrived already preprocessed */
+    char *source = unit->source ? xstrdup(unit->source) : read_source_file(input_file);
+    if (!source) {
+        fprintf(diag, "Error: cannot open file '%s'\n", input_file);
+        xfree(dep_file);
+        unit_phases_end(&phases);
+        return 1;
+    }
+
+    /* Register source for diagnostics */
+    diagnostic_set_source(input_file, source);
+
+    SyntaxDefinition *syntax = job->syntax;
+
+    /* Preprocess if needed */
+    bool self_contained = unit->source != NULL || !syntax->supports_preprocessor;
+    if (syntax->supports_preprocessor && !unit->source) {
+        PreprocessorOptions pp_opts = {
+            .keep_comments = false,
+            .keep_whitespace = false,
+            .expand_macros = true,
+            .target_triple = opts->target_triple,
+            .dep_file = dep_file,
+            .dep_target = opts->dep_target ? opts->dep_target : output_file,
+            .dep_system_headers = opts->dep_system_headers || temporary_dep_file,
+            .macros_file = job->pch ? pch_header(job->pch) : NULL
+        };
+        Preprocessor *pp = preprocessor_create(&pp_opts);
+        apply_preprocessor_flags(pp, opts);
+        char *preprocessed = preprocessor_process_string(pp, source, input_file);
+        if (preprocessed) {
+            /* Locations from here on are lines of the preprocessed text */
+            diagnostic_set_source(input_file, preprocessed);
+            xfree(source);
+            source = preprocessed;
+            self_contained = true;
+        }
+        preprocessor_destroy(pp);
+
+        if (emit == EMIT_PCH && preprocessed) {
+            pch_deps = depfile_read(dep_file);
+            if (!pch_deps) {
+                fprintf(diag, "Error: cannot read the dependencies of '%s'\n", input_file);
+                if (temporary_dep_file) remove(dep_file);
+                release_unit_source(input_file, source, dep_file);
+                unit_phases_end(&phases);
+                return 1;
+            }
+        }
+        if (temporary_dep_file) remove(dep_file);
+    }
+
+    /* Object cache: a hit skips parsing and code generation entirely. Only
+     * fully preprocessed text is a sound key (headers are inlined). */
+    char cache_key[OBJCACHE_KEY_SIZE] = "";
+    bool use_cache = opts->cache_dir && emit == EMIT_OBJECT && self_contained &&
+                     !debug_requested(debug_flags);
+    if (use_cache) {
+        ObjectCacheFlags cache_flags = cache_flags_for(opts, input_file);
+        cache_flags.prefix_hash = job->pch ? pch_hash(job->pch) : 0;
+        objcache_key(cache_key, source, strlen(source), &cache_flags);
+
+        if (objcache_fetch(opts->cache_dir, cache_key, output_file)) {
+            unit->cached = true;
+            finish_unit(job, opts, output_file, dep_file);
+            release_unit_source(input_file, source, dep_file);
+            unit_phases_end(&phases);
+            return 0;
+        }
+    }
+
+    /* Ship the self-contained unit to a worker process when configured;
+     * debug output is only available from a local compile, and workers do
+     * not have the prefix snapshot */
+    if (opts->dist_workers && emit == EMIT_OBJECT && !unit->source && !job->pch &&
+        !debug_requested(debug_flags)) {
+        int remote_status = 1;
+        if (dist_compile(opts, input_file, source, output_file, &remote_status)) {
+            if (remote_status == 0) {
+                if (use_cache) objcache_store(opts->cache_dir, cache_key, output_file, opts->cache_limit);
+                finish_unit(job, opts, output_file, dep_file);
+            }
+            release_unit_source(input_file, source, dep_file);
+            unit_phases_end(&phases);
+            return remote_status;
+        }
+    }
+
+    /* Without anything that needs the whole AST, each top-level declaration
+     * goes to code generation as soon as it is parsed and is then freed with
+     * its tokens; lexing happens on demand as the parser advances */
+    bool streaming = opts->stream && emit != EMIT_PCH && !job->pch &&
+                     !debug_requested(debug_flags);
+
+    /* Lex */
+    unit_phase(&phases, MEMORY_PHASE_LEX);
+    if (progress && !streaming) printf("Lexing...\n");
+    Lexer *lexer = lexer_create(source, input_file, syntax);
+    TokenList *tokens = streaming ? lexer->tokens : lexer_tokenize(lexer);
+
+    if (error_count() > 0) {
+        fprintf(diag, "%d error(s) during lexing\n", error_count());
+        lexer_destroy(lexer);
+        release_unit_source(input_file, source, dep_file);
+        depfile_destroy(pch_deps);
+        unit_phases_end(&phases);
+        return 1;
+    }
+
+    if (progress && !streaming) printf("Lexed %zu tokens\n", tokens->count);
+
+    /* Debug output for lexer */
+    FILE *debug_out = debug_flags->output_file ? fopen(debug_flags->output_file, "w") : stdout;
+    if (!debug_out) debug_out = stdout;
+
+    if (debug_flags->lexer || debug_flags->all) {
+        fprintf(debug_out, "\n=== LEXER DEBUG OUTPUT ===\n");
+        debug_print_token_list(debug_out, tokens);
+    }
+
+    if (debug_flags->tokens || debug_flags->all) {
+        fprintf(debug_out, "\n=== TOKEN DUMP ===\n");
+        debug_print_token_list_compact(debug_out, tokens);
+    }
+
+    if (debug_flags->stats || debug_flags->all) {
+        fprintf(debug_out, "\n=== LEXER STATISTICS ===\n");
+        debug_print_token_stats(debug_out, tokens);
+    }
+
+    /* Parse, unless the same token stream was parsed before. A mapped image
+     * is used in place and released as a whole at cleanup. */
+    char ast_key[OBJCACHE_KEY_SIZE] = "";
+    bool use_ast_cache = opts->cache_dir && emit != EMIT_PCH && !streaming &&
+                         !debug_requested(debug_flags);
+    ASTImage *ast_image = NULL;
+    if (use_ast_cache) {
+        ast_cache_key(ast_key, tokens, job->pch ? pch_hash(job->pch) : 0);
+        ast_image = fetch_ast_image(opts, ast_key);
+    }
+
+    /* With a cache, only functions whose inputs changed are re-optimized */
+    FunctionCache function_cache = {
+        .fetch = fetch_function_shard,
+        .store = store_function_shard,
+        .owner = (void *)opts
+    };
+
+    int status = 1;
+    CodegenContext *codegen = NULL;
+    ASTNode *program = NULL;
+    CParser *parser = NULL;
+    ASTNode *ast = NULL;
+    unit_phase(&phases, MEMORY_PHASE_PARSE);
+    if (ast_image) {
+        ast = ast_image_root(ast_image);
+        if (progress) printf("Loaded cached AST (%zu nodes)\n", ast_image_node_count(ast_image));
+    } else if (streaming) {
+        if (progress) printf("Parsing and generating code...\n");
+        parser = c_parser_create_streaming(lexer, C_STD_C99);
+        codegen = create_codegen(opts, &function_cache, unit);
+        if (!codegen || !codegen_begin(codegen, input_file)) {
+            fprintf(diag, "Error: failed to initialize codegen\n");
+            goto cleanup;
+        }
+        c_parse_translation_unit_streaming(parser, generate_decl, codegen);
+    } else {
+        if (progress) printf("Parsing...\n");
+        int warnings_before = warning_count();
+        parser = c_parser_create(tokens, C_STD_C99);
+        if (job->pch) pch_restore_names(job->pch, parser);
+        ast = c_parser_parse(parser);
+
+        /* A hit would not replay parser warnings, so only clean parses are
+         * stored */
+        if (use_ast_cache && error_count() == 0 && warning_count() == warnings_before) {
+            store_ast_image(opts, ast_key, ast);
+        }
+    }
+
+    if (error_count() > 0) {
+        fprintf(diag, "%d error(s) during parsing\n", error_count());
+
+        /* Always dump debug info on error, but respect output file setting;
+         * a streamed parse has no whole AST left to dump */
+        if (streaming) {
+            goto cleanup;
+        }
+        if (!debug_flags->output_file) {
+            char debug_file[256];
+            snprintf(debug_file, sizeof(debug_file), "debug_parse_error_%s.txt",
+                     strrchr(input_file, '/') ? strrchr(input_file, '/') + 1 : input_file);
+            debug_dump_all_to_file(debug_file, tokens, ast);
+            fprintf(diag, "Debug info dumped to: %s\n", debug_file);
+        } else {
+            debug_dump_all_to_file(debug_flags->output_file, tokens, ast);
+            fprintf(diag, "Debug info dumped to: %s\n", debug_flags->output_file);
+        }
+        goto cleanup;
+    }
+
+    if (progress && !ast_image && !streaming) printf("Parsed successfully\n");
+
+    /* The snapshot's declarations come first, as if the header had been
+     * included at the top */
+    program = job->pch ? pch_prepend(job->pch, ast) : ast;
+
+    /* Debug output for AST */
+    if (debug_flags->ast || debug_flags->all) {
+        fprintf(debug_out, "\n=== AST DEBUG OUTPUT ===\n");
+        debug_print_ast_detailed(debug_out, program);
+    }
+
+    if (debug_flags->stats || debug_flags->all) {
+        fprintf(debug_out, "\n=== AST STATISTICS ===\n");
+        debug_print_ast_stats(debug_out, program);
+    }
+
+    if (emit == EMIT_PCH) {
+        if (pch_write(output_file, input_file, pch_deps, parser, program)) {
+            finish_unit(job, opts, output_file, dep_file);
+            status = 0;
+        }
+        goto cleanup;
+    }
+
+    /* Codegen */
+    unit_phase(&phases, MEMORY_PHASE_CODEGEN);
+    if (streaming) {
+        codegen_finish(codegen);
+    } else {
+        if (progress) printf("Generating code...\n");
+
+        if (debug_flags->codegen || debug_flags->all) {
+            fprintf(debug_out, "\n=== CODEGEN DEBUG OUTPUT ===\n");
+            fprintf(debug_out, "Backend: %d\n", opts->backend);
+            fprintf(debug_out, "Target: %s\n", opts->target_triple ? opts->target_triple : "default");
+            fprintf(debug_out, "Optimization level: %d\n", opts->opt_level);
+            fprintf(debug_out, "Debug info: %s\n", opts->debug_info ? "enabled" : "disabled");
+        }
+
+        codegen = create_codegen(opts, &function_cache, unit);
+        if (!codegen) {
+            fprintf(diag, "Error: failed to initialize codegen\n");
+            goto cleanup;
+        }
+
+        if (!codegen_generate(codegen, program, input_file)) {
+            fprintf(diag, "Error: %s\n", codegen_get_error(codegen));
+            goto cleanup;
+        }
+    }
+
+    if (progress && function_cache.reused + function_cache.rebuilt > 0) {
+        printf("Reused %zu of %zu functions\n", function_cache.reused,
+               function_cache.reused + function_cache.rebuilt);
+    }
+
+    if (debug_flags->codegen || debug_flags->all) {
+        fprintf(debug_out, "Code generation completed successfully\n");
+    }
+
+    /* Emit output */
+    unit_phase(&phases, MEMORY_PHASE_EMIT);
+    bool success = false;
+    switch (emit) {
+        case EMIT_LLVM_IR:
+            success = codegen_emit_llvm_ir(codegen, output_file);
+            break;
+        case EMIT_ASSEMBLY:
+            success = codegen_emit_assembly(codegen, output_file);
+            break;
+        case EMIT_OBJECT:
+            success = codegen_emit_object(codegen, output_file);
+            if (success && use_cache) {
+                objcache_store(opts->cache_dir, cache_key, output_file, opts->cache_limit);
+            }
+            break;
+        case EMIT_EXECUTABLE: {
+            /* Compile and link; with -jN the object code comes in N pieces
+             * built in parallel */
+            size_t parts = job->emit_parts > 1 ? job->emit_parts : 1;
+
+            /* Under make, every piece beyond our own job slot needs a token;
+             * split only as far as the tokens free right now allow */
+            int *tokens = NULL;
+            size_t token_count = 0;
+            if (parts > 1 && job->jobserver) {
+                tokens = xmalloc((parts - 1) * sizeof(int));
+                while (token_count < parts - 1) {
+                    int token = jobserver_try_acquire(job->jobserver);
+                    if (token < 0) break;
+                    tokens[token_count++] = token;
+                }
+                parts = token_count + 1;
+            }
+
+            char **obj_files = xcalloc(parts, sizeof(char *));
+            success = true;
+            for (size_t i = 0; i < parts && success; i++) {
+                obj_files[i] = make_temp_object();
+                success = obj_files[i] != NULL;
+            }
+            size_t written = 0;
+            if (success) {
+                written = parts > 1 ? codegen_emit_object_parts(codegen, job->pool,
+                                                                (const char **)obj_files, parts)
+                                    : codegen_emit_object(codegen, obj_files[0]);
+                success = written > 0;
+            }
+            if (success) {
+                success = codegen_link(codegen, (const char **)obj_files, written, output_file, false);
+            }
+            for (size_t i = 0; i < parts; i++) {
+                if (obj_files[i]) remove(obj_files[i]);
+                xfree(obj_files[i]);
+            }
+            xfree(obj_files);
+            for (size_t i = 0; i < token_count; i++) {
+                jobserver_release(job->jobserver, tokens[i]);
+            }
+            xfree(tokens);
+            break;
+        }
+        case EMIT_PCH:
+            break;      /* Written before code generation */
+    }
+
+    if (!success) {
+        fprintf(diag, "Error: %s\n", codegen_get_error(codegen));
+    } else {
+        finish_unit(job, opts, output_file, dep_file);
+        status = 0;
+    }
+
+cleanup:
+    unit_phases_end(&phases);
+    if (debug_flags->stats || debug_flags->all) {
+        fprintf(debug_out, "\n=== MEMORY STATISTICS ===\n");
+        debug_print_memory_stats(debug_out);
+    }
+
+    /* Close debug output file if we opened one */
+    if (debug_flags->output_file && debug_out != stdout) {
+        fclose(debug_out);
+        if (debug_flags->verbose) {
+            printf("Debug output written to: %s\n", debug_flags->output_file);
+        }
+    }
+
+    codegen_destroy(codegen);
+    if (program != ast) pch_release_unit(program);
+    if (ast_image) {
+        ast_image_unmap(ast_image);
+    } else {
+        /* Nodes go back to this thread's slab list for the next unit */
+        c_parser_destroy(parser);
+        ast_free_tree(ast);
+    }
+    lexer_destroy(lexer);
+    diagnostic_clear_source(input_file);
+    xfree(source);
+    xfree(dep_file);
+    depfile_destroy(pch_deps);
+
+    return status;
+}
+
+/* ===== PARALLEL SCHEDULING ===== */
+
+/* Under a jobserver the process already holds one slot; every other unit
+ * in flight needs a token so `make -jN` is not oversubscribed */
+static bool implicit_slot_busy(void *ctx) {
+    DriverQueue *queue = (DriverQueue *)ctx;
+    pthread_mutex_lock(&queue->lock);
+    bool busy = queue->implicit_slot_taken;
+    pthread_mutex_unlock(&queue->lock);
+    return busy;
+}
+
+/* Returns the token to give back, or -1 when running on the implicit slot
+ * (or without a jobserver) */
+static int acquire_slot(DriverQueue *queue) {
+    if (!queue->jobserver) return -1;
+
+    for (;;) {
+        pthread_mutex_lock(&queue->lock);
+        if (!queue->implicit_slot_taken) {
+            queue->implicit_slot_taken = true;
+            pthread_mutex_unlock(&queue->lock);
+            return -1;
+        }
+        pthread_mutex_unlock(&queue->lock);
+
+        /* Stop waiting for make as soon as our own slot frees up */
+        int token = jobserver_acquire(queue->jobserver, implicit_slot_busy, queue);
+        if (token >= 0) return token;
+        if (!implicit_slot_busy(queue)) continue;
+
+        /* The jobserver failed; make do with the implicit slot */
+        pthread_mutex_lock(&queue->lock);
+        while (queue->implicit_slot_taken) {
+            pthread_cond_wait(&queue->slot_free, &queue->lock);
+        }
+        queue->implicit_slot_taken = true;
+        pthread_mutex_unlock(&queue->lock);
+        return -1;
+    }
+}
+
+static void release_slot(DriverQueue *queue, int token) {
+    if (!queue->jobserver) return;
+    if (token >= 0) {
+        jobserver_release(queue->jobserver, token);
+        return;
+    }
+    pthread_mutex_lock(&queue->lock);
+    queue->implicit_slot_taken = false;
+    pthread_cond_signal(&queue->slot_free);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+/* Report a finished unit; called in input order */
+static void report_unit(void *ctx, size_t index) {
+    DriverQueue *queue = (DriverQueue *)ctx;
+    DriverUnit *unit = &queue->units[index];
+
+    if (queue->diag_lens[index] > 0) {
+        fwrite(queue->diags[index], 1, queue->diag_lens[index], queue->diag_out);
+    }
+    xfree(queue->diags[index]);
+    queue->diags[index] = NULL;
+
+    if (unit->status != 0) {
+        fprintf(queue->diag_out, "Error: failed to compile '%s'\n", unit->input);
+    } else if (unit->skipped) {
+        printf("Up to date: %s\n", unit->output);
+    } else if (unit->cached) {
+        printf("Cached: %s -> %s\n", unit->input, unit->output);
+    } else if (queue->job->link_after) {
+        printf("Compiled: %s (%.1f ms)\n", unit->input, unit->seconds * 1000.0);
+    } else {
+        printf("Compiled: %s -> %s (%.1f ms)\n", unit->input, unit->output,
+               unit->seconds * 1000.0);
+    }
+    fflush(stdout);
+}
+
+typedef struct {
+    DriverQueue *queue;
+    size_t index;
+} UnitTask;
+
+static void compile_unit_task(void *arg) {
+    UnitTask *task = (UnitTask *)arg;
+    DriverQueue *queue = task->queue;
+    DriverUnit *unit = &queue->units[task->index];
+
+    int token = acquire_slot(queue);
+
+    /* Diagnostics are buffered per unit and written out in one piece */
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    error_reset();
+    diagnostic_begin_capture();
+    LLVMC_PROBE1(unit__start, unit->input);
+    unit->status = compile_unit(queue->job, unit);
+    LLVMC_PROBE2(unit__done, unit->input, unit->status);
+    queue->diags[task->index] = diagnostic_end_capture(&queue->diag_lens[task->index]);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    unit->seconds = (double)(end.tv_sec - start.tv_sec) +
+                    (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+
+    release_slot(queue, token);
+    task_order_complete(&queue->order, task->index);
+}
+
+/* Units are tasks on a work-stealing pool; results are reported in input
+ * order however they finish */
+static void run_units(DriverJob *job, DriverUnit *units, size_t count, int jobs) {
+    DriverQueue queue = {
+        .job = job,
+        .units = units,
+        .count = count,
+        .diags = xcalloc(count, sizeof(char *)),
+        .diag_lens = xcalloc(count, sizeof(size_t)),
+        .diag_out = diagnostic_stream(),
+        .jobserver = jobserver_connect(),
+        .implicit_slot_taken = false
+    };
+    pthread_mutex_init(&queue.lock, NULL);
+    pthread_cond_init(&queue.slot_free, NULL);
+    task_order_init(&queue.order, count, report_unit, &queue);
+
+    /* Without -j, run as wide as the machine when make hands out slots */
+    size_t thread_count = 1;
+    if (jobs > 0) {
+        thread_count = (size_t)jobs;
+    } else if (queue.jobserver) {
+        thread_count = taskpool_default_size();
+    }
+    if (thread_count > count) thread_count = count;
+
+    /* Without a pool (one thread, or none could be started) every unit is
+     * compiled right here as it is spawned */
+    TaskPool *pool = thread_count > 1 ? taskpool_create(thread_count, DRIVER_THREAD_STACK_SIZE) : NULL;
+    UnitTask *tasks = xmalloc(count * sizeof(UnitTask));
+    TaskGroup group;
+    taskgroup_init(&group, pool);
+    for (size_t i = 0; i < count; i++) {
+        tasks[i] = (UnitTask){.queue = &queue, .index = i};
+        taskgroup_spawn(&group, compile_unit_task, &tasks[i]);
+    }
+    taskgroup_wait(&group);
+
+    taskpool_destroy(pool);
+    xfree(tasks);
+    task_order_destroy(&queue.order);
+    xfree(queue.diags);
+    xfree(queue.diag_lens);
+    pthread_cond_destroy(&queue.slot_free);
+    pthread_mutex_destroy(&queue.lock);
+    jobserver_disconnect(queue.jobserver);
+}
+
+/* ===== FUNCTION REPORT ===== */
+
+typedef struct {
+    const char *unit;
+    const FunctionRecord *record;
+    double total_ms;
+} ReportRow;
+
+static int compare_report_rows(const void *a, const void *b) {
+    const ReportRow *x = (const ReportRow *)a, *y = (const ReportRow *)b;
+    if (x->total_ms != y->total_ms) return x->total_ms < y->total_ms ? 1 : -1;
+    return strcmp(x->record->name, y->record->name);
+}
+
+static void write_report_string(FILE *out, const char *s, bool json) {
+    /* CSV fields only need quoting when they hold a separator or quote */
+    if (!json && !strpbrk(s, ",\"\n")) {
+        fputs(s, out);
+        return;
+    }
+    fputc('"', out);
+    for (const unsigned char *p = (const unsigned char *)s; *p; p++) {
+        if (*p == '"') {
+            fputs(json ? "\\\"" : "\"\"", out);
+        } else if (json && *p == '\\') {
+            fputs("\\\\", out);
+        } else if (json && *p < 0x20) {
+            fprintf(out, "\\u%04x", *p);
+        } else {
+            fputc(*p, out);
+        }
+    }
+    fputc('"', out);
+}
+
+bool driver_write_function_report(const char *path, DriverUnit *units, size_t count) {
+    size_t total = 0;
+    for (size_t i = 0; i < count; i++) total += units[i].functions.count;
+
+    ReportRow *rows = xmalloc((total + 1) * sizeof(ReportRow));
+    size_t n = 0;
+    for (size_t i = 0; i < count; i++) {
+        for (size_t f = 0; f < units[i].functions.count; f++) {
+            const FunctionRecord *record = &units[i].functions.records[f];
+            rows[n].unit = units[i].input;
+            rows[n].record = record;
+            rows[n].total_ms = record->codegen_ms + record->optimize_ms + record->emit_ms;
+            n++;
+        }
+    }
+    qsort(rows, n, sizeof(ReportRow), compare_report_rows);
+
+    size_t len = strlen(path);
+    bool json = len >= 5 && strcmp(path + len - 5, ".json") == 0;
+    FILE *out = fopen(path, "w");
+    bool ok = out != NULL;
+    if (out) {
+        if (json) {
+            fprintf(out, "[");
+        } else {
+            fprintf(out, "unit,function,ast_nodes,blocks_before,instructions_before,blocks_after,"
+                         "instructions_after,codegen_ms,optimize_ms,emit_ms,total_ms,code_bytes\n");
+        }
+        for (size_t i = 0; i < n; i++) {
+            const FunctionRecord *r = rows[i].record;
+            if (json) {
+                fprintf(out, "%s\n  {\"unit\": ", i > 0 ? "," : "");
+                write_report_string(out, rows[i].unit, true);
+                fprintf(out, ", \"function\": ");
+                write_report_string(out, r->name, true);
+                fprintf(out, ", \"ast_nodes\": %zu, \"blocks_before\": %zu, \"instructions_before\": %zu, "
+                             "\"blocks_after\": %zu, \"instructions_after\": %zu, \"codegen_ms\": %.3f, "
+                             "\"optimize_ms\": %.3f, \"emit_ms\": %.3f, \"total_ms\": %.3f, "
+                             "\"code_bytes\": %zu}",
+                        r->ast_nodes, r->blocks_before, r->instructions_before, r->blocks_after,
+                        r->instructions_after, r->codegen_ms, r->optimize_ms, r->emit_ms,
+                        rows[i].total_ms, r->code_bytes);
+            } else {
+                write_report_string(out, rows[i].unit, false);
+                fputc(',', out);
+                write_report_string(out, r->name, false);
+                fprintf(out, ",%zu,%zu,%zu,%zu,%zu,%.3f,%.3f,%.3f,%.3f,%zu\n",
+                        r->ast_nodes, r->blocks_before, r->instructions_before, r->blocks_after,
+                        r->instructions_after, r->codegen_ms, r->optimize_ms, r->emit_ms,
+                        rows[i].total_ms, r->code_bytes);
+            }
+        }
+        if (json) fprintf(out, "%s]\n", n > 0 ? "\n" : "");
+        if (ferror(out)) ok = false;
+        if (fclose(out) != 0) ok = false;
+    }
+    if (!ok) fprintf(diagnostic_stream(), "Error: cannot write function report '%s'\n", path);
+
+    xfree(rows);
+    for (size_t i = 0; i < count; i++) {
+        function_report_free(&units[i].functions);
+    }
+    return ok;
+}
+
+/* ===== ENTRY POINT ===== */
+
+/* Map -include-pch once per run; every unit shares the snapshot */
+static bool load_prefix_snapshot(const DriverOptions *opts, PrefixSnapshot **pch) {
+    *pch = NULL;
+    if (!opts->include_pch) return true;
+    *pch = pch_load(opts->include_pch);
+    return *pch != NULL;
+}
+
+static void enable_parser_debug(const DriverOptions *opts) {
+    if (opts->debug.parser || opts->debug.verbose || opts->debug.all) {
+        debug_set_parser_verbose(true);
+    }
+}
+
+static size_t compile_units(const DriverOptions *opts, DriverUnit *units, size_t count,
+                            bool link_after) {
+
+    enable_parser_debug(opts);
+
+    PrefixSnapshot *pch = NULL;
+    if (!load_prefix_snapshot(opts, &pch)) {
+        for (size_t i = 0; i < count; i++) units[i].status = 1;
+        return count;
+    }
+
+    /* Syntax tables are built once and shared by every unit */
+    SyntaxDefinition *syntax = syntax_c99_create();
+
+    EmitKind emit = emit_kind_for(opts);
+    DriverJob job = {
+        .opts = opts,
+        .syntax = syntax,
+        .emit = emit == EMIT_EXECUTABLE ? EMIT_OBJECT : emit,
+        .progress = false,
+        .link_after = link_after,
+        .pch = pch
+    };
+
+    run_units(&job, units, count, opts->jobs);
+    syntax_c99_destroy(syntax);
+    pch_unload(pch);
+
+    size_t failed = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (units[i].status != 0) failed++;
+    }
+    return failed;
+}
+
+size_t driver_compile_units(const DriverOptions *opts, DriverUnit *units, size_t count) {
+    if (!opts || !units || count == 0) return 0;
+    return compile_units(opts, units, count, false);
+}
+
+int driver_run(const DriverOptions *opts, const char **inputs, size_t count) {
+    if (!opts || !inputs || count == 0) return 1;
+
+    EmitKind emit = emit_kind_for(opts);
+    const char *ext = emit == EMIT_LLVM_IR ? ".ll" : emit == EMIT_ASSEMBLY ? ".s" :
+                      emit == EMIT_PCH ? ".pch" : ".o";
+
+    bool multi = count > 1;
+    if (multi && emit != EMIT_EXECUTABLE && opts->output_file) {
+        fprintf(diagnostic_stream(), "Error: cannot specify -o with -c, -S or --emit-llvm with multiple files\n");
+        return 1;
+    }
+    if (multi && (opts->dep_file || opts->dep_target)) {
+        fprintf(diagnostic_stream(), "Error: cannot specify -MF or -MT with multiple files\n");
+        return 1;
+    }
+
+    DriverUnit *units = xcalloc(count, sizeof(DriverUnit));
+    const char *final_output = opts->output_file ? opts->output_file : "a.out";
+    int status = 0;
+
+    if (!multi) {
+        /* Classic single-file path: everything on this thread, diagnostics
+         * streamed as they happen */
+        enable_parser_debug(opts);
+        PrefixSnapshot *pch = NULL;
+        if (!load_prefix_snapshot(opts, &pch)) {
+            xfree(units);
+            return 1;
+        }
+
+        SyntaxDefinition *syntax = syntax_c99_create();
+        DriverJob job = {
+            .opts = opts,
+            .syntax = syntax,
+            .emit = emit,
+            .progress = true,
+            .link_after = false,
+            .pch = pch
+        };
+
+        /* One input has no units to spread over -jN, but the code
+         * generation of an executable can be split */
+        if (emit == EMIT_EXECUTABLE && opts->jobs > 1) {
+            job.pool = taskpool_create((size_t)opts->jobs, DRIVER_THREAD_STACK_SIZE);
+            job.emit_parts = (size_t)opts->jobs;
+            job.jobserver = jobserver_connect();
+        }
+
+        units[0].input = inputs[0];
+        units[0].output = emit == EMIT_PCH && !opts->output_file ? derive_output_name(inputs[0], ext)
+                                                                 : xstrdup(final_output);
+        LLVMC_PROBE1(unit__start, units[0].input);
+        units[0].status = compile_unit(&job, &units[0]);
+        LLVMC_PROBE2(unit__done, units[0].input, units[0].status);
+        status = units[0].status;
+        taskpool_destroy(job.pool);
+        jobserver_disconnect(job.jobserver);
+        syntax_c99_destroy(syntax);
+        pch_unload(pch);
+    } else {
+        /* Several inputs: compile to objects (temporary ones when linking)
+         * in parallel, then link once */
+        for (size_t i = 0; i < count; i++) {
+            units[i].input = inputs[i];
+            units[i].output = emit == EMIT_EXECUTABLE ? make_temp_object()
+                                                      : derive_output_name(inputs[i], ext);
+            if (!units[i].output) {
+                fprintf(diagnostic_stream(), "Error: cannot create temporary object file\n");
+                status = 1;
+            }
+        }
+
+        if (status == 0) {
+            size_t failed = compile_units(opts, units, count, emit == EMIT_EXECUTABLE);
+            if (failed > 0) {
+                fprintf(diagnostic_stream(), "%zu of %zu translation unit(s) failed\n", failed, count);
+                status = 1;
+            }
+        }
+
+        if (status == 0 && emit == EMIT_EXECUTABLE) {
+            const char **objs = xmalloc(count * sizeof(char *));
+            for (size_t i = 0; i < count; i++) {
+                objs[i] = units[i].output;
+            }
+
+            CodegenContext *linker = codegen_init(opts->backend, opts->target_triple);
+            if (linker && codegen_link(linker, objs, count, final_output, false)) {
+                printf("Successfully generated: %s\n", final_output);
+            } else {
+                fprintf(diagnostic_stream(), "Error: linking '%s' failed\n", final_output);
+                status = 1;
+            }
+            codegen_destroy(linker);
+            xfree(objs);
+        }
+
+        if (emit == EMIT_EXECUTABLE) {
+            for (size_t i = 0; i < count; i++) {
+                if (units[i].output) remove(units[i].output);
+            }
+        }
+    }
+
+    if (opts->function_report &&
+        !driver_write_function_report(opts->function_report, units, count)) {
+        status = 1;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        xfree(units[i].output);
+    }
+    xfree(units);
+
+    return status;
+}
@@ -0,0 +1,127 @@
+#ifndef DRIVER_H
+#define DRIVER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "../codegen/backend.h"
+#include "../preprocessor/depfile.h"
+
+/* Debug flags */
+typedef struct {
+    bool lexer;
+    bool parser;
+    bool ast;
+    bool codegen;
+    bool tokens;
+    bool stats;
+    bool verbose;
+    bool all;
+    char *output_file;
+} DebugFlags;
+
+/* A search path or macro for the preprocessor */
+typedef enum {
+    PP_FLAG_INCLUDE,            /* -I<dir> */
+    PP_FLAG_SYSTEM_INCLUDE,     /* -isystem <dir> */
+    PP_FLAG_DEFINE,             /* -D<name>[=<value>] */
+    PP_FLAG_UNDEFINE            /* -U<name> */
+} PreprocessorFlagKind;
+
+typedef struct {
+    PreprocessorFlagKind kind;
+    const char *value;
+} PreprocessorFlag;
+
+/* Everything the command line controls for a compilation */
+typedef struct {
+    /* Output */
+    const char *output_file;    /* -o, NULL for the default */
+    int opt_level;
+    bool debug_info;
+    bool emit_assembly;
+    bool emit_llvm;
+    bool compile_only;
+    bool emit_pch;              /* --emit-pch: snapshot a header's parse */
+    BackendType backend;
+    const char *target_triple;
+
+    /* Search paths and macros, in the order given */
+    const PreprocessorFlag *pp_flags;
+    size_t pp_flag_count;
+
+    /* Dependency tracking */
+    bool dep_requested;
+    bool dep_system_headers;
+    const char *dep_file;       /* -MF, only valid with a single input */
+    const char *dep_target;     /* -MT, only valid with a single input */
+    bool skip_if_up_to_date;
+    DepCheckMode skip_mode;
+    uint64_t command_hash;      /* Hash of the flags that affect outputs */
+
+    /* Prefix snapshot every unit starts from (-include-pch), or NULL */
+    const char *include_pch;
+
+    /* Generate each top-level declaration as soon as it is parsed (--stream) */
+    bool stream;
+
+    /* Object cache */
+    const char *cache_dir;      /* --cache, NULL when disabled */
+    uint64_t cache_limit;       /* Bytes before LRU eviction */
+
+    /* Per-function costs (--function-report): CSV, or JSON when the name
+     * ends in .json; NULL when not asked */
+    const char *function_report;
+
+    /* Distribution */
+    const char *dist_workers;   /* --dist, comma-separated worker addresses */
+
+    /* Parallelism */
+    int jobs;                   /* -j, translation units compiled at once;
+                                 * 0 = 1, or one per CPU under a make
+                                 * jobserver */
+
+    DebugFlags debug;
+} DriverOptions;
+
+/* One translation unit and the result of compiling it */
+typedef struct {
+    const char *input;
+    char *output;               /* Artifact written for this unit */
+    const DriverOptions *opts;  /* Per-unit options, NULL for the run's */
+    const char *source;         /* Already preprocessed text to compile
+                                 * instead of reading `input`, or NULL */
+    int status;                 /* 0 on success */
+    bool skipped;               /* Output was already up to date */
+    bool cached;                /* Output came from the object cache */
+    double seconds;             /* Wall time spent on this unit */
+    FunctionReport functions;   /* With --function-report */
+} DriverUnit;
+
+/* Fill in defaults */
+void driver_options_init(DriverOptions *opts);
+
+/* Initialize process-wide state (LLVM targets, parser tables) ahead of the
+ * first compile; otherwise this happens lazily */
+void driver_warm_up(void);
+
+/* Compile prepared units on the worker pool without linking. Units that
+ * carry their own options are always emitted as objects unless those
+ * options ask for -S or --emit-llvm. Returns the number of failed units. */
+size_t driver_compile_units(const DriverOptions *opts, DriverUnit *units, size_t count);
+
+/* Write the functions recorded in `units` to `path`, most expensive first,
+ * and release them */
+bool driver_write_function_report(const char *path, DriverUnit *units, size_t count);
+
+/* Compile `count` inputs and, unless -c/-S/--emit-llvm, link them into one
+ * output. A single input behaves exactly like the classic one-file driver;
+ * several inputs are scheduled over `opts->jobs` worker threads that share
+ * one process (LLVM targets and syntax tables are set up once). When run
+ * under `make -jN`, units beyond the first take GNU make jobserver tokens.
+ * Results are reported in input order. With one input, -jN instead splits
+ * code generation for an executable into N objects built in parallel.
+ * Returns the process exit status. */
+int driver_run(const DriverOptions *opts, const char **inputs, size_t count);
+
+#endif /* DRIVER_H */
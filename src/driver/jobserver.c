@@ -0,0 +1,153 @@
+#define _POSIX_C_SOURCE 200809L
+#include "jobserver.h"
+#include "../common/memory.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* How often a waiting worker re-checks whether it still needs a token */
+#define JOBSERVER_POLL_MS 100
+
+struct Jobserver {
+    int read_fd;
+    int write_fd;
+    bool owns_read_fd;      /* read_fd was opened here and must be closed */
+};
+
+/* ===== MAKEFLAGS PARSING ===== */
+
+/* Find the value of the last --jobserver-auth= (or the pre-4.2 spelling
+ * --jobserver-fds=) word in MAKEFLAGS */
+static char *find_jobserver_auth(const char *makeflags) {
+    static const char *const prefixes[] = {"--jobserver-auth=", "--jobserver-fds="};
+    char *value = NULL;
+    const char *p = makeflags;
+
+    while (*p) {
+        while (*p == ' ' || *p == '\t') p++;
+        const char *word = p;
+        while (*p && *p != ' ' && *p != '\t') p++;
+        size_t word_len = (size_t)(p - word);
+
+        for (size_t i = 0; i < sizeof(prefixes) / sizeof(prefixes[0]); i++) {
+            size_t prefix_len = strlen(prefixes[i]);
+            if (word_len > prefix_len && strncmp(word, prefixes[i], prefix_len) == 0) {
+                xfree(value);
+                value = xstrndup(word + prefix_len, word_len - prefix_len);
+            }
+        }
+    }
+
+    return value;
+}
+
+static bool fd_is_open(int fd) {
+    return fd >= 0 && fcntl(fd, F_GETFD) != -1;
+}
+
+/* ===== CONNECTION ===== */
+
+Jobserver *jobserver_connect(void) {
+    const char *makeflags = getenv("MAKEFLAGS");
+    if (!makeflags) return NULL;
+
+    char *auth = find_jobserver_auth(makeflags);
+    if (!auth) return NULL;
+
+    Jobserver *js = xcalloc(1, sizeof(Jobserver));
+    js->read_fd = -1;
+    js->write_fd = -1;
+
+    if (strncmp(auth, "fifo:", 5) == 0) {
+        /* Named fifo (make 4.4+): our own descriptor, so non-blocking is safe */
+        int fd = open(auth + 5, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+        if (fd >= 0) {
+            js->read_fd = fd;
+            js->write_fd = fd;
+            js->owns_read_fd = true;
+        }
+    } else {
+        int read_fd = -1, write_fd = -1;
+        if (sscanf(auth, "%d,%d", &read_fd, &write_fd) == 2 &&
+            fd_is_open(read_fd) && fd_is_open(write_fd)) {
+            /* The inherited pipe is shared with make and its other children,
+             * so reopen the read end to get a private non-blocking file
+             * description. Fall back to the shared blocking one. */
+            char path[64];
+            snprintf(path, sizeof(path), "/proc/self/fd/%d", read_fd);
+            int private_fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+            if (private_fd >= 0) {
+                js->read_fd = private_fd;
+                js->owns_read_fd = true;
+            } else {
+                js->read_fd = read_fd;
+            }
+            js->write_fd = write_fd;
+        }
+    }
+
+    xfree(auth);
+
+    if (js->read_fd < 0) {
+        xfree(js);
+        return NULL;
+    }
+    return js;
+}
+
+void jobserver_disconnect(Jobserver *js) {
+    if (!js) return;
+    if (js->owns_read_fd) close(js->read_fd);
+    xfree(js);
+}
+
+/* ===== TOKENS ===== */
+
+/* One poll for a token: the token byte, -1 if none came within `timeout_ms`,
+ * or -2 if the jobserver is unusable */
+static int take_token(Jobserver *js, int timeout_ms) {
+    struct pollfd pfd = {.fd = js->read_fd, .events = POLLIN, .revents = 0};
+    int ready = poll(&pfd, 1, timeout_ms);
+    if (ready < 0) return errno == EINTR ? -1 : -2;
+    if (ready == 0) return -1;
+    if (pfd.revents & POLLNVAL) return -2;
+
+    /* Another client may have taken the byte since poll() returned */
+    unsigned char token;
+    ssize_t n = read(js->read_fd, &token, 1);
+    if (n == 1) return token;
+    if (n == 0) return -2;  /* make went away */
+    if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) return -2;
+    return -1;
+}
+
+int jobserver_acquire(Jobserver *js, bool (*keep_waiting)(void *ctx), void *ctx) {
+    if (!js) return -1;
+
+    for (;;) {
+        if (keep_waiting && !keep_waiting(ctx)) return -1;
+
+        int token = take_token(js, JOBSERVER_POLL_MS);
+        if (token >= 0) return token;
+        if (token == -2) return -1;
+    }
+}
+
+int jobserver_try_acquire(Jobserver *js) {
+    if (!js) return -1;
+    int token = take_token(js, 0);
+    return token >= 0 ? token : -1;
+}
+
+void jobserver_release(Jobserver *js, int token) {
+    if (!js || token < 0) return;
+
+    unsigned char byte = (unsigned char)token;
+    while (write(js->write_fd, &byte, 1) < 0 && errno == EINTR) {
+        /* Retry */
+    }
+}
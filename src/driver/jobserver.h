@@ -0,0 +1,31 @@
+#ifndef JOBSERVER_H
+#define JOBSERVER_H
+
+#include <stdbool.h>
+
+/* Client side of the GNU make jobserver protocol.
+ *
+ * When invoked from `make -jN`, MAKEFLAGS carries --jobserver-auth with
+ * either a named fifo ("fifo:PATH") or an inherited pipe ("R,W"). Every
+ * process owns one implicit job slot; each additional concurrent job needs
+ * a token (one byte) read from the jobserver and written back afterwards. */
+
+typedef struct Jobserver Jobserver;
+
+/* Connect to the jobserver advertised in MAKEFLAGS; NULL if there is none
+ * or its descriptors are not usable */
+Jobserver *jobserver_connect(void);
+void jobserver_disconnect(Jobserver *js);
+
+/* Block until a token is available. `keep_waiting` is polled periodically
+ * and the wait is abandoned when it returns false. Returns the token byte,
+ * or -1 if no token was acquired. */
+int jobserver_acquire(Jobserver *js, bool (*keep_waiting)(void *ctx), void *ctx);
+
+/* Take a token only if one is available right now; -1 otherwise */
+int jobserver_try_acquire(Jobserver *js);
+
+/* Return a token obtained from jobserver_acquire */
+void jobserver_release(Jobserver *js, int token);
+
+#endif /* JOBSERVER_H */
@@ -0,0 +1,443 @@
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
+#include "objcache.h"
+#include "../common/hash.h"
+#include "../common/memory.h"
+#include "../common/probes.h"
+#include "../common/thread.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <sys/utsname.h>
+#include <time.h>
+#include <unistd.h>
+
+#define OBJCACHE_DEFAULT_LIMIT (5ULL * 1024 * 1024 * 1024)
+
+/* Eviction trims to this fraction of the limit so it does not rerun on
+ * every store */
+#define OBJCACHE_TRIM_PERCENT 90
+
+/* Abandoned temporaries older than this are removed by eviction */
+#define OBJCACHE_STALE_TEMP_SECONDS 3600
+
+#define OBJCACHE_COUNTER_FILE "size"
+
+/* Bump when the key layout changes */
+#define OBJCACHE_FORMAT "llvm-c object cache 2"
+
+/* ===== CONFIGURATION ===== */
+
+char *objcache_default_dir(void) {
+    const char *env = getenv(OBJCACHE_DIR_ENV);
+    if (env && *env) return xstrdup(env);
+
+    const char *base = getenv("XDG_CACHE_HOME");
+    const char *suffix = "/llvm-c";
+    if (!base || !*base) {
+        base = getenv("HOME");
+        suffix = "/.cache/llvm-c";
+    }
+    if (!base || !*base) base = "/tmp";
+
+    size_t len = strlen(base) + strlen(suffix) + 1;
+    char *dir = xmalloc(len);
+    snprintf(dir, len, "%s%s", base, suffix);
+    return dir;
+}
+
+uint64_t objcache_default_limit(void) {
+    const char *env = getenv(OBJCACHE_SIZE_ENV);
+    if (!env || !*env) return OBJCACHE_DEFAULT_LIMIT;
+
+    char *end;
+    double value = strtod(env, &end);
+    if (value <= 0) return OBJCACHE_DEFAULT_LIMIT;
+
+    switch (*end) {
+        case 'k': case 'K': value *= 1024.0; break;
+        case 'm': case 'M': value *= 1024.0 * 1024.0; break;
+        case 'g': case 'G': value *= 1024.0 * 1024.0 * 1024.0; break;
+        case 't': case 'T': value *= 1024.0 * 1024.0 * 1024.0 * 1024.0; break;
+        default: break;
+    }
+    return (uint64_t)value;
+}
+
+/* ===== KEYS ===== */
+
+/* Identifies this compiler build: a rebuilt compiler may produce different
+ * objects, so its size and mtime are part of every key */
+static char g_compiler_identity[256];
+static pthread_once_t g_compiler_identity_once = PTHREAD_ONCE_INIT;
+
+static void compute_compiler_identity(void) {
+    struct stat st;
+    if (stat("/proc/self/exe", &st) == 0) {
+        snprintf(g_compiler_identity, sizeof(g_compiler_identity), "%lld-%lld.%09ld",
+                 (long long)st.st_size, (long long)st.st_mtim.tv_sec, (long)st.st_mtim.tv_nsec);
+    } else {
+        snprintf(g_compiler_identity, sizeof(g_compiler_identity), "%s %s", __DATE__, __TIME__);
+    }
+
+    /* The default triple depends on the host */
+    struct utsname host;
+    if (uname(&host) == 0) {
+        size_t len = strlen(g_compiler_identity);
+        snprintf(g_compiler_identity + len, sizeof(g_compiler_identity) - len, " %s-%s",
+                 host.machine, host.sysname);
+    }
+}
+
+void objcache_key(char key[OBJCACHE_KEY_SIZE], const char *source, size_t source_len,
+                  const ObjectCacheFlags *flags) {
+    pthread_once(&g_compiler_identity_once, compute_compiler_identity);
+
+    char numbers[96];
+    snprintf(numbers, sizeof(numbers), "%d %d %d %d %zu %llx", flags->backend, flags->opt_level,
+             flags->debug_info ? 1 : 0, flags->pic ? 1 : 0, source_len,
+             (unsigned long long)flags->prefix_hash);
+
+    /* A shared cache directory must not hand one user's object to another
+     * who crafted a colliding source, so the key is a SHA-256 */
+    Sha256 h;
+    sha256_init(&h);
+    sha256_update_str(&h, OBJCACHE_FORMAT);
+    sha256_update_str(&h, g_compiler_identity);
+    sha256_update_str(&h, flags->input_name);
+    sha256_update_str(&h, flags->target_triple ? flags->target_triple : "<default>");
+    sha256_update_str(&h, flags->target_cpu ? flags->target_cpu : "generic");
+    sha256_update_str(&h, flags->target_features);
+    sha256_update_str(&h, numbers);
+    sha256_update(&h, source, source_len);
+    sha256_final_hex(&h, key);
+}
+
+/* ===== FILES ===== */
+
+static char *entry_path(const char *dir, const char *key, const char *ext) {
+    size_t len = strlen(dir) + strlen(key) + strlen(ext) + 4;
+    char *path = xmalloc(len);
+    snprintf(path, len, "%s/%.2s/%s%s", dir, key, key + 2, ext);
+    return path;
+}
+
+static bool make_dirs(const char *path) {
+    char *copy = xstrdup(path);
+    for (char *p = copy + 1; *p; p++) {
+        if (*p != '/') continue;
+        *p = '\0';
+        if (mkdir(copy, 0755) != 0 && errno != EEXIST) {
+            xfree(copy);
+            return false;
+        }
+        *p = '/';
+    }
+    bool ok = mkdir(copy, 0755) == 0 || errno == EEXIST;
+    xfree(copy);
+    return ok;
+}
+
+/* Create <dir>/<xx> for an entry on first use */
+static bool make_bucket(const char *path) {
+    char *sub = xstrdup(path);
+    *strrchr(sub, '/') = '\0';
+    bool ready = make_dirs(sub);
+    xfree(sub);
+    return ready;
+}
+
+/* Copy `from` into a fresh temporary next to `to`. Returns the temporary's
+ * path for publish(), or NULL on failure. */
+static char *copy_to_temp(const char *from, const char *to, uint64_t *copied) {
+    int in = open(from, O_RDONLY);
+    if (in < 0) return NULL;
+
+    size_t to_len = strlen(to);
+    char *temp = xmalloc(to_len + 12);
+    snprintf(temp, to_len + 12, "%s.tmp.XXXXXX", to);
+
+    int out = mkstemp(temp);
+    if (out < 0) {
+        close(in);
+        xfree(temp);
+        return NULL;
+    }
+
+    bool ok = true;
+    uint64_t total = 0;
+    char buffer[65536];
+    for (;;) {
+        ssize_t n = read(in, buffer, sizeof(buffer));
+        if (n == 0) break;
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            ok = false;
+            break;
+        }
+        for (ssize_t done = 0; ok && done < n;) {
+            ssize_t w = write(out, buffer + done, (size_t)(n - done));
+            if (w < 0 && errno != EINTR) ok = false;
+            if (w > 0) done += w;
+        }
+        if (!ok) break;
+        total += (uint64_t)n;
+    }
+
+    fchmod(out, 0644);
+    if (close(out) != 0) ok = false;
+    close(in);
+    if (!ok) {
+        unlink(temp);
+        xfree(temp);
+        return NULL;
+    }
+
+    if (copied) *copied = total;
+    return temp;
+}
+
+/* Write `data` to a fresh temporary next to `to`, as copy_to_temp() */
+static char *write_to_temp(const char *to, const char *data, size_t len) {
+    size_t to_len = strlen(to);
+    char *temp = xmalloc(to_len + 12);
+    snprintf(temp, to_len + 12, "%s.tmp.XXXXXX", to);
+
+    int out = mkstemp(temp);
+    if (out < 0) {
+        xfree(temp);
+        return NULL;
+    }
+
+    bool ok = true;
+    for (size_t done = 0; ok && done < len;) {
+        ssize_t w = write(out, data + done, len - done);
+        if (w < 0 && errno != EINTR) ok = false;
+        if (w > 0) done += (size_t)w;
+    }
+
+    fchmod(out, 0644);
+    if (close(out) != 0) ok = false;
+    if (!ok) {
+        unlink(temp);
+        xfree(temp);
+        return NULL;
+    }
+    return temp;
+}
+
+/* Rename a temporary over `to`; frees `temp` either way */
+static bool publish(char *temp, const char *to) {
+    bool ok = rename(temp, to) == 0;
+    if (!ok) unlink(temp);
+    xfree(temp);
+    return ok;
+}
+
+/* ===== LOOKUP ===== */
+
+static bool note_lookup(const char *key, const char *ext, bool hit) {
+    if (hit) {
+        LLVMC_PROBE2(cache__hit, key, ext);
+    } else {
+        LLVMC_PROBE2(cache__miss, key, ext);
+    }
+    return hit;
+}
+
+bool objcache_fetch(const char *dir, const char *key, const char *output) {
+    char *path = entry_path(dir, key, ".o");
+    char *temp = copy_to_temp(path, output, NULL);
+    bool hit = temp && publish(temp, output);
+
+    /* Mark as recently used for LRU eviction */
+    if (hit) utimensat(AT_FDCWD, path, NULL, 0);
+
+    xfree(path);
+    return note_lookup(key, ".o", hit);
+}
+
+bool objcache_fetch_blob(const char *dir, const char *key, const char *ext,
+                         char **data, size_t *len) {
+    *data = NULL;
+    *len = 0;
+
+    char *path = entry_path(dir, key, ext);
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        if (fd >= 0) close(fd);
+        xfree(path);
+        return note_lookup(key, ext, false);
+    }
+
+    size_t size = (size_t)st.st_size;
+    char *buffer = xmalloc(size + 1);
+    size_t total = 0;
+    while (total < size) {
+        ssize_t n = read(fd, buffer + total, size - total);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        total += (size_t)n;
+    }
+    close(fd);
+
+    bool hit = total == size;
+    if (hit) {
+        utimensat(AT_FDCWD, path, NULL, 0);
+        *data = buffer;
+        *len = size;
+    } else {
+        xfree(buffer);
+    }
+    xfree(path);
+    return note_lookup(key, ext, hit);
+}
+
+int objcache_open_blob(const char *dir, const char *key, const char *ext) {
+    char *path = entry_path(dir, key, ext);
+    int fd = open(path, O_RDONLY);
+    if (fd >= 0) utimensat(AT_FDCWD, path, NULL, 0);
+    xfree(path);
+    return fd;
+}
+
+/* ===== EVICTION ===== */
+
+typedef struct {
+    char *path;
+    uint64_t size;
+    time_t used;
+} CacheEntry;
+
+static int compare_least_recent(const void *a, const void *b) {
+    const CacheEntry *ea = (const CacheEntry *)a;
+    const CacheEntry *eb = (const CacheEntry *)b;
+    return (ea->used > eb->used) - (ea->used < eb->used);
+}
+
+/* Scan every entry, drop stale temporaries and delete least recently used
+ * objects until the total is under the trim target. Returns the new total.
+ * Called with the counter lock held. */
+static uint64_t evict(const char *dir, uint64_t limit) {
+    size_t count = 0, capacity = 1024;
+    CacheEntry *entries = xmalloc(capacity * sizeof(CacheEntry));
+    uint64_t total = 0;
+    time_t now = time(NULL);
+
+    for (int bucket = 0; bucket < 256; bucket++) {
+        char sub[4096];
+        snprintf(sub, sizeof(sub), "%s/%02x", dir, bucket);
+        DIR *d = opendir(sub);
+        if (!d) continue;
+
+        struct dirent *de;
+        while ((de = readdir(d)) != NULL) {
+            if (de->d_name[0] == '.') continue;
+
+            char path[4096 + 256];
+            snprintf(path, sizeof(path), "%s/%s", sub, de->d_name);
+            struct stat st;
+            if (stat(path, &st) != 0 || !S_ISREG(st.st_mode)) continue;
+
+            if (strstr(de->d_name, ".tmp.")) {
+                if (now - st.st_mtime > OBJCACHE_STALE_TEMP_SECONDS) unlink(path);
+                continue;
+            }
+
+            if (count == capacity) {
+                capacity *= 2;
+                entries = xrealloc(entries, capacity * sizeof(CacheEntry));
+            }
+            entries[count].path = xstrdup(path);
+            entries[count].size = (uint64_t)st.st_size;
+            entries[count].used = st.st_mtime;
+            total += (uint64_t)st.st_size;
+            count++;
+        }
+        closedir(d);
+    }
+
+    qsort(entries, count, sizeof(CacheEntry), compare_least_recent);
+
+    uint64_t target = limit / 100 * OBJCACHE_TRIM_PERCENT;
+    for (size_t i = 0; i < count; i++) {
+        if (total > target && unlink(entries[i].path) == 0) {
+            total -= entries[i].size;
+        }
+        xfree(entries[i].path);
+    }
+    xfree(entries);
+
+    return total;
+}
+
+/* Publish `temp` as the entry at `path` and add its size to the shared
+ * counter, less that of any entry it replaces, evicting if over `limit`.
+ * The rename happens under the counter lock so concurrent stores of one key
+ * cannot both count it. */
+static void publish_entry(const char *dir, char *temp, const char *path, uint64_t size,
+                          uint64_t limit) {
+    size_t len = strlen(dir) + sizeof(OBJCACHE_COUNTER_FILE) + 2;
+    char *counter_path = xmalloc(len);
+    snprintf(counter_path, len, "%s/%s", dir, OBJCACHE_COUNTER_FILE);
+
+    int fd = open(counter_path, O_RDWR | O_CREAT, 0644);
+    xfree(counter_path);
+    if (fd < 0 || flock(fd, LOCK_EX) != 0) {
+        /* Unaccounted; the next eviction scan corrects the total */
+        publish(temp, path);
+        if (fd >= 0) close(fd);
+        return;
+    }
+
+    struct stat st;
+    uint64_t replaced = stat(path, &st) == 0 ? (uint64_t)st.st_size : 0;
+    if (publish(temp, path)) {
+        char text[32] = {0};
+        ssize_t n = pread(fd, text, sizeof(text) - 1, 0);
+        uint64_t total = n > 0 ? strtoull(text, NULL, 10) : 0;
+
+        total = (total > replaced ? total - replaced : 0) + size;
+        if (total > limit) {
+            total = evict(dir, limit);
+        }
+
+        int written = snprintf(text, sizeof(text), "%llu\n", (unsigned long long)total);
+        if (ftruncate(fd, 0) == 0) {
+            ssize_t ignored = pwrite(fd, text, (size_t)written, 0);
+            (void)ignored;
+        }
+    }
+    flock(fd, LOCK_UN);
+    close(fd);
+}
+
+/* ===== STORE ===== */
+
+void objcache_store(const char *dir, const char *key, const char *object_path, uint64_t limit) {
+    char *path = entry_path(dir, key, ".o");
+
+    uint64_t size = 0;
+    char *temp = make_bucket(path) ? copy_to_temp(object_path, path, &size) : NULL;
+    if (temp) {
+        publish_entry(dir, temp, path, size, limit);
+    }
+    xfree(path);
+}
+
+void objcache_store_blob(const char *dir, const char *key, const char *ext,
+                         const char *data, size_t len, uint64_t limit) {
+    char *path = entry_path(dir, key, ext);
+
+    char *temp = make_bucket(path) ? write_to_temp(path, data, len) : NULL;
+    if (temp) {
+        publish_entry(dir, temp, path, (uint64_t)len, limit);
+    }
+    xfree(path);
+}
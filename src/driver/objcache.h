@@ -0,0 +1,71 @@
+#ifndef OBJCACHE_H
+#define OBJCACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Content-addressed object cache (--cache).
+ *
+ * Objects are stored under a directory as <dir>/<2 hex>/<62 hex>.o, keyed
+ * by a SHA-256 of the preprocessed source and everything else that
+ * determines the object. Entries are published with rename(), so
+ * concurrent processes only ever see complete files. A hit refreshes the entry's mtime, which is
+ * what eviction orders by; the directory's total size is tracked in a
+ * flock()-protected counter and trimmed back under the limit, oldest
+ * entries first, when a store pushes it over.
+ *
+ * Blobs (per-function code shards, AST images) share the same directory,
+ * buckets and size limit; they only differ in file extension. */
+
+#define OBJCACHE_KEY_SIZE 65        /* 64 hex digits + NUL */
+
+/* Environment overrides */
+#define OBJCACHE_DIR_ENV  "LLVMC_CACHE_DIR"
+#define OBJCACHE_SIZE_ENV "LLVMC_CACHE_SIZE"
+
+/* Everything besides the source text that goes into the object */
+typedef struct {
+    const char *input_name;     /* Module and debug-info file name */
+    const char *target_triple;  /* NULL for the host default */
+    const char *target_cpu;     /* NULL for generic */
+    const char *target_features;
+    int backend;
+    int opt_level;
+    bool debug_info;
+    bool pic;
+    uint64_t prefix_hash;       /* pch_hash() of -include-pch, 0 for none */
+} ObjectCacheFlags;
+
+/* $LLVMC_CACHE_DIR, else $XDG_CACHE_HOME/llvm-c, else ~/.cache/llvm-c.
+ * Caller frees. */
+char *objcache_default_dir(void);
+
+/* $LLVMC_CACHE_SIZE ("500M", "5G", ...) or 5 GiB */
+uint64_t objcache_default_limit(void);
+
+/* Compute the cache key for a preprocessed unit */
+void objcache_key(char key[OBJCACHE_KEY_SIZE], const char *source, size_t source_len,
+                  const ObjectCacheFlags *flags);
+
+/* Copy a cached object to `output`; false on a miss */
+bool objcache_fetch(const char *dir, const char *key, const char *output);
+
+/* Add a freshly built object; failures are silently ignored, the cache is
+ * only an accelerator */
+void objcache_store(const char *dir, const char *key, const char *object_path, uint64_t limit);
+
+/* Read the blob stored under `key` with extension `ext` into a buffer the
+ * caller frees; false on a miss */
+bool objcache_fetch_blob(const char *dir, const char *key, const char *ext,
+                         char **data, size_t *len);
+
+/* Open the blob stored under `key` for reading, e.g. to mmap it; -1 on a
+ * miss. The caller closes the descriptor. */
+int objcache_open_blob(const char *dir, const char *key, const char *ext);
+
+/* Add an in-memory blob; failures are ignored like objcache_store() */
+void objcache_store_blob(const char *dir, const char *key, const char *ext,
+                         const char *data, size_t len, uint64_t limit);
+
+#endif /* OBJCACHE_H */
@@ -0,0 +1,304 @@
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
+#include "pch.h"
+#include "../ast/ast.h"
+#include "../ast/ast_image.h"
+#include "../common/error.h"
+#include "../common/hash.h"
+#include "../common/memory.h"
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define PCH_MAGIC "LLVMCPCH"
+#define PCH_VERSION 2
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t dep_count;         /* Files the header was built from */
+    uint64_t content_hash;      /* Hash of the name tables and the image */
+    uint64_t name_counts[C_NAMES_TABLE_COUNT];
+    uint64_t names_offset;      /* Header path, dependencies, then each
+                                 * table's names */
+    uint64_t names_len;
+    uint64_t image_offset;
+} PchFileHeader;
+
+struct PrefixSnapshot {
+    void *base;                 /* File header and name tables */
+    size_t size;
+    const PchFileHeader *header;
+    const char *header_path;
+    const char *deps;           /* "<hash> <path>" for each dependency */
+    const char *names[C_NAMES_TABLE_COUNT];
+    ASTImage *image;
+};
+
+/* ===== WRITING ===== */
+
+typedef struct {
+    char *data;
+    size_t len;
+    size_t capacity;
+    uint64_t count;
+} NameBuffer;
+
+static void append_name(const char *name, void *ctx) {
+    NameBuffer *buf = (NameBuffer *)ctx;
+    size_t len = strlen(name) + 1;
+    if (buf->len + len > buf->capacity) {
+        while (buf->len + len > buf->capacity) {
+            buf->capacity = buf->capacity ? buf->capacity * 2 : 4096;
+        }
+        buf->data = xrealloc(buf->data, buf->capacity);
+    }
+    memcpy(buf->data + buf->len, name, len);
+    buf->len += len;
+    buf->count++;
+}
+
+/* Record a dependency as "<hash> <path>", like a line of a depfile's hash
+ * stamp */
+static bool append_dependency(NameBuffer *names, const char *resolved) {
+    uint64_t hash = 0;
+    if (!hash64_file(resolved, &hash)) return false;
+
+    char entry[PATH_MAX + 32];
+    snprintf(entry, sizeof(entry), "%016" PRIx64 " %s", hash, resolved);
+    append_name(entry, names);
+    return true;
+}
+
+bool pch_write(const char *path, const char *header, const DepFile *deps, CParser *parser,
+               ASTNode *ast) {
+    FILE *diag = diagnostic_stream();
+
+    char resolved[PATH_MAX];
+    NameBuffer names = {0};
+    if (!realpath(header, resolved)) {
+        fprintf(diag, "Error: cannot read '%s'\n", header);
+        return false;
+    }
+    append_name(resolved, &names);
+
+    /* The header itself first, then whatever it included */
+    names.count = 0;
+    const char *unreadable = append_dependency(&names, resolved) ? NULL : header;
+    for (size_t i = 0; !unreadable && deps && i < deps->dep_count; i++) {
+        char dep[PATH_MAX];
+        if (!realpath(deps->deps[i], dep) ||
+            (strcmp(dep, resolved) != 0 && !append_dependency(&names, dep))) {
+            unreadable = deps->deps[i];
+        }
+    }
+    if (unreadable) {
+        fprintf(diag, "Error: cannot read '%s'\n", unreadable);
+        xfree(names.data);
+        return false;
+    }
+    uint64_t dep_count = names.count;
+
+    char *image = NULL;
+    size_t image_len = 0;
+    if (!ast_image_write(ast, &image, &image_len)) {
+        fprintf(diag, "Error: cannot serialize the declarations of '%s'\n", header);
+        xfree(names.data);
+        return false;
+    }
+
+    PchFileHeader file_header;
+    memset(&file_header, 0, sizeof(file_header));
+    memcpy(file_header.magic, PCH_MAGIC, sizeof(file_header.magic));
+    file_header.version = PCH_VERSION;
+    file_header.dep_count = dep_count;
+
+    for (int t = 0; t < C_NAMES_TABLE_COUNT; t++) {
+        names.count = 0;
+        c_parser_visit_names(parser, (CNameTable)t, append_name, &names);
+        file_header.name_counts[t] = names.count;
+    }
+
+    file_header.names_offset = sizeof(PchFileHeader);
+    file_header.names_len = names.len;
+    file_header.image_offset = (file_header.names_offset + names.len + PCH_IMAGE_ALIGN - 1) /
+                               PCH_IMAGE_ALIGN * PCH_IMAGE_ALIGN;
+
+    Hash64 content;
+    hash64_init(&content);
+    hash64_update(&content, names.data, names.len);
+    hash64_update(&content, image, image_len);
+    file_header.content_hash = hash64_final(&content);
+
+    size_t total = (size_t)file_header.image_offset + image_len;
+    char *data = xcalloc(1, total);
+    memcpy(data, &file_header, sizeof(file_header));
+    memcpy(data + file_header.names_offset, names.data, names.len);
+    memcpy(data + file_header.image_offset, image, image_len);
+
+    FILE *out = fopen(path, "wb");
+    bool ok = out && fwrite(data, 1, total, out) == total;
+    if (out && fclose(out) != 0) ok = false;
+    if (!ok) {
+        fprintf(diag, "Error: cannot write '%s'\n", path);
+        remove(path);
+    }
+
+    xfree(data);
+    xfree(names.data);
+    xfree(image);
+    return ok;
+}
+
+/* ===== LOADING ===== */
+
+/* The first recorded file whose contents are not what they were when the
+ * snapshot was built, or NULL if none changed */
+static const char *changed_dependency(const PrefixSnapshot *pch) {
+    const char *entry = pch->deps;
+    for (uint64_t i = 0; i < pch->header->dep_count; i++) {
+        char *end = NULL;
+        uint64_t recorded = strtoull(entry, &end, 16);
+        if (end != entry + 16 || *end != ' ') return entry;
+
+        const char *file = end + 1;
+        uint64_t current = 0;
+        if (!hash64_file(file, &current) || current != recorded) return file;
+        entry += strlen(entry) + 1;
+    }
+    return NULL;
+}
+
+/* Locate each table in the name region; false if the counts do not fit */
+static bool index_names(PrefixSnapshot *pch) {
+    const char *p = (const char *)pch->base + pch->header->names_offset;
+    const char *end = p + pch->header->names_len;
+    if (pch->header->names_len == 0 || end[-1] != '\0') return false;
+
+    pch->header_path = p;
+    p += strlen(p) + 1;
+    pch->deps = p;
+    for (uint64_t i = 0; i < pch->header->dep_count; i++) {
+        if (p >= end) return false;
+        p += strlen(p) + 1;
+    }
+    for (int t = 0; t < C_NAMES_TABLE_COUNT; t++) {
+        pch->names[t] = p;
+        for (uint64_t i = 0; i < pch->header->name_counts[t]; i++) {
+            if (p >= end) return false;
+            p += strlen(p) + 1;
+        }
+    }
+    return true;
+}
+
+PrefixSnapshot *pch_load(const char *path) {
+    FILE *diag = diagnostic_stream();
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(diag, "Error: cannot open precompiled header '%s'\n", path);
+        return NULL;
+    }
+
+    struct stat st;
+    PchFileHeader header;
+    bool valid = fstat(fd, &st) == 0 &&
+                 pread(fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header) &&
+                 memcmp(header.magic, PCH_MAGIC, sizeof(header.magic)) == 0 &&
+                 header.version == PCH_VERSION &&
+                 header.names_offset == sizeof(PchFileHeader) &&
+                 header.image_offset % PCH_IMAGE_ALIGN == 0 &&
+                 header.names_len <= header.image_offset - header.names_offset &&
+                 header.image_offset < (uint64_t)st.st_size;
+    if (!valid) {
+        fprintf(diag, "Error: '%s' is not a precompiled header for this compiler\n", path);
+        close(fd);
+        return NULL;
+    }
+
+    PrefixSnapshot *pch = xcalloc(1, sizeof(PrefixSnapshot));
+    pch->size = (size_t)header.image_offset;
+    pch->base = mmap(NULL, pch->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (pch->base == MAP_FAILED) {
+        pch->base = NULL;
+        valid = false;
+    } else {
+        pch->header = (const PchFileHeader *)pch->base;
+        valid = index_names(pch);
+    }
+    if (valid) {
+        pch->image = ast_image_map_at(fd, pch->size);
+        valid = pch->image != NULL;
+    }
+    close(fd);
+
+    if (!valid) {
+        fprintf(diag, "Error: '%s' is not a precompiled header for this compiler\n", path);
+        pch_unload(pch);
+        return NULL;
+    }
+
+    /* Like a stale object, a snapshot of an edited header must not be used,
+     * nor one whose included headers changed: the unit's -imacros pass would
+     * see their new macros next to the snapshot's old declarations */
+    const char *changed = changed_dependency(pch);
+    if (changed) {
+        fprintf(diag, "Error: '%s' has changed since precompiled header '%s' was built\n",
+                changed, path);
+        pch_unload(pch);
+        return NULL;
+    }
+
+    return pch;
+}
+
+void pch_unload(PrefixSnapshot *pch) {
+    if (!pch) return;
+    ast_image_unmap(pch->image);
+    if (pch->base) munmap(pch->base, pch->size);
+    xfree(pch);
+}
+
+const char *pch_header(const PrefixSnapshot *pch) {
+    return pch->header_path;
+}
+
+uint64_t pch_hash(const PrefixSnapshot *pch) {
+    return pch->header->content_hash;
+}
+
+/* ===== USE ===== */
+
+void pch_restore_names(const PrefixSnapshot *pch, CParser *parser) {
+    for (int t = 0; t < C_NAMES_TABLE_COUNT; t++) {
+        const char *name = pch->names[t];
+        for (uint64_t i = 0; i < pch->header->name_counts[t]; i++) {
+            c_parser_add_name(parser, (CNameTable)t, name);
+            name += strlen(name) + 1;
+        }
+    }
+}
+
+ASTNode *pch_prepend(const PrefixSnapshot *pch, ASTNode *unit) {
+    ASTNode *combined = ast_create_translation_unit(unit->location);
+    ASTNode *prefix = ast_image_root(pch->image);
+    for (size_t i = 0; i < prefix->child_count; i++) {
+        ast_add_child(combined, prefix->children[i]);
+    }
+    for (size_t i = 0; i < unit->child_count; i++) {
+        ast_add_child(combined, unit->children[i]);
+    }
+    return combined;
+}
+
+void pch_release_unit(ASTNode *combined) {
+    ast_free_node(combined);
+}
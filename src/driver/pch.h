@@ -0,0 +1,63 @@
+#ifndef PCH_H
+#define PCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "../common/types.h"
+#include "../parser/c_parser.h"
+#include "../preprocessor/depfile.h"
+
+/* Prefix snapshots (--emit-pch / -include-pch).
+ *
+ * A snapshot holds what the front end knows after parsing a header: the
+ * parser's file-scope name tables (typedef names and struct/union/enum
+ * tags) and the header's declarations as a relocatable AST image. A unit
+ * compiled with -include-pch starts from that state instead of lexing and
+ * parsing the header again: the tables are seeded before parsing and the
+ * snapshot's declarations are placed ahead of the unit's own.
+ *
+ * Macros belong to the external preprocessor, which has no state to save,
+ * so the unit is preprocessed with the header as -imacros: its macros are
+ * defined (and its include guard with them) while its text is dropped.
+ *
+ * Because those macros are read afresh from the headers on every use, the
+ * snapshot records the content hash of the header and of every file it
+ * included, and is refused once any of them changes. Files a -MMD
+ * dependency file leaves out (system headers) are not tracked.
+ *
+ * File layout: header | dependencies and name tables | padding | AST image.
+ * The image starts on a PCH_IMAGE_ALIGN boundary so it can be mapped in
+ * place. */
+
+#define PCH_IMAGE_ALIGN 65536u
+
+typedef struct PrefixSnapshot PrefixSnapshot;
+
+/* Save the state left by parsing `header` into `path`. `deps` lists the
+ * files preprocessing `header` read, or is NULL if it was not preprocessed. */
+bool pch_write(const char *path, const char *header, const DepFile *deps, CParser *parser,
+               ASTNode *ast);
+
+/* Map a snapshot; reports problems (missing file, incompatible build, header
+ * or one it includes changed since the snapshot was made) to diagnostic_stream() and returns
+ * NULL. The result is read-only and may be shared by concurrent units. */
+PrefixSnapshot *pch_load(const char *path);
+void pch_unload(PrefixSnapshot *pch);
+
+/* Absolute path of the header the snapshot was built from */
+const char *pch_header(const PrefixSnapshot *pch);
+
+/* Identifies the snapshot's contents, for cache keys */
+uint64_t pch_hash(const PrefixSnapshot *pch);
+
+/* Seed a fresh parser with the snapshot's name tables */
+void pch_restore_names(const PrefixSnapshot *pch, CParser *parser);
+
+/* A translation unit holding the snapshot's declarations followed by those
+ * of `unit`. Neither tree is copied or modified; release the result with
+ * pch_release_unit() before either is destroyed. */
+ASTNode *pch_prepend(const PrefixSnapshot *pch, ASTNode *unit);
+void pch_release_unit(ASTNode *combined);
+
+#endif /* PCH_H */
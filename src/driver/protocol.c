@@ -0,0 +1,246 @@
+#define _POSIX_C_SOURCE 200809L
+#include "protocol.h"
+#include "../common/memory.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/* Upper bound for a single item, to reject garbage early */
+#define PROTO_MAX_ITEM (256u * 1024u * 1024u)
+#define PROTO_MAX_ITEMS (1u << 20)
+
+/* ===== MESSAGES ===== */
+
+void proto_message_init(ProtoMessage *msg) {
+    memset(msg, 0, sizeof(*msg));
+}
+
+void proto_message_free(ProtoMessage *msg) {
+    for (size_t i = 0; i < msg->count; i++) {
+        xfree(msg->items[i]);
+    }
+    xfree(msg->items);
+    xfree(msg->lengths);
+    proto_message_init(msg);
+}
+
+void proto_message_add(ProtoMessage *msg, const char *data, size_t len) {
+    if (msg->count == msg->capacity) {
+        msg->capacity = msg->capacity ? msg->capacity * 2 : 16;
+        msg->items = xrealloc(msg->items, msg->capacity * sizeof(char *));
+        msg->lengths = xrealloc(msg->lengths, msg->capacity * sizeof(size_t));
+    }
+
+    char *copy = xmalloc(len + 1);
+    if (len > 0) memcpy(copy, data, len);
+    copy[len] = '\0';
+
+    msg->items[msg->count] = copy;
+    msg->lengths[msg->count] = len;
+    msg->count++;
+}
+
+void proto_message_add_str(ProtoMessage *msg, const char *str) {
+    proto_message_add(msg, str ? str : "", str ? strlen(str) : 0);
+}
+
+/* ===== I/O ===== */
+
+static bool write_all(int fd, const void *data, size_t len) {
+    const char *p = data;
+    while (len > 0) {
+        /* A peer that went away is an error, not a SIGPIPE */
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+static bool read_all(int fd, void *data, size_t len) {
+    char *p = data;
+    while (len > 0) {
+        ssize_t n = read(fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        if (n == 0) return false;
+        p += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+static bool write_u32(int fd, uint32_t value) {
+    uint32_t net = htonl(value);
+    return write_all(fd, &net, sizeof(net));
+}
+
+static bool read_u32(int fd, uint32_t *value) {
+    uint32_t net;
+    if (!read_all(fd, &net, sizeof(net))) return false;
+    *value = ntohl(net);
+    return true;
+}
+
+bool proto_send(int fd, const ProtoMessage *msg) {
+    if (!write_u32(fd, (uint32_t)msg->count)) return false;
+    for (size_t i = 0; i < msg->count; i++) {
+        if (!write_u32(fd, (uint32_t)msg->lengths[i])) return false;
+        if (!write_all(fd, msg->items[i], msg->lengths[i])) return false;
+    }
+    return true;
+}
+
+bool proto_recv(int fd, ProtoMessage *msg) {
+    proto_message_init(msg);
+
+    uint32_t count;
+    if (!read_u32(fd, &count) || count > PROTO_MAX_ITEMS) return false;
+
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t len;
+        if (!read_u32(fd, &len) || len > PROTO_MAX_ITEM) goto fail;
+
+        char *data = xmalloc((size_t)len + 1);
+        if (!read_all(fd, data, len)) {
+            xfree(data);
+            goto fail;
+        }
+        proto_message_add(msg, data, len);
+        xfree(data);
+    }
+    return true;
+
+fail:
+    proto_message_free(msg);
+    return false;
+}
+
+/* ===== SOCKETS ===== */
+
+char *proto_default_socket_path(void) {
+    const char *env = getenv(PROTO_SOCKET_ENV);
+    if (env && *env) return xstrdup(env);
+
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/llvm-c-%u.sock", (unsigned)getuid());
+    return xstrdup(path);
+}
+
+int proto_connect(const char *socket_path) {
+    struct sockaddr_un addr;
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) return -1;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, socket_path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* Split "HOST:PORT" (the last colon separates the port); NULL if not TCP */
+static char *split_tcp_address(const char *address, const char **port) {
+    const char *colon = strrchr(address, ':');
+    if (!colon || colon == address || !colon[1]) return NULL;
+    *port = colon + 1;
+    return xstrndup(address, (size_t)(colon - address));
+}
+
+static const char *unix_socket_path(const char *address) {
+    if (strncmp(address, "unix:", 5) == 0) return address + 5;
+    if (address[0] == '/') return address;
+    return NULL;
+}
+
+/* Resolve and connect or bind a TCP address */
+static int tcp_socket(const char *address, bool listening) {
+    const char *port;
+    char *host = split_tcp_address(address, &port);
+    if (!host) return -1;
+
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = listening ? AI_PASSIVE : 0;
+
+    struct addrinfo *results = NULL;
+    int rc = getaddrinfo(host, port, &hints, &results);
+    xfree(host);
+    if (rc != 0) return -1;
+
+    int fd = -1;
+    for (struct addrinfo *ai = results; ai; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0) continue;
+
+        int one = 1;
+        if (listening) {
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+            if (bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 && listen(fd, SOMAXCONN) == 0) break;
+        } else {
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) break;
+        }
+        close(fd);
+        fd = -1;
+    }
+
+    freeaddrinfo(results);
+    return fd;
+}
+
+int proto_connect_address(const char *address) {
+    const char *path = unix_socket_path(address);
+    return path ? proto_connect(path) : tcp_socket(address, false);
+}
+
+int proto_listen_address(const char *address) {
+    const char *path = unix_socket_path(address);
+    if (!path) return tcp_socket(address, true);
+
+    struct sockaddr_un addr;
+    if (strlen(path) >= sizeof(addr.sun_path)) return -1;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+
+    /* Only the owning user may submit compiles, as with the daemon */
+    unlink(path);
+    mode_t old_mask = umask(077);
+    int bound = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+    umask(old_mask);
+
+    if (bound < 0 || listen(fd, SOMAXCONN) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
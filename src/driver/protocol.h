@@ -0,0 +1,51 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+/* Wire format shared by the compile server (--daemon) and its client.
+ *
+ * A message is a list of byte strings. On the wire it is a 32-bit item
+ * count followed by each item as a 32-bit length and its bytes, all
+ * integers in network byte order.
+ *
+ * Request:  PROTO_MAGIC, cwd, argc, argv[0..argc), environment entries...
+ * Response: PROTO_MAGIC, exit status, stdout text, stderr text */
+
+#define PROTO_MAGIC "llvm-c/1"
+
+/* Environment variable overriding the default socket path */
+#define PROTO_SOCKET_ENV "LLVMC_DAEMON_SOCKET"
+
+typedef struct {
+    char **items;       /* Each item is also NUL-terminated */
+    size_t *lengths;
+    size_t count;
+    size_t capacity;
+} ProtoMessage;
+
+void proto_message_init(ProtoMessage *msg);
+void proto_message_free(ProtoMessage *msg);
+void proto_message_add(ProtoMessage *msg, const char *data, size_t len);
+void proto_message_add_str(ProtoMessage *msg, const char *str);
+
+/* Blocking send/receive of one whole message */
+bool proto_send(int fd, const ProtoMessage *msg);
+bool proto_recv(int fd, ProtoMessage *msg);
+
+/* $LLVMC_DAEMON_SOCKET, or a per-user path under /tmp. Caller frees. */
+char *proto_default_socket_path(void);
+
+/* Connect to a server socket; returns the fd or -1 */
+int proto_connect(const char *socket_path);
+
+/* Addresses are "unix:PATH", an absolute socket path, or "HOST:PORT" for
+ * TCP. Both return the fd or -1. A Unix socket is created accessible to
+ * its owner only. TCP has neither authentication nor encryption: anyone
+ * who can reach the port runs the compiler as the listening user, so only
+ * listen on TCP inside a trusted network. */
+int proto_connect_address(const char *address);
+int proto_listen_address(const char *address);
+
+#endif /* PROTOCOL_H */
@@ -1,6 +1,7 @@
 #include "lexer.h"
 #include "../common/memory.h"
 #include "../common/error.h"
+#include "../common/statistic.h"
 #include <string.h>
 #include <stdlib.h>
 #include <ctype.h>
@@ -13,6 +14,13 @@
 #define AT_END(lexer) ((lexer)->position >= (lexer)->length)
 #define ADVANCE(lexer) ((lexer)->position++, (lexer)->column++)
 
+STATISTIC(NumIdentifiers, "lexer", "Identifier tokens");
+STATISTIC(NumKeywords, "lexer", "Keyword tokens");
+STATISTIC(NumKeywordProbes, "lexer", "Keyword table comparisons");
+STATISTIC(NumNumbers, "lexer", "Number literal tokens");
+STATISTIC(NumStrings, "lexer", "String and character literal tokens");
+STATISTIC(NumPunctuators, "lexer", "Operator and punctuator tokens");
+
 /* Create lexer */
 Lexer *lexer_create(const char *source, const char *filename, SyntaxDefinition *syntax) {
     Lexer *lexer = xcalloc(1, sizeof(Lexer));
@@ -177,6 +185,8 @@ static Token *lex_identifier(Lexer *lexer) {
     /* Check if it's a keyword */
     for (size_t i = 0; i < lexer->syntax->keyword_count; i++) {
         if (strcmp(lexeme, lexer->syntax->keywords[i].name) == 0) {
+            STATISTIC_ADD(NumKeywordProbes, i + 1);
+            STATISTIC_INC(NumKeywords);
             Token *token = token_create(lexer->syntax->keywords[i].token_type,
                                        lexeme, length, loc);
             xfree(lexeme);
@@ -185,6 +195,8 @@ static Token *lex_identifier(Lexer *lexer) {
     }
     
     /* It's an identifier */
+    STATISTIC_ADD(NumKeywordProbes, lexer->syntax->keyword_count);
+    STATISTIC_INC(NumIdentifiers);
     Token *token = token_create(TOKEN_IDENTIFIER, lexeme, length, loc);
     xfree(lexeme);
     return token;
@@ -441,8 +453,8 @@ static Token *lex_operator_or_punct(Lexer *lexer) {
     return token_create(TOKEN_ERROR, unknown, 1, loc);
 }
 
-/* Tokenize entire source */
-TokenList *lexer_tokenize(Lexer *lexer) {
+/* Lex the next token, skipping trivia */
+Token *lexer_next_token(Lexer *lexer) {
     while (!AT_END(lexer)) {
         skip_trivia(lexer);
         
@@ -455,17 +467,48 @@ TokenList *lexer_tokenize(Lexer *lexer) {
             token = lex_identifier(lexer);
         } else if (lexer->syntax->is_digit(current)) {
             token = lex_number(lexer);
+            STATISTIC_INC(NumNumbers);
         } else if (current == lexer->syntax->string_delimiter) {
             token = lex_string(lexer);
+            STATISTIC_INC(NumStrings);
         } else if (current == lexer->syntax->char_delimiter) {
             token = lex_char(lexer);
+            STATISTIC_INC(NumStrings);
         } else {
             token = lex_operator_or_punct(lexer);
+            if (token) STATISTIC_INC(NumPunctuators);
         }
         
-        if (token) {
-            token_list_append(lexer->tokens, token);
-        }
+        if (token) return token;
+    }
+    return NULL;
+}
+
+Token *lexer_stream_token(Lexer *lexer) {
+    Token *token = lexer_next_token(lexer);
+    return token ? token : token_create(TOKEN_EOF, "", 0, lexer_location(lexer));
+}
+
+LexerCheckpoint lexer_checkpoint_at(const Token *token) {
+    LexerCheckpoint checkpoint = {
+        .position = token->location.offset,
+        .line = token->location.line,
+        .column = token->location.column
+    };
+    return checkpoint;
+}
+
+void lexer_restore(Lexer *lexer, LexerCheckpoint checkpoint) {
+    lexer->position = checkpoint.position;
+    lexer->line = checkpoint.line;
+    lexer->column = checkpoint.column;
+}
+
+/* Tokenize entire source */
+TokenList *lexer_tokenize(Lexer *lexer) {
+    Token *token;
+    while ((token = lexer_next_token(lexer)) != NULL) {
+        token_list_append(lexer->tokens, token);
     }
     
     /* Add EOF token */
@@ -513,8 +556,10 @@ Token *token_list_get(TokenList *list, size_t index) {
 }
 
 /* Token operations */
+static Slab token_slab = SLAB_INIT("Token", Token);
+
 Token *token_create(TokenType type, const char *lexeme, size_t length, SourceLocation loc) {
-    Token *token = xcalloc(1, sizeof(Token));
+    Token *token = slab_alloc(&token_slab);
     token->type = type;
     token->lexeme = xstrndup(lexeme, length);
     token->length = length;
@@ -529,7 +574,7 @@ void token_destroy(Token *token) {
         if (token->type == TOKEN_STRING_LITERAL && token->value.string_value) {
             xfree(token->value.string_value);
         }
-        xfree(token);
+        slab_free(&token_slab, token);
     }
 }
 
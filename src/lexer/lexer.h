@@ -32,6 +32,25 @@ void lexer_destroy(Lexer *lexer);
 /* Tokenize entire source */
 TokenList *lexer_tokenize(Lexer *lexer);
 
+/* Lex the token after the current position without adding it to the
+ * lexer's list; NULL at the end of the source (no EOF token) */
+Token *lexer_next_token(Lexer *lexer);
+
+/* Same, but an EOF token at the end, for a parser lexing on demand */
+Token *lexer_stream_token(Lexer *lexer);
+
+/* Lexer state between tokens. The lexer carries nothing else from one
+ * token to the next, so resuming from a checkpoint taken at a token's
+ * location yields exactly the tokens a full run would. */
+typedef struct {
+    size_t position;
+    uint32_t line;
+    uint32_t column;
+} LexerCheckpoint;
+
+LexerCheckpoint lexer_checkpoint_at(const Token *token);
+void lexer_restore(Lexer *lexer, LexerCheckpoint checkpoint);
+
 /* Token list operations */
 TokenList *token_list_create(void);
 void token_list_destroy(TokenList *list);
@@ -1,33 +1,21 @@
-#include "ast/ast.h"
-#include "codegen/codegen.h"
-#include "common/debug.h"
 #include "common/error.h"
+#include "common/hash.h"
 #include "common/memory.h"
-#include "lexer/lexer.h"
-#include "parser/c_parser.h"
-#include "parser/parser.h"
-#include "preprocessor/preprocessor.h"
-#include "syntax/c_syntax.h"
-#include "syntax/syntax.h"
+#include "common/perfcount.h"
+#include "common/statistic.h"
+#include "common/timer.h"
+#include "driver/compdb.h"
+#include "driver/daemon.h"
+#include "driver/dist.h"
+#include "driver/objcache.h"
+#include "driver/driver.h"
+#include "driver/protocol.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-/* Debug flags */
-typedef struct {
-    bool lexer;
-    bool parser;
-    bool ast;
-    bool codegen;
-    bool tokens;
-    bool stats;
-    bool verbose;
-    bool all;
-    char *output_file;
-} DebugFlags;
-
 static void print_usage(const char *program) {
-  printf("Usage: %s [options] <input-file>\n", program);
+  printf("Usage: %s [options] <input-file>...\n", program);
   printf("\nOptions:\n");
   printf("  -o <file>          Write output to <file>\n");
   printf("  -O<level>          Optimization level (0-3, s, z)\n");
@@ -35,10 +23,40 @@ static void print_usage(const char *program) {
   printf("  -S                 Emit assembly\n");
   printf("  -c                 Compile only, don't link\n");
   printf("  --emit-llvm        Emit LLVM IR\n");
+  printf("  --emit-pch         Save the parsed state of a header (default\n");
+  printf("                     output: <header>.pch)\n");
+  printf("  -include-pch <f>   Start every input from a --emit-pch snapshot\n");
+  printf("                     instead of parsing its header\n");
   printf("  --backend=<name>   Use backend (llvm, rust, zig, c)\n");
   printf("  --target=<triple>  Target triple\n");
   printf("  -I<path>           Add include path\n");
   printf("  -D<macro>=<value>  Define macro\n");
+  printf("  -MD                Write a dependency file (all headers)\n");
+  printf("  -MMD               Write a dependency file (user headers only)\n");
+  printf("  -MF <file>         Dependency file path (default: output with .d)\n");
+  printf("  -MT <target>       Dependency rule target (default: output)\n");
+  printf("  --skip-if-up-to-date[=mtime|hash]\n");
+  printf("                     Skip compiling when the output is current with\n");
+  printf("                     respect to its recorded dependencies\n");
+  printf("  -j <n>, -j<n>      Compile up to <n> input files in parallel\n");
+  printf("                     (under make -jN, job slots come from make);\n");
+  printf("                     with one input, split the executable's code\n");
+  printf("                     generation into <n> parallel pieces\n");
+  printf("  --build <db>       Compile every entry of a compile_commands.json,\n");
+  printf("                     skipping entries whose outputs are up to date\n");
+  printf("  --daemon[=<sock>]  Serve compile requests on a Unix socket\n");
+  printf("                     (default: $%s or /tmp/llvm-c-<uid>.sock)\n", PROTO_SOCKET_ENV);
+  printf("  --stream           Generate code for each declaration as soon as it\n");
+  printf("                     is parsed and free it, keeping front-end memory\n");
+  printf("                     bounded by the largest declaration\n");
+  printf("  --cache[=<dir>]    Reuse objects from a content-addressed cache\n");
+  printf("                     (default: $%s or ~/.cache/llvm-c; size\n", OBJCACHE_DIR_ENV);
+  printf("                     limit: $%s, default 5G); with -O1 and up,\n", OBJCACHE_SIZE_ENV);
+  printf("                     unchanged functions are reused as well\n");
+  printf("  --dist=<addr>,...  Compile objects on remote workers (unix:PATH or\n");
+  printf("                     HOST:PORT; default: $%s)\n", DIST_WORKERS_ENV);
+  printf("  --dist-worker=<addr> Serve distributed compile requests (TCP: trusted\n");
+  printf("                     networks only, requests are not authenticated)\n");
   printf("  -v, --verbose      Verbose output\n");
   printf("  -h, --help         Show this help\n");
   printf("\nDebug Options:\n");
@@ -51,6 +69,24 @@ static void print_usage(const char *program) {
   printf("  --debug-stats      Show compilation statistics\n");
   printf("  --debug-verbose    Extra verbose debug output\n");
   printf("  --debug-file <f>   Write debug output to file instead of stdout\n");
+  printf("  --heap-profile[=<f>] Sample allocations (every $%s bytes,\n", MEMORY_PROFILE_RATE_ENV);
+  printf("                     default %d) and print the top allocation sites;\n",
+         MEMORY_PROFILE_DEFAULT_RATE);
+  printf("                     with <f>, also write folded stacks for flame graphs\n");
+  printf("  --perf-counters    Count cycles, instructions, branch and cache misses\n");
+  printf("                     and page faults per compiler phase\n");
+  printf("  --stats            Print internal event counts (tokens, table probes, ...)\n");
+  printf("  --stats-json=<f>   Write the same counts to <f> as JSON\n");
+  printf("  -ftime-report      Print time spent per phase, function and pass\n");
+  printf("  -ftime-trace[=<f>] Write a Chrome trace of the same regions to <f>\n");
+  printf("                     (default time-trace.json)\n");
+  printf("  -Rpass=<re>        Report optimizations done by passes matching <re>\n");
+  printf("  -Rpass-missed=<re> Report optimizations missed by passes matching <re>\n");
+  printf("  -Rpass-analysis=<re> Report the analysis behind the decisions of passes\n");
+  printf("                     matching <re>\n");
+  printf("  --function-report=<f> Write each function's size and time spent in IR\n");
+  printf("                     generation, optimization and emission to <f>, as\n");
+  printf("                     CSV, or JSON if <f> ends in .json\n");
   printf("\nBackends:\n");
   printf("  llvm               LLVM backend (default)\n");
   printf("  rust               Rust backend (if available)\n");
@@ -58,7 +94,13 @@ static void print_usage(const char *program) {
   printf("  c                  C transpiler\n");
 }
 
-int main(int argc, char **argv) {
+/* --skip-if-up-to-date, bare or with =<mode>, but not a longer flag */
+static bool is_skip_if_up_to_date(const char *arg) {
+  return strncmp(arg, "--skip-if-up-to-date", 20) == 0 && (arg[20] == '\0' || arg[20] == '=');
+}
+
+/* One compiler invocation; also what the daemon runs per request */
+static int run_command_line(int argc, char **argv) {
   if (argc < 2) {
     print_usage(argv[0]);
     return 1;
@@ -68,286 +110,279 @@ int main(int argc, char **argv) {
   diagnostic_init();
 
   /* Parse command line */
-  const char *input_file = NULL;
-  const char *output_file = "a.out";
-  int opt_level = 0;
-  bool debug_info = false;
-  bool emit_assembly = false;
-  bool emit_llvm = false;
-  bool compile_only = false;
-  BackendType backend = BACKEND_LLVM;
-  const char *target_triple = NULL;
-  
-  /* Initialize debug flags */
-  DebugFlags debug_flags = {0};
-  debug_flags.output_file = NULL;
+  DriverOptions opts;
+  driver_options_init(&opts);
+  DebugFlags *debug_flags = &opts.debug;
+
+  const char **inputs = xmalloc(argc * sizeof(char *));
+  size_t input_count = 0;
+  const char *build_database = NULL;
+  char *default_cache_dir = NULL;
+  bool use_cache = getenv(OBJCACHE_DIR_ENV) != NULL;
+  bool heap_profile = false;
+  const char *heap_profile_file = NULL;
+  bool perf_counters = false;
+  bool stats = false;
+  const char *stats_json_file = NULL;
+  bool time_report = false;
+  const char *time_trace_file = NULL;
+  RemarkFilters remarks = {NULL, NULL, NULL};
+  int status = 1;
 
   for (int i = 1; i < argc; i++) {
     if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
       print_usage(argv[0]);
-      return 0;
+      status = 0;
+      goto done;
     } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
-      output_file = argv[++i];
+      opts.output_file = argv[++i];
     } else if (strncmp(argv[i], "-O", 2) == 0) {
       char level = argv[i][2];
       if (level >= '0' && level <= '3') {
-        opt_level = level - '0';
+        opts.opt_level = level - '0';
       } else if (level == 's' || level == 'z') {
-        opt_level = 2; /* Size optimization */
+        opts.opt_level = 2; /* Size optimization */
       }
     } else if (strcmp(argv[i], "-g") == 0) {
-      debug_info = true;
+      opts.debug_info = true;
     } else if (strcmp(argv[i], "-S") == 0) {
-      emit_assembly = true;
+      opts.emit_assembly = true;
     } else if (strcmp(argv[i], "-c") == 0) {
-      compile_only = true;
+      opts.compile_only = true;
     } else if (strcmp(argv[i], "--emit-llvm") == 0) {
-      emit_llvm = true;
+      opts.emit_llvm = true;
+    } else if (strcmp(argv[i], "--emit-pch") == 0) {
+      opts.emit_pch = true;
+    } else if (strcmp(argv[i], "-include-pch") == 0 && i + 1 < argc) {
+      opts.include_pch = argv[++i];
+    } else if (strncmp(argv[i], "-j", 2) == 0) {
+      const char *count = argv[i][2] ? argv[i] + 2 : (i + 1 < argc ? argv[++i] : "");
+      opts.jobs = atoi(count);
+      if (opts.jobs < 1) {
+        fprintf(stderr, "Invalid job count: %s\n", count);
+        goto done;
+      }
+    } else if (strcmp(argv[i], "--stream") == 0) {
+      opts.stream = true;
+    } else if (strcmp(argv[i], "--cache") == 0) {
+      use_cache = true;
+    } else if (strncmp(argv[i], "--cache=", 8) == 0) {
+      use_cache = true;
+      opts.cache_dir = argv[i] + 8;
+    } else if (strncmp(argv[i], "--dist=", 7) == 0) {
+      opts.dist_workers = argv[i] + 7;
+    } else if (strcmp(argv[i], "--build") == 0 && i + 1 < argc) {
+      build_database = argv[++i];
     } else if (strncmp(argv[i], "--backend=", 10) == 0) {
       const char *backend_name = argv[i] + 10;
       if (strcmp(backend_name, "llvm") == 0) {
-        backend = BACKEND_LLVM;
+        opts.backend = BACKEND_LLVM;
       } else if (strcmp(backend_name, "rust") == 0) {
-        backend = BACKEND_RUST;
+        opts.backend = BACKEND_RUST;
       } else if (strcmp(backend_name, "zig") == 0) {
-        backend = BACKEND_ZIG;
+        opts.backend = BACKEND_ZIG;
       } else if (strcmp(backend_name, "c") == 0) {
-        backend = BACKEND_C;
+        opts.backend = BACKEND_C;
       } else {
         fprintf(stderr, "Unknown backend: %s\n", backend_name);
-        return 1;
+        goto done;
+      }
+    } else if (strcmp(argv[i], "-MD") == 0) {
+      opts.dep_requested = true;
+      opts.dep_system_headers = true;
+    } else if (strcmp(argv[i], "-MMD") == 0) {
+      opts.dep_requested = true;
+    } else if (strcmp(argv[i], "-MF") == 0 && i + 1 < argc) {
+      opts.dep_file = argv[++i];
+    } else if (strcmp(argv[i], "-MT") == 0 && i + 1 < argc) {
+      opts.dep_target = argv[++i];
+    } else if (is_skip_if_up_to_date(argv[i])) {
+      const char *mode = argv[i] + 20;
+      opts.skip_if_up_to_date = true;
+      if (strcmp(mode, "=hash") == 0) {
+        opts.skip_mode = DEP_CHECK_HASH;
+      } else if (*mode != '\0' && strcmp(mode, "=mtime") != 0) {
+        fprintf(stderr, "Unknown up-to-date check: %s\n", mode + 1);
+        goto done;
       }
     } else if (strncmp(argv[i], "--target=", 9) == 0) {
-      target_triple = argv[i] + 9;
+      opts.target_triple = argv[i] + 9;
     } else if (strcmp(argv[i], "--debug-lexer") == 0) {
-      debug_flags.lexer = true;
+      debug_flags->lexer = true;
     } else if (strcmp(argv[i], "--debug-parser") == 0) {
-      debug_flags.parser = true;
+      debug_flags->parser = true;
     } else if (strcmp(argv[i], "--debug-ast") == 0) {
-      debug_flags.ast = true;
+      debug_flags->ast = true;
     } else if (strcmp(argv[i], "--debug-codegen") == 0) {
-      debug_flags.codegen = true;
+      debug_flags->codegen = true;
     } else if (strcmp(argv[i], "--debug-tokens") == 0) {
-      debug_flags.tokens = true;
+      debug_flags->tokens = true;
     } else if (strcmp(argv[i], "--debug-stats") == 0) {
-      debug_flags.stats = true;
+      debug_flags->stats = true;
     } else if (strcmp(argv[i], "--debug-verbose") == 0) {
-      debug_flags.verbose = true;
+      debug_flags->verbose = true;
     } else if (strcmp(argv[i], "--debug-all") == 0) {
-      debug_flags.all = true;
-      debug_flags.lexer = true;
-      debug_flags.parser = true;
-      debug_flags.ast = true;
-      debug_flags.codegen = true;
-      debug_flags.tokens = true;
-      debug_flags.stats = true;
-      debug_flags.verbose = true;
+      debug_flags->all = true;
+      debug_flags->lexer = true;
+      debug_flags->parser = true;
+      debug_flags->ast = true;
+      debug_flags->codegen = true;
+      debug_flags->tokens = true;
+      debug_flags->stats = true;
+      debug_flags->verbose = true;
     } else if (strcmp(argv[i], "--debug-file") == 0 && i + 1 < argc) {
-      debug_flags.output_file = argv[++i];
+      debug_flags->output_file = argv[++i];
+    } else if (strncmp(argv[i], "--heap-profile", 14) == 0 &&
+               (argv[i][14] == '\0' || argv[i][14] == '=')) {
+      heap_profile = true;
+      heap_profile_file = argv[i][14] == '=' ? argv[i] + 15 : NULL;
+    } else if (strcmp(argv[i], "--stats") == 0) {
+      stats = true;
+    } else if (strncmp(argv[i], "--stats-json=", 13) == 0) {
+      stats_json_file = argv[i] + 13;
+    } else if (strcmp(argv[i], "--perf-counters") == 0) {
+      perf_counters = true;
+    } else if (strcmp(argv[i], "-ftime-report") == 0) {
+      time_report = true;
+    } else if (strncmp(argv[i], "-ftime-trace", 12) == 0 &&
+               (argv[i][12] == '\0' || argv[i][12] == '=')) {
+      time_trace_file = argv[i][12] == '=' ? argv[i] + 13 : "time-trace.json";
+    } else if (strncmp(argv[i], "-Rpass=", 7) == 0) {
+      remarks.passed = argv[i] + 7;
+    } else if (strncmp(argv[i], "-Rpass-missed=", 14) == 0) {
+      remarks.missed = argv[i] + 14;
+    } else if (strncmp(argv[i], "-Rpass-analysis=", 16) == 0) {
+      remarks.analysis = argv[i] + 16;
+    } else if (strncmp(argv[i], "--function-report=", 18) == 0) {
+      opts.function_report = argv[i] + 18;
     } else if (argv[i][0] != '-') {
-      input_file = argv[i];
+      inputs[input_count++] = argv[i];
     }
   }
 
-  if (!input_file) {
+  if (input_count == 0 && !build_database) {
     fprintf(stderr, "Error: no input file\n");
     print_usage(argv[0]);
-    return 1;
+    goto done;
   }
 
-  /* Read input file */
-  FILE *f = fopen(input_file, "r");
-  if (!f) {
-    fprintf(stderr, "Error: cannot open file '%s'\n", input_file);
-    return 1;
+  /* A snapshot only carries its own header's macros (see pch.h) */
+  if (opts.emit_pch && opts.include_pch) {
+    fprintf(stderr, "Error: --emit-pch cannot be combined with -include-pch\n");
+    goto done;
   }
 
-  fseek(f, 0, SEEK_END);
-  long size = ftell(f);
-  fseek(f, 0, SEEK_SET);
-
-  char *source = xmalloc(size + 1);
-  fread(source, 1, size, f);
-  source[size] = '\0';
-  fclose(f);
-
-  /* Register source for diagnostics */
-  diagnostic_set_source(input_file, source);
+  if (!backend_set_remark_filters(&remarks)) {
+    goto done;
+  }
 
-  /* Create syntax definition */
-  SyntaxDefinition *syntax = syntax_c99_create();
+  if (!opts.dist_workers) {
+    opts.dist_workers = getenv(DIST_WORKERS_ENV);
+  }
 
-  /* Preprocess if needed */
-  if (syntax->supports_preprocessor) {
-    Preprocessor *pp = preprocessor_create(NULL);
-    char *preprocessed = preprocessor_process_string(pp, source, input_file);
-    if (preprocessed) {
-      xfree(source);
-      source = preprocessed;
+  if (use_cache) {
+    if (!opts.cache_dir) {
+      default_cache_dir = objcache_default_dir();
+      opts.cache_dir = default_cache_dir;
     }
-    preprocessor_destroy(pp);
+    opts.cache_limit = objcache_default_limit();
   }
 
-  /* Lex */
-  if (!debug_flags.verbose) printf("Lexing...\n");
-  Lexer *lexer = lexer_create(source, input_file, syntax);
-  TokenList *tokens = lexer_tokenize(lexer);
+  /* Skipping needs recorded dependencies, so it implies -MD */
+  if (opts.skip_if_up_to_date && !opts.dep_requested) {
+    opts.dep_requested = true;
+    opts.dep_system_headers = true;
+  }
 
-  if (error_count() > 0) {
-    fprintf(stderr, "%d error(s) during lexing\n", error_count());
-    lexer_destroy(lexer);
-    syntax_c99_destroy(syntax);
-    xfree(source);
-    return 1;
+  /* Flags that change the output invalidate it just like a header edit;
+   * -j, --cache and --dist do not change what a unit compiles to */
+  Hash64 command_hash;
+  hash64_init(&command_hash);
+  for (int i = 1; i < argc; i++) {
+    if (is_skip_if_up_to_date(argv[i])) continue;
+    if (strncmp(argv[i], "--dist=", 7) == 0) continue;
+    if (strncmp(argv[i], "--cache", 7) == 0) continue;
+    if (strncmp(argv[i], "--heap-profile", 14) == 0) continue;
+    if (strncmp(argv[i], "-ftime-", 7) == 0) continue;
+    if (strcmp(argv[i], "--perf-counters") == 0) continue;
+    if (strncmp(argv[i], "--stats", 7) == 0) continue;
+    if (strncmp(argv[i], "--function-report=", 18) == 0) continue;
+    if (strncmp(argv[i], "-Rpass", 6) == 0) continue;
+    if (strncmp(argv[i], "-j", 2) == 0) {
+      if (argv[i][2] == '\0') i++;
+      continue;
+    }
+    hash64_update_str(&command_hash, argv[i]);
   }
+  opts.command_hash = hash64_final(&command_hash);
 
-  if (!debug_flags.verbose) printf("Lexed %zu tokens\n", tokens->count);
-  
-  /* Debug output for lexer */
-  FILE *debug_out = debug_flags.output_file ? fopen(debug_flags.output_file, "w") : stdout;
-  if (!debug_out) debug_out = stdout;
-  
-  if (debug_flags.lexer || debug_flags.all) {
-    fprintf(debug_out, "\n=== LEXER DEBUG OUTPUT ===\n");
-    debug_print_token_list(debug_out, tokens);
+  if (heap_profile) {
+    const char *rate = getenv(MEMORY_PROFILE_RATE_ENV);
+    memory_profile_start(rate ? (size_t)strtoull(rate, NULL, 10) : 0);
   }
-  
-  if (debug_flags.tokens || debug_flags.all) {
-    fprintf(debug_out, "\n=== TOKEN DUMP ===\n");
-    debug_print_token_list_compact(debug_out, tokens);
+
+  if (stats || stats_json_file) {
+    statistics_enable();
   }
-  
-  if (debug_flags.stats || debug_flags.all) {
-    fprintf(debug_out, "\n=== LEXER STATISTICS ===\n");
-    debug_print_token_stats(debug_out, tokens);
+
+  /* Without counters the compile still runs; perfcount_start has warned */
+  if (perf_counters && !perfcount_start()) {
+    perf_counters = false;
   }
 
-  /* Parse */
-  if (!debug_flags.verbose) printf("Parsing...\n");
-  
-  /* Enable parser debug output if requested */
-  if (debug_flags.parser || debug_flags.verbose || debug_flags.all) {
-    debug_set_parser_verbose(true);
+  if (time_report || time_trace_file) {
+    if (time_report) timer_enable_pass_timing();
+    timer_start_recording();
   }
-  
-  CParser *parser = c_parser_create(tokens, C_STD_C99);
-  ASTNode *ast = c_parser_parse(parser);
 
-  if (error_count() > 0) {
-    fprintf(stderr, "%d error(s) during parsing\n", error_count());
+  if (build_database) {
+    status = compdb_build(build_database, &opts);
+  } else {
+    status = driver_run(&opts, inputs, input_count);
+  }
 
-    /* Always dump debug info on error, but respect output file setting */
-    const char *error_debug_file = debug_flags.output_file ? debug_flags.output_file : "debug_parse_error.txt";
-    if (!debug_flags.output_file) {
-      char debug_file[256];
-      snprintf(debug_file, sizeof(debug_file), "debug_parse_error_%s.txt",
-               strrchr(input_file, '/') ? strrchr(input_file, '/') + 1 : input_file);
-      debug_dump_all_to_file(debug_file, tokens, ast);
-      fprintf(stderr, "Debug info dumped to: %s\n", debug_file);
-    } else {
-      debug_dump_all_to_file(error_debug_file, tokens, ast);
-      fprintf(stderr, "Debug info dumped to: %s\n", error_debug_file);
+  if (heap_profile) {
+    memory_profile_report(stderr, 10);
+    if (heap_profile_file && !memory_profile_write_folded(heap_profile_file) && status == 0) {
+      status = 1;
     }
-
-    c_parser_destroy(parser);
-    lexer_destroy(lexer);
-    syntax_c99_destroy(syntax);
-    xfree(source);
-    return 1;
   }
 
-  if (!debug_flags.verbose) printf("Parsed successfully\n");
-  
-  /* Debug output for AST */
-  if (debug_flags.ast || debug_flags.all) {
-    fprintf(debug_out, "\n=== AST DEBUG OUTPUT ===\n");
-    debug_print_ast_detailed(debug_out, ast);
+  if (stats) {
+    statistics_report(stderr);
   }
-  
-  if (debug_flags.stats || debug_flags.all) {
-    fprintf(debug_out, "\n=== AST STATISTICS ===\n");
-    debug_print_ast_stats(debug_out, ast);
+  if (stats_json_file && !statistics_write_json(stats_json_file) && status == 0) {
+    status = 1;
   }
-
-  /* Codegen */
-  if (!debug_flags.verbose) printf("Generating code...\n");
-  
-  if (debug_flags.codegen || debug_flags.all) {
-    fprintf(debug_out, "\n=== CODEGEN DEBUG OUTPUT ===\n");
-    fprintf(debug_out, "Backend: %d\n", backend);
-    fprintf(debug_out, "Target: %s\n", target_triple ? target_triple : "default");
-    fprintf(debug_out, "Optimization level: %d\n", opt_level);
-    fprintf(debug_out, "Debug info: %s\n", debug_info ? "enabled" : "disabled");
+  if (perf_counters) {
+    perfcount_report(stderr);
   }
-  
-  CodegenContext *codegen = codegen_init(backend, target_triple);
-  if (!codegen) {
-    fprintf(stderr, "Error: failed to initialize codegen\n");
-    ast_destroy_node(ast);
-    c_parser_destroy(parser);
-    lexer_destroy(lexer);
-    syntax_c99_destroy(syntax);
-    xfree(source);
-    return 1;
-  }
-
-  codegen_set_opt_level(codegen, opt_level);
-  codegen_set_debug_info(codegen, debug_info);
-
-  if (!codegen_generate(codegen, ast, input_file)) {
-    fprintf(stderr, "Error: %s\n", codegen_get_error(codegen));
-    codegen_destroy(codegen);
-    ast_destroy_node(ast);
-    c_parser_destroy(parser);
-    lexer_destroy(lexer);
-    syntax_c99_destroy(syntax);
-    xfree(source);
-    return 1;
+  if (time_report) {
+    timer_report(stderr);
   }
-  
-  if (debug_flags.codegen || debug_flags.all) {
-    fprintf(debug_out, "Code generation completed successfully\n");
+  if (time_trace_file && !timer_write_trace(time_trace_file) && status == 0) {
+    status = 1;
   }
 
-  /* Emit output */
-  bool success = false;
-  if (emit_llvm) {
-    success = codegen_emit_llvm_ir(codegen, output_file);
-  } else if (emit_assembly) {
-    success = codegen_emit_assembly(codegen, output_file);
-  } else if (compile_only) {
-    success = codegen_emit_object(codegen, output_file);
-  } else {
-    /* Compile and link */
-    const char *obj_file = "/tmp/temp.o";
-    success = codegen_emit_object(codegen, obj_file);
-    if (success) {
-      const char *objs[] = {obj_file};
-      success = codegen_link(codegen, objs, 1, output_file, false);
-    }
-  }
+done:
+  xfree(default_cache_dir);
+  xfree(inputs);
+  return status;
+}
 
-  if (!success) {
-    fprintf(stderr, "Error: %s\n", codegen_get_error(codegen));
-  } else {
-    printf("Successfully generated: %s\n", output_file);
+int main(int argc, char **argv) {
+  if (argc >= 2 && strncmp(argv[1], "--daemon", 8) == 0 &&
+      (argv[1][8] == '\0' || argv[1][8] == '=')) {
+    char *socket_path = argv[1][8] == '=' ? xstrdup(argv[1] + 9) : proto_default_socket_path();
+    int status = daemon_serve(socket_path, run_command_line);
+    xfree(socket_path);
+    return status;
   }
 
-  /* Close debug output file if we opened one */
-  if (debug_flags.output_file && debug_out != stdout) {
-    fclose(debug_out);
-    if (debug_flags.verbose) {
-      printf("Debug output written to: %s\n", debug_flags.output_file);
-    }
+  if (argc >= 2 && strncmp(argv[1], "--dist-worker=", 14) == 0) {
+    diagnostic_init();
+    return dist_worker_serve(argv[1] + 14);
   }
 
-  /* Cleanup */
-  codegen_destroy(codegen);
-  ast_destroy_node(ast);
-  c_parser_destroy(parser);
-  lexer_destroy(lexer);
-  syntax_c99_destroy(syntax);
-  xfree(source);
-
-  return success ? 0 : 1;
+  return run_command_line(argc, argv);
 }
@@ -1,6 +1,8 @@
 #include "c_parser.h"
 #include "../ast/ast.h"
 #include "../common/memory.h"
+#include "../common/statistic.h"
+#include "../common/thread.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -34,6 +36,13 @@ typedef struct SymbolEntry {
   struct SymbolEntry *next;
 } SymbolEntry;
 
+static Slab symbol_slab = SLAB_INIT("ParserSymbol", SymbolEntry);
+
+STATISTIC(NumSymbolLookups, "parser", "Typedef table lookups");
+STATISTIC(NumSymbolProbes, "parser", "Typedef table chain entries compared");
+STATISTIC_MAX(MaxSymbolChain, "parser", "Longest typedef table chain walked");
+STATISTIC(NumCastRewinds, "parser", "Parenthesized expressions re-parsed after a cast attempt");
+
 /* Simple hash table for symbol tracking */
 #define SYMBOL_TABLE_SIZE 1024  /* Power of 2 for bitmasking */
 #define SYMBOL_TABLE_MASK (SYMBOL_TABLE_SIZE - 1)
@@ -59,9 +68,10 @@ static unsigned int hash_builtin_type(const char *str) {
   return (unsigned int)(hash & BUILTIN_TYPES_TABLE_MASK);  /* Bitmasking is much faster than % */
 }
 
-/* Global builtin types hash table */
+/* Global builtin types hash table - built once, then read-only and shared
+ * by every parser (including parsers running on other threads) */
 static SymbolEntry *builtin_types_table[BUILTIN_TYPES_TABLE_SIZE] = {NULL};
-static bool builtin_types_initialized = false;
+static pthread_once_t builtin_types_once = PTHREAD_ONCE_INIT;
 
 /* Add a builtin type to the global hash table */
 static void add_builtin_type(const char *name) {
@@ -83,11 +93,8 @@ static bool is_builtin_type(const char *name) {
   return false;
 }
 
-/* Initialize builtin types hash table (called once) */
-static void init_builtin_types(void) {
-  if (builtin_types_initialized) return;
-  builtin_types_initialized = true;
-  
+/* Initialize builtin types hash table (called once, via init_builtin_types) */
+static void build_builtin_types(void) {
   /* Add ALL builtin types from the original list - runs once at startup */
   /* va_list types */
   add_builtin_type("__gnuc_va_list"); add_builtin_type("__builtin_va_list"); add_builtin_type("__va_list_tag");
@@ -187,6 +194,14 @@ static void init_builtin_types(void) {
   add_builtin_type("fexcept_t");
 }
 
+static void init_builtin_types(void) {
+  pthread_once(&builtin_types_once, build_builtin_types);
+}
+
+void c_parser_init_tables(void) {
+  init_builtin_types();
+}
+
 static void symbol_table_init(void **table) {
   *table = xcalloc(SYMBOL_TABLE_SIZE, sizeof(SymbolEntry *));
 }
@@ -201,16 +216,17 @@ static void symbol_table_destroy(void *table) {
     while (entry) {
       SymbolEntry *next = entry->next;
       xfree(entry->name);
-      xfree(entry);
+      slab_free(&symbol_slab, entry);
       entry = next;
     }
   }
   xfree(table);
 }
 
-static void symbol_table_add(void *table, const char *name) {
+/* Returns true if `name` was not in the table yet */
+static bool symbol_table_add(void *table, const char *name) {
   if (!table || !name)
-    return;
+    return false;
 
   SymbolEntry **entries = (SymbolEntry **)table;
   unsigned int index = hash_string(name);
@@ -219,16 +235,17 @@ static void symbol_table_add(void *table, const char *name) {
   SymbolEntry *entry = entries[index];
   while (entry) {
     if (strcmp(entry->name, name) == 0) {
-      return; /* Already exists */
+      return false; /* Already exists */
     }
     entry = entry->next;
   }
 
   /* Add new entry */
-  SymbolEntry *new_entry = xcalloc(1, sizeof(SymbolEntry));
+  SymbolEntry *new_entry = slab_alloc(&symbol_slab);
   new_entry->name = xstrdup(name);
   new_entry->next = entries[index];
   entries[index] = new_entry;
+  return true;
 }
 
 static bool symbol_table_contains(void *table, const char *name) {
@@ -239,13 +256,20 @@ static bool symbol_table_contains(void *table, const char *name) {
   unsigned int index = hash_string(name);
 
   SymbolEntry *entry = entries[index];
+  unsigned long long probes = 0;
+  bool found = false;
   while (entry) {
+    probes++;
     if (strcmp(entry->name, name) == 0) {
-      return true;
+      found = true;
+      break;
     }
     entry = entry->next;
   }
-  return false;
+  STATISTIC_INC(NumSymbolLookups);
+  STATISTIC_ADD(NumSymbolProbes, probes);
+  STATISTIC_NOTE_MAX(MaxSymbolChain, probes);
+  return found;
 }
 
 /* Helper macros for cleaner code - cast CTokenType to TokenType */
@@ -361,6 +385,15 @@ CParser *c_parser_create(TokenList *tokens, CStandard standard) {
   return parser;
 }
 
+CParser *c_parser_create_streaming(Lexer *lexer, CStandard standard) {
+  if (!lexer->tokens->head) {
+    token_list_append(lexer->tokens, lexer_stream_token(lexer));
+  }
+  CParser *parser = c_parser_create(lexer->tokens, standard);
+  parser->base.lexer = lexer;
+  return parser;
+}
+
 void c_parser_destroy(CParser *parser) {
   /* Free symbol tables */
   symbol_table_destroy(parser->typedef_names);
@@ -383,53 +416,76 @@ ASTNode *c_parser_parse(CParser *parser) {
 ASTNode *c_parse_translation_unit(CParser *parser) {
   SourceLocation loc = CURRENT(parser)->location;
   ASTNode *unit = ast_create_translation_unit(loc);
+  int consecutive_errors = 0;
 
   while (!AT_END(parser)) {
-    Token *before = CURRENT(parser);
-    ASTNode *decl = c_parse_external_declaration(parser);
-    Token *after = CURRENT(parser);
-
+    ASTNode *decl = c_parse_top_level_step(parser, &consecutive_errors);
     if (decl) {
       ast_add_child(unit, decl);
     }
+  }
 
-    if (parser->base.panic_mode) {
-      parser_synchronize(&parser->base);
-    }
+  return unit;
+}
 
-    /* Safety check: ensure we're making progress */
-    if (before == after && !AT_END(parser)) {
-      /* No progress made - force advance to avoid infinite loop */
-      ERROR(parser, "parser stuck - forcing advance");
-      ADVANCE(parser);
+bool c_parse_translation_unit_streaming(CParser *parser, CDeclHandler handler, void *ctx) {
+  int consecutive_errors = 0;
+
+  while (!AT_END(parser)) {
+    ASTNode *decl = c_parse_top_level_step(parser, &consecutive_errors);
+    parser_release_consumed(&parser->base);
+    if (decl) {
+      bool keep_going = handler(decl, ctx);
+      ast_free_tree(decl);
+      if (!keep_going) {
+        return false;
+      }
     }
+  }
 
-    /* Additional safety: if we've had too many consecutive errors, skip more
-     * aggressively */
-    static int consecutive_errors = 0;
-    if (!decl) {
-      consecutive_errors++;
-      if (consecutive_errors > 10) {
-        /* Skip to next likely declaration start */
-        while (!AT_END(parser) && !CHECK(parser, TOKEN_TYPEDEF) &&
-               !CHECK(parser, TOKEN_STRUCT) && !CHECK(parser, TOKEN_UNION) &&
-               !CHECK(parser, TOKEN_ENUM) && !CHECK(parser, TOKEN_STATIC) &&
-               !CHECK(parser, TOKEN_EXTERN) && !CHECK(parser, TOKEN_INLINE) &&
-               !CHECK(parser, TOKEN___UINT16_T) &&
-               !CHECK(parser, TOKEN___UINT32_T) &&
-               !CHECK(parser, TOKEN___UINT64_T) && !CHECK(parser, TOKEN_INT) &&
-               !CHECK(parser, TOKEN_CHAR) && !CHECK(parser, TOKEN_VOID) &&
-               !CHECK(parser, TOKEN_BOOL)) {
-          ADVANCE(parser);
-        }
-        consecutive_errors = 0;
+  return true;
+}
+
+ASTNode *c_parse_top_level_step(CParser *parser, int *consecutive_errors) {
+  Token *before = CURRENT(parser);
+  ASTNode *decl = c_parse_external_declaration(parser);
+  Token *after = CURRENT(parser);
+
+  if (parser->base.panic_mode) {
+    parser_synchronize(&parser->base);
+  }
+
+  /* Safety check: ensure we're making progress */
+  if (before == after && !AT_END(parser)) {
+    /* No progress made - force advance to avoid infinite loop */
+    ERROR(parser, "parser stuck - forcing advance");
+    ADVANCE(parser);
+  }
+
+  /* Additional safety: if we've had too many consecutive errors, skip more
+   * aggressively */
+  if (!decl) {
+    (*consecutive_errors)++;
+    if (*consecutive_errors > 10) {
+      /* Skip to next likely declaration start */
+      while (!AT_END(parser) && !CHECK(parser, TOKEN_TYPEDEF) &&
+             !CHECK(parser, TOKEN_STRUCT) && !CHECK(parser, TOKEN_UNION) &&
+             !CHECK(parser, TOKEN_ENUM) && !CHECK(parser, TOKEN_STATIC) &&
+             !CHECK(parser, TOKEN_EXTERN) && !CHECK(parser, TOKEN_INLINE) &&
+             !CHECK(parser, TOKEN___UINT16_T) &&
+             !CHECK(parser, TOKEN___UINT32_T) &&
+             !CHECK(parser, TOKEN___UINT64_T) && !CHECK(parser, TOKEN_INT) &&
+             !CHECK(parser, TOKEN_CHAR) && !CHECK(parser, TOKEN_VOID) &&
+             !CHECK(parser, TOKEN_BOOL)) {
+        ADVANCE(parser);
       }
-    } else {
-      consecutive_errors = 0;
+      *consecutive_errors = 0;
     }
+  } else {
+    *consecutive_errors = 0;
   }
 
-  return unit;
+  return decl;
 }
 
 ASTNode *c_parse_external_declaration(CParser *parser) {
@@ -2187,9 +2243,11 @@ ASTNode *c_parse_cast_expression(CParser *parser) {
           ast_destroy_node(declarator);
         parser->base.position = saved_pos;
         parser->base.current = token_list_get(parser->base.tokens, saved_pos);
+        STATISTIC_INC(NumCastRewinds);
       }
     } else {
       /* Not a type - restore position and parse as parenthesized expr */
+      STATISTIC_INC(NumCastRewinds);
       parser->base.position = saved_pos;
       parser->base.current = token_list_get(parser->base.tokens, saved_pos);
     }
@@ -2876,9 +2934,7 @@ bool c_is_declaration_specifier(CParser *parser) {
 
 bool c_is_type_name(CParser *parser, const char *name) {
   /* Initialize builtin types hash table on first call */
-  if (!builtin_types_initialized) {
-    init_builtin_types();
-  }
+  init_builtin_types();
   
   /* Check if identifier is a typedef name */
   if (symbol_table_contains(parser->typedef_names, name)) {
@@ -2912,7 +2968,41 @@ void c_parser_exit_scope(CParser *parser) {
 
 void c_parser_add_typedef(CParser *parser, const char *name) {
   /* Add typedef name to symbol table */
-  symbol_table_add(parser->typedef_names, name);
+  if (symbol_table_add(parser->typedef_names, name) && parser->typedef_observer) {
+    parser->typedef_observer(name, parser->typedef_observer_ctx);
+  }
+}
+
+static void *name_table(CParser *parser, CNameTable table) {
+  switch (table) {
+  case C_NAMES_TYPEDEFS:
+    return parser->typedef_names;
+  case C_NAMES_STRUCT_TAGS:
+    return parser->struct_tags;
+  case C_NAMES_UNION_TAGS:
+    return parser->union_tags;
+  case C_NAMES_ENUM_TAGS:
+    return parser->enum_tags;
+  default:
+    return NULL;
+  }
+}
+
+void c_parser_visit_names(CParser *parser, CNameTable table, CNameVisitor visit,
+                          void *ctx) {
+  SymbolEntry **entries = (SymbolEntry **)name_table(parser, table);
+  if (!entries)
+    return;
+
+  for (int i = 0; i < SYMBOL_TABLE_SIZE; i++) {
+    for (SymbolEntry *entry = entries[i]; entry; entry = entry->next) {
+      visit(entry->name, ctx);
+    }
+  }
+}
+
+void c_parser_add_name(CParser *parser, CNameTable table, const char *name) {
+  symbol_table_add(name_table(parser, table), name);
 }
 
 /* Extract the identifier name from a declarator (handles complex declarators)
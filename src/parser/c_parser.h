@@ -18,17 +18,44 @@ typedef struct CParser {
     
     /* Current scope depth */
     int scope_depth;
+    
+    /* Called for each typedef name the first time it is declared */
+    void (*typedef_observer)(const char *name, void *ctx);
+    void *typedef_observer_ctx;
 } CParser;
 
 /* Create C parser */
 CParser *c_parser_create(TokenList *tokens, CStandard standard);
+
+/* Create a parser that lexes on demand from `lexer` into the lexer's own
+ * token list, instead of reading a tokenized list */
+CParser *c_parser_create_streaming(Lexer *lexer, CStandard standard);
 void c_parser_destroy(CParser *parser);
 
 /* Parse entry point */
 ASTNode *c_parser_parse(CParser *parser);
 
+/* Build process-wide tables (builtin type names) now rather than on first
+ * use; safe to call repeatedly and from any thread */
+void c_parser_init_tables(void);
+
 /* ===== DECLARATIONS ===== */
 ASTNode *c_parse_translation_unit(CParser *parser);
+
+/* Receives each top-level declaration of a streamed parse; false stops it */
+typedef bool (*CDeclHandler)(ASTNode *decl, void *ctx);
+
+/* Parse like c_parse_translation_unit, but hand each declaration to
+ * `handler` as soon as it is complete, then free it together with the
+ * tokens it was parsed from; memory stays bounded by the largest
+ * declaration. False if the handler stopped the parse. */
+bool c_parse_translation_unit_streaming(CParser *parser, CDeclHandler handler, void *ctx);
+
+/* One iteration of c_parse_translation_unit: the next top-level declaration
+ * (NULL if it failed to parse) followed by error recovery, so the parser
+ * always ends up past the tokens it consumed. `consecutive_errors` carries
+ * the recovery state from one call to the next and starts at 0. */
+ASTNode *c_parse_top_level_step(CParser *parser, int *consecutive_errors);
 ASTNode *c_parse_external_declaration(CParser *parser);
 ASTNode *c_parse_function_definition(CParser *parser);
 ASTNode *c_parse_declaration(CParser *parser);
@@ -117,4 +144,17 @@ void c_parser_enter_scope(CParser *parser);
 void c_parser_exit_scope(CParser *parser);
 void c_parser_add_typedef(CParser *parser, const char *name);
 
+/* File-scope name tables, as saved and restored by prefix snapshots */
+typedef enum {
+    C_NAMES_TYPEDEFS,
+    C_NAMES_STRUCT_TAGS,
+    C_NAMES_UNION_TAGS,
+    C_NAMES_ENUM_TAGS,
+    C_NAMES_TABLE_COUNT
+} CNameTable;
+
+typedef void (*CNameVisitor)(const char *name, void *ctx);
+void c_parser_visit_names(CParser *parser, CNameTable table, CNameVisitor visit, void *ctx);
+void c_parser_add_name(CParser *parser, CNameTable table, const char *name);
+
 #endif /* C_PARSER_H */
@@ -0,0 +1,467 @@
+#define _POSIX_C_SOURCE 200809L
+#include "incremental.h"
+#include "c_parser.h"
+#include "../ast/ast.h"
+#include "../lexer/lexer.h"
+#include "../common/memory.h"
+#include <stdint.h>
+#include <string.h>
+
+/* One top-level declaration and the tokens it was parsed from */
+typedef struct {
+    Token *first;
+    Token *last;
+    size_t token_count;
+    LexerCheckpoint start;      /* Lexer state at `first` */
+    ASTNode *decl;              /* NULL if it failed to parse */
+    char **typedefs;            /* Typedef names it introduced */
+    size_t typedef_count;
+} Segment;
+
+typedef struct {
+    Segment *items;
+    size_t count;
+    size_t capacity;
+} SegmentList;
+
+struct IncrementalUnit {
+    char *source;
+    size_t length;
+    char *filename;
+    SyntaxDefinition *syntax;
+    TokenList *tokens;          /* Every segment's tokens in order, then EOF */
+    SegmentList segments;
+    ASTNode *root;
+    IncrementalStats stats;
+};
+
+/* How a location after an edit moves: offsets by `offset` and lines by
+ * `line`; columns only move on the line the edit ended on */
+typedef struct {
+    int64_t offset;
+    int64_t line;
+    uint32_t end_line;
+    int64_t column;
+} Shift;
+
+/* ===== SEGMENTS ===== */
+
+static Segment *segment_push(SegmentList *list) {
+    if (list->count == list->capacity) {
+        list->capacity = list->capacity ? list->capacity * 2 : 64;
+        list->items = xrealloc(list->items, list->capacity * sizeof(Segment));
+    }
+    Segment *segment = &list->items[list->count++];
+    memset(segment, 0, sizeof(Segment));
+    return segment;
+}
+
+/* Frees the declaration and names; the tokens belong to the unit's list */
+static void segment_release(Segment *segment) {
+    if (segment->decl) {
+        ast_free_tree(segment->decl);
+    }
+    for (size_t i = 0; i < segment->typedef_count; i++) {
+        xfree(segment->typedefs[i]);
+    }
+    xfree(segment->typedefs);
+}
+
+static void record_typedef(const char *name, void *ctx) {
+    SegmentList *list = (SegmentList *)ctx;
+    Segment *segment = &list->items[list->count - 1];
+    segment->typedefs = xrealloc(segment->typedefs,
+                                 (segment->typedef_count + 1) * sizeof(char *));
+    segment->typedefs[segment->typedef_count++] = xstrdup(name);
+}
+
+/* True if segments [first, end) of `old` introduce the same typedef names as
+ * all of `parsed` */
+static bool same_typedefs(const SegmentList *old, size_t first, size_t end,
+                          const SegmentList *parsed) {
+    size_t i = first, j = 0, ni = 0, nj = 0;
+    for (;;) {
+        while (i < end && ni == old->items[i].typedef_count) { i++; ni = 0; }
+        while (j < parsed->count && nj == parsed->items[j].typedef_count) { j++; nj = 0; }
+        if (i == end || j == parsed->count) {
+            return i == end && j == parsed->count;
+        }
+        if (strcmp(old->items[i].typedefs[ni++], parsed->items[j].typedefs[nj++]) != 0) {
+            return false;
+        }
+    }
+}
+
+/* ===== RE-LEXING ===== */
+
+/* Lexer line and column at `target`, counting from `from` */
+static void locate(const char *text, LexerCheckpoint from, size_t target,
+                   uint32_t *line, uint32_t *column) {
+    *line = from.line;
+    *column = from.column;
+    for (size_t i = from.position; i < target; i++) {
+        if (text[i] == '\n') {
+            (*line)++;
+            *column = 1;
+        } else {
+            (*column)++;
+        }
+    }
+}
+
+/* Lex the new source from `from` until a token starts exactly where one of
+ * the segments from `*resync` on now starts (their checkpoints are still in
+ * old coordinates, `delta` bytes off); that segment is the first one kept.
+ * If the lexer runs to the end instead, every remaining segment is replaced
+ * and `*resync` becomes the segment count. The list ends in an EOF token
+ * placed where lexing stopped. */
+static TokenList *relex(IncrementalUnit *unit, LexerCheckpoint from, int64_t delta,
+                        size_t *resync) {
+    const SegmentList *segments = &unit->segments;
+    size_t next = *resync;
+
+    Lexer *lexer = lexer_create(unit->source, unit->filename, unit->syntax);
+    lexer_restore(lexer, from);
+    TokenList *tokens = token_list_create();
+
+    SourceLocation end;
+    Token *token;
+    while ((token = lexer_next_token(lexer)) != NULL) {
+        int64_t offset = token->location.offset;
+        while (next < segments->count &&
+               (int64_t)segments->items[next].start.position + delta < offset) {
+            next++;
+        }
+        if (next < segments->count &&
+            (int64_t)segments->items[next].start.position + delta == offset) {
+            end = token->location;
+            token_destroy(token);
+            break;
+        }
+        token_list_append(tokens, token);
+    }
+    if (!token) {
+        next = segments->count;
+        end = (SourceLocation){
+            .filename = lexer->filename,
+            .line = lexer->line,
+            .column = lexer->column,
+            .offset = (uint32_t)lexer->position
+        };
+    }
+    token_list_append(tokens, token_create(TOKEN_EOF, "", 0, end));
+
+    lexer_destroy(lexer);
+    *resync = next;
+    return tokens;
+}
+
+/* ===== RE-PARSING ===== */
+
+/* Parse `tokens` one top-level declaration at a time, exactly as
+ * c_parse_translation_unit would, knowing the typedef names declared before
+ * segment `first`. Returns the parser's error count. */
+static int parse_region(IncrementalUnit *unit, size_t first, TokenList *tokens,
+                        SegmentList *out) {
+    CParser *parser = c_parser_create(tokens, C_STD_C99);
+    for (size_t i = 0; i < first; i++) {
+        const Segment *segment = &unit->segments.items[i];
+        for (size_t j = 0; j < segment->typedef_count; j++) {
+            c_parser_add_name(parser, C_NAMES_TYPEDEFS, segment->typedefs[j]);
+        }
+    }
+    parser->typedef_observer = record_typedef;
+    parser->typedef_observer_ctx = out;
+
+    int consecutive_errors = 0;
+    while (!parser_at_end(&parser->base)) {
+        Segment *segment = segment_push(out);
+        segment->first = parser->base.current;
+        segment->start = lexer_checkpoint_at(segment->first);
+
+        ASTNode *decl = c_parse_top_level_step(parser, &consecutive_errors);
+
+        segment = &out->items[out->count - 1];
+        segment->decl = decl;
+        for (Token *t = segment->first; t != parser->base.current; t = t->next) {
+            segment->last = t;
+            segment->token_count++;
+        }
+    }
+
+    int errors = parser->base.error_count;
+    c_parser_destroy(parser);
+    return errors;
+}
+
+static void discard_region(TokenList *tokens, SegmentList *parsed) {
+    for (size_t i = 0; i < parsed->count; i++) {
+        segment_release(&parsed->items[i]);
+    }
+    xfree(parsed->items);
+    token_list_destroy(tokens);
+}
+
+/* ===== SHIFTING ===== */
+
+static void shift_location(SourceLocation *loc, const Shift *shift) {
+    if (loc->line == shift->end_line) {
+        loc->column = (uint32_t)((int64_t)loc->column + shift->column);
+    }
+    loc->line = (uint32_t)((int64_t)loc->line + shift->line);
+    loc->offset = (uint32_t)((int64_t)loc->offset + shift->offset);
+}
+
+/* Declarations share subtrees (declaration specifiers between declarators),
+ * so each node is moved once */
+typedef struct {
+    const Shift *shift;
+    ASTNode **seen;
+    size_t capacity;
+    size_t count;
+} ShiftVisit;
+
+static bool mark_seen(ShiftVisit *visit, ASTNode *node) {
+    if ((visit->count + 1) * 2 > visit->capacity) {
+        size_t old_capacity = visit->capacity;
+        ASTNode **old = visit->seen;
+        visit->capacity = old_capacity ? old_capacity * 2 : 64;
+        visit->seen = xcalloc(visit->capacity, sizeof(ASTNode *));
+        visit->count = 0;
+        for (size_t i = 0; i < old_capacity; i++) {
+            if (old[i]) mark_seen(visit, old[i]);
+        }
+        xfree(old);
+    }
+    size_t mask = visit->capacity - 1;
+    size_t slot = (size_t)(((uintptr_t)node >> 4) * 0x9E3779B97F4A7C15ull) & mask;
+    while (visit->seen[slot]) {
+        if (visit->seen[slot] == node) return false;
+        slot = (slot + 1) & mask;
+    }
+    visit->seen[slot] = node;
+    visit->count++;
+    return true;
+}
+
+static void shift_node(ASTNode *node, void *data) {
+    ShiftVisit *visit = (ShiftVisit *)data;
+    if (mark_seen(visit, node)) {
+        shift_location(&node->location, visit->shift);
+    }
+}
+
+static void shift_segment(Segment *segment, const Shift *shift) {
+    Token *token = segment->first;
+    for (size_t i = 0; i < segment->token_count; i++, token = token->next) {
+        shift_location(&token->location, shift);
+    }
+    segment->start = lexer_checkpoint_at(segment->first);
+
+    if (segment->decl) {
+        ShiftVisit visit = { .shift = shift };
+        ast_traverse(segment->decl, shift_node, &visit);
+        xfree(visit.seen);
+    }
+}
+
+/* ===== SPLICING ===== */
+
+/* Replace segments [first, resync) and their tokens with the re-parsed ones
+ * and move everything after them */
+static void splice_region(IncrementalUnit *unit, size_t first, size_t resync,
+                          TokenList *fresh, SegmentList *parsed, const Shift *shift) {
+    SegmentList *segments = &unit->segments;
+    Token *eof = unit->tokens->tail;
+    Token *prev = first > 0 ? segments->items[first - 1].last : NULL;
+    Token *next = resync < segments->count ? segments->items[resync].first : eof;
+
+    /* Drop the old tokens */
+    Token *old = prev ? prev->next : unit->tokens->head;
+    size_t old_count = 0;
+    while (old != next) {
+        Token *following = old->next;
+        token_destroy(old);
+        old = following;
+        old_count++;
+    }
+
+    /* Link in the new ones in place of the region's temporary EOF */
+    Token *head = next;
+    size_t new_count = fresh->count - 1;
+    if (parsed->count > 0) {
+        head = fresh->head;
+        parsed->items[parsed->count - 1].last->next = next;
+    }
+    if (prev) {
+        prev->next = head;
+    } else {
+        unit->tokens->head = head;
+    }
+    unit->tokens->count = unit->tokens->count - old_count + new_count;
+
+    if (resync == segments->count) {
+        eof->location = fresh->tail->location;
+    } else {
+        for (size_t i = resync; i < segments->count; i++) {
+            shift_segment(&segments->items[i], shift);
+        }
+        shift_location(&eof->location, shift);
+    }
+    token_destroy(fresh->tail);
+    xfree(fresh);
+
+    /* Replace the segments */
+    for (size_t i = first; i < resync; i++) {
+        segment_release(&segments->items[i]);
+    }
+    size_t kept = segments->count - resync;
+    size_t count = first + parsed->count + kept;
+    if (count > segments->capacity) {
+        segments->capacity = count;
+        segments->items = xrealloc(segments->items, count * sizeof(Segment));
+    }
+    memmove(&segments->items[first + parsed->count], &segments->items[resync],
+            kept * sizeof(Segment));
+    if (parsed->count > 0) {
+        memcpy(&segments->items[first], parsed->items, parsed->count * sizeof(Segment));
+    }
+    segments->count = count;
+    xfree(parsed->items);
+
+    /* Rebuild the translation unit from the declarations */
+    unit->root->child_count = 0;
+    unit->root->location = unit->tokens->head->location;
+    for (size_t i = 0; i < segments->count; i++) {
+        if (segments->items[i].decl) {
+            ast_add_child(unit->root, segments->items[i].decl);
+        }
+    }
+}
+
+/* Re-lex and re-parse from segment `first` (whose lexer state is `from`),
+ * reusing the segments from `end` on where the token stream allows */
+static void update(IncrementalUnit *unit, size_t first, size_t end,
+                   LexerCheckpoint from, const Shift *shift) {
+    size_t resync = end;
+    for (;;) {
+        TokenList *fresh = relex(unit, from, shift->offset, &resync);
+        SegmentList parsed = {0};
+        int errors = parse_region(unit, first, fresh, &parsed);
+
+        /* Error recovery skips to the end of the file, and different typedef
+         * names change how the following declarations parse; either way
+         * nothing after the region can be kept */
+        if (resync < unit->segments.count &&
+            (errors > 0 || !same_typedefs(&unit->segments, first, resync, &parsed))) {
+            discard_region(fresh, &parsed);
+            resync = unit->segments.count;
+            continue;
+        }
+
+        unit->stats.tokens_relexed = fresh->count - 1;
+        unit->stats.decls_reparsed = parsed.count;
+        unit->stats.decls_reused = unit->segments.count - (resync - first);
+        splice_region(unit, first, resync, fresh, &parsed, shift);
+        return;
+    }
+}
+
+/* ===== PUBLIC API ===== */
+
+IncrementalUnit *incremental_create(const char *source, const char *filename,
+                                    SyntaxDefinition *syntax) {
+    IncrementalUnit *unit = xcalloc(1, sizeof(IncrementalUnit));
+    unit->length = strlen(source);
+    unit->source = xstrdup(source);
+    unit->filename = xstrdup(filename);
+    unit->syntax = syntax;
+
+    SourceLocation start = { .filename = unit->filename, .line = 1, .column = 1, .offset = 0 };
+    unit->tokens = token_list_create();
+    token_list_append(unit->tokens, token_create(TOKEN_EOF, "", 0, start));
+    unit->root = ast_create_translation_unit(start);
+
+    LexerCheckpoint from = { .position = 0, .line = 1, .column = 1 };
+    Shift none = {0};
+    update(unit, 0, 0, from, &none);
+    return unit;
+}
+
+void incremental_destroy(IncrementalUnit *unit) {
+    if (!unit) return;
+    unit->root->child_count = 0;
+    ast_free_tree(unit->root);
+    for (size_t i = 0; i < unit->segments.count; i++) {
+        segment_release(&unit->segments.items[i]);
+    }
+    xfree(unit->segments.items);
+    token_list_destroy(unit->tokens);
+    xfree(unit->filename);
+    xfree(unit->source);
+    xfree(unit);
+}
+
+bool incremental_edit(IncrementalUnit *unit, size_t offset, size_t removed,
+                      const char *text, size_t text_len) {
+    if (offset > unit->length || removed > unit->length - offset) {
+        return false;
+    }
+    const SegmentList *segments = &unit->segments;
+    size_t old_end = offset + removed;
+
+    /* Start at the segment holding the byte before the edit: a token ending
+     * right at `offset` may now run on into the inserted text */
+    size_t first = 0;
+    LexerCheckpoint from = { .position = 0, .line = 1, .column = 1 };
+    if (segments->count > 0 && segments->items[0].start.position < offset) {
+        while (first + 1 < segments->count &&
+               segments->items[first + 1].start.position < offset) {
+            first++;
+        }
+        from = segments->items[first].start;
+    }
+    size_t end = first;
+    while (end < segments->count && segments->items[end].start.position < old_end) {
+        end++;
+    }
+
+    Shift shift = {0};
+    uint32_t old_line, old_column, new_line, new_column;
+    locate(unit->source, from, old_end, &old_line, &old_column);
+
+    size_t length = unit->length - removed + text_len;
+    char *source = xmalloc(length + 1);
+    memcpy(source, unit->source, offset);
+    memcpy(source + offset, text, text_len);
+    memcpy(source + offset + text_len, unit->source + old_end, unit->length - old_end);
+    source[length] = '\0';
+    xfree(unit->source);
+    unit->source = source;
+    unit->length = length;
+
+    locate(unit->source, from, offset + text_len, &new_line, &new_column);
+    shift.offset = (int64_t)text_len - (int64_t)removed;
+    shift.line = (int64_t)new_line - (int64_t)old_line;
+    shift.end_line = old_line;
+    shift.column = (int64_t)new_column - (int64_t)old_column;
+
+    update(unit, first, end, from, &shift);
+    return true;
+}
+
+ASTNode *incremental_ast(const IncrementalUnit *unit) {
+    return unit->root;
+}
+
+TokenList *incremental_tokens(const IncrementalUnit *unit) {
+    return unit->tokens;
+}
+
+const char *incremental_source(const IncrementalUnit *unit) {
+    return unit->source;
+}
+
+const IncrementalStats *incremental_stats(const IncrementalUnit *unit) {
+    return &unit->stats;
+}
@@ -0,0 +1,47 @@
+#ifndef INCREMENTAL_H
+#define INCREMENTAL_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include "../common/types.h"
+#include "../syntax/syntax.h"
+
+/* Incremental reparsing for editor integration.
+ *
+ * A unit keeps the source, token stream and AST of one file, split into
+ * top-level declarations. Each declaration remembers its token range, the
+ * lexer checkpoint at its first token and the typedef names it introduced.
+ * An edit re-lexes from the checkpoint of the first declaration it touches
+ * until the lexer lands exactly on the start of an untouched declaration,
+ * re-parses only the declarations in between (seeded with the typedef names
+ * declared before them), and shifts the locations of everything after. If
+ * the re-parsed declarations introduce a different set of typedef names,
+ * the rest of the file is re-parsed as well, since later declarations may
+ * read differently. */
+
+typedef struct IncrementalUnit IncrementalUnit;
+
+/* What the last update had to redo */
+typedef struct {
+    size_t tokens_relexed;
+    size_t decls_reparsed;
+    size_t decls_reused;
+} IncrementalStats;
+
+/* Parse `source` in full. `syntax` is borrowed and must outlive the unit. */
+IncrementalUnit *incremental_create(const char *source, const char *filename,
+                                    SyntaxDefinition *syntax);
+void incremental_destroy(IncrementalUnit *unit);
+
+/* Replace `removed` bytes at `offset` with `text_len` bytes of `text` and
+ * bring tokens and AST up to date; false if the range is out of bounds */
+bool incremental_edit(IncrementalUnit *unit, size_t offset, size_t removed,
+                      const char *text, size_t text_len);
+
+/* Current state; owned by the unit and valid until the next edit */
+ASTNode *incremental_ast(const IncrementalUnit *unit);
+TokenList *incremental_tokens(const IncrementalUnit *unit);
+const char *incremental_source(const IncrementalUnit *unit);
+const IncrementalStats *incremental_stats(const IncrementalUnit *unit);
+
+#endif /* INCREMENTAL_H */
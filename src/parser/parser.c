@@ -2,10 +2,14 @@
 #include "../common/error.h"
 #include "../common/memory.h"
 #include "../common/debug.h"
+#include "../common/statistic.h"
 #include "../ast/ast.h"
 #include <string.h>
 #include <stdio.h>
 
+STATISTIC(NumSynchronizations, "parser", "Error recoveries");
+STATISTIC(NumSynchronizeSkips, "parser", "Tokens skipped during error recovery");
+
 /* Stub implementation - to be completed with full C99 parser */
 
 Parser *parser_create(TokenList *tokens, SyntaxDefinition *syntax) {
@@ -27,9 +31,17 @@ Token *parser_current(Parser *parser) {
     return parser->current;
 }
 
+/* Lex the token after `token` if it has not been lexed yet */
+static void parser_pull(Parser *parser, Token *token) {
+    if (parser->lexer && !token->next && token->type != TOKEN_EOF) {
+        token_list_append(parser->tokens, lexer_stream_token(parser->lexer));
+    }
+}
+
 Token *parser_peek(Parser *parser, int offset) {
     Token *token = parser->current;
     for (int i = 0; i < offset && token; i++) {
+        parser_pull(parser, token);
         token = token->next;
     }
     return token;
@@ -51,6 +63,7 @@ bool parser_check(Parser *parser, TokenType type) {
 Token *parser_advance(Parser *parser) {
     if (!parser_at_end(parser)) {
         Token *prev = parser->current;
+        parser_pull(parser, prev);
         parser->current = parser->current->next;
         parser->position++;
         return prev;
@@ -71,16 +84,28 @@ bool parser_at_end(Parser *parser) {
     return parser->current == NULL || parser->current->type == TOKEN_EOF;
 }
 
+void parser_release_consumed(Parser *parser) {
+    TokenList *tokens = parser->tokens;
+    while (tokens->head && tokens->head != parser->current) {
+        Token *next = tokens->head->next;
+        token_destroy(tokens->head);
+        tokens->head = next;
+        tokens->count--;
+    }
+    if (!tokens->head) tokens->tail = NULL;
+    parser->position = 0;
+}
+
 void parser_error(Parser *parser, const char *message) {
     if (parser->panic_mode) return;
     
     Token *token = parser->current;
     if (token) {
         error_report(ERROR_PARSER, token->location, "%s", message);
-        debug_print_parser_error(stderr, token, message);
-        debug_print_parser_context(stderr, token, 5);
+        debug_print_parser_error(diagnostic_stream(), token, message);
+        debug_print_parser_context(diagnostic_stream(), token, 5);
     } else {
-        fprintf(stderr, "error: %s (at EOF)\n", message);
+        fprintf(diagnostic_stream(), "error: %s (at EOF)\n", message);
     }
     
     parser->error_count++;
@@ -93,10 +118,12 @@ void parser_error_at_current(Parser *parser, const char *message) {
 
 void parser_synchronize(Parser *parser) {
     parser->panic_mode = false;
+    STATISTIC_INC(NumSynchronizations);
     
     /* Skip tokens until we find a synchronization point */
     while (!parser_at_end(parser)) {
         parser_advance(parser);
+        STATISTIC_INC(NumSynchronizeSkips);
         /* TODO: Add proper synchronization logic */
         if (parser->current && parser->current->type == 0) {
             return;
@@ -15,6 +15,10 @@ typedef struct Parser {
     
     SyntaxDefinition *syntax;
     
+    /* When set, tokens are lexed as the parser reaches the end of `tokens`
+     * (which then belongs to the lexer); NULL if `tokens` is complete */
+    Lexer *lexer;
+    
     /* Error recovery */
     bool panic_mode;
     int error_count;
@@ -36,6 +40,10 @@ Token *parser_advance(Parser *parser);
 Token *parser_expect(Parser *parser, TokenType type, const char *message);
 bool parser_at_end(Parser *parser);
 
+/* Free the tokens before the current one; nothing may refer to them or
+ * backtrack into them afterwards */
+void parser_release_consumed(Parser *parser);
+
 /* Error handling */
 void parser_error(Parser *parser, const char *message);
 void parser_error_at_current(Parser *parser, const char *message);
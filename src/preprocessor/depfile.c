@@ -0,0 +1,253 @@
+#define _POSIX_C_SOURCE 200809L
+#include "depfile.h"
+#include "../common/memory.h"
+#include "../common/hash.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <sys/stat.h>
+
+/* ===== PARSING ===== */
+
+static char *read_whole_file(const char *path, size_t *out_len) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
+
+    size_t capacity = 4096;
+    size_t size = 0;
+    char *data = xmalloc(capacity);
+    size_t n;
+    while ((n = fread(data + size, 1, capacity - size - 1, f)) > 0) {
+        size += n;
+        if (capacity - size <= 1) {
+            capacity *= 2;
+            data = xrealloc(data, capacity);
+        }
+    }
+    fclose(f);
+
+    data[size] = '\0';
+    if (out_len) *out_len = size;
+    return data;
+}
+
+static void depfile_add(DepFile *dep, size_t *capacity, const char *path) {
+    if (dep->dep_count >= *capacity) {
+        *capacity = *capacity ? *capacity * 2 : 16;
+        dep->deps = xrealloc(dep->deps, *capacity * sizeof(char *));
+    }
+    dep->deps[dep->dep_count++] = xstrdup(path);
+}
+
+DepFile *depfile_read(const char *path) {
+    size_t len = 0;
+    char *text = read_whole_file(path, &len);
+    if (!text) return NULL;
+
+    DepFile *dep = xcalloc(1, sizeof(DepFile));
+    size_t capacity = 0;
+
+    /* Single pass over make syntax: whitespace separates words, "\<newline>"
+     * continues a rule, "\ " and "\#" escape, "$$" is a literal '$'. Words
+     * ending in ':' name a target; every other word is a prerequisite. */
+    char *word = xmalloc(len + 1);
+    size_t word_len = 0;
+
+    for (size_t i = 0; i <= len; i++) {
+        char c = text[i];
+
+        if (c == '\\' && i + 1 < len) {
+            char next = text[i + 1];
+            if (next == '\n' || (next == '\r' && i + 2 < len && text[i + 2] == '\n')) {
+                i += (next == '\r') ? 2 : 1;
+                c = ' ';
+            } else if (next == ' ' || next == '#' || next == '\\') {
+                word[word_len++] = next;
+                i++;
+                continue;
+            }
+        } else if (c == '$' && i + 1 < len && text[i + 1] == '$') {
+            word[word_len++] = '$';
+            i++;
+            continue;
+        }
+
+        if (c == '\0' || c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+            if (word_len == 0) continue;
+            word[word_len] = '\0';
+
+            if (word[word_len - 1] == ':') {
+                word[word_len - 1] = '\0';
+                if (!dep->target && word_len > 1) {
+                    dep->target = xstrdup(word);
+                }
+            } else if (strcmp(word, ":") != 0) {
+                depfile_add(dep, &capacity, word);
+            }
+            word_len = 0;
+            continue;
+        }
+
+        word[word_len++] = c;
+    }
+
+    xfree(word);
+    xfree(text);
+
+    if (!dep->target) {
+        depfile_destroy(dep);
+        return NULL;
+    }
+    return dep;
+}
+
+void depfile_destroy(DepFile *dep) {
+    if (!dep) return;
+
+    for (size_t i = 0; i < dep->dep_count; i++) {
+        xfree(dep->deps[i]);
+    }
+    xfree(dep->deps);
+    xfree(dep->target);
+    xfree(dep);
+}
+
+char *depfile_default_path(const char *output) {
+    if (!output) return NULL;
+
+    const char *slash = strrchr(output, '/');
+    const char *dot = strrchr(output, '.');
+    size_t stem_len = (dot && (!slash || dot > slash)) ? (size_t)(dot - output) : strlen(output);
+
+    char *path = xmalloc(stem_len + 3);
+    memcpy(path, output, stem_len);
+    memcpy(path + stem_len, ".d", 3);
+    return path;
+}
+
+/* ===== UP-TO-DATE CHECKS ===== */
+
+static bool file_mtime(const char *path, struct timespec *out) {
+    struct stat st;
+    if (stat(path, &st) != 0) return false;
+    *out = st.st_mtim;
+    return true;
+}
+
+static bool timespec_newer(struct timespec a, struct timespec b) {
+    if (a.tv_sec != b.tv_sec) return a.tv_sec > b.tv_sec;
+    return a.tv_nsec > b.tv_nsec;
+}
+
+static char *stamp_path(const char *dep_path) {
+    size_t len = strlen(dep_path);
+    char *path = xmalloc(len + 6);
+    memcpy(path, dep_path, len);
+    memcpy(path + len, ".hash", 6);
+    return path;
+}
+
+static bool check_mtimes(const char *output, const DepFile *dep) {
+    struct timespec out_time;
+    if (!file_mtime(output, &out_time)) return false;
+
+    for (size_t i = 0; i < dep->dep_count; i++) {
+        struct timespec dep_time;
+        if (!file_mtime(dep->deps[i], &dep_time)) return false;
+        if (timespec_newer(dep_time, out_time)) return false;
+    }
+    return true;
+}
+
+static bool check_hashes(const char *dep_path, const DepFile *dep, uint64_t command_hash) {
+    char *path = stamp_path(dep_path);
+    FILE *f = fopen(path, "r");
+    xfree(path);
+    if (!f) return false;
+
+    bool ok = true;
+    uint64_t recorded_cmd = 0;
+    if (fscanf(f, "cmd %" SCNx64 "\n", &recorded_cmd) != 1 || recorded_cmd != command_hash) {
+        ok = false;
+    }
+
+    /* The stamp lists dependencies in depfile order, one "<hash> <path>" per line */
+    char line[4096];
+    size_t index = 0;
+    while (ok && fgets(line, sizeof(line), f)) {
+        uint64_t recorded = 0;
+        int consumed = 0;
+        if (sscanf(line, "%" SCNx64 " %n", &recorded, &consumed) != 1) {
+            ok = false;
+            break;
+        }
+        line[strcspn(line, "\n")] = '\0';
+
+        if (index >= dep->dep_count || strcmp(line + consumed, dep->deps[index]) != 0) {
+            ok = false;
+            break;
+        }
+
+        uint64_t current = 0;
+        if (!hash64_file(dep->deps[index], &current) || current != recorded) {
+            ok = false;
+        }
+        index++;
+    }
+    fclose(f);
+
+    return ok && index == dep->dep_count;
+}
+
+bool depfile_is_up_to_date(const char *output, const char *dep_path,
+                           DepCheckMode mode, uint64_t command_hash) {
+    if (!output || !dep_path) return false;
+
+    struct stat st;
+    if (stat(output, &st) != 0) return false;
+
+    DepFile *dep = depfile_read(dep_path);
+    if (!dep) return false;
+
+    bool up_to_date = (mode == DEP_CHECK_HASH)
+        ? check_hashes(dep_path, dep, command_hash)
+        : check_mtimes(output, dep);
+
+    depfile_destroy(dep);
+    return up_to_date;
+}
+
+bool depfile_write_stamp(const char *dep_path, uint64_t command_hash) {
+    DepFile *dep = depfile_read(dep_path);
+    if (!dep) return false;
+
+    char *path = stamp_path(dep_path);
+    FILE *f = fopen(path, "w");
+    xfree(path);
+    if (!f) {
+        depfile_destroy(dep);
+        return false;
+    }
+
+    fprintf(f, "cmd %016" PRIx64 "\n", command_hash);
+    bool ok = true;
+    for (size_t i = 0; i < dep->dep_count; i++) {
+        uint64_t h = 0;
+        if (!hash64_file(dep->deps[i], &h)) {
+            ok = false;
+            break;
+        }
+        fprintf(f, "%016" PRIx64 " %s\n", h, dep->deps[i]);
+    }
+
+    if (fclose(f) != 0) ok = false;
+    if (!ok) {
+        /* A partial stamp must never make a stale output look current */
+        path = stamp_path(dep_path);
+        remove(path);
+        xfree(path);
+    }
+    depfile_destroy(dep);
+    return ok;
+}
@@ -0,0 +1,42 @@
+#ifndef DEPFILE_H
+#define DEPFILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Make-style dependency files (-MD/-MMD/-MF).
+ *
+ * The depfile itself is written by the preprocessor as a byproduct of the
+ * normal `clang -E` run; this module only reads it back so the driver can
+ * decide whether an output needs rebuilding (--skip-if-up-to-date). */
+
+typedef enum {
+    DEP_CHECK_MTIME,    /* Output is newer than every dependency */
+    DEP_CHECK_HASH      /* Dependency contents match the recorded stamp */
+} DepCheckMode;
+
+typedef struct {
+    char *target;
+    char **deps;
+    size_t dep_count;
+} DepFile;
+
+/* Parse a depfile; returns NULL if it does not exist or is malformed */
+DepFile *depfile_read(const char *path);
+void depfile_destroy(DepFile *dep);
+
+/* Default depfile path for an output: "dir/foo.o" -> "dir/foo.d" */
+char *depfile_default_path(const char *output);
+
+/* Check whether `output` is current with respect to the dependencies
+ * recorded in `dep_path`. `command_hash` covers the flags that affect the
+ * output; it is only compared in DEP_CHECK_HASH mode. */
+bool depfile_is_up_to_date(const char *output, const char *dep_path,
+                           DepCheckMode mode, uint64_t command_hash);
+
+/* Record content hashes of every dependency next to the depfile
+ * (<dep_path>.hash) for later DEP_CHECK_HASH queries */
+bool depfile_write_stamp(const char *dep_path, uint64_t command_hash);
+
+#endif /* DEPFILE_H */
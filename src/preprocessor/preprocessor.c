@@ -1,5 +1,6 @@
 #include "preprocessor.h"
 #include "../common/memory.h"
+#include "../common/probes.h"
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -7,16 +8,17 @@
 
 /* Preprocessor implementation using Clang's C API */
 
+/* Characters that pass through /bin/sh unquoted */
+#define SHELL_SAFE_CHARS "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789_-./+,:@%"
+
 struct Preprocessor {
     CXIndex index;
     char **include_paths;
     size_t include_path_count;
     char **system_include_paths;
     size_t system_include_path_count;
-    char **defines;
+    char **defines;             /* -D and -U, in the order given */
     size_t define_count;
-    char **undefines;
-    size_t undefine_count;
     char *last_error;
     PreprocessorOptions options;
 };
@@ -35,6 +37,10 @@ Preprocessor *preprocessor_create(PreprocessorOptions *opts) {
         pp->options.keep_whitespace = false;
         pp->options.expand_macros = true;
         pp->options.target_triple = NULL;
+        pp->options.dep_file = NULL;
+        pp->options.dep_target = NULL;
+        pp->options.dep_system_headers = false;
+        pp->options.macros_file = NULL;
     }
     
     return pp;
@@ -61,12 +67,6 @@ void preprocessor_destroy(Preprocessor *pp) {
     }
     xfree(pp->defines);
     
-    /* Free undefines */
-    for (size_t i = 0; i < pp->undefine_count; i++) {
-        xfree(pp->undefines[i]);
-    }
-    xfree(pp->undefines);
-    
     xfree(pp->last_error);
     
     /* Dispose Clang index */
@@ -99,7 +99,7 @@ void preprocessor_define(Preprocessor *pp, const char *name, const char *value)
     /* Format: -DNAME=VALUE or -DNAME */
     /* Store as two separate strings to avoid shell escaping issues */
     char *define;
-    if (value && strlen(value) > 0) {
+    if (value) {
         /* Allocate space for -D prefix + name + = + value */
         size_t len = strlen(name) + strlen(value) + 4;
         define = xmalloc(len);
@@ -122,8 +122,9 @@ void preprocessor_undefine(Preprocessor *pp, const char *name) {
     char *undefine = xmalloc(len);
     snprintf(undefine, len, "-U%s", name);
     
-    pp->undefines = xrealloc(pp->undefines, (pp->undefine_count + 1) * sizeof(char *));
-    pp->undefines[pp->undefine_count++] = undefine;
+    /* Shares the define list: a later -D or -U of the same name wins */
+    pp->defines = xrealloc(pp->defines, (pp->define_count + 1) * sizeof(char *));
+    pp->defines[pp->define_count++] = undefine;
 }
 
 /* These functions are kept for potential future use with libclang API */
@@ -167,7 +168,7 @@ static char **build_clang_args(Preprocessor *pp, size_t *arg_count) {
         args[count++] = xstrdup(pp->system_include_paths[i]);
     }
     
-    /* Add defines */
+    /* Add defines and undefines */
     for (size_t i = 0; i < pp->define_count; i++) {
         if (count + 1 >= capacity) {
             capacity *= 2;
@@ -176,15 +177,6 @@ static char **build_clang_args(Preprocessor *pp, size_t *arg_count) {
         args[count++] = xstrdup(pp->defines[i]);
     }
     
-    /* Add undefines */
-    for (size_t i = 0; i < pp->undefine_count; i++) {
-        if (count + 1 >= capacity) {
-            capacity *= 2;
-            args = xrealloc(args, capacity * sizeof(char *));
-        }
-        args[count++] = xstrdup(pp->undefines[i]);
-    }
-    
     *arg_count = count;
     return args;
 }
@@ -208,12 +200,29 @@ char *preprocessor_process_file(Preprocessor *pp, const char *filename) {
     
     /* Build command using execvp-style array to avoid shell escaping issues */
     size_t argc = 0;
-    char **argv = xmalloc(256 * sizeof(char *));
+    char **argv = xmalloc((16 + pp->include_path_count + 2 * pp->system_include_path_count +
+                           pp->define_count) * sizeof(char *));
     
     argv[argc++] = xstrdup("clang");
     argv[argc++] = xstrdup("-E");
     argv[argc++] = xstrdup("-P");  /* Don't generate line markers */
     
+    /* Dependency file comes out of this same run - no extra pass */
+    if (pp->options.dep_file) {
+        argv[argc++] = xstrdup(pp->options.dep_system_headers ? "-MD" : "-MMD");
+        argv[argc++] = xstrdup("-MF");
+        argv[argc++] = xstrdup(pp->options.dep_file);
+        if (pp->options.dep_target) {
+            argv[argc++] = xstrdup("-MT");
+            argv[argc++] = xstrdup(pp->options.dep_target);
+        }
+    }
+    
+    if (pp->options.macros_file) {
+        argv[argc++] = xstrdup("-imacros");
+        argv[argc++] = xstrdup(pp->options.macros_file);
+    }
+    
     /* Add include paths */
     for (size_t i = 0; i < pp->include_path_count; i++) {
         char *arg = xmalloc(strlen(pp->include_paths[i]) + 3);
@@ -227,23 +236,18 @@ char *preprocessor_process_file(Preprocessor *pp, const char *filename) {
         argv[argc++] = xstrdup(pp->system_include_paths[i]);
     }
     
-    /* Add defines */
+    /* Add defines and undefines */
     for (size_t i = 0; i < pp->define_count; i++) {
         argv[argc++] = xstrdup(pp->defines[i]);
     }
     
-    /* Add undefines */
-    for (size_t i = 0; i < pp->undefine_count; i++) {
-        argv[argc++] = xstrdup(pp->undefines[i]);
-    }
-    
     argv[argc++] = xstrdup(filename);
     argv[argc] = NULL;
     
     /* Build command string for popen (properly escaped) */
     size_t cmd_len = 0;
     for (size_t i = 0; i < argc; i++) {
-        cmd_len += strlen(argv[i]) + 3;  /* quotes + space */
+        cmd_len += 4 * strlen(argv[i]) + 3;  /* every char may be an escaped quote */
     }
     char *cmd = xmalloc(cmd_len + 1);
     cmd[0] = '\0';
@@ -251,14 +255,10 @@ char *preprocessor_process_file(Preprocessor *pp, const char *filename) {
     for (size_t i = 0; i < argc; i++) {
         if (i > 0) strcat(cmd, " ");
         
-        /* Check if argument needs quoting - quote all defines to be safe */
-        bool needs_quote = strchr(argv[i], ' ') != NULL || 
-                          strchr(argv[i], '(') != NULL ||
-                          strchr(argv[i], ')') != NULL ||
-                          strchr(argv[i], '>') != NULL ||
-                          strchr(argv[i], '<') != NULL ||
-                          strchr(argv[i], '=') != NULL ||
-                          (argv[i][0] == '-' && argv[i][1] == 'D');  /* Always quote defines */
+        /* Quote anything the shell could act on: paths and macros from a
+         * compilation database may hold spaces, quotes or '$' */
+        bool needs_quote = argv[i][0] == '\0' ||
+                           argv[i][strspn(argv[i], SHELL_SAFE_CHARS)] != '\0';
         
         if (needs_quote) {
             strcat(cmd, "'");
@@ -284,6 +284,7 @@ char *preprocessor_process_file(Preprocessor *pp, const char *filename) {
     }
     xfree(argv);
     
+    LLVMC_PROBE2(preprocess__spawn, filename, cmd);
     FILE *fp = popen(cmd, "r");
     xfree(cmd);
     
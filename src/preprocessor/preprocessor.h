@@ -13,6 +13,15 @@ typedef struct {
     bool keep_whitespace;
     bool expand_macros;
     const char *target_triple;  /* e.g., "x86_64-pc-linux-gnu" */
+    
+    /* Dependency file output, written by the same preprocessor run */
+    const char *dep_file;       /* -MF path, NULL to disable */
+    const char *dep_target;     /* -MT rule target (usually the object file) */
+    bool dep_system_headers;    /* -MD lists system headers, -MMD does not */
+
+    /* Header whose macros are predefined while its text is dropped
+     * (-imacros); used when a prefix snapshot supplies the declarations */
+    const char *macros_file;
 } PreprocessorOptions;
 
 /* Initialize preprocessor (using Clang's preprocessor) */
@@ -23,7 +32,8 @@ void preprocessor_destroy(Preprocessor *pp);
 void preprocessor_add_include_path(Preprocessor *pp, const char *path);
 void preprocessor_add_system_include_path(Preprocessor *pp, const char *path);
 
-/* Define/undefine macros */
+/* Define/undefine macros, like -D and -U in the order called. A NULL value
+ * defines the name as 1; "" defines it empty. */
 void preprocessor_define(Preprocessor *pp, const char *name, const char *value);
 void preprocessor_undefine(Preprocessor *pp, const char *name);
 
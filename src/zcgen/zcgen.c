@@ -0,0 +1,123 @@
+#define _POSIX_C_SOURCE 200809L
+#include "zcgen.h"
+#include "../codegen/codegen.h"
+#include "../common/error.h"
+#include "../common/memory.h"
+#include "../lexer/lexer.h"
+#include "../parser/c_parser.h"
+#include "../syntax/c_syntax.h"
+#include <stdio.h>
+#include <string.h>
+
+struct CompilerSession {
+    DiagnosticOptions diagnostic_options;
+    DiagnosticState *diagnostics;
+    SyntaxDefinition *syntax;
+};
+
+void zcgen_options_init(ZcgenOptions *opts) {
+    memset(opts, 0, sizeof(*opts));
+    opts->emit = ZCGEN_EMIT_OBJECT;
+}
+
+CompilerSession *zcgen_session_create(void) {
+    c_parser_init_tables();
+
+    CompilerSession *session = xcalloc(1, sizeof(CompilerSession));
+
+    /* Plain text: the output goes to the embedder, not a terminal */
+    session->diagnostic_options = (DiagnosticOptions){
+        .use_color = false,
+        .show_source_location = true,
+        .show_source_snippet = true,
+        .show_caret = true,
+        .show_column = true,
+        .show_line_numbers = true,
+        .context_lines = 0,
+        .show_option_name = true,
+        .show_fix_hints = true
+    };
+    session->diagnostics = diagnostic_state_create(&session->diagnostic_options);
+    session->syntax = syntax_c99_create();
+    return session;
+}
+
+void zcgen_session_destroy(CompilerSession *session) {
+    if (!session) return;
+    syntax_c99_destroy(session->syntax);
+    diagnostic_state_destroy(session->diagnostics);
+    xfree(session);
+}
+
+static BackendOutput backend_output_for(ZcgenEmitKind emit) {
+    switch (emit) {
+        case ZCGEN_EMIT_ASSEMBLY: return BACKEND_OUTPUT_ASSEMBLY;
+        case ZCGEN_EMIT_LLVM_IR:  return BACKEND_OUTPUT_LLVM_IR;
+        case ZCGEN_EMIT_BITCODE:  return BACKEND_OUTPUT_BITCODE;
+        case ZCGEN_EMIT_OBJECT:   break;
+    }
+    return BACKEND_OUTPUT_OBJECT;
+}
+
+/* Declarations go to the backend as they are parsed, until the first error */
+static bool generate_decl(ASTNode *decl, void *ctx) {
+    if (error_count() > 0) return false;
+    codegen_add_decl((CodegenContext *)ctx, decl);
+    return true;
+}
+
+bool zcgen_compile(CompilerSession *session, const char *source, size_t len,
+                   const char *filename, const ZcgenOptions *opts, ZcgenResult *result) {
+    memset(result, 0, sizeof(*result));
+
+    /* Everything below reports into the session */
+    DiagnosticState *previous = diagnostic_bind(session->diagnostics);
+    error_reset();
+    diagnostic_begin_capture();
+    FILE *diag = diagnostic_stream();
+
+    char *text = xstrndup(source, len);
+    diagnostic_set_source(filename, text);
+
+    Lexer *lexer = lexer_create(text, filename, session->syntax);
+    CParser *parser = c_parser_create_streaming(lexer, C_STD_C99);
+    CodegenContext *codegen = codegen_init(BACKEND_LLVM, opts->target_triple);
+    bool ok = false;
+
+    if (!codegen) {
+        fprintf(diag, "Error: failed to initialize codegen\n");
+    } else {
+        codegen_set_opt_level(codegen, opts->opt_level);
+        codegen_set_debug_info(codegen, opts->debug_info);
+        if (!codegen_begin(codegen, filename)) {
+            fprintf(diag, "Error: %s\n", codegen_get_error(codegen));
+        } else {
+            c_parse_translation_unit_streaming(parser, generate_decl, codegen);
+            if (error_count() == 0) {
+                codegen_finish(codegen);
+                ok = codegen_emit_to_memory(codegen, backend_output_for(opts->emit),
+                                            &result->data, &result->len);
+                if (!ok) fprintf(diag, "Error: %s\n", codegen_get_error(codegen));
+            }
+        }
+    }
+
+    codegen_destroy(codegen);
+    c_parser_destroy(parser);
+    lexer_destroy(lexer);
+    diagnostic_clear_source(filename);
+    xfree(text);
+
+    result->errors = error_count();
+    result->warnings = warning_count();
+    result->diagnostics = diagnostic_end_capture(&result->diagnostics_len);
+    diagnostic_bind(previous);
+    return ok && result->errors == 0;
+}
+
+void zcgen_result_release(ZcgenResult *result) {
+    if (!result) return;
+    xfree(result->data);
+    xfree(result->diagnostics);
+    memset(result, 0, sizeof(*result));
+}
@@ -0,0 +1,58 @@
+#ifndef ZCGEN_H
+#define ZCGEN_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+/* libzcgen: the compiler as an embeddable library.
+ *
+ * A CompilerSession owns the state a compilation reports into (error and
+ * warning counts, the diagnostic text, the sources used for snippets) and
+ * the syntax tables the lexer reads. Each session may be used by one thread
+ * at a time; sessions on different threads compile concurrently without
+ * sharing mutable state. What remains process-wide is immutable after first
+ * use (builtin type names, LLVM target registration) or locked (allocation
+ * statistics).
+ *
+ * Input is preprocessed C, as produced by `clang -E`; the library does not
+ * run a preprocessor. */
+
+typedef struct CompilerSession CompilerSession;
+
+typedef enum {
+    ZCGEN_EMIT_OBJECT,
+    ZCGEN_EMIT_ASSEMBLY,
+    ZCGEN_EMIT_LLVM_IR,
+    ZCGEN_EMIT_BITCODE
+} ZcgenEmitKind;
+
+typedef struct {
+    ZcgenEmitKind emit;
+    int opt_level;              /* 0-3 */
+    bool debug_info;
+    const char *target_triple;  /* NULL for the host */
+} ZcgenOptions;
+
+/* Output of one compilation; release with zcgen_result_release() */
+typedef struct {
+    char *data;                 /* Emitted code, NULL on failure */
+    size_t len;
+    char *diagnostics;          /* Everything reported, NUL-terminated */
+    size_t diagnostics_len;
+    int errors;
+    int warnings;
+} ZcgenResult;
+
+void zcgen_options_init(ZcgenOptions *opts);
+
+CompilerSession *zcgen_session_create(void);
+void zcgen_session_destroy(CompilerSession *session);
+
+/* Compile `len` bytes of `source`; `filename` names it in diagnostics.
+ * False if anything was reported as an error or nothing could be emitted;
+ * `result` is filled in either way. */
+bool zcgen_compile(CompilerSession *session, const char *source, size_t len,
+                   const char *filename, const ZcgenOptions *opts, ZcgenResult *result);
+void zcgen_result_release(ZcgenResult *result);
+
+#endif /* ZCGEN_H */
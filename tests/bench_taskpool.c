@@ -0,0 +1,173 @@
+/* Micro-benchmarks for the work-stealing task pool
+ *
+ *   bench_taskpool [workers]
+ *
+ * spawn:      tasks spawned from outside the pool (injection queue)
+ * fan-out:    tasks spawned by one worker and stolen by the others
+ * fork-join:  recursive fib, spawning and waiting at every level
+ * steal:      delay from a push until another worker starts the task */
+
+#define _POSIX_C_SOURCE 200809L
+#include "../src/common/taskpool.h"
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define SPAWN_TASKS 1000000
+#define FIB_N 30
+#define STEAL_ROUNDS 20000
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void report(const char *name, double seconds, double tasks) {
+    printf("%-10s %10.0f tasks in %7.3f s  %8.2f Mtasks/s  %7.1f ns/task\n",
+           name, tasks, seconds, tasks / seconds / 1e6, seconds * 1e9 / tasks);
+}
+
+static void nothing(void *arg) {
+    (void)arg;
+}
+
+static void bench_spawn(TaskPool *pool) {
+    double start = now();
+    TaskGroup group;
+    taskgroup_init(&group, pool);
+    for (int i = 0; i < SPAWN_TASKS; i++) {
+        taskgroup_spawn(&group, nothing, NULL);
+    }
+    taskgroup_wait(&group);
+    report("spawn", now() - start, SPAWN_TASKS);
+}
+
+static void fan_out(void *arg) {
+    TaskPool *pool = (TaskPool *)arg;
+    TaskGroup group;
+    taskgroup_init(&group, pool);
+    for (int i = 0; i < SPAWN_TASKS; i++) {
+        taskgroup_spawn(&group, nothing, NULL);
+    }
+    taskgroup_wait(&group);
+}
+
+static void bench_fan_out(TaskPool *pool) {
+    double start = now();
+    TaskGroup group;
+    taskgroup_init(&group, pool);
+    taskgroup_spawn(&group, fan_out, pool);
+    taskgroup_wait(&group);
+    report("fan-out", now() - start, SPAWN_TASKS);
+}
+
+typedef struct {
+    TaskPool *pool;
+    int n;
+    long result;
+} FibTask;
+
+static void fib(void *arg) {
+    FibTask *task = (FibTask *)arg;
+    if (task->n < 2) {
+        task->result = task->n;
+        return;
+    }
+    FibTask left = {task->pool, task->n - 1, 0};
+    FibTask right = {task->pool, task->n - 2, 0};
+    TaskGroup group;
+    taskgroup_init(&group, task->pool);
+    taskgroup_spawn(&group, fib, &left);
+    fib(&right);
+    taskgroup_wait(&group);
+    task->result = left.result + right.result;
+}
+
+static void bench_fork_join(TaskPool *pool) {
+    FibTask root = {pool, FIB_N, 0};
+    double start = now();
+    TaskGroup group;
+    taskgroup_init(&group, pool);
+    taskgroup_spawn(&group, fib, &root);
+    taskgroup_wait(&group);
+    double seconds = now() - start;
+    /* One spawn per inner call: fib(n + 1) - 1 of them */
+    FibTask count = {NULL, FIB_N + 1, 0};
+    fib(&count);
+    report("fork-join", seconds, (double)(count.result - 1));
+}
+
+/* A probe records when it starts; the pusher never pops it itself */
+typedef struct {
+    double pushed;
+    double started;
+    int running;
+} Probe;
+
+static void probe(void *arg) {
+    Probe *p = (Probe *)arg;
+    p->started = now();
+    __atomic_store_n(&p->running, 1, __ATOMIC_RELEASE);
+}
+
+typedef struct {
+    TaskPool *pool;
+    double *samples;
+} StealBench;
+
+static void steal_rounds(void *arg) {
+    StealBench *bench = (StealBench *)arg;
+    for (int i = 0; i < STEAL_ROUNDS; i++) {
+        Probe p = {0, 0, 0};
+        TaskGroup group;
+        taskgroup_init(&group, bench->pool);
+        p.pushed = now();
+        taskgroup_spawn(&group, probe, &p);
+        while (!__atomic_load_n(&p.running, __ATOMIC_ACQUIRE)) {
+            sched_yield();
+        }
+        taskgroup_wait(&group);
+        bench->samples[i] = p.started - p.pushed;
+    }
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void bench_steal(TaskPool *pool) {
+    StealBench bench = {pool, malloc(STEAL_ROUNDS * sizeof(double))};
+    TaskGroup group;
+    taskgroup_init(&group, pool);
+    taskgroup_spawn(&group, steal_rounds, &bench);
+    taskgroup_wait(&group);
+
+    qsort(bench.samples, STEAL_ROUNDS, sizeof(double), compare_double);
+    printf("%-10s %10d rounds  median %7.0f ns  p90 %7.0f ns  p99 %7.0f ns\n", "steal",
+           STEAL_ROUNDS, bench.samples[STEAL_ROUNDS / 2] * 1e9,
+           bench.samples[STEAL_ROUNDS * 9 / 10] * 1e9, bench.samples[STEAL_ROUNDS * 99 / 100] * 1e9);
+    free(bench.samples);
+}
+
+int main(int argc, char **argv) {
+    size_t workers = argc > 1 ? (size_t)atoi(argv[1]) : taskpool_default_size();
+    if (workers < 2) workers = 2;
+
+    TaskPool *pool = taskpool_create(workers, 0);
+    if (!pool) {
+        fprintf(stderr, "cannot start %zu workers\n", workers);
+        return 1;
+    }
+    printf("%zu workers (%zu CPUs in affinity mask)\n", workers, taskpool_default_size());
+
+    bench_spawn(pool);
+    bench_fan_out(pool);
+    bench_fork_join(pool);
+    bench_steal(pool);
+
+    taskpool_destroy(pool);
+    return 0;
+}
@@ -6,7 +6,12 @@
 #include "../src/ast/ast.h"
 #include "../src/codegen/codegen.h"
 #include "../src/common/debug.h"
+#include "../src/common/memory.h"
+#include <llvm-c/Core.h>
+#include <llvm-c/ExecutionEngine.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 #include <assert.h>
 
 /* Test simple function codegen */
@@ -163,6 +168,204 @@ void test_optimization(void) {
     printf("PASS: Optimization levels\n\n");
 }
 
+/* Test object code split into pieces compiled on a task pool */
+void test_parallel_emission(void) {
+    const char *source =
+        "static int counter = 0;\n"
+        "int total;\n"
+        "static int square(int x) { counter = counter + 1; return x * x; }\n"
+        "int sum_squares(int n) { int s = 0; while (n > 0) { s = s + square(n); n = n - 1; } return s; }\n"
+        "int factorial(int n) { if (n <= 1) return 1; return n * factorial(n - 1); }\n"
+        "int run(int k) { total = sum_squares(k) + factorial(k); return counter; }\n";
+
+    printf("Test: Parallel emission\n");
+
+    SyntaxDefinition *syntax = syntax_c99_create();
+    Lexer *lexer = lexer_create(source, "test.c", syntax);
+    TokenList *tokens = lexer_tokenize(lexer);
+    CParser *parser = c_parser_create(tokens, C_STD_C99);
+    ASTNode *ast = c_parser_parse(parser);
+    assert(ast != NULL);
+
+    CodegenContext *ctx = codegen_init(BACKEND_LLVM, "x86_64-pc-linux-gnu");
+    assert(ctx != NULL);
+    codegen_set_opt_level(ctx, 0);
+    bool success = codegen_generate(ctx, ast, "test_parts");
+    assert(success);
+
+    TaskPool *pool = taskpool_create(2, 0);
+    const char *parts[] = {"test_part0.o", "test_part1.o", "test_part2.o"};
+    size_t written = codegen_emit_object_parts(ctx, pool, parts, 3);
+    if (written != 3) {
+        fprintf(stderr, "Split emission wrote %zu parts: %s\n", written, codegen_get_error(ctx));
+    }
+    assert(written == 3);
+    for (size_t i = 0; i < written; i++) {
+        FILE *f = fopen(parts[i], "rb");
+        assert(f != NULL);
+        char magic[4] = {0};
+        size_t got = fread(magic, 1, 4, f);
+        assert(got == 4 && magic[0] == 0x7f && magic[1] == 'E');
+        (void)got;
+        fclose(f);
+        remove(parts[i]);
+    }
+    printf("✓ %zu objects emitted in parallel\n", written);
+
+    /* Without a pool the same split runs on this thread */
+    written = codegen_emit_object_parts(ctx, NULL, parts, 2);
+    assert(written == 2);
+    (void)success;
+    remove(parts[0]);
+    remove(parts[1]);
+
+    taskpool_destroy(pool);
+    codegen_destroy(ctx);
+    ast_destroy_node(ast);
+    c_parser_destroy(parser);
+    lexer_destroy(lexer);
+    syntax_c99_destroy(syntax);
+
+    printf("PASS: Parallel emission\n\n");
+}
+
+/* Function cache kept in memory for the tests */
+#define TEST_CACHE_SLOTS 32
+
+typedef struct {
+    char *fingerprints[TEST_CACHE_SLOTS];
+    char *data[TEST_CACHE_SLOTS];
+    size_t lens[TEST_CACHE_SLOTS];
+    size_t count;
+} MemoryCache;
+
+static bool memory_cache_fetch(void *owner, const char *fingerprint, char **data, size_t *len) {
+    MemoryCache *cache = (MemoryCache *)owner;
+    for (size_t i = 0; i < cache->count; i++) {
+        if (strcmp(cache->fingerprints[i], fingerprint) == 0) {
+            *data = xmalloc(cache->lens[i]);
+            memcpy(*data, cache->data[i], cache->lens[i]);
+            *len = cache->lens[i];
+            return true;
+        }
+    }
+    return false;
+}
+
+static void memory_cache_store(void *owner, const char *fingerprint, const char *data, size_t len) {
+    MemoryCache *cache = (MemoryCache *)owner;
+    assert(cache->count < TEST_CACHE_SLOTS);
+    cache->fingerprints[cache->count] = xstrdup(fingerprint);
+    cache->data[cache->count] = xmalloc(len);
+    memcpy(cache->data[cache->count], data, len);
+    cache->lens[cache->count] = len;
+    cache->count++;
+}
+
+/* Compile `source` at O2 for this machine, through `cache` if not NULL */
+static CodegenContext *compile_optimized(const char *source, FunctionCache *cache) {
+    SyntaxDefinition *syntax = syntax_c99_create();
+    Lexer *lexer = lexer_create(source, "test.c", syntax);
+    TokenList *tokens = lexer_tokenize(lexer);
+    CParser *parser = c_parser_create(tokens, C_STD_C99);
+    ASTNode *ast = c_parser_parse(parser);
+    assert(ast != NULL);
+
+    CodegenContext *ctx = codegen_init(BACKEND_LLVM, NULL);
+    assert(ctx != NULL);
+    codegen_set_opt_level(ctx, 2);
+    codegen_set_function_cache(ctx, cache);
+    bool success = codegen_generate(ctx, ast, "test_cached");
+    if (!success) {
+        fprintf(stderr, "Codegen failed: %s\n", codegen_get_error(ctx));
+    }
+    assert(success);
+    (void)success;
+
+    ast_destroy_node(ast);
+    c_parser_destroy(parser);
+    lexer_destroy(lexer);
+    syntax_c99_destroy(syntax);
+    return ctx;
+}
+
+/* Run int name(int) from a copy of the compiled module */
+static int call_function(CodegenContext *ctx, const char *name, int arg) {
+    LLVMModuleRef module = LLVMCloneModule((LLVMModuleRef)ctx->current_module);
+    LLVMExecutionEngineRef engine = NULL;
+    char *error = NULL;
+    bool failed = LLVMCreateExecutionEngineForModule(&engine, module, &error);
+    if (failed) {
+        fprintf(stderr, "Cannot create execution engine: %s\n", error);
+    }
+    assert(!failed);
+    (void)failed;
+
+    uint64_t address = LLVMGetFunctionAddress(engine, name);
+    assert(address != 0);
+    int (*function)(int) = (int (*)(int))(uintptr_t)address;
+    int result = function(arg);
+
+    LLVMDisposeExecutionEngine(engine);
+    return result;
+}
+
+/* Test that an edit re-optimizes only the functions it can affect */
+void test_function_cache(void) {
+    const char *original =
+        "int square(int x) { int s; s = 6; return s * s; }\n"
+        "int cube(int x) { int s; s = 3; return s * s * s; }\n"
+        "int combine(int x) { return square(1) + square(2) + 1; }\n"
+        "int scale(int x) { int s; int n; s = 0; n = 5; while (n > 0) { s = s + 3; n = n - 1; } return s; }\n";
+    const char *edited =
+        "int square(int x) { int s; s = 6; return s * s; }\n"
+        "int cube(int x) { int s; s = 3; return s * s * s + 1; }\n"
+        "int combine(int x) { return square(1) + square(2) + 1; }\n"
+        "int scale(int x) { int s; int n; s = 0; n = 5; while (n > 0) { s = s + 3; n = n - 1; } return s; }\n";
+    const char *functions[] = {"square", "cube", "combine", "scale"};
+
+    printf("Test: Function cache\n");
+
+    LLVMLinkInMCJIT();
+    MemoryCache store = {{NULL}, {NULL}, {0}, 0};
+    FunctionCache cache = {memory_cache_fetch, memory_cache_store, &store, 0, 0};
+
+    /* A cold cache optimizes every function and stores each one */
+    CodegenContext *ctx = compile_optimized(original, &cache);
+    assert(cache.reused == 0 && cache.rebuilt == 4);
+    assert(store.count == 4);
+    codegen_destroy(ctx);
+
+    /* Editing cube leaves the other three, which do not call it, cached */
+    cache.reused = cache.rebuilt = 0;
+    CodegenContext *cached = compile_optimized(edited, &cache);
+    assert(cache.reused == 3 && cache.rebuilt == 1);
+    printf("✓ Reused %zu of %zu functions\n", cache.reused, cache.reused + cache.rebuilt);
+
+    /* The spliced module computes what whole-module optimization does */
+    CodegenContext *whole = compile_optimized(edited, NULL);
+    for (size_t f = 0; f < sizeof(functions) / sizeof(functions[0]); f++) {
+        int expected = call_function(whole, functions[f], 0);
+        int actual = call_function(cached, functions[f], 0);
+        assert(actual == expected);
+        (void)expected;
+        (void)actual;
+    }
+    int edited_cube = call_function(cached, "cube", 0);
+    assert(edited_cube == 28);
+    (void)edited_cube;
+    printf("✓ Spliced module matches whole-module optimization\n");
+
+    codegen_destroy(whole);
+    codegen_destroy(cached);
+    for (size_t i = 0; i < store.count; i++) {
+        xfree(store.fingerprints[i]);
+        xfree(store.data[i]);
+    }
+
+    printf("PASS: Function cache\n\n");
+}
+
 int main(void) {
     printf("================================================================\n");
     printf("                LLVM CODEGEN TEST SUITE\n");
@@ -171,6 +374,8 @@ int main(void) {
     test_simple_function();
     test_expressions();
     test_optimization();
+    test_parallel_emission();
+    test_function_cache();
 
     printf("================================================================\n");
     printf("                ALL CODEGEN TESTS PASSED\n");
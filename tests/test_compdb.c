@@ -0,0 +1,305 @@
+/* Test the compilation database reader and --build */
+
+#define _POSIX_C_SOURCE 200809L
+#include "../src/driver/compdb.h"
+#include "../src/common/error.h"
+#include "../src/common/memory.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static char work_dir[] = "/tmp/test_compdb_XXXXXX";
+
+static void write_file(const char *path, const char *text) {
+    FILE *f = fopen(path, "w");
+    assert(f != NULL);
+    fputs(text, f);
+    fclose(f);
+}
+
+static CompileDatabase *load_text(const char *json) {
+    char path[256];
+    snprintf(path, sizeof(path), "%s/compile_commands.json", work_dir);
+    write_file(path, json);
+    return compdb_load(path);
+}
+
+static bool has_arguments(const CompileCommand *cmd, const char *const *expected, size_t count) {
+    if (cmd->argument_count != count) return false;
+    for (size_t i = 0; i < count; i++) {
+        if (strcmp(cmd->arguments[i], expected[i]) != 0) return false;
+    }
+    return true;
+}
+
+/* String escapes decode, unknown members of any shape are skipped */
+void test_escaping(void) {
+    printf("Test: Escaping\n");
+
+    CompileDatabase *db = load_text(
+        "[\n"
+        "  {\n"
+        "    \"directory\": \"/src/with \\\"quotes\\\" and \\\\ back\\/slash\",\n"
+        "    \"file\": \"caf\\u00e9\\t\\u20ac.c\",\n"
+        "    \"extra\": {\"nested\": [1, 2.5, true, null, {\"k\": \"v\"}]},\n"
+        "    \"arguments\": [\"cc\", \"-DMSG=\\\"hi\\\"\", \"line\\nbreak\"],\n"
+        "    \"output\": \"out.o\"\n"
+        "  }\n"
+        "]\n");
+    assert(db != NULL && db->count == 1);
+
+    const CompileCommand *cmd = &db->entries[0];
+    assert(strcmp(cmd->directory, "/src/with \"quotes\" and \\ back/slash") == 0);
+    assert(strcmp(cmd->file, "caf\xc3\xa9\t\xe2\x82\xac.c") == 0);
+    assert(strcmp(cmd->output, "out.o") == 0);
+    const char *const expected[] = {"cc", "-DMSG=\"hi\"", "line\nbreak"};
+    assert(has_arguments(cmd, expected, 3));
+    (void)cmd;
+    (void)expected;
+    compdb_destroy(db);
+
+    /* An empty database is valid */
+    db = load_text("  [ ]  ");
+    assert(db != NULL && db->count == 0);
+    compdb_destroy(db);
+
+    printf("PASS: Escaping test\n\n");
+}
+
+/* "command" is split like /bin/sh would; "arguments" wins over it */
+void test_arguments_and_command(void) {
+    printf("Test: Arguments and command\n");
+
+    CompileDatabase *db = load_text(
+        "[\n"
+        "  {\"directory\": \"/d\", \"file\": \"a.c\",\n"
+        "   \"command\": \"cc  -c 'my file.c' -o \\\"out dir/a.o\\\" -DX=a\\\\ b \\\"\\\\$HOME\\\"\"},\n"
+        "  {\"directory\": \"/d\", \"file\": \"b.c\",\n"
+        "   \"command\": \"cc -c ignored.c\", \"arguments\": [\"cc\", \"-c\", \"b.c\"]},\n"
+        "  {\"directory\": \"/d\", \"arguments\": [\"cc\", \"-c\", \"c.c\"], \"file\": \"c.c\",\n"
+        "   \"command\": \"cc -c ignored.c\"},\n"
+        "  {\"directory\": \"/d\", \"file\": \"d.c\"}\n"
+        "]\n");
+    assert(db != NULL && db->count == 4);
+    assert(db->entries[0].output == NULL);
+
+    const char *const split[] = {"cc", "-c", "my file.c", "-o", "out dir/a.o", "-DX=a b", "$HOME"};
+    assert(has_arguments(&db->entries[0], split, 7));
+    const char *const b[] = {"cc", "-c", "b.c"};
+    assert(has_arguments(&db->entries[1], b, 3));
+    const char *const c[] = {"cc", "-c", "c.c"};
+    assert(has_arguments(&db->entries[2], c, 3));
+    assert(db->entries[3].argument_count == 0);
+    (void)split;
+    (void)b;
+    (void)c;
+    compdb_destroy(db);
+
+    printf("PASS: Arguments and command test\n\n");
+}
+
+/* Entries without a directory or file, and broken JSON, are rejected */
+void test_malformed(void) {
+    printf("Test: Malformed databases\n");
+
+    const char *bad[] = {
+        "",
+        "{}",
+        "[{\"file\": \"a.c\", \"command\": \"cc a.c\"}]",
+        "[{\"directory\": \"/d\", \"command\": \"cc a.c\"}]",
+        "[{\"directory\": \"/d\", \"file\": \"a.c\"}",
+        "[{\"directory\": \"/d\", \"file\": \"a.c}]",
+        "[{\"directory\": \"/d\" \"file\": \"a.c\"}]",
+        "[{\"directory\": \"/d\", \"file\": \"a.c\", \"arguments\": [\"cc\", 1]}]"
+    };
+
+    /* Each one reports a diagnostic; keep them out of the test log */
+    fflush(stderr);
+    int saved_err = dup(STDERR_FILENO);
+    FILE *quiet = freopen("/dev/null", "w", stderr);
+    assert(quiet != NULL);
+    (void)quiet;
+
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        CompileDatabase *db = load_text(bad[i]);
+        assert(db == NULL);
+        (void)db;
+    }
+
+    char missing[256];
+    snprintf(missing, sizeof(missing), "%s/missing.json", work_dir);
+    CompileDatabase *db = compdb_load(missing);
+    assert(db == NULL);
+    (void)db;
+
+    fflush(stderr);
+    dup2(saved_err, STDERR_FILENO);
+    close(saved_err);
+
+    printf("PASS: Malformed databases test\n\n");
+}
+
+static bool exists(const char *dir, const char *name) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    return access(path, F_OK) == 0;
+}
+
+/* Inputs, outputs and depfiles are relative to each entry's directory,
+ * not to where --build runs */
+void test_directory(void) {
+    printf("Test: Directory handling\n");
+
+    char sub[256], path[512];
+    snprintf(sub, sizeof(sub), "%s/sub", work_dir);
+    int made = mkdir(sub, 0700);
+    assert(made == 0);
+    (void)made;
+    snprintf(path, sizeof(path), "%s/lib", sub);
+    made = mkdir(path, 0700);
+    assert(made == 0);
+    snprintf(path, sizeof(path), "%s/lib/a.c", sub);
+    write_file(path, "int a(void) { return 1; }\n");
+    snprintf(path, sizeof(path), "%s/b.c", sub);
+    write_file(path, "int b(void) { return 2; }\n");
+
+    char json[2048];
+    snprintf(json, sizeof(json),
+             "[\n"
+             "  {\"directory\": \"%s\", \"file\": \"lib/a.c\",\n"
+             "   \"arguments\": [\"cc\", \"-c\", \"lib/a.c\", \"-o\", \"a-out.o\", \"-MMD\", \"-MF\", \"a.d\"]},\n"
+             "  {\"directory\": \"%s\", \"file\": \"b.c\", \"command\": \"cc -c b.c\"},\n"
+             "  {\"directory\": \"%s\", \"file\": \"%s/b.c\", \"output\": \"b-abs.o\",\n"
+             "   \"command\": \"cc -c b.c -o ignored.o\"}\n"
+             "]\n",
+             sub, sub, work_dir, sub);
+    char db_path[256];
+    snprintf(db_path, sizeof(db_path), "%s/compile_commands.json", work_dir);
+    write_file(db_path, json);
+
+    DriverOptions opts;
+    driver_options_init(&opts);
+    opts.jobs = 2;
+
+    /* Run from somewhere else entirely */
+    char saved_cwd[4096];
+    char *got_cwd = getcwd(saved_cwd, sizeof(saved_cwd));
+    int moved = chdir("/");
+    assert(got_cwd != NULL && moved == 0);
+    (void)got_cwd;
+
+    fflush(stdout);
+    int status = compdb_build(db_path, &opts);
+    assert(status == 0);
+    (void)status;
+    moved = chdir(saved_cwd);
+    (void)moved;
+
+    assert(exists(sub, "a-out.o") && exists(sub, "a.d"));
+    assert(exists(sub, "b.o"));
+    assert(exists(work_dir, "b-abs.o") && !exists(work_dir, "ignored.o"));
+    assert(!exists("/", "a-out.o") && !exists("/", "b.o"));
+
+    printf("PASS: Directory handling test\n\n");
+}
+
+/* An entry's -I, -isystem, -D and -U reach the preprocessor, with
+ * relative directories taken from the entry's directory */
+void test_preprocessor_flags(void) {
+    printf("Test: Preprocessor flags\n");
+
+    char sub[256], path[512];
+    snprintf(sub, sizeof(sub), "%s/pp", work_dir);
+    int made = mkdir(sub, 0700);
+    assert(made == 0);
+    snprintf(path, sizeof(path), "%s/my inc", sub);
+    made = mkdir(path, 0700);
+    assert(made == 0);
+    snprintf(path, sizeof(path), "%s/sys", sub);
+    made = mkdir(path, 0700);
+    assert(made == 0);
+    (void)made;
+
+    snprintf(path, sizeof(path), "%s/my inc/local.h", sub);
+    write_file(path, "#define LOCAL_VALUE 2\n");
+    snprintf(path, sizeof(path), "%s/sys/system.h", sub);
+    write_file(path, "#define SYSTEM_VALUE 3\n");
+    snprintf(path, sizeof(path), "%s/flags.c", sub);
+    write_file(path,
+               "#include \"local.h\"\n"
+               "#include <system.h>\n"
+               "#ifdef DROPPED\n"
+               "#error DROPPED should be undefined\n"
+               "#endif\n"
+               "#if !defined(EMPTY) || !defined(LATE)\n"
+               "#error EMPTY and LATE should be defined\n"
+               "#endif\n"
+               "const char *message(void) { return MESSAGE; }\n"
+               "int flags(void) { return LOCAL_VALUE + SYSTEM_VALUE + EXTRA EMPTY; }\n");
+
+    char json[2048];
+    snprintf(json, sizeof(json),
+             "[\n"
+             "  {\"directory\": \"%s\", \"file\": \"flags.c\",\n"
+             "   \"arguments\": [\"cc\", \"-c\", \"flags.c\", \"-Imy inc\", \"-isystem\", \"sys\",\n"
+             "                 \"-D\", \"EXTRA=4\", \"-DMESSAGE=\\\"a $HOME 'b'\\\"\", \"-DEMPTY=\",\n"
+             "                 \"-DDROPPED\", \"-UDROPPED\", \"-ULATE\", \"-DLATE\"]}\n"
+             "]\n",
+             sub);
+    char db_path[256];
+    snprintf(db_path, sizeof(db_path), "%s/pp_commands.json", work_dir);
+    write_file(db_path, json);
+
+    DriverOptions opts;
+    driver_options_init(&opts);
+    opts.jobs = 1;
+
+    fflush(stdout);
+    int status = compdb_build(db_path, &opts);
+    assert(status == 0);
+    (void)status;
+    assert(exists(sub, "flags.o"));
+
+    /* The depfile lists the headers found through the entry's paths */
+    snprintf(path, sizeof(path), "%s/flags.d", sub);
+    FILE *f = fopen(path, "r");
+    assert(f != NULL);
+    char deps[2048];
+    size_t got = fread(deps, 1, sizeof(deps) - 1, f);
+    deps[got] = '\0';
+    fclose(f);
+    assert(strstr(deps, "local.h") != NULL && strstr(deps, "system.h") != NULL);
+
+    printf("PASS: Preprocessor flags test\n\n");
+}
+
+int main(void) {
+    printf("================================================================\n");
+    printf("COMPILATION DATABASE TEST SUITE\n");
+    printf("================================================================\n\n");
+
+    char *created = mkdtemp(work_dir);
+    assert(created != NULL);
+    (void)created;
+    diagnostic_init();
+
+    test_escaping();
+    test_arguments_and_command();
+    test_malformed();
+    test_directory();
+    test_preprocessor_flags();
+
+    char command[128];
+    snprintf(command, sizeof(command), "rm -rf %s", work_dir);
+    int removed = system(command);
+    (void)removed;
+
+    printf("================================================================\n");
+    printf("ALL COMPILATION DATABASE TESTS PASSED\n");
+    printf("================================================================\n");
+
+    return 0;
+}
@@ -0,0 +1,220 @@
+/* Test the compile server round trip */
+
+#define _POSIX_C_SOURCE 200809L
+#include "../src/driver/daemon.h"
+#include "../src/driver/protocol.h"
+#include "../src/common/error.h"
+#include "../src/common/memory.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+static char work_dir[] = "/tmp/test_daemon_XXXXXX";
+static char socket_path[256];
+
+/* Stands in for the compiler's command line: reports what it was given */
+static int echo_command(int argc, char **argv) {
+    char cwd[4096];
+    if (!getcwd(cwd, sizeof(cwd))) cwd[0] = '\0';
+    const char *value = getenv("TEST_DAEMON_VALUE");
+
+    printf("cwd=%s\n", cwd);
+    for (int i = 0; i < argc; i++) printf("argv[%d]=%s\n", i, argv[i]);
+    printf("env=%s\n", value ? value : "(unset)");
+    fprintf(stderr, "diagnostic for %s\n", argc > 1 ? argv[1] : "nothing");
+
+    /* A fatal error deep inside the compiler */
+    if (argc > 1 && strcmp(argv[1], "fatal") == 0) exit(1);
+    return argc;
+}
+
+static pid_t start_server(void) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        if (!freopen("/dev/null", "w", stdout)) _exit(1);
+        _exit(daemon_serve(socket_path, echo_command));
+    }
+
+    struct timespec pause = {0, 10 * 1000 * 1000};
+    for (int i = 0; i < 500 && access(socket_path, F_OK) != 0; i++) {
+        nanosleep(&pause, NULL);
+    }
+    nanosleep(&pause, NULL);
+    return pid;
+}
+
+/* Send a command line the way llvm-c-client does; false if the server
+ * did not answer */
+static bool submit(const char *cwd, int argc, const char **argv, const char **env,
+                   ProtoMessage *response) {
+    int fd = proto_connect(socket_path);
+    if (fd < 0) return false;
+
+    char argc_str[16];
+    snprintf(argc_str, sizeof(argc_str), "%d", argc);
+
+    ProtoMessage request;
+    proto_message_init(&request);
+    proto_message_add_str(&request, PROTO_MAGIC);
+    proto_message_add_str(&request, cwd);
+    proto_message_add_str(&request, argc_str);
+    for (int i = 0; i < argc; i++) proto_message_add_str(&request, argv[i]);
+    for (size_t i = 0; env && env[i]; i++) proto_message_add_str(&request, env[i]);
+
+    bool ok = proto_send(fd, &request) && proto_recv(fd, response);
+    proto_message_free(&request);
+    close(fd);
+    if (ok && (response->count < 4 || strcmp(response->items[0], PROTO_MAGIC) != 0)) {
+        proto_message_free(response);
+        return false;
+    }
+    return ok;
+}
+
+/* The command runs in the client's directory and environment, and its
+ * status and output come back */
+void test_round_trip(void) {
+    printf("Test: Round trip\n");
+
+    char expected[8192];
+    const char *argv[] = {"llvm-c", "-c", "a file.c"};
+    const char *env[] = {"TEST_DAEMON_VALUE=from client", "PATH=/usr/bin:/bin", NULL};
+
+    for (int i = 0; i < 3; i++) {
+        ProtoMessage response;
+        bool ok = submit(work_dir, 3, argv, env, &response);
+        assert(ok);
+        (void)ok;
+
+        assert(strcmp(response.items[1], "3") == 0);
+        snprintf(expected, sizeof(expected),
+                 "cwd=%s\nargv[0]=llvm-c\nargv[1]=-c\nargv[2]=a file.c\nenv=from client\n",
+                 work_dir);
+        assert(strcmp(response.items[2], expected) == 0);
+        assert(strcmp(response.items[3], "diagnostic for -c\n") == 0);
+        proto_message_free(&response);
+    }
+
+    /* The server's own environment does not leak into requests */
+    const char *bare_argv[] = {"llvm-c"};
+    ProtoMessage response;
+    bool ok = submit(work_dir, 1, bare_argv, NULL, &response);
+    assert(ok && strcmp(response.items[1], "1") == 0);
+    assert(strstr(response.items[2], "env=(unset)\n") != NULL);
+    proto_message_free(&response);
+    (void)ok;
+    (void)expected;
+
+    printf("PASS: Round trip test\n\n");
+}
+
+/* exit() inside the command and an unusable cwd still get an answer */
+void test_failures(void) {
+    printf("Test: Failures\n");
+
+    const char *fatal_argv[] = {"llvm-c", "fatal"};
+    ProtoMessage response;
+    bool ok = submit(work_dir, 2, fatal_argv, NULL, &response);
+    assert(ok && strcmp(response.items[1], "1") == 0);
+    assert(strcmp(response.items[3], "diagnostic for fatal\n") == 0);
+    proto_message_free(&response);
+
+    char missing[300];
+    snprintf(missing, sizeof(missing), "%s/missing", work_dir);
+    const char *argv[] = {"llvm-c", "-c"};
+    ok = submit(missing, 2, argv, NULL, &response);
+    assert(ok && strcmp(response.items[1], "1") == 0);
+    assert(response.lengths[2] == 0);
+    assert(strstr(response.items[3], "cannot change to directory") != NULL);
+    proto_message_free(&response);
+
+    /* A malformed request is dropped without an answer, and the server
+     * keeps serving */
+    int fd = proto_connect(socket_path);
+    assert(fd >= 0);
+    ProtoMessage request;
+    proto_message_init(&request);
+    proto_message_add_str(&request, PROTO_MAGIC);
+    proto_message_add_str(&request, work_dir);
+    proto_message_add_str(&request, "5");
+    proto_message_add_str(&request, "llvm-c");
+    ok = proto_send(fd, &request) && proto_recv(fd, &response);
+    assert(!ok);
+    proto_message_free(&request);
+    close(fd);
+
+    ok = submit(work_dir, 2, argv, NULL, &response);
+    assert(ok && strcmp(response.items[1], "2") == 0);
+    proto_message_free(&response);
+    (void)ok;
+
+    printf("PASS: Failures test\n\n");
+}
+
+/* A second server refuses a live socket; a stopped one cleans up after
+ * itself */
+void test_lifecycle(pid_t server) {
+    printf("Test: Lifecycle\n");
+
+    struct stat st;
+    int found = stat(socket_path, &st);
+    assert(found == 0 && (st.st_mode & 077) == 0);
+
+    fflush(stdout);
+    pid_t second = fork();
+    if (second == 0) {
+        if (!freopen("/dev/null", "w", stderr)) _exit(2);
+        _exit(daemon_serve(socket_path, echo_command));
+    }
+    int status = 0;
+    waitpid(second, &status, 0);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 1);
+
+    kill(server, SIGTERM);
+    waitpid(server, &status, 0);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    found = stat(socket_path, &st);
+    assert(found != 0);
+    (void)found;
+
+    /* No server: the client falls back to compiling locally */
+    ProtoMessage response;
+    const char *argv[] = {"llvm-c"};
+    bool ok = submit(work_dir, 1, argv, NULL, &response);
+    assert(!ok);
+    (void)ok;
+
+    printf("PASS: Lifecycle test\n\n");
+}
+
+int main(void) {
+    printf("================================================================\n");
+    printf("DAEMON TEST SUITE\n");
+    printf("================================================================\n\n");
+
+    char *created = mkdtemp(work_dir);
+    assert(created != NULL);
+    (void)created;
+    snprintf(socket_path, sizeof(socket_path), "%s/d.sock", work_dir);
+    diagnostic_init();
+
+    pid_t server = start_server();
+    test_round_trip();
+    test_failures();
+    test_lifecycle(server);
+
+    rmdir(work_dir);
+
+    printf("================================================================\n");
+    printf("ALL DAEMON TESTS PASSED\n");
+    printf("================================================================\n");
+
+    return 0;
+}
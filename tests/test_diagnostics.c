@@ -0,0 +1,116 @@
+/* Test diagnostic source snippets */
+
+#include "../src/common/error.h"
+#include "../src/common/memory.h"
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+static SourceLocation at(const char *filename, uint32_t line, uint32_t column) {
+    SourceLocation loc = {filename, line, column, 0};
+    return loc;
+}
+
+/* The text printed for one diagnostic */
+static char *emit_captured(SourceLocation loc) {
+    bool capturing = diagnostic_begin_capture();
+    assert(capturing);
+    (void)capturing;
+    diagnostic_emit(DIAG_NOTE, loc, "here");
+    return diagnostic_end_capture(NULL);
+}
+
+void test_snippet_lines(void) {
+    printf("Test: Snippet lines\n");
+
+    const char *source = "int a;\n\nint b = 1;\nlast line";
+    diagnostic_set_source("a.c", source);
+
+    char *text = emit_captured(at("a.c", 1, 5));
+    assert(strstr(text, "    1 | int a;\n") != NULL);
+    assert(strstr(text, "      |     ^\n") != NULL);
+    xfree(text);
+
+    text = emit_captured(at("a.c", 2, 0));
+    assert(strstr(text, "    2 | \n") != NULL);
+    xfree(text);
+
+    /* The last line has no newline */
+    text = emit_captured(at("a.c", 4, 1));
+    assert(strstr(text, "    4 | last line\n") != NULL);
+    xfree(text);
+
+    /* Past the end, or an unknown file: no snippet */
+    text = emit_captured(at("a.c", 5, 1));
+    assert(strstr(text, " | ") == NULL);
+    xfree(text);
+    text = emit_captured(at("b.c", 1, 1));
+    assert(strstr(text, " | ") == NULL);
+    xfree(text);
+
+    diagnostic_clear_source("a.c");
+    printf("PASS: Snippet lines test\n\n");
+}
+
+void test_source_registry(void) {
+    printf("Test: Source registry\n");
+
+    /* Registering a name again replaces its text and line index */
+    diagnostic_set_source("a.c", "old\n");
+    char *text = emit_captured(at("a.c", 1, 1));
+    assert(strstr(text, "    1 | old\n") != NULL);
+    xfree(text);
+    diagnostic_set_source("a.c", "new\nsecond\n");
+    text = emit_captured(at("a.c", 2, 1));
+    assert(strstr(text, "    2 | second\n") != NULL);
+    xfree(text);
+
+    /* Many files at once, cleared in any order */
+    static char names[600][16];
+    static char sources[600][32];
+    for (int i = 0; i < 600; i++) {
+        snprintf(names[i], sizeof(names[i]), "f%d.c", i);
+        snprintf(sources[i], sizeof(sources[i]), "line one\nfile %d\n", i);
+        diagnostic_set_source(names[i], sources[i]);
+    }
+    for (int i = 0; i < 600; i += 2) {
+        diagnostic_clear_source(names[i]);
+    }
+    for (int i = 0; i < 600; i++) {
+        char expected[32];
+        snprintf(expected, sizeof(expected), "    2 | file %d\n", i);
+        text = emit_captured(at(names[i], 2, 1));
+        assert((strstr(text, expected) != NULL) == (i % 2 == 1));
+        xfree(text);
+    }
+    for (int i = 1; i < 600; i += 2) {
+        diagnostic_clear_source(names[i]);
+    }
+
+    text = emit_captured(at("a.c", 1, 1));
+    assert(strstr(text, "    1 | new\n") != NULL);
+    xfree(text);
+    diagnostic_clear_source("a.c");
+
+    printf("PASS: Source registry test\n\n");
+}
+
+int main(void) {
+    printf("================================================================\n");
+    printf("DIAGNOSTICS TEST SUITE\n");
+    printf("================================================================\n\n");
+
+    diagnostic_init();
+    DiagnosticOptions opts = *diagnostic_get_options();
+    opts.use_color = false;
+    diagnostic_set_options(&opts);
+
+    test_snippet_lines();
+    test_source_registry();
+
+    printf("================================================================\n");
+    printf("ALL DIAGNOSTICS TESTS PASSED\n");
+    printf("================================================================\n");
+
+    return 0;
+}
@@ -0,0 +1,376 @@
+/* Test compiling several inputs in one process */
+
+#define _POSIX_C_SOURCE 200809L
+#include "../src/driver/driver.h"
+#include "../src/common/error.h"
+#include "../src/common/memory.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define INPUT_COUNT 6
+
+static char work_dir[] = "/tmp/test_driver_XXXXXX";
+
+static void write_file(const char *path, const char *text) {
+    FILE *f = fopen(path, "w");
+    assert(f != NULL);
+    fputs(text, f);
+    fclose(f);
+}
+
+static char *read_file(const char *path) {
+    FILE *f = fopen(path, "r");
+    assert(f != NULL);
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *text = xmalloc((size_t)size + 1);
+    size_t got = fread(text, 1, (size_t)size, f);
+    text[got] = '\0';
+    fclose(f);
+    return text;
+}
+
+/* Run the driver with stdout and stderr sent to files */
+static int run_captured(const DriverOptions *opts, const char **inputs, size_t count,
+                        char **out, char **err) {
+    char out_path[256], err_path[256];
+    snprintf(out_path, sizeof(out_path), "%s/stdout", work_dir);
+    snprintf(err_path, sizeof(err_path), "%s/stderr", work_dir);
+
+    fflush(stdout);
+    fflush(stderr);
+    int saved_out = dup(STDOUT_FILENO), saved_err = dup(STDERR_FILENO);
+    int out_fd = open(out_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    int err_fd = open(err_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    assert(saved_out >= 0 && saved_err >= 0 && out_fd >= 0 && err_fd >= 0);
+    dup2(out_fd, STDOUT_FILENO);
+    dup2(err_fd, STDERR_FILENO);
+    close(out_fd);
+    close(err_fd);
+
+    int status = driver_run(opts, inputs, count);
+
+    fflush(stdout);
+    fflush(stderr);
+    dup2(saved_out, STDOUT_FILENO);
+    dup2(saved_err, STDERR_FILENO);
+    close(saved_out);
+    close(saved_err);
+
+    *out = read_file(out_path);
+    *err = read_file(err_path);
+    return status;
+}
+
+/* The first unit is by far the slowest, so it finishes last */
+static char *slow_source(void) {
+    size_t size = 64 * 1024, len = 0;
+    char *text = xmalloc(size);
+    for (int i = 0; i < 400; i++) {
+        len += (size_t)snprintf(text + len, size - len,
+                                "int f%d(void) { int a = %d; int b = a * 3; return a + b; }\n", i, i);
+        if (size - len < 128) {
+            size *= 2;
+            text = xrealloc(text, size);
+        }
+    }
+    return text;
+}
+
+/* Results and each unit's diagnostics come out in input order and in one
+ * piece, however the units finish */
+void test_output_order(void) {
+    printf("Test: Output order\n");
+
+    char paths[INPUT_COUNT][256];
+    const char *inputs[INPUT_COUNT];
+    for (int i = 0; i < INPUT_COUNT; i++) {
+        snprintf(paths[i], sizeof(paths[i]), "%s/unit%d.c", work_dir, i);
+        inputs[i] = paths[i];
+    }
+
+    char *slow = slow_source();
+    write_file(paths[0], slow);
+    xfree(slow);
+    write_file(paths[1], "int one(void) { return 1; }\n");
+    write_file(paths[2], "int two(void) { return 2 }\nint three( { }\n");
+    write_file(paths[3], "int four(void) { return 4; }\n");
+    write_file(paths[4], "int five(void) { return 5 }\n");
+    write_file(paths[5], "int six(void) { return 6; }\n");
+
+    DriverOptions opts;
+    driver_options_init(&opts);
+    opts.compile_only = true;
+    opts.jobs = 4;
+
+    for (int round = 0; round < 3; round++) {
+        char *out = NULL, *err = NULL;
+        int status = run_captured(&opts, inputs, INPUT_COUNT, &out, &err);
+        assert(status != 0);
+        (void)status;
+
+        /* Successful units, in order */
+        const char *p = out;
+        for (int i = 0; i < INPUT_COUNT; i++) {
+            if (i == 2 || i == 4) continue;
+            char expected[300];
+            snprintf(expected, sizeof(expected), "Compiled: %s ->", paths[i]);
+            const char *at = strstr(p, expected);
+            assert(at != NULL);
+            p = at + strlen(expected);
+        }
+
+        /* Failed units: every line about unit2 precedes every line about
+         * unit4, and each block ends with its unit's failure */
+        char fail2[300], fail4[300];
+        snprintf(fail2, sizeof(fail2), "Error: failed to compile '%s'", paths[2]);
+        snprintf(fail4, sizeof(fail4), "Error: failed to compile '%s'", paths[4]);
+        const char *end2 = strstr(err, fail2);
+        const char *end4 = strstr(err, fail4);
+        assert(end2 != NULL && end4 != NULL && end2 < end4);
+
+        const char *first4 = strstr(err, "unit4.c");
+        const char *last2 = end2;
+        for (const char *q = err; (q = strstr(q, "unit2.c")) != NULL; q++) last2 = q;
+        assert(last2 < first4);
+        assert(strstr(err, "unit1.c") == NULL && strstr(err, "unit3.c") == NULL);
+        (void)end4;
+        (void)first4;
+        (void)last2;
+
+        xfree(out);
+        xfree(err);
+    }
+
+    printf("PASS: Output order test\n\n");
+}
+
+static void add_record(FunctionReport *report, const char *name, double codegen_ms,
+                       double optimize_ms, double emit_ms, size_t base) {
+    report->records = xrealloc(report->records, (report->count + 1) * sizeof(FunctionRecord));
+    report->records[report->count++] = (FunctionRecord){
+        .name = xstrdup(name),
+        .ast_nodes = base,
+        .blocks_before = base + 1,
+        .instructions_before = base + 2,
+        .blocks_after = base + 3,
+        .instructions_after = base + 4,
+        .codegen_ms = codegen_ms,
+        .optimize_ms = optimize_ms,
+        .emit_ms = emit_ms,
+        .code_bytes = base + 5,
+    };
+    report->capacity = report->count;
+}
+
+/* Hand-built records: rows sorted by total time then name, CSV fields
+ * quoted only when they need it, JSON strings escaped */
+void test_function_report_format(void) {
+    printf("Test: Function report format\n");
+
+    const char *expected_csv =
+        "unit,function,ast_nodes,blocks_before,instructions_before,blocks_after,"
+        "instructions_after,codegen_ms,optimize_ms,emit_ms,total_ms,code_bytes\n"
+        "b.c,\"line\nbreak\\\x01\",20,21,22,23,24,8.000,1.500,0.500,10.000,25\n"
+        "\"dir,1/a.c\",plain,10,11,12,13,14,1.000,2.000,0.500,3.500,15\n"
+        "\"dir,1/a.c\",\"we\"\"ird,name\",30,31,32,33,34,0.500,0.500,2.500,3.500,35\n";
+    const char *expected_json =
+        "[\n"
+        "  {\"unit\": \"b.c\", \"function\": \"line\\u000abreak\\\\\\u0001\", \"ast_nodes\": 20, "
+        "\"blocks_before\": 21, \"instructions_before\": 22, \"blocks_after\": 23, "
+        "\"instructions_after\": 24, \"codegen_ms\": 8.000, \"optimize_ms\": 1.500, "
+        "\"emit_ms\": 0.500, \"total_ms\": 10.000, \"code_bytes\": 25},\n"
+        "  {\"unit\": \"dir,1/a.c\", \"function\": \"plain\", \"ast_nodes\": 10, "
+        "\"blocks_before\": 11, \"instructions_before\": 12, \"blocks_after\": 13, "
+        "\"instructions_after\": 14, \"codegen_ms\": 1.000, \"optimize_ms\": 2.000, "
+        "\"emit_ms\": 0.500, \"total_ms\": 3.500, \"code_bytes\": 15},\n"
+        "  {\"unit\": \"dir,1/a.c\", \"function\": \"we\\\"ird,name\", \"ast_nodes\": 30, "
+        "\"blocks_before\": 31, \"instructions_before\": 32, \"blocks_after\": 33, "
+        "\"instructions_after\": 34, \"codegen_ms\": 0.500, \"optimize_ms\": 0.500, "
+        "\"emit_ms\": 2.500, \"total_ms\": 3.500, \"code_bytes\": 35}\n"
+        "]\n";
+
+    const char *names[] = {"report.csv", "report.json"};
+    const char *expected[] = {expected_csv, expected_json};
+    for (int i = 0; i < 2; i++) {
+        DriverUnit units[2];
+        memset(units, 0, sizeof(units));
+        units[0].input = "dir,1/a.c";
+        units[1].input = "b.c";
+        add_record(&units[0].functions, "we\"ird,name", 0.5, 0.5, 2.5, 30);
+        add_record(&units[0].functions, "plain", 1.0, 2.0, 0.5, 10);
+        add_record(&units[1].functions, "line\nbreak\\\x01", 8.0, 1.5, 0.5, 20);
+
+        char path[300];
+        snprintf(path, sizeof(path), "%s/%s", work_dir, names[i]);
+        bool written = driver_write_function_report(path, units, 2);
+        assert(written);
+        (void)written;
+
+        /* The records are released once written */
+        assert(units[0].functions.count == 0 && units[0].functions.records == NULL);
+        assert(units[1].functions.count == 0 && units[1].functions.records == NULL);
+
+        char *text = read_file(path);
+        assert(strcmp(text, expected[i]) == 0);
+        xfree(text);
+    }
+    (void)expected;
+
+    /* Nothing recorded still gives a well-formed file */
+    DriverUnit empty;
+    memset(&empty, 0, sizeof(empty));
+    empty.input = "empty.c";
+    char path[300];
+    snprintf(path, sizeof(path), "%s/empty.json", work_dir);
+    bool written = driver_write_function_report(path, &empty, 1);
+    assert(written);
+    (void)written;
+    char *text = read_file(path);
+    assert(strcmp(text, "[]\n") == 0);
+    xfree(text);
+
+    printf("PASS: Function report format test\n\n");
+}
+
+/* --function-report on a real compile lists every defined function of
+ * every unit */
+void test_function_report_compile(void) {
+    printf("Test: Function report from a compile\n");
+
+    char paths[2][256];
+    const char *inputs[2] = {paths[0], paths[1]};
+    snprintf(paths[0], sizeof(paths[0]), "%s/report_a.c", work_dir);
+    snprintf(paths[1], sizeof(paths[1]), "%s/report_b.c", work_dir);
+    write_file(paths[0], "int alpha(int x) { return x * 2; }\nint beta(void) { return alpha(3); }\n");
+    write_file(paths[1], "int gamma_fn(void) { int s = 0; for (int i = 0; i < 4; i++) s += i; return s; }\n");
+
+    char report_path[300];
+    snprintf(report_path, sizeof(report_path), "%s/functions.csv", work_dir);
+
+    DriverOptions opts;
+    driver_options_init(&opts);
+    opts.compile_only = true;
+    opts.jobs = 2;
+    opts.function_report = report_path;
+
+    char *out = NULL, *err = NULL;
+    int status = run_captured(&opts, inputs, 2, &out, &err);
+    assert(status == 0);
+    (void)status;
+    xfree(out);
+    xfree(err);
+
+    char *text = read_file(report_path);
+    assert(strncmp(text, "unit,function,", 14) == 0);
+    const char *functions[] = {"alpha", "beta", "gamma_fn"};
+    for (int i = 0; i < 3; i++) {
+        char row[400];
+        snprintf(row, sizeof(row), "\n%s,%s,", i < 2 ? paths[0] : paths[1], functions[i]);
+        const char *at = strstr(text, row);
+        assert(at != NULL);
+        (void)at;
+    }
+    size_t lines = 0;
+    for (const char *p = text; *p; p++) lines += *p == '\n';
+    assert(lines == 4);
+    (void)functions;
+    (void)lines;
+    xfree(text);
+
+    printf("PASS: Function report from a compile test\n\n");
+}
+
+/* A snapshot is refused once the header or anything it includes changes */
+void test_pch_dependencies(void) {
+    printf("Test: Snapshot dependencies\n");
+
+    char header[256], inner[256], unit[256], snapshot[256], object[256];
+    snprintf(header, sizeof(header), "%s/prefix.h", work_dir);
+    snprintf(inner, sizeof(inner), "%s/inner.h", work_dir);
+    snprintf(unit, sizeof(unit), "%s/uses_prefix.c", work_dir);
+    snprintf(snapshot, sizeof(snapshot), "%s/prefix.pch", work_dir);
+    snprintf(object, sizeof(object), "%s/uses_prefix.o", work_dir);
+    write_file(header, "#include \"inner.h\"\ntypedef int prefix_int;\n");
+    write_file(inner, "#define PREFIX_VALUE 3\nint inner_fn(int x);\n");
+    write_file(unit, "int main() { prefix_int v = PREFIX_VALUE; return v; }\n");
+
+    DriverOptions emit_opts;
+    driver_options_init(&emit_opts);
+    emit_opts.emit_pch = true;
+    emit_opts.output_file = snapshot;
+    const char *emit_inputs[] = {header};
+    char *out = NULL, *err = NULL;
+    int status = run_captured(&emit_opts, emit_inputs, 1, &out, &err);
+    assert(status == 0);
+    xfree(out);
+    xfree(err);
+
+    /* The temporary depfile does not outlive the snapshot's creation */
+    char temporary[300];
+    snprintf(temporary, sizeof(temporary), "%s.tmp.d", snapshot);
+    assert(access(temporary, F_OK) != 0);
+
+    DriverOptions use_opts;
+    driver_options_init(&use_opts);
+    use_opts.compile_only = true;
+    use_opts.include_pch = snapshot;
+    use_opts.output_file = object;
+    const char *use_inputs[] = {unit};
+    status = run_captured(&use_opts, use_inputs, 1, &out, &err);
+    assert(status == 0);
+    xfree(out);
+    xfree(err);
+
+    /* Only the included header changes */
+    write_file(inner, "#define PREFIX_VALUE 4\nint inner_fn(int x);\n");
+    status = run_captured(&use_opts, use_inputs, 1, &out, &err);
+    assert(status != 0);
+    assert(strstr(err, "inner.h' has changed since precompiled header") != NULL);
+    (void)status;
+    xfree(out);
+    xfree(err);
+
+    printf("PASS: Snapshot dependencies test\n\n");
+}
+
+int main(void) {
+    printf("================================================================\n");
+    printf("DRIVER TEST SUITE\n");
+    printf("================================================================\n\n");
+
+    char *created = mkdtemp(work_dir);
+    assert(created != NULL);
+    (void)created;
+    diagnostic_init();
+
+    /* Parse failures leave debug dumps in the working directory */
+    char saved_cwd[4096];
+    char *got_cwd = getcwd(saved_cwd, sizeof(saved_cwd));
+    int moved = chdir(work_dir);
+    assert(got_cwd != NULL && moved == 0);
+    (void)got_cwd;
+    (void)moved;
+
+    test_output_order();
+    test_function_report_format();
+    test_function_report_compile();
+    test_pch_dependencies();
+
+    moved = chdir(saved_cwd);
+    char command[128];
+    snprintf(command, sizeof(command), "rm -rf %s", work_dir);
+    int removed = system(command);
+    (void)removed;
+
+    printf("================================================================\n");
+    printf("ALL DRIVER TESTS PASSED\n");
+    printf("================================================================\n");
+
+    return 0;
+}
@@ -0,0 +1,220 @@
+/* Test the GNU make jobserver client */
+
+#define _POSIX_C_SOURCE 200809L
+#include "../src/driver/jobserver.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static void put_tokens(int fd, const char *tokens) {
+    ssize_t written = write(fd, tokens, strlen(tokens));
+    assert(written == (ssize_t)strlen(tokens));
+    (void)written;
+}
+
+/* Take every token that is available now, in order */
+static size_t drain(Jobserver *js, char *tokens, size_t max) {
+    size_t count = 0;
+    int token;
+    while (count < max && (token = jobserver_try_acquire(js)) >= 0) {
+        tokens[count++] = (char)token;
+    }
+    return count;
+}
+
+/* Anything but a usable --jobserver-auth means no jobserver */
+void test_no_jobserver(void) {
+    printf("Test: No jobserver\n");
+
+    unsetenv("MAKEFLAGS");
+    Jobserver *js = jobserver_connect();
+    assert(js == NULL);
+
+    const char *flags[] = {
+        "",
+        "-k -j4",
+        "--jobserver-auth=",
+        "--jobserver-auth=fifo:/nonexistent/jobserver",
+        "--jobserver-auth=1000,1001",
+        "--jobserver-auth=garbage",
+        "x--jobserver-auth=3,4"
+    };
+    for (size_t i = 0; i < sizeof(flags) / sizeof(flags[0]); i++) {
+        setenv("MAKEFLAGS", flags[i], 1);
+        js = jobserver_connect();
+        assert(js == NULL);
+    }
+
+    /* Calls on a missing jobserver are no-ops */
+    int token = jobserver_acquire(NULL, NULL, NULL);
+    assert(token == -1);
+    token = jobserver_try_acquire(NULL);
+    assert(token == -1);
+    jobserver_release(NULL, 'x');
+    jobserver_disconnect(NULL);
+    (void)js;
+    (void)token;
+
+    unsetenv("MAKEFLAGS");
+    printf("PASS: No jobserver test\n\n");
+}
+
+/* make 4.4+ names a fifo */
+void test_fifo_auth(void) {
+    printf("Test: fifo: auth\n");
+
+    char dir[] = "/tmp/test_jobserver_XXXXXX";
+    char *created = mkdtemp(dir);
+    assert(created != NULL);
+    (void)created;
+    char path[256];
+    snprintf(path, sizeof(path), "%s/fifo", dir);
+    int made = mkfifo(path, 0600);
+    assert(made == 0);
+    (void)made;
+
+    /* Stands in for make, which keeps the fifo open */
+    int make_fd = open(path, O_RDWR | O_NONBLOCK);
+    assert(make_fd >= 0);
+    put_tokens(make_fd, "ab");
+
+    char makeflags[512];
+    snprintf(makeflags, sizeof(makeflags), " -j --jobserver-auth=fifo:%s", path);
+    setenv("MAKEFLAGS", makeflags, 1);
+    Jobserver *js = jobserver_connect();
+    assert(js != NULL);
+
+    char tokens[8];
+    size_t count = drain(js, tokens, sizeof(tokens));
+    assert(count == 2 && tokens[0] == 'a' && tokens[1] == 'b');
+
+    /* Released tokens go back where make can see them */
+    jobserver_release(js, 'a');
+    char back = 0;
+    ssize_t got = read(make_fd, &back, 1);
+    assert(got == 1 && back == 'a');
+
+    jobserver_release(js, 'b');
+    int token = jobserver_acquire(js, NULL, NULL);
+    assert(token == 'b');
+    (void)count;
+    (void)got;
+    (void)token;
+
+    jobserver_disconnect(js);
+    close(make_fd);
+    unlink(path);
+    rmdir(dir);
+    unsetenv("MAKEFLAGS");
+
+    printf("PASS: fifo: auth test\n\n");
+}
+
+/* Older make passes an inherited pipe as "R,W"; the last word wins, and
+ * the pre-4.2 --jobserver-fds spelling is understood */
+void test_pipe_auth(void) {
+    printf("Test: R,W auth\n");
+
+    int fds[2], stale[2];
+    int piped = pipe(fds);
+    int piped_stale = pipe(stale);
+    assert(piped == 0 && piped_stale == 0);
+    (void)piped;
+    (void)piped_stale;
+    put_tokens(fds[1], "+++");
+
+    const char *forms[] = {
+        "-j4 --jobserver-auth=%d,%d",
+        "--jobserver-fds=%d,%d -j",
+        "--jobserver-auth=%d,%d --jobserver-auth=%d,%d"
+    };
+    for (size_t i = 0; i < sizeof(forms) / sizeof(forms[0]); i++) {
+        char makeflags[128];
+        if (i == 2) {
+            snprintf(makeflags, sizeof(makeflags), forms[i], stale[0], stale[1], fds[0], fds[1]);
+        } else {
+            snprintf(makeflags, sizeof(makeflags), forms[i], fds[0], fds[1]);
+        }
+        setenv("MAKEFLAGS", makeflags, 1);
+        Jobserver *js = jobserver_connect();
+        assert(js != NULL);
+
+        char tokens[8];
+        size_t count = drain(js, tokens, sizeof(tokens));
+        assert(count == 3 && memcmp(tokens, "+++", 3) == 0);
+        (void)count;
+
+        /* An empty pipe does not block a try */
+        int token = jobserver_try_acquire(js);
+        assert(token == -1);
+        (void)token;
+
+        for (size_t t = 0; t < 3; t++) jobserver_release(js, '+');
+        jobserver_disconnect(js);
+    }
+
+    /* Disconnecting leaves make's descriptors open */
+    assert(fcntl(fds[0], F_GETFD) != -1 && fcntl(fds[1], F_GETFD) != -1);
+
+    close(fds[0]);
+    close(fds[1]);
+    close(stale[0]);
+    close(stale[1]);
+    unsetenv("MAKEFLAGS");
+
+    printf("PASS: R,W auth test\n\n");
+}
+
+static bool stop_after_one_poll(void *ctx) {
+    int *polls = (int *)ctx;
+    return (*polls)++ == 0;
+}
+
+/* A blocked acquire gives up once told to stop waiting */
+void test_abandon_wait(void) {
+    printf("Test: Abandon wait\n");
+
+    int fds[2];
+    int piped = pipe(fds);
+    assert(piped == 0);
+    (void)piped;
+
+    char makeflags[64];
+    snprintf(makeflags, sizeof(makeflags), "--jobserver-auth=%d,%d", fds[0], fds[1]);
+    setenv("MAKEFLAGS", makeflags, 1);
+    Jobserver *js = jobserver_connect();
+    assert(js != NULL);
+
+    int polls = 0;
+    int token = jobserver_acquire(js, stop_after_one_poll, &polls);
+    assert(token == -1 && polls == 2);
+    (void)token;
+
+    jobserver_disconnect(js);
+    close(fds[0]);
+    close(fds[1]);
+    unsetenv("MAKEFLAGS");
+
+    printf("PASS: Abandon wait test\n\n");
+}
+
+int main(void) {
+    printf("================================================================\n");
+    printf("JOBSERVER TEST SUITE\n");
+    printf("================================================================\n\n");
+
+    test_no_jobserver();
+    test_fifo_auth();
+    test_pipe_auth();
+    test_abandon_wait();
+
+    printf("================================================================\n");
+    printf("ALL JOBSERVER TESTS PASSED\n");
+    printf("================================================================\n");
+
+    return 0;
+}
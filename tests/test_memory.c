@@ -0,0 +1,374 @@
+/* Test the default allocator */
+
+#define _POSIX_C_SOURCE 200809L
+#include "../src/common/memory.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#define THREAD_COUNT 4
+#define BLOCKS_PER_THREAD 1000
+#define PROFILE_RATE 4096
+
+static const size_t class_sizes[] = {
+    16, 32, 48, 64, 80, 96, 112, 128,
+    160, 192, 224, 256, 320, 384, 448, 512,
+    640, 768, 896, 1024
+};
+
+/* A request is served from the smallest class that holds it, and a freed
+ * block goes back to the largest class it can serve */
+void test_size_classes(void) {
+    printf("Test: Size classes\n");
+
+    size_t count = sizeof(class_sizes) / sizeof(class_sizes[0]);
+    for (size_t i = 0; i < count; i++) {
+        size_t below = i == 0 ? 0 : class_sizes[i - 1];
+        size_t requests[] = {below + 1, (below + class_sizes[i]) / 2, class_sizes[i]};
+
+        for (size_t r = 0; r < 3; r++) {
+            char *block = xmalloc(requests[r]);
+            assert(malloc_usable_size(block) >= class_sizes[i]);
+            memset(block, 0xab, requests[r]);
+            xfree(block);
+
+            /* Any request of the same class reuses the cached block */
+            char *again = xcalloc(1, class_sizes[i]);
+            assert(again == block);
+            for (size_t b = 0; b < class_sizes[i]; b++) assert(again[b] == 0);
+
+            /* The next class up does not */
+            if (i + 1 < count) {
+                char *larger = xmalloc(class_sizes[i] + 1);
+                assert(larger != again);
+                xfree(larger);
+            }
+            xfree(again);
+        }
+    }
+
+    printf("PASS: Size classes test\n\n");
+}
+
+typedef struct {
+    char *kept[BLOCKS_PER_THREAD / 2];
+    pthread_barrier_t *counted;     /* Hold the thread alive until read */
+} AllocTask;
+
+static void *allocate_blocks(void *arg) {
+    AllocTask *task = (AllocTask *)arg;
+    for (int i = 0; i < BLOCKS_PER_THREAD; i++) {
+        char *block = xmalloc(100);
+        if (i % 2 == 0) {
+            task->kept[i / 2] = block;
+        } else {
+            xfree(block);
+        }
+    }
+    if (task->counted) {
+        pthread_barrier_wait(task->counted);
+        pthread_barrier_wait(task->counted);
+    }
+    return NULL;
+}
+
+/* Statistics of running threads and of threads that exited both count */
+void test_thread_stats(void) {
+    printf("Test: Thread statistics\n");
+
+    AllocTask *tasks = xcalloc(THREAD_COUNT, sizeof(AllocTask));
+    pthread_t threads[THREAD_COUNT];
+    pthread_barrier_t counted;
+    pthread_barrier_init(&counted, NULL, THREAD_COUNT / 2 + 1);
+
+    MemoryStats before = *memory_get_stats();
+
+    for (int t = 0; t < THREAD_COUNT; t++) {
+        tasks[t].counted = t % 2 == 0 ? &counted : NULL;
+        int created = pthread_create(&threads[t], NULL, allocate_blocks, &tasks[t]);
+        assert(created == 0);
+        (void)created;
+    }
+
+    /* Half the threads are still alive here */
+    for (int t = 1; t < THREAD_COUNT; t += 2) pthread_join(threads[t], NULL);
+    pthread_barrier_wait(&counted);
+    MemoryStats live = *memory_get_stats();
+    pthread_barrier_wait(&counted);
+    for (int t = 0; t < THREAD_COUNT; t += 2) pthread_join(threads[t], NULL);
+    MemoryStats retired = *memory_get_stats();
+
+    const MemoryStats *merged[] = {&live, &retired};
+    for (int m = 0; m < 2; m++) {
+        const MemoryStats *stats = merged[m];
+        size_t allocated = stats->total_allocated - before.total_allocated;
+        size_t freed = stats->total_freed - before.total_freed;
+        assert(stats->allocation_count - before.allocation_count == THREAD_COUNT * BLOCKS_PER_THREAD);
+        assert(stats->free_count - before.free_count == THREAD_COUNT * BLOCKS_PER_THREAD / 2);
+        assert(allocated >= (size_t)THREAD_COUNT * BLOCKS_PER_THREAD * 100);
+        assert(freed >= (size_t)THREAD_COUNT * BLOCKS_PER_THREAD / 2 * 100);
+        assert(stats->current_usage - before.current_usage == allocated - freed);
+        assert(stats->peak_usage >= stats->current_usage);
+        (void)allocated;
+        (void)freed;
+    }
+    (void)merged;
+
+    for (int t = 0; t < THREAD_COUNT; t++) {
+        for (int i = 0; i < BLOCKS_PER_THREAD / 2; i++) xfree(tasks[t].kept[i]);
+    }
+    const MemoryStats *after = memory_get_stats();
+    assert(after->current_usage == before.current_usage);
+    (void)after;
+
+    pthread_barrier_destroy(&counted);
+    xfree(tasks);
+
+    printf("PASS: Thread statistics test\n\n");
+}
+
+static MemoryPhase hook_calls[8][2];
+static int hook_count;
+
+static void record_phase_change(MemoryPhase from, MemoryPhase to) {
+    if (hook_count < 8) {
+        hook_calls[hook_count][0] = from;
+        hook_calls[hook_count][1] = to;
+    }
+    hook_count++;
+}
+
+static void *allocate_in_emit(void *arg) {
+    (void)arg;
+    MemoryPhase start = memory_set_phase(MEMORY_PHASE_EMIT);
+    for (int i = 0; i < 7; i++) xfree(xmalloc(100));
+    return (void *)(size_t)start;
+}
+
+/* Allocations are charged to the allocating thread's current phase; the
+ * hook sees every change */
+void test_phases(void) {
+    printf("Test: Phases\n");
+
+    assert(strcmp(memory_phase_name(MEMORY_PHASE_PARSE), "parse") == 0);
+    assert(strcmp(memory_phase_name(MEMORY_PHASE_COUNT), "?") == 0);
+    MemoryStats before = *memory_get_stats();
+
+    MemoryPhase previous = memory_set_phase(MEMORY_PHASE_PARSE);
+    assert(previous == MEMORY_PHASE_OTHER && memory_get_phase() == MEMORY_PHASE_PARSE);
+    char *blocks[10];
+    for (int i = 0; i < 10; i++) blocks[i] = xmalloc(200);
+
+    previous = memory_set_phase(MEMORY_PHASE_CODEGEN);
+    assert(previous == MEMORY_PHASE_PARSE);
+    for (int i = 0; i < 5; i++) xfree(blocks[i]);
+    for (int i = 0; i < 3; i++) blocks[i] = xmalloc(300);
+
+    /* Another thread starts out in no phase and keeps its own */
+    pthread_t thread;
+    void *thread_start = NULL;
+    int created = pthread_create(&thread, NULL, allocate_in_emit, NULL);
+    assert(created == 0);
+    (void)created;
+    pthread_join(thread, &thread_start);
+    assert((MemoryPhase)(size_t)thread_start == MEMORY_PHASE_OTHER);
+    assert(memory_get_phase() == MEMORY_PHASE_CODEGEN);
+
+    memory_set_phase(MEMORY_PHASE_OTHER);
+    for (int i = 0; i < 3; i++) xfree(blocks[i]);
+    for (int i = 5; i < 10; i++) xfree(blocks[i]);
+
+    const MemoryStats *after = memory_get_stats();
+    const PhaseStats *parse = &after->phases[MEMORY_PHASE_PARSE];
+    const PhaseStats *codegen = &after->phases[MEMORY_PHASE_CODEGEN];
+    const PhaseStats *emit = &after->phases[MEMORY_PHASE_EMIT];
+    assert(parse->allocations - before.phases[MEMORY_PHASE_PARSE].allocations == 10);
+    assert(parse->allocated - before.phases[MEMORY_PHASE_PARSE].allocated >= 10 * 200);
+    assert(parse->freed == before.phases[MEMORY_PHASE_PARSE].freed);
+    assert(parse->live >= 10 * 200 && parse->peak >= parse->live);
+    assert(codegen->allocations - before.phases[MEMORY_PHASE_CODEGEN].allocations == 3);
+    assert(codegen->allocated - before.phases[MEMORY_PHASE_CODEGEN].allocated >= 3 * 300);
+    assert(codegen->freed - before.phases[MEMORY_PHASE_CODEGEN].freed >= 5 * 200);
+    assert(emit->allocations - before.phases[MEMORY_PHASE_EMIT].allocations == 7);
+    assert(emit->freed - before.phases[MEMORY_PHASE_EMIT].freed >= 7 * 100);
+    (void)parse;
+    (void)codegen;
+    (void)emit;
+
+    /* The hook runs on real changes only */
+    memory_set_phase_hook(record_phase_change);
+    memory_set_phase(MEMORY_PHASE_LEX);
+    memory_set_phase(MEMORY_PHASE_LEX);
+    previous = memory_set_phase(MEMORY_PHASE_OTHER);
+    memory_set_phase_hook(NULL);
+    memory_set_phase(MEMORY_PHASE_LEX);
+    memory_set_phase(MEMORY_PHASE_OTHER);
+    assert(previous == MEMORY_PHASE_LEX && hook_count == 2);
+    assert(hook_calls[0][0] == MEMORY_PHASE_OTHER && hook_calls[0][1] == MEMORY_PHASE_LEX);
+    assert(hook_calls[1][0] == MEMORY_PHASE_LEX && hook_calls[1][1] == MEMORY_PHASE_OTHER);
+    (void)previous;
+
+    /* Resident memory touched during a phase is charged to it */
+    size_t touched = 8 * 1024 * 1024;
+    memory_sample_rss(true);
+    memory_set_phase(MEMORY_PHASE_OPTIMIZE);
+    char *large = xmalloc(touched);
+    memset(large, 1, touched);
+    memory_set_phase(MEMORY_PHASE_OTHER);
+    memory_sample_rss(false);
+    xfree(large);
+    after = memory_get_stats();
+    assert(after->phases[MEMORY_PHASE_OPTIMIZE].peak_rss >= touched);
+    assert(after->peak_rss > 0);
+    (void)before;
+
+    printf("PASS: Phases test\n\n");
+}
+
+/* Allocation sites the profile must tell apart; not static, so that the
+ * folded stacks can name them */
+static int heavy_line, light_line;
+
+__attribute__((noinline)) void heavy_site(void) {
+    for (int i = 0; i < 1000; i++) {
+        heavy_line = __LINE__ + 1;
+        char *block = xmalloc(1024);
+        xfree(block);
+    }
+}
+
+__attribute__((noinline)) void light_site(void) {
+    for (int i = 0; i < 100; i++) {
+        light_line = __LINE__ + 1;
+        char *block = xmalloc(64);
+        xfree(block);
+    }
+}
+
+/* Bytes and count the report gives the site at `line`, 0 if not listed */
+static size_t report_bytes(const char *report, int line, size_t *count) {
+    char site[64];
+    snprintf(site, sizeof(site), "test_memory.c:%d\n", line);
+    const char *at = strstr(report, site);
+    if (!at) return 0;
+    while (at > report && at[-1] != '\n') at--;
+    size_t bytes = 0;
+    int fields = sscanf(at, "%zu %zu", &bytes, count);
+    return fields == 2 ? bytes : 0;
+}
+
+static char *read_stream(FILE *f) {
+    fflush(f);
+    long size = ftell(f);
+    rewind(f);
+    char *text = xmalloc((size_t)size + 1);
+    size_t got = fread(text, 1, (size_t)size, f);
+    text[got] = '\0';
+    return text;
+}
+
+/* Sampled bytes stay within one sample of the truth at every site; the
+ * folded stacks carry the same weights under their callers. Profiling
+ * cannot be stopped, so this runs last. */
+void test_heap_profile(void) {
+    printf("Test: Heap profile\n");
+
+    assert(!memory_profile_active());
+    memory_profile_start(PROFILE_RATE);
+    assert(memory_profile_active());
+    light_site();
+    heavy_site();
+
+    FILE *f = tmpfile();
+    assert(f != NULL);
+    memory_profile_report(f, 10);
+    char *report = read_stream(f);
+    fclose(f);
+
+    size_t heavy_count = 0, light_count = 0;
+    size_t heavy = report_bytes(report, heavy_line, &heavy_count);
+    size_t light = report_bytes(report, light_line, &light_count);
+    assert(strstr(report, "Sampling:            1 per 4096 bytes") != NULL);
+    assert(heavy + PROFILE_RATE >= 1000 * 1024 && heavy <= 1000 * 1024 + PROFILE_RATE);
+    assert(heavy_count == heavy / 1024);
+    assert(light + PROFILE_RATE >= 100 * 64 && light <= 100 * 64 + PROFILE_RATE);
+    assert(light_count == light / 64);
+
+    /* Heaviest first */
+    char heavy_site_text[64];
+    snprintf(heavy_site_text, sizeof(heavy_site_text), "test_memory.c:%d", heavy_line);
+    const char *by_bytes = strstr(report, "Top allocation sites by bytes:");
+    const char *first_site = by_bytes ? strstr(by_bytes, "site\n") : NULL;
+    assert(first_site != NULL);
+    const char *first_end = strchr(first_site + 5, '\n');
+    const char *heavy_at = strstr(first_site, heavy_site_text);
+    assert(heavy_at != NULL && heavy_at < first_end);
+    (void)heavy_at;
+    (void)first_end;
+    xfree(report);
+
+    char path[] = "/tmp/test_memory_XXXXXX";
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    close(fd);
+    bool written = memory_profile_write_folded(path);
+    assert(written);
+    (void)written;
+
+    /* "main;...;heavy_site;test_memory.c:N bytes" */
+    f = fopen(path, "r");
+    assert(f != NULL);
+    char line[8192];
+    size_t folded_heavy = 0;
+    char suffix[80];
+    snprintf(suffix, sizeof(suffix), "%s ", heavy_site_text);
+    while (fgets(line, sizeof(line), f)) {
+        const char *site = strrchr(line, ';');
+        assert(site != NULL && strchr(site, ' ') != NULL);
+        const char *at = strstr(site, suffix);
+        if (!at) continue;
+
+        const char *caller = strstr(line, "heavy_site;");
+        const char *outer = strstr(line, "main;");
+        assert(caller != NULL && outer != NULL && outer < caller);
+        (void)caller;
+        (void)outer;
+        folded_heavy += strtoull(at + strlen(suffix), NULL, 10);
+    }
+    fclose(f);
+    remove(path);
+    assert(folded_heavy == heavy);
+    (void)heavy;
+    (void)light;
+    (void)heavy_count;
+    (void)light_count;
+    (void)folded_heavy;
+
+    printf("PASS: Heap profile test\n\n");
+}
+
+int main(void) {
+    printf("================================================================\n");
+    printf("MEMORY TEST SUITE\n");
+    printf("================================================================\n\n");
+
+    /* Size classes and these statistics belong to the default allocator */
+    if (memory_debug_enabled()) {
+        printf("Guarded allocator in use, skipping\n\n");
+    } else {
+        test_size_classes();
+        test_thread_stats();
+    }
+    test_phases();
+    test_heap_profile();
+
+    printf("================================================================\n");
+    printf("ALL MEMORY TESTS PASSED\n");
+    printf("================================================================\n");
+
+    return 0;
+}
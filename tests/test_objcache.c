@@ -0,0 +1,270 @@
+/* Test the content-addressed object cache */
+
+#define _POSIX_C_SOURCE 200809L
+#include "../src/driver/objcache.h"
+#include "../src/common/hash.h"
+#include "../src/common/memory.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define LIMIT_UNLIMITED (1ULL << 40)
+
+static char cache_dir[] = "/tmp/test_objcache_XXXXXX";
+
+static const char *KEY_A = "aa00000000000000000000000000000000000000000000000000000000000001";
+static const char *KEY_B = "bb00000000000000000000000000000000000000000000000000000000000002";
+static const char *KEY_C = "cc00000000000000000000000000000000000000000000000000000000000003";
+static const char *KEY_D = "dd00000000000000000000000000000000000000000000000000000000000004";
+
+static char *blob_path(const char *key) {
+    size_t len = strlen(cache_dir) + strlen(key) + 16;
+    char *path = xmalloc(len);
+    snprintf(path, len, "%s/%.2s/%s.blob", cache_dir, key, key + 2);
+    return path;
+}
+
+static bool blob_exists(const char *key) {
+    char *path = blob_path(key);
+    bool exists = access(path, F_OK) == 0;
+    xfree(path);
+    return exists;
+}
+
+/* Pretend the blob was last used `age` seconds ago */
+static void age_blob(const char *key, time_t age) {
+    char *path = blob_path(key);
+    struct timespec times[2];
+    times[0].tv_sec = times[1].tv_sec = time(NULL) - age;
+    times[0].tv_nsec = times[1].tv_nsec = 0;
+    int changed = utimensat(AT_FDCWD, path, times, 0);
+    assert(changed == 0);
+    (void)changed;
+    xfree(path);
+}
+
+/* The size counter the cache keeps for eviction */
+static unsigned long long counted_size(void) {
+    char path[256];
+    snprintf(path, sizeof(path), "%s/size", cache_dir);
+    FILE *f = fopen(path, "r");
+    assert(f != NULL);
+    unsigned long long size = 0;
+    int read = fscanf(f, "%llu", &size);
+    assert(read == 1);
+    (void)read;
+    fclose(f);
+    return size;
+}
+
+static void write_file(const char *path, const char *text) {
+    FILE *f = fopen(path, "w");
+    assert(f != NULL);
+    fputs(text, f);
+    fclose(f);
+}
+
+/* Keys are SHA-256 digests of the source and every flag */
+void test_key(void) {
+    printf("Test: Cache keys\n");
+
+    char hex[SHA256_HEX_SIZE];
+    Sha256 h;
+    sha256_init(&h);
+    sha256_update(&h, "abc", 3);
+    sha256_final_hex(&h, hex);
+    assert(strcmp(hex, "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad") == 0);
+
+    /* Fed in pieces across block boundaries */
+    char message[200];
+    memset(message, 'x', sizeof(message));
+    sha256_init(&h);
+    sha256_update(&h, message, sizeof(message));
+    char whole[SHA256_HEX_SIZE];
+    sha256_final_hex(&h, whole);
+    sha256_init(&h);
+    for (size_t i = 0; i < sizeof(message); i += 7) {
+        sha256_update(&h, message + i, sizeof(message) - i < 7 ? sizeof(message) - i : 7);
+    }
+    sha256_final_hex(&h, hex);
+    assert(strcmp(hex, whole) == 0);
+
+    ObjectCacheFlags flags = {
+        .input_name = "a.c",
+        .target_features = "",
+        .opt_level = 2
+    };
+    const char *source = "int main(void) { return 0; }\n";
+    char key[OBJCACHE_KEY_SIZE], again[OBJCACHE_KEY_SIZE], other[OBJCACHE_KEY_SIZE];
+    objcache_key(key, source, strlen(source), &flags);
+    objcache_key(again, source, strlen(source), &flags);
+    assert(strlen(key) == OBJCACHE_KEY_SIZE - 1);
+    assert(strspn(key, "0123456789abcdef") == OBJCACHE_KEY_SIZE - 1);
+    assert(strcmp(key, again) == 0);
+
+    objcache_key(other, source, strlen(source) - 1, &flags);
+    assert(strcmp(key, other) != 0);
+    flags.opt_level = 3;
+    objcache_key(other, source, strlen(source), &flags);
+    assert(strcmp(key, other) != 0);
+    flags.opt_level = 2;
+    flags.input_name = "b.c";
+    objcache_key(other, source, strlen(source), &flags);
+    assert(strcmp(key, other) != 0);
+
+    printf("PASS: Cache keys test\n\n");
+}
+
+/* Stored objects and blobs come back; anything else is a miss */
+void test_hit_and_miss(void) {
+    printf("Test: Hit and miss\n");
+
+    char object[256], output[256];
+    snprintf(object, sizeof(object), "%s/built.o", cache_dir);
+    snprintf(output, sizeof(output), "%s/fetched.o", cache_dir);
+    write_file(object, "object code");
+
+    bool hit = objcache_fetch(cache_dir, KEY_A, output);
+    assert(!hit);
+    objcache_store(cache_dir, KEY_A, object, LIMIT_UNLIMITED);
+    hit = objcache_fetch(cache_dir, KEY_A, output);
+    assert(hit);
+
+    char text[32] = {0};
+    FILE *f = fopen(output, "r");
+    assert(f != NULL);
+    size_t got = fread(text, 1, sizeof(text) - 1, f);
+    fclose(f);
+    assert(got == 11 && strcmp(text, "object code") == 0);
+
+    char *data = NULL;
+    size_t len = 0;
+    hit = objcache_fetch_blob(cache_dir, KEY_B, ".blob", &data, &len);
+    assert(!hit && data == NULL);
+    objcache_store_blob(cache_dir, KEY_B, ".blob", "blob\0data", 9, LIMIT_UNLIMITED);
+    hit = objcache_fetch_blob(cache_dir, KEY_B, ".blob", &data, &len);
+    assert(hit && len == 9 && memcmp(data, "blob\0data", 9) == 0);
+    xfree(data);
+
+    /* Extensions keep an object and a blob of one key apart */
+    hit = objcache_fetch_blob(cache_dir, KEY_A, ".blob", &data, &len);
+    assert(!hit);
+    int fd = objcache_open_blob(cache_dir, KEY_B, ".blob");
+    assert(fd >= 0);
+    close(fd);
+    fd = objcache_open_blob(cache_dir, KEY_C, ".blob");
+    assert(fd < 0);
+
+    unsigned long long size = counted_size();
+    assert(size == 11 + 9);
+    remove(object);
+    remove(output);
+    (void)hit;
+    (void)got;
+    (void)size;
+
+    printf("PASS: Hit and miss test\n\n");
+}
+
+/* Storing a key again replaces its entry without counting it twice */
+void test_restore_accounting(void) {
+    printf("Test: Re-store accounting\n");
+
+    unsigned long long before = counted_size();
+    char data[100];
+    memset(data, 'r', sizeof(data));
+    objcache_store_blob(cache_dir, KEY_C, ".blob", data, 100, LIMIT_UNLIMITED);
+    unsigned long long stored = counted_size();
+    objcache_store_blob(cache_dir, KEY_C, ".blob", data, 100, LIMIT_UNLIMITED);
+    unsigned long long restored = counted_size();
+    objcache_store_blob(cache_dir, KEY_C, ".blob", data, 40, LIMIT_UNLIMITED);
+    unsigned long long shrunk = counted_size();
+    assert(stored == before + 100);
+    assert(restored == before + 100);
+    assert(shrunk == before + 40);
+    (void)before;
+    (void)stored;
+    (void)restored;
+    (void)shrunk;
+
+    printf("PASS: Re-store accounting test\n\n");
+}
+
+/* Going over the limit removes least recently used entries first */
+void test_eviction(void) {
+    printf("Test: Eviction\n");
+
+    char evict_dir[] = "/tmp/test_objcache_XXXXXX";
+    char *created = mkdtemp(evict_dir);
+    assert(created != NULL);
+    (void)created;
+    char saved_dir[sizeof(cache_dir)];
+    memcpy(saved_dir, cache_dir, sizeof(cache_dir));
+    memcpy(cache_dir, evict_dir, sizeof(cache_dir));
+
+    char data[300];
+    memset(data, 'e', sizeof(data));
+    const uint64_t limit = 1000;
+    objcache_store_blob(cache_dir, KEY_A, ".blob", data, 300, limit);
+    objcache_store_blob(cache_dir, KEY_B, ".blob", data, 300, limit);
+    objcache_store_blob(cache_dir, KEY_C, ".blob", data, 300, limit);
+    age_blob(KEY_A, 300);
+    age_blob(KEY_B, 200);
+    age_blob(KEY_C, 100);
+
+    /* A hit makes A the most recently used */
+    char *fetched = NULL;
+    size_t len = 0;
+    bool hit = objcache_fetch_blob(cache_dir, KEY_A, ".blob", &fetched, &len);
+    assert(hit);
+    (void)hit;
+    xfree(fetched);
+
+    /* 1200 bytes: trimming to 90% of the limit drops B, the oldest */
+    objcache_store_blob(cache_dir, KEY_D, ".blob", data, 300, limit);
+    bool kept[4] = {blob_exists(KEY_A), blob_exists(KEY_B), blob_exists(KEY_C), blob_exists(KEY_D)};
+    unsigned long long size = counted_size();
+    assert(kept[0] && !kept[1] && kept[2] && kept[3]);
+    assert(size == 900);
+    (void)kept;
+    (void)size;
+
+    char command[128];
+    snprintf(command, sizeof(command), "rm -rf %s", cache_dir);
+    int removed = system(command);
+    (void)removed;
+    memcpy(cache_dir, saved_dir, sizeof(cache_dir));
+
+    printf("PASS: Eviction test\n\n");
+}
+
+int main(void) {
+    printf("================================================================\n");
+    printf("OBJECT CACHE TEST SUITE\n");
+    printf("================================================================\n\n");
+
+    char *created = mkdtemp(cache_dir);
+    assert(created != NULL);
+    (void)created;
+
+    test_key();
+    test_hit_and_miss();
+    test_restore_accounting();
+    test_eviction();
+
+    char command[128];
+    snprintf(command, sizeof(command), "rm -rf %s", cache_dir);
+    int removed = system(command);
+    (void)removed;
+
+    printf("================================================================\n");
+    printf("ALL OBJECT CACHE TESTS PASSED\n");
+    printf("================================================================\n");
+
+    return 0;
+}
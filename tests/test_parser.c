@@ -1,11 +1,19 @@
 /* Test the parser with real C code */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include "../src/lexer/lexer.h"
 #include "../src/parser/c_parser.h"
 #include "../src/syntax/c_syntax.h"
 #include "../src/ast/ast.h"
+#include "../src/ast/ast_image.h"
+#include "../src/parser/incremental.h"
 #include "../src/common/debug.h"
+#include "../src/common/memory.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 #include <assert.h>
 
 /* Test simple expression */
@@ -381,6 +389,242 @@ void test_typedefs(void) {
     printf("PASS: Typedefs test\n\n");
 }
 
+/* Test AST image round trip: a mapped image serializes back to the same bytes */
+void test_ast_image(void) {
+    const char *source = 
+        "struct Point { int x; int y; };\n"
+        "int add(int a, int b) {\n"
+        "    const char *s = \"text\";\n"
+        "    for (int i = 0; i < b; i++) { a += i; }\n"
+        "    if (a > b) return add(a - 1, b); else return -a;\n"
+        "}\n";
+    
+    SyntaxDefinition *syntax = syntax_c99_create();
+    Lexer *lexer = lexer_create(source, "test.c", syntax);
+    TokenList *tokens = lexer_tokenize(lexer);
+    
+    CParser *parser = c_parser_create(tokens, C_STD_C99);
+    ASTNode *ast = c_parser_parse(parser);
+    assert(ast != NULL);
+    
+    printf("Test: AST image round trip\n");
+    
+    char *data = NULL;
+    size_t len = 0;
+    bool written = ast_image_write(ast, &data, &len);
+    assert(written);
+    
+    char path[] = "/tmp/test_ast_image_XXXXXX";
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    ssize_t stored = write(fd, data, len);
+    assert(stored == (ssize_t)len);
+    
+    ASTImage *image = ast_image_map(fd);
+    close(fd);
+    unlink(path);
+    assert(image != NULL);
+    
+    ASTNode *root = ast_image_root(image);
+    assert(root->type == ast->type);
+    assert(root->child_count == ast->child_count);
+    debug_print_ast(stdout, root);
+    
+    char *again = NULL;
+    size_t again_len = 0;
+    written = ast_image_write(root, &again, &again_len);
+    assert(written);
+    assert(again_len == len && memcmp(again, data, len) == 0);
+    
+    /* A truncated image is rejected, not mapped */
+    char truncated[] = "/tmp/test_ast_image_XXXXXX";
+    fd = mkstemp(truncated);
+    assert(fd >= 0);
+    stored = write(fd, data, len / 2);
+    assert(stored == (ssize_t)(len / 2));
+    ASTImage *rejected = ast_image_map(fd);
+    assert(rejected == NULL);
+    close(fd);
+    unlink(truncated);
+    (void)written;
+    (void)stored;
+    (void)rejected;
+    
+    xfree(again);
+    xfree(data);
+    ast_image_unmap(image);
+    ast_destroy_node(ast);
+    c_parser_destroy(parser);
+    lexer_destroy(lexer);
+    syntax_c99_destroy(syntax);
+    printf("PASS: AST image test\n\n");
+}
+
+static void count_name(const char *name, void *ctx) {
+    if (strcmp(name, "Integer") == 0) (*(int *)ctx)++;
+}
+
+/* Test exporting and seeding the file-scope name tables */
+void test_name_tables(void) {
+    const char *source = "typedef int Integer;\n";
+    
+    SyntaxDefinition *syntax = syntax_c99_create();
+    Lexer *lexer = lexer_create(source, "test.c", syntax);
+    TokenList *tokens = lexer_tokenize(lexer);
+    
+    CParser *parser = c_parser_create(tokens, C_STD_C99);
+    ASTNode *ast = c_parser_parse(parser);
+    assert(ast != NULL);
+    
+    printf("Test: Name tables\n");
+    
+    int found = 0;
+    c_parser_visit_names(parser, C_NAMES_TYPEDEFS, count_name, &found);
+    assert(found == 1);
+    
+    CParser *seeded = c_parser_create(tokens, C_STD_C99);
+    assert(!c_is_type_name(seeded, "Integer"));
+    c_parser_add_name(seeded, C_NAMES_TYPEDEFS, "Integer");
+    assert(c_is_type_name(seeded, "Integer"));
+    
+    c_parser_destroy(seeded);
+    ast_destroy_node(ast);
+    c_parser_destroy(parser);
+    lexer_destroy(lexer);
+    syntax_c99_destroy(syntax);
+    printf("PASS: Name tables test\n\n");
+}
+
+/* The incremental unit must match a full parse of the edited source */
+static void check_incremental(IncrementalUnit *unit, SyntaxDefinition *syntax) {
+    const char *source = incremental_source(unit);
+    Lexer *lexer = lexer_create(source, "test.c", syntax);
+    TokenList *tokens = lexer_tokenize(lexer);
+    CParser *parser = c_parser_create(tokens, C_STD_C99);
+    ASTNode *ast = c_parser_parse(parser);
+    
+    TokenList *kept = incremental_tokens(unit);
+    assert(kept->count == tokens->count);
+    for (Token *a = kept->head, *b = tokens->head; a || b; a = a->next, b = b->next) {
+        assert(a && b && a->type == b->type && strcmp(a->lexeme, b->lexeme) == 0);
+        assert(a->location.line == b->location.line);
+        assert(a->location.column == b->location.column);
+        assert(a->location.offset == b->location.offset);
+    }
+    
+    char *expected = NULL, *actual = NULL;
+    size_t expected_len = 0, actual_len = 0;
+    bool wrote_expected = ast_image_write(ast, &expected, &expected_len);
+    bool wrote_actual = ast_image_write(incremental_ast(unit), &actual, &actual_len);
+    assert(wrote_expected && wrote_actual);
+    assert(actual_len == expected_len && memcmp(actual, expected, actual_len) == 0);
+    (void)wrote_expected;
+    (void)wrote_actual;
+    
+    xfree(actual);
+    xfree(expected);
+    ast_destroy_node(ast);
+    c_parser_destroy(parser);
+    lexer_destroy(lexer);
+}
+
+static void edit(IncrementalUnit *unit, const char *find, const char *replace) {
+    const char *source = incremental_source(unit);
+    const char *at = strstr(source, find);
+    assert(at != NULL);
+    bool edited = incremental_edit(unit, (size_t)(at - source), strlen(find),
+                                   replace, strlen(replace));
+    assert(edited);
+    (void)edited;
+}
+
+/* Test reparsing only the edited declarations */
+void test_incremental(void) {
+    const char *source = 
+        "typedef int Integer;\n"
+        "struct Point { Integer x; Integer y; };\n"
+        "int first(int a) { return a + 1; }\n"
+        "Integer second(Integer b) {\n"
+        "    Integer c = b * 2; return c;\n"
+        "}\n"
+        "int third(void) { return second(3); }\n";
+    
+    printf("Test: Incremental reparse\n");
+    
+    SyntaxDefinition *syntax = syntax_c99_create();
+    IncrementalUnit *unit = incremental_create(source, "test.c", syntax);
+    check_incremental(unit, syntax);
+    assert(incremental_stats(unit)->decls_reparsed == 5);
+    
+    /* An edit inside one body reparses that function only */
+    edit(unit, "b * 2", "b * 20 + 7");
+    check_incremental(unit, syntax);
+    assert(incremental_stats(unit)->decls_reparsed == 1);
+    assert(incremental_stats(unit)->decls_reused == 4);
+    
+    /* New lines move every later declaration */
+    edit(unit, "int first", "int zeroth(void) {\n  return 0;\n}\n\nint first");
+    check_incremental(unit, syntax);
+    assert(incremental_stats(unit)->decls_reparsed == 3);
+    assert(incremental_stats(unit)->decls_reused == 3);
+    
+    /* Joining lines moves columns on the line the edit ended on */
+    edit(unit, "{\n    Integer c", "{ Integer c");
+    check_incremental(unit, syntax);
+    
+    /* Renaming a typedef changes how everything after it parses */
+    edit(unit, "typedef int Integer", "typedef long Integer");
+    check_incremental(unit, syntax);
+    assert(incremental_stats(unit)->decls_reparsed == 1);
+    edit(unit, "long Integer;", "long Number;");
+    check_incremental(unit, syntax);
+    assert(incremental_stats(unit)->decls_reused == 0);
+    
+    bool edited = incremental_edit(unit, strlen(incremental_source(unit)) + 1, 0, "", 0);
+    assert(!edited);
+    (void)edited;
+    
+    incremental_destroy(unit);
+    syntax_c99_destroy(syntax);
+    printf("PASS: Incremental reparse test\n\n");
+}
+
+static bool count_decl(ASTNode *decl, void *ctx) {
+    assert(decl->type != AST_TRANSLATION_UNIT);
+    (void)decl;
+    (*(int *)ctx)++;
+    return true;
+}
+
+/* Test parsing one declaration at a time with on-demand lexing */
+void test_streaming(void) {
+    const char *source = 
+        "typedef int Integer;\n"
+        "Integer first(Integer a) { return (Integer)a + 1; }\n"
+        "int second(void) { return first(2); }\n";
+    
+    printf("Test: Streaming parse\n");
+    
+    SyntaxDefinition *syntax = syntax_c99_create();
+    Lexer *lexer = lexer_create(source, "test.c", syntax);
+    CParser *parser = c_parser_create_streaming(lexer, C_STD_C99);
+    
+    int decls = 0;
+    bool parsed = c_parse_translation_unit_streaming(parser, count_decl, &decls);
+    assert(parsed);
+    assert(decls == 3);
+    (void)parsed;
+    assert(parser->base.error_count == 0);
+    
+    /* Only the EOF token is left */
+    assert(lexer->tokens->count == 1 && lexer->tokens->head->type == TOKEN_EOF);
+    
+    c_parser_destroy(parser);
+    lexer_destroy(lexer);
+    syntax_c99_destroy(syntax);
+    printf("PASS: Streaming parse test\n\n");
+}
+
 int main(void) {
     printf("================================================================\n");
     printf("LLVM-C PARSER TEST SUITE\n");
@@ -402,6 +646,10 @@ int main(void) {
     test_nested_control_flow();
     test_global_variables();
     test_typedefs();
+    test_ast_image();
+    test_name_tables();
+    test_incremental();
+    test_streaming();
     
     printf("\n================================================================\n");
     printf("ALL PARSER TESTS PASSED\n");
@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <string.h>
 #include "../src/preprocessor/preprocessor.h"
+#include "../src/preprocessor/depfile.h"
 #include "../src/lexer/lexer.h"
 #include "../src/parser/parser.h"
 #include "../src/parser/c_parser.h"
@@ -184,6 +185,58 @@ void test_macro_expansion(void) {
     preprocessor_destroy(pp);
 }
 
+void test_depfile(void) {
+    printf("\n=== Test: Dependency File Parsing ===\n");
+    
+    /* Dependencies: the source and a header with an escaped space */
+    FILE *fp = fopen("/tmp/test_dep_src.c", "w");
+    if (fp) { fputs("int x;\n", fp); fclose(fp); }
+    fp = fopen("/tmp/test dep header.h", "w");
+    if (fp) { fputs("#define Y 1\n", fp); fclose(fp); }
+    
+    fp = fopen("/tmp/test_dep.d", "w");
+    if (fp) {
+        fputs("/tmp/test_dep.o: /tmp/test_dep_src.c \\\n"
+              "  /tmp/test\\ dep\\ header.h\n", fp);
+        fclose(fp);
+    }
+    
+    DepFile *dep = depfile_read("/tmp/test_dep.d");
+    if (!dep || strcmp(dep->target, "/tmp/test_dep.o") != 0 || dep->dep_count != 2 ||
+        strcmp(dep->deps[1], "/tmp/test dep header.h") != 0) {
+        printf("FAIL: depfile not parsed as expected\n");
+        depfile_destroy(dep);
+        return;
+    }
+    depfile_destroy(dep);
+    
+    /* Output written after its dependencies is current; hash stamps too */
+    fp = fopen("/tmp/test_dep.o", "w");
+    if (fp) { fputs("obj", fp); fclose(fp); }
+    
+    bool mtime_ok = depfile_is_up_to_date("/tmp/test_dep.o", "/tmp/test_dep.d", DEP_CHECK_MTIME, 0);
+    bool stamp_ok = depfile_write_stamp("/tmp/test_dep.d", 42);
+    bool hash_ok = depfile_is_up_to_date("/tmp/test_dep.o", "/tmp/test_dep.d", DEP_CHECK_HASH, 42);
+    bool flags_changed = depfile_is_up_to_date("/tmp/test_dep.o", "/tmp/test_dep.d", DEP_CHECK_HASH, 43);
+    
+    fp = fopen("/tmp/test dep header.h", "w");
+    if (fp) { fputs("#define Y 2\n", fp); fclose(fp); }
+    bool header_changed = depfile_is_up_to_date("/tmp/test_dep.o", "/tmp/test_dep.d", DEP_CHECK_HASH, 42);
+    
+    if (mtime_ok && stamp_ok && hash_ok && !flags_changed && !header_changed) {
+        printf("PASS\n");
+    } else {
+        printf("FAIL: up-to-date checks (mtime=%d stamp=%d hash=%d flags=%d header=%d)\n",
+               mtime_ok, stamp_ok, hash_ok, flags_changed, header_changed);
+    }
+    
+    remove("/tmp/test_dep_src.c");
+    remove("/tmp/test dep header.h");
+    remove("/tmp/test_dep.d");
+    remove("/tmp/test_dep.d.hash");
+    remove("/tmp/test_dep.o");
+}
+
 int main(void) {
     printf("=================================================================\n");
     printf("                PREPROCESSOR TESTS\n");
@@ -193,6 +246,7 @@ int main(void) {
     test_include_file();
     test_conditional_compilation();
     test_macro_expansion();
+    test_depfile();
     
     printf("\n=================================================================\n");
     printf("                ALL PREPROCESSOR TESTS COMPLETED\n");
@@ -0,0 +1,261 @@
+/* Test the compile server wire format and distributed fallback */
+
+#define _POSIX_C_SOURCE 200809L
+#include "../src/driver/protocol.h"
+#include "../src/driver/dist.h"
+#include "../src/common/error.h"
+#include "../src/common/memory.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <arpa/inet.h>
+#include <signal.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+static char socket_dir[] = "/tmp/test_protocol_XXXXXX";
+
+static void socket_path(char *path, size_t size, const char *name) {
+    snprintf(path, size, "%s/%s", socket_dir, name);
+}
+
+static void write_u32(int fd, uint32_t value) {
+    uint32_t net = htonl(value);
+    ssize_t written = write(fd, &net, sizeof(net));
+    assert(written == (ssize_t)sizeof(net));
+    (void)written;
+}
+
+/* Wait until a server has bound `path` */
+static void wait_for_socket(const char *path) {
+    struct timespec pause = {0, 10 * 1000 * 1000};
+    for (int i = 0; i < 500 && access(path, F_OK) != 0; i++) {
+        nanosleep(&pause, NULL);
+    }
+    nanosleep(&pause, NULL);
+}
+
+/* Messages survive the wire item for item, including NULs and empty items */
+void test_framing(void) {
+    printf("Test: Framing\n");
+
+    int fds[2];
+    int paired = socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+    assert(paired == 0);
+    (void)paired;
+
+    char large[65536];
+    for (size_t i = 0; i < sizeof(large); i++) large[i] = (char)(i * 7);
+
+    ProtoMessage sent;
+    proto_message_init(&sent);
+    proto_message_add_str(&sent, PROTO_MAGIC);
+    proto_message_add_str(&sent, "");
+    proto_message_add_str(&sent, NULL);
+    proto_message_add(&sent, "a\0b", 3);
+    proto_message_add(&sent, large, sizeof(large));
+    bool ok = proto_send(fds[0], &sent);
+    assert(ok);
+
+    ProtoMessage received;
+    ok = proto_recv(fds[1], &received);
+    assert(ok);
+    assert(received.count == sent.count);
+    for (size_t i = 0; i < sent.count; i++) {
+        assert(received.lengths[i] == sent.lengths[i]);
+        assert(memcmp(received.items[i], sent.items[i], sent.lengths[i]) == 0);
+        assert(received.items[i][received.lengths[i]] == '\0');
+    }
+    proto_message_free(&received);
+    proto_message_free(&sent);
+
+    /* An item count beyond the limit is rejected before any allocation */
+    write_u32(fds[0], 0xffffffffu);
+    ok = proto_recv(fds[1], &received);
+    assert(!ok && received.count == 0);
+
+    /* So is a message cut short by the peer */
+    write_u32(fds[0], 2);
+    write_u32(fds[0], 5);
+    ssize_t written = write(fds[0], "ab", 2);
+    assert(written == 2);
+    (void)written;
+    close(fds[0]);
+    ok = proto_recv(fds[1], &received);
+    assert(!ok && received.count == 0);
+    close(fds[1]);
+    (void)ok;
+
+    printf("PASS: Framing test\n\n");
+}
+
+/* A Unix listener is reachable by its owner only */
+void test_unix_listener(void) {
+    printf("Test: Unix listener\n");
+
+    char path[256], address[264];
+    socket_path(path, sizeof(path), "listen.sock");
+    snprintf(address, sizeof(address), "unix:%s", path);
+
+    mode_t old_mask = umask(022);
+    int listen_fd = proto_listen_address(address);
+    umask(old_mask);
+    assert(listen_fd >= 0);
+
+    struct stat st;
+    int found = stat(path, &st);
+    assert(found == 0 && S_ISSOCK(st.st_mode));
+    assert((st.st_mode & 077) == 0);
+    (void)found;
+
+    /* Both address spellings reach it */
+    int client = proto_connect_address(path);
+    assert(client >= 0);
+    int server = accept(listen_fd, NULL, NULL);
+    assert(server >= 0);
+
+    ProtoMessage request, reply;
+    proto_message_init(&request);
+    proto_message_add_str(&request, "ping");
+    bool ok = proto_send(client, &request) && proto_recv(server, &reply);
+    assert(ok && reply.count == 1 && strcmp(reply.items[0], "ping") == 0);
+    (void)ok;
+    proto_message_free(&reply);
+    proto_message_free(&request);
+    close(server);
+    close(client);
+
+    client = proto_connect_address(address);
+    assert(client >= 0);
+    close(client);
+
+    close(listen_fd);
+    unlink(path);
+
+    int missing = proto_connect_address(path);
+    int invalid = proto_listen_address("no-port:");
+    assert(missing < 0 && invalid < 0);
+    (void)missing;
+    (void)invalid;
+
+    printf("PASS: Unix listener test\n\n");
+}
+
+/* A worker that hangs up without answering */
+static pid_t start_broken_worker(const char *address) {
+    int listen_fd = proto_listen_address(address);
+    assert(listen_fd >= 0);
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        for (;;) {
+            int conn = accept(listen_fd, NULL, NULL);
+            if (conn >= 0) close(conn);
+        }
+    }
+    close(listen_fd);
+    return pid;
+}
+
+static pid_t start_worker(const char *address, const char *path) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        if (!freopen("/dev/null", "w", stdout)) _exit(1);
+        _exit(dist_worker_serve(address));
+    }
+    wait_for_socket(path);
+    return pid;
+}
+
+static void stop_worker(pid_t pid) {
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+}
+
+/* With no worker answering, dist_compile hands the unit back for a local
+ * compile; a working worker further down the list is used instead */
+void test_local_fallback(void) {
+    printf("Test: Local fallback\n");
+
+    const char *source = "int answer(void) { return 42; }\n";
+    char output[256];
+    socket_path(output, sizeof(output), "answer.o");
+
+    char missing[256], broken[256], good[256];
+    socket_path(missing, sizeof(missing), "missing.sock");
+    socket_path(broken, sizeof(broken), "broken.sock");
+    socket_path(good, sizeof(good), "good.sock");
+
+    char workers[1024];
+    DriverOptions opts;
+    driver_options_init(&opts);
+    opts.dist_workers = workers;
+
+    /* Nobody listening, and a worker that drops the connection */
+    char broken_address[264];
+    snprintf(broken_address, sizeof(broken_address), "unix:%s", broken);
+    pid_t broken_pid = start_broken_worker(broken_address);
+    snprintf(workers, sizeof(workers), "unix:%s,unix:%s", missing, broken);
+
+    int status = -1;
+    bool remote = dist_compile(&opts, "answer.c", source, output, &status);
+    assert(!remote && status == -1);
+    assert(access(output, F_OK) != 0);
+
+    /* Failed workers are skipped for one that answers */
+    char good_address[264];
+    snprintf(good_address, sizeof(good_address), "unix:%s", good);
+    pid_t good_pid = start_worker(good_address, good);
+    snprintf(workers, sizeof(workers), "unix:%s,unix:%s,unix:%s", missing, broken, good);
+
+    for (int i = 0; i < 3; i++) {
+        status = -1;
+        remote = dist_compile(&opts, "answer.c", source, output, &status);
+        assert(remote && status == 0);
+
+        FILE *f = fopen(output, "rb");
+        assert(f != NULL);
+        char magic[4] = {0};
+        size_t got = fread(magic, 1, 4, f);
+        fclose(f);
+        assert(got == 4 && magic[0] == 0x7f && magic[1] == 'E');
+        (void)got;
+        remove(output);
+    }
+    (void)remote;
+
+    stop_worker(good_pid);
+    stop_worker(broken_pid);
+    unlink(broken);
+
+    printf("PASS: Local fallback test\n\n");
+}
+
+int main(void) {
+    printf("================================================================\n");
+    printf("PROTOCOL TEST SUITE\n");
+    printf("================================================================\n\n");
+
+    char *created = mkdtemp(socket_dir);
+    assert(created != NULL);
+    (void)created;
+    diagnostic_init();
+
+    test_framing();
+    test_unix_listener();
+    test_local_fallback();
+
+    rmdir(socket_dir);
+
+    printf("================================================================\n");
+    printf("ALL PROTOCOL TESTS PASSED\n");
+    printf("================================================================\n");
+
+    return 0;
+}
@@ -0,0 +1,227 @@
+/* Test STATISTIC counters across threads */
+
+#define _POSIX_C_SOURCE 200809L
+#include "../src/common/statistic.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#define THREADS 8
+#define INCREMENTS 100000
+
+STATISTIC(NumEvents, "test", "Events counted");
+STATISTIC(NumBytes, "test", "Bytes added");
+STATISTIC_MAX(MaxDepth, "test", "Deepest nesting");
+STATISTIC(NumLate, "alpha", "Counted only by late threads");
+
+static char work_dir[] = "/tmp/test_statistic_XXXXXX";
+
+static char *report_text(void) {
+    FILE *f = tmpfile();
+    assert(f != NULL);
+    statistics_report(f);
+    long size = ftell(f);
+    rewind(f);
+    char *text = malloc((size_t)size + 1);
+    assert(text != NULL);
+    size_t got = fread(text, 1, (size_t)size, f);
+    text[got] = '\0';
+    fclose(f);
+    return text;
+}
+
+/* The merged value of "group.name" as the JSON dump has it, -1 if absent */
+static long long json_value(const char *key) {
+    char path[256];
+    snprintf(path, sizeof(path), "%s/stats.json", work_dir);
+    bool written = statistics_write_json(path);
+    assert(written);
+    (void)written;
+
+    FILE *f = fopen(path, "r");
+    assert(f != NULL);
+    char pattern[128], line[256];
+    snprintf(pattern, sizeof(pattern), "\t\"%s\": ", key);
+    long long value = -1;
+    while (fgets(line, sizeof(line), f)) {
+        if (strncmp(line, pattern, strlen(pattern)) == 0) {
+            value = strtoll(line + strlen(pattern), NULL, 10);
+        }
+    }
+    fclose(f);
+    unlink(path);
+    return value;
+}
+
+static void expect_value(const char *key, long long expected) {
+    long long value = json_value(key);
+    assert(value == expected);
+    (void)value;
+    (void)expected;
+}
+
+typedef struct {
+    unsigned index;
+    pthread_barrier_t *counted;     /* Everyone has counted */
+    pthread_barrier_t *reported;    /* The main thread has read the totals */
+} Worker;
+
+/* Half the workers exit before the totals are read, so both the retired
+ * and the live slots are summed */
+static void *count_events(void *arg) {
+    Worker *w = (Worker *)arg;
+    for (unsigned i = 0; i < INCREMENTS; i++) STATISTIC_INC(NumEvents);
+    STATISTIC_ADD(NumBytes, w->index + 1);
+    STATISTIC_NOTE_MAX(MaxDepth, 10 * (w->index + 1));
+    STATISTIC_NOTE_MAX(MaxDepth, 5);
+    pthread_barrier_wait(w->counted);
+    if (w->index % 2 == 1) pthread_barrier_wait(w->reported);
+    return NULL;
+}
+
+/* Run THREADS workers numbered from first_index; while_live, if given,
+ * runs once the even half has exited and the odd half is still alive */
+static void run_workers(unsigned first_index, void (*while_live)(void)) {
+    pthread_barrier_t counted, reported;
+    pthread_barrier_init(&counted, NULL, THREADS + 1);
+    pthread_barrier_init(&reported, NULL, THREADS / 2 + 1);
+    pthread_t threads[THREADS];
+    Worker workers[THREADS];
+    for (unsigned i = 0; i < THREADS; i++) {
+        workers[i].index = first_index + i;
+        workers[i].counted = &counted;
+        workers[i].reported = &reported;
+        pthread_create(&threads[i], NULL, count_events, &workers[i]);
+    }
+    pthread_barrier_wait(&counted);
+    for (unsigned i = 0; i < THREADS; i++) {
+        if (workers[i].index % 2 == 0) pthread_join(threads[i], NULL);
+    }
+
+    if (while_live) while_live();
+    pthread_barrier_wait(&reported);
+    for (unsigned i = 0; i < THREADS; i++) {
+        if (workers[i].index % 2 == 1) pthread_join(threads[i], NULL);
+    }
+    pthread_barrier_destroy(&counted);
+    pthread_barrier_destroy(&reported);
+}
+
+/* Before anything is counted the report says so */
+void test_empty(void) {
+    printf("Test: Empty report\n");
+
+    char *text = report_text();
+    assert(strstr(text, "Nothing was counted") != NULL);
+    free(text);
+    expect_value("test.NumEvents", -1);
+
+    printf("PASS: Empty report test\n\n");
+}
+
+static void check_first_round(void) {
+    expect_value("test.NumEvents", (long long)THREADS * INCREMENTS);
+    expect_value("test.NumBytes", THREADS * (THREADS + 1) / 2);
+    expect_value("test.MaxDepth", 10 * THREADS);
+}
+
+/* Counts from every thread add up, whether the thread is still running
+ * or has exited */
+void test_merge(void) {
+    printf("Test: Merge across threads\n");
+
+    /* Read once with half the workers alive, and again with none */
+    run_workers(0, check_first_round);
+    check_first_round();
+
+    /* A second round keeps adding */
+    run_workers(0, NULL);
+    expect_value("test.NumEvents", 2LL * THREADS * INCREMENTS);
+    expect_value("test.NumBytes", THREADS * (THREADS + 1));
+
+    printf("PASS: Merge across threads test\n\n");
+}
+
+/* A max statistic keeps the highest value any thread noted, rather than
+ * the sum */
+void test_max(void) {
+    printf("Test: Max statistics\n");
+
+    /* test_merge ran workers 0..THREADS-1 twice; the max did not add up */
+    expect_value("test.MaxDepth", 10 * THREADS);
+
+    /* A higher value from new threads wins; lower ones change nothing */
+    run_workers(2 * THREADS, NULL);
+    expect_value("test.MaxDepth", 10 * 3 * THREADS);
+    STATISTIC_NOTE_MAX(MaxDepth, 1);
+    run_workers(0, NULL);
+    expect_value("test.MaxDepth", 10 * 3 * THREADS);
+
+    char *text = report_text();
+    assert(strstr(text, "test       - Deepest nesting (max)\n") != NULL);
+    assert(strstr(text, "test       - Events counted\n") != NULL);
+    assert(strstr(text, "Events counted (max)") == NULL);
+    free(text);
+
+    printf("PASS: Max statistics test\n\n");
+}
+
+static void *count_late(void *arg) {
+    (void)arg;
+    STATISTIC_INC(NumLate);
+    return NULL;
+}
+
+/* A statistic first counted by many threads at once gets one slot, and
+ * the report sorts by group, then name */
+void test_registration(void) {
+    printf("Test: Registration\n");
+
+    pthread_t threads[THREADS];
+    for (unsigned i = 0; i < THREADS; i++) pthread_create(&threads[i], NULL, count_late, NULL);
+    for (unsigned i = 0; i < THREADS; i++) pthread_join(threads[i], NULL);
+    expect_value("alpha.NumLate", THREADS);
+
+    char *text = report_text();
+    char *late = strstr(text, "Counted only by late threads");
+    char *bytes = strstr(text, "Bytes added");
+    char *depth = strstr(text, "Deepest nesting");
+    char *events = strstr(text, "Events counted");
+    assert(late && bytes && depth && events);
+    /* MaxDepth, NumBytes, NumEvents by name within "test" */
+    assert(late < depth && depth < bytes && bytes < events);
+    assert(strstr(late + 1, "Counted only by late threads") == NULL);
+    (void)late;
+    (void)bytes;
+    (void)depth;
+    (void)events;
+    free(text);
+
+    printf("PASS: Registration test\n\n");
+}
+
+int main(void) {
+    printf("================================================================\n");
+    printf("STATISTIC TEST SUITE\n");
+    printf("================================================================\n\n");
+
+    char *created = mkdtemp(work_dir);
+    assert(created != NULL);
+    (void)created;
+
+    test_empty();
+    test_merge();
+    test_max();
+    test_registration();
+
+    rmdir(work_dir);
+
+    printf("================================================================\n");
+    printf("ALL STATISTIC TESTS PASSED\n");
+    printf("================================================================\n");
+
+    return 0;
+}
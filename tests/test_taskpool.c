@@ -0,0 +1,197 @@
+/* Test the work-stealing task pool */
+
+#include "../src/common/taskpool.h"
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#define TASK_COUNT 10000
+
+static void increment(void *arg) {
+    __atomic_add_fetch((long *)arg, 1, __ATOMIC_RELAXED);
+}
+
+/* Every spawned task runs exactly once before wait returns */
+void test_spawn_and_wait(void) {
+    printf("Test: Spawn and wait\n");
+
+    size_t sizes[] = {0, 1, 4};
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        TaskPool *pool = taskpool_create(sizes[s], 0);
+        assert(pool != NULL);
+        assert(taskpool_workers(pool) == sizes[s]);
+
+        long counter = 0;
+        TaskGroup group;
+        taskgroup_init(&group, pool);
+        for (int i = 0; i < TASK_COUNT; i++) {
+            taskgroup_spawn(&group, increment, &counter);
+        }
+        taskgroup_wait(&group);
+        assert(counter == TASK_COUNT);
+
+        taskpool_destroy(pool);
+    }
+
+    /* Without a pool, tasks run on the spot */
+    long counter = 0;
+    TaskGroup group;
+    taskgroup_init(&group, NULL);
+    taskgroup_spawn(&group, increment, &counter);
+    assert(counter == 1);
+    taskgroup_wait(&group);
+
+    assert(taskpool_default_size() >= 1);
+    printf("PASS: Spawn and wait test\n\n");
+}
+
+/* Recursive fork-join: tasks spawn and wait on their own groups */
+typedef struct {
+    TaskPool *pool;
+    int n;
+    long result;
+} FibTask;
+
+static void fib(void *arg) {
+    FibTask *task = (FibTask *)arg;
+    if (task->n < 2) {
+        task->result = task->n;
+        return;
+    }
+
+    FibTask left = {task->pool, task->n - 1, 0};
+    FibTask right = {task->pool, task->n - 2, 0};
+    TaskGroup group;
+    taskgroup_init(&group, task->pool);
+    taskgroup_spawn(&group, fib, &left);
+    fib(&right);
+    taskgroup_wait(&group);
+    task->result = left.result + right.result;
+}
+
+void test_nested_groups(void) {
+    printf("Test: Nested groups\n");
+
+    size_t sizes[] = {0, 3};
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        TaskPool *pool = taskpool_create(sizes[s], 0);
+        FibTask root = {pool, 20, 0};
+        TaskGroup group;
+        taskgroup_init(&group, pool);
+        taskgroup_spawn(&group, fib, &root);
+        taskgroup_wait(&group);
+        assert(root.result == 6765);
+        taskpool_destroy(pool);
+    }
+
+    printf("PASS: Nested groups test\n\n");
+}
+
+static void square_range(void *ctx, size_t lo, size_t hi) {
+    long *values = (long *)ctx;
+    for (size_t i = lo; i < hi; i++) {
+        values[i] = (long)(i * i);
+    }
+}
+
+/* Subranges cover the whole range exactly once */
+void test_parallel_for(void) {
+    printf("Test: Parallel for\n");
+
+    static long values[TASK_COUNT];
+    TaskPool *pool = taskpool_create(4, 0);
+
+    size_t grains[] = {0, 1, 7, TASK_COUNT};
+    for (size_t g = 0; g < sizeof(grains) / sizeof(grains[0]); g++) {
+        memset(values, 0xff, sizeof(values));
+        taskpool_parallel_for(pool, 0, TASK_COUNT, grains[g], square_range, values);
+        for (size_t i = 0; i < TASK_COUNT; i++) {
+            assert(values[i] == (long)(i * i));
+        }
+    }
+
+    /* Empty and serial ranges */
+    taskpool_parallel_for(pool, 5, 5, 0, square_range, values);
+    memset(values, 0, sizeof(values));
+    taskpool_parallel_for(NULL, 10, 20, 0, square_range, values);
+    assert(values[9] == 0 && values[10] == 100 && values[19] == 361 && values[20] == 0);
+
+    taskpool_destroy(pool);
+    printf("PASS: Parallel for test\n\n");
+}
+
+/* Results are released in index order however the tasks finish */
+typedef struct {
+    size_t emitted[64];
+    size_t count;
+} OrderLog;
+
+static void log_index(void *ctx, size_t index) {
+    OrderLog *log = (OrderLog *)ctx;
+    log->emitted[log->count++] = index;
+}
+
+typedef struct {
+    TaskOrder *order;
+    size_t index;
+} OrderedTask;
+
+static void complete_ordered(void *arg) {
+    OrderedTask *task = (OrderedTask *)arg;
+    task_order_complete(task->order, task->index);
+}
+
+void test_task_order(void) {
+    printf("Test: Task order\n");
+
+    OrderLog log = {{0}, 0};
+    TaskOrder order;
+    task_order_init(&order, 4, log_index, &log);
+    task_order_complete(&order, 2);
+    task_order_complete(&order, 1);
+    assert(log.count == 0);
+    task_order_complete(&order, 0);
+    assert(log.count == 3);
+    task_order_complete(&order, 3);
+    for (size_t i = 0; i < 4; i++) {
+        assert(log.emitted[i] == i);
+    }
+    task_order_destroy(&order);
+
+    TaskPool *pool = taskpool_create(4, 0);
+    OrderedTask tasks[64];
+    log.count = 0;
+    task_order_init(&order, 64, log_index, &log);
+    TaskGroup group;
+    taskgroup_init(&group, pool);
+    for (size_t i = 0; i < 64; i++) {
+        tasks[i] = (OrderedTask){&order, 63 - i};
+        taskgroup_spawn(&group, complete_ordered, &tasks[i]);
+    }
+    taskgroup_wait(&group);
+    assert(log.count == 64);
+    for (size_t i = 0; i < 64; i++) {
+        assert(log.emitted[i] == i);
+    }
+    task_order_destroy(&order);
+    taskpool_destroy(pool);
+
+    printf("PASS: Task order test\n\n");
+}
+
+int main(void) {
+    printf("================================================================\n");
+    printf("TASK POOL TEST SUITE\n");
+    printf("================================================================\n\n");
+
+    test_spawn_and_wait();
+    test_nested_groups();
+    test_parallel_for();
+    test_task_order();
+
+    printf("================================================================\n");
+    printf("ALL TASK POOL TESTS PASSED\n");
+    printf("================================================================\n");
+
+    return 0;
+}
@@ -0,0 +1,124 @@
+/* Test the hierarchical phase timers */
+
+#define _POSIX_C_SOURCE 200809L
+#include "../src/common/timer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+
+#define TRACE_FILE "test_timer_trace.json"
+
+static char *read_file(const char *path) {
+    FILE *f = fopen(path, "r");
+    assert(f != NULL);
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *data = malloc((size_t)size + 1);
+    size_t got = fread(data, 1, (size_t)size, f);
+    assert(got == (size_t)size);
+    data[got] = '\0';
+    fclose(f);
+    return data;
+}
+
+static size_t count_of(const char *haystack, const char *needle) {
+    size_t count = 0;
+    for (const char *p = strstr(haystack, needle); p; p = strstr(p + 1, needle)) count++;
+    return count;
+}
+
+/* Nothing is kept before recording starts */
+void test_not_recording(void) {
+    printf("Test: Not recording\n");
+
+    assert(!timer_recording());
+    timer_begin("ignored", NULL);
+    timer_end();
+    timer_end();
+
+    printf("PASS: Not recording test\n\n");
+}
+
+static void *worker(void *arg) {
+    (void)arg;
+    timer_begin("worker", "thread \"1\"");
+    timer_end();
+    return NULL;
+}
+
+/* Nested regions come out as a tree, merged by name path */
+void test_report_and_trace(void) {
+    printf("Test: Report and trace\n");
+
+    timer_start_recording();
+    assert(timer_recording());
+
+    timer_begin("unit", "a.c");
+    for (int i = 0; i < 3; i++) {
+        timer_begin("function", i == 0 ? "main" : "helper");
+        timer_end();
+    }
+    timer_begin("emit", NULL);
+    timer_end();
+    timer_end();
+
+    pthread_t thread;
+    int created = pthread_create(&thread, NULL, worker, NULL);
+    assert(created == 0);
+    (void)created;
+    pthread_join(thread, NULL);
+
+    char *report = NULL;
+    size_t length = 0;
+    FILE *out = open_memstream(&report, &length);
+    timer_report(out);
+    fclose(out);
+    assert(strstr(report, "TIME REPORT") != NULL);
+    assert(strstr(report, "\nunit ") != NULL);
+    assert(strstr(report, "\n  function ") != NULL);
+    assert(strstr(report, "\n  emit ") != NULL);
+    assert(strstr(report, "\nworker ") != NULL);
+    size_t functions = count_of(report, "function");
+    assert(functions == 1);
+    free(report);
+
+    bool written = timer_write_trace(TRACE_FILE);
+    assert(written);
+    char *trace = read_file(TRACE_FILE);
+    size_t complete = count_of(trace, "\"ph\":\"X\"");
+    size_t metadata = count_of(trace, "\"ph\":\"M\"");
+    assert(strncmp(trace, "{\"traceEvents\":[", 16) == 0);
+    assert(complete == 6);
+    assert(metadata == 2);
+    assert(strstr(trace, "\"detail\":\"main\"") != NULL);
+    assert(strstr(trace, "\"detail\":\"thread \\\"1\\\"\"") != NULL);
+    free(trace);
+    remove(TRACE_FILE);
+
+    written = timer_write_trace("/nonexistent/dir/trace.json");
+    assert(!written);
+    (void)written;
+    (void)functions;
+    (void)complete;
+    (void)metadata;
+
+    printf("PASS: Report and trace test\n\n");
+}
+
+int main(void) {
+    printf("================================================================\n");
+    printf("TIMER TEST SUITE\n");
+    printf("================================================================\n\n");
+
+    test_not_recording();
+    test_report_and_trace();
+
+    printf("================================================================\n");
+    printf("ALL TIMER TESTS PASSED\n");
+    printf("================================================================\n");
+
+    return 0;
+}
@@ -0,0 +1,135 @@
+/* Test the embeddable library API */
+
+#include "../src/zcgen/zcgen.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#define THREAD_COUNT 4
+#define ROUNDS 8
+
+/* Compile to IR and to an object */
+void test_compile_to_memory(void) {
+    const char *source = "int add(int a, int b) { return a + b; }\n";
+
+    printf("Test: Compile to memory\n");
+
+    CompilerSession *session = zcgen_session_create();
+    ZcgenOptions opts;
+    zcgen_options_init(&opts);
+    ZcgenResult result;
+
+    opts.emit = ZCGEN_EMIT_LLVM_IR;
+    bool ok = zcgen_compile(session, source, strlen(source), "add.c", &opts, &result);
+    assert(ok);
+    assert(result.errors == 0);
+    assert(strstr(result.data, "define i32 @add") != NULL);
+    zcgen_result_release(&result);
+
+    opts.emit = ZCGEN_EMIT_OBJECT;
+    opts.opt_level = 2;
+    ok = zcgen_compile(session, source, strlen(source), "add.c", &opts, &result);
+    assert(ok);
+    assert(result.len > 4 && memcmp(result.data, "\177ELF", 4) == 0);
+    zcgen_result_release(&result);
+    (void)ok;
+
+    zcgen_session_destroy(session);
+    printf("PASS: Compile to memory test\n\n");
+}
+
+/* Errors are reported into the session's result, not stderr */
+void test_compile_error(void) {
+    const char *source = "int broken( { return; }\n";
+
+    printf("Test: Compile error\n");
+
+    CompilerSession *session = zcgen_session_create();
+    ZcgenOptions opts;
+    zcgen_options_init(&opts);
+    ZcgenResult result;
+
+    bool ok = zcgen_compile(session, source, strlen(source), "broken.c", &opts, &result);
+    assert(!ok);
+    assert(result.errors > 0);
+    assert(result.data == NULL);
+    assert(strstr(result.diagnostics, "broken.c:1:") != NULL);
+    zcgen_result_release(&result);
+
+    /* The next compilation starts clean */
+    const char *fixed = "int fixed(void) { return 0; }\n";
+    ok = zcgen_compile(session, fixed, strlen(fixed), "fixed.c", &opts, &result);
+    assert(ok);
+    assert(result.errors == 0);
+    zcgen_result_release(&result);
+    (void)ok;
+
+    zcgen_session_destroy(session);
+    printf("PASS: Compile error test\n\n");
+}
+
+static void *compile_in_thread(void *arg) {
+    int index = *(int *)arg;
+    CompilerSession *session = zcgen_session_create();
+    ZcgenOptions opts;
+    zcgen_options_init(&opts);
+    opts.emit = ZCGEN_EMIT_LLVM_IR;
+
+    char source[128], name[32], expected[64];
+    for (int round = 0; round < ROUNDS; round++) {
+        /* Odd threads alternate good and bad units; counts must not leak
+         * between sessions */
+        bool bad = (index % 2) && (round % 2);
+        snprintf(source, sizeof(source), bad ? "int f%d( {\n" : "int f%d(void) { return %d; }\n",
+                 index, round);
+        snprintf(name, sizeof(name), "unit%d.c", index);
+        snprintf(expected, sizeof(expected), "@f%d", index);
+
+        ZcgenResult result;
+        bool ok = zcgen_compile(session, source, strlen(source), name, &opts, &result);
+        assert(ok == !bad);
+        assert(bad ? result.errors > 0 : result.errors == 0);
+        if (!bad) assert(strstr(result.data, expected) != NULL);
+        zcgen_result_release(&result);
+        (void)ok;
+    }
+
+    zcgen_session_destroy(session);
+    return NULL;
+}
+
+/* Independent sessions compile concurrently */
+void test_concurrent_sessions(void) {
+    printf("Test: Concurrent sessions\n");
+
+    pthread_t threads[THREAD_COUNT];
+    int indices[THREAD_COUNT];
+    for (int i = 0; i < THREAD_COUNT; i++) {
+        indices[i] = i;
+        int created = pthread_create(&threads[i], NULL, compile_in_thread, &indices[i]);
+        assert(created == 0);
+        (void)created;
+    }
+    for (int i = 0; i < THREAD_COUNT; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    printf("PASS: Concurrent sessions test\n\n");
+}
+
+int main(void) {
+    printf("================================================================\n");
+    printf("LIBZCGEN TEST SUITE\n");
+    printf("================================================================\n\n");
+
+    test_compile_to_memory();
+    test_compile_error();
+    test_concurrent_sessions();
+
+    printf("================================================================\n");
+    printf("ALL LIBZCGEN TESTS PASSED\n");
+    printf("================================================================\n");
+
+    return 0;
+}